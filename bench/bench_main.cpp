@@ -0,0 +1,392 @@
+/**
+ * 热点路径的微基准：签名、base64、XML解析、响应头解析、日志
+ *   make bench                    全部运行
+ *   ./bench hmac                  只运行名字里包含hmac的项
+ *   ./bench --json result.json    额外输出json，便于比对性能回退
+ *
+ * 输出每项的 ns/op（均值、p50、p90、p99，按批次统计）、allocs/op、bytes/op
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "minio_utils.hpp"
+#include "http_client.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// 统计分配次数，替换全局的operator new/delete
+
+static atomic<long long> g_alloc_count{0};
+static atomic<long long> g_alloc_bytes{0};
+
+void* operator new(size_t size){
+    g_alloc_count.fetch_add(1, memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if(p == nullptr) throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept{
+    free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+
+struct BenchResult{
+    string name;
+    long long operations = 0;
+    double mean_ns = 0;
+    double p50_ns = 0;
+    double p90_ns = 0;
+    double p99_ns = 0;
+    double allocs_per_op = 0;
+    double bytes_per_op = 0;
+};
+
+static long long now_ns(){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(vector<double>& samples, double q){
+    if(samples.empty()) return 0;
+    size_t index = min(samples.size() - 1, (size_t)(q * (samples.size() - 1) + 0.5));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+static void finish(BenchResult& r, vector<double>& samples, long long total_ns, long long allocs, long long bytes){
+    r.mean_ns = total_ns / (double)max(1LL, r.operations);
+    r.allocs_per_op = allocs / (double)max(1LL, r.operations);
+    r.bytes_per_op = bytes / (double)max(1LL, r.operations);
+    r.p50_ns = percentile(samples, 0.5);
+    r.p90_ns = percentile(samples, 0.9);
+    r.p99_ns = percentile(samples, 0.99);
+}
+
+// 单线程：每批batch次，按批计时得到ns/op的分布，至少跑min_seconds并且不少于50批
+static BenchResult run_bench(const string& name, int batch, const function<void()>& fn, double min_seconds = 0.5){
+
+    for(int i = 0; i < batch; ++i) fn();
+
+    BenchResult r;
+    r.name = name;
+
+    vector<double> samples;
+    long long total_ns = 0;
+    long long alloc_begin = g_alloc_count.load();
+    long long bytes_begin = g_alloc_bytes.load();
+    long long deadline = now_ns() + (long long)(min_seconds * 1e9);
+
+    while(now_ns() < deadline || samples.size() < 50){
+        long long t0 = now_ns();
+        for(int i = 0; i < batch; ++i) fn();
+        long long cost = now_ns() - t0;
+
+        samples.push_back(cost / (double)batch);
+        total_ns += cost;
+        r.operations += batch;
+    }
+
+    finish(r, samples, total_ns, g_alloc_count.load() - alloc_begin, g_alloc_bytes.load() - bytes_begin);
+    return r;
+}
+
+// 多线程竞争：每次调用单独计时，分布反映排队等待；mean为所有线程的平均单次延迟
+static BenchResult run_contention_bench(const string& name, int threads, int ops_per_thread, const function<void()>& fn){
+
+    BenchResult r;
+    r.name = name;
+
+    vector<vector<double>> per_thread(threads);
+    vector<thread> workers;
+    atomic<int> ready{0};
+    atomic<bool> go{false};
+    long long alloc_begin = g_alloc_count.load();
+    long long bytes_begin = g_alloc_bytes.load();
+
+    for(int t = 0; t < threads; ++t){
+        workers.emplace_back([&, t]{
+            auto& samples = per_thread[t];
+            samples.reserve(ops_per_thread);
+            ready++;
+            while(!go) this_thread::yield();
+
+            for(int i = 0; i < ops_per_thread; ++i){
+                long long t0 = now_ns();
+                fn();
+                samples.push_back(now_ns() - t0);
+            }
+        });
+    }
+
+    while(ready < threads) this_thread::yield();
+    go = true;
+    for(auto& w : workers) w.join();
+
+    vector<double> samples;
+    long long total_ns = 0;
+    for(auto& s : per_thread){
+        for(auto v : s) total_ns += (long long)v;
+        samples.insert(samples.end(), s.begin(), s.end());
+    }
+
+    r.operations = samples.size();
+    finish(r, samples, total_ns, g_alloc_count.load() - alloc_begin, g_alloc_bytes.load() - bytes_begin);
+    return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// 测试数据
+
+static string make_bucket_list_xml(int num_buckets){
+    string xml =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<ListAllMyBucketsResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">"
+        "<Owner><ID>02d6176db174dc93cb1b899f7c6078f08654445fe8cf1b6ce98d8855f66bdbf4</ID><DisplayName>minio</DisplayName></Owner><Buckets>";
+
+    for(int i = 0; i < num_buckets; ++i){
+        xml += iLogger::format("<Bucket><Name>bucket-%06d-training-data</Name><CreationDate>2021-07-28T09:56:02.000Z</CreationDate></Bucket>", i);
+    }
+    xml += "</Buckets></ListAllMyBucketsResult>";
+    return xml;
+}
+
+static string make_http_headers(){
+    return
+        "HTTP/1.1 200 OK\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "Content-Length: 65536\r\n"
+        "Content-Security-Policy: block-all-mixed-content\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "ETag: \"5d41402abc4b2a76b9719d911017c592\"\r\n"
+        "Last-Modified: Wed, 28 Jul 2021 09:56:02 GMT\r\n"
+        "Server: MinIO\r\n"
+        "Strict-Transport-Security: max-age=31536000; includeSubDomains\r\n"
+        "Vary: Origin\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "X-Amz-Request-Id: 1695B3B1D2D2C8A4\r\n"
+        "X-Content-Type-Options: nosniff\r\n"
+        "X-Xss-Protection: 1; mode=block\r\n"
+        "Date: Wed, 28 Jul 2021 09:56:02 GMT\r\n\r\n";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static volatile size_t g_sink = 0;
+
+static vector<BenchResult> run_all(const string& filter){
+
+    vector<BenchResult> results;
+    auto want = [&](const string& name){return filter.empty() || name.find(filter) != string::npos;};
+    auto add = [&](const BenchResult& r){
+        results.push_back(r);
+        printf("%-40s %12.1f %10.1f %10.1f %10.1f %10.2f %12.1f\n",
+            r.name.c_str(), r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.allocs_per_op, r.bytes_per_op);
+        fflush(stdout);
+    };
+
+    printf("%-40s %12s %10s %10s %10s %10s %12s\n", "benchmark", "ns/op", "p50", "p90", "p99", "allocs/op", "bytes/op");
+
+    const string secret = "zuf+tfteSlswRu7BJ86wekitnifILbZam1KYY3TG";
+    const string date = "Wed, 28 Jul 2021 17:56:02 +0800";
+    const string path = "/test-bucket/wish/wish235.txt";
+    if(want("minio_hmac_encode")){
+        add(run_bench("minio_hmac_encode", 1000, [&]{
+            g_sink += minio_hmac_encode(secret, "PUT", "application/octet-stream", date, path).size();
+        }));
+    }
+
+    // 构造一个签名请求（不发送）：newHttp + 格式化字符串 vs 线程复用的请求对象 + 栈上签名
+    const string server = "http://127.0.0.1:9000";
+    const string access_key = "Q3AM3UQ867SPQQA43P2F";
+    if(want("request_setup/newHttp")){
+        add(run_bench("request_setup/newHttp", 1000, [&]{
+            auto time = minio_gmtime_now(0);
+            auto signature = minio_hmac_encode(secret, "PUT", "application/octet-stream", time, path);
+            auto http = newHttp(iLogger::format("%s%s", server.c_str(), path.c_str()));
+            http->add_header(iLogger::format("Date: %s", time.c_str()))
+                ->add_header(iLogger::format("Content-Type: %s", "application/octet-stream"))
+                ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()));
+            g_sink += (size_t)http.get();
+        }));
+    }
+
+    if(want("request_setup/thread_local_http")){
+        add(run_bench("request_setup/thread_local_http", 1000, [&]{
+            char time[64], signature[64];
+            minio_gmtime_now(0, time, sizeof(time));
+            minio_hmac_sign(secret, "PUT", "application/octet-stream", time, path.c_str(), signature, sizeof(signature));
+            auto http = thread_local_http(server, path)
+                ->add_header_format("Date: %s", time)
+                ->add_header_format("Content-Type: %s", "application/octet-stream")
+                ->add_header_format("Authorization: AWS %s:%s", access_key.c_str(), signature);
+            g_sink += (size_t)http;
+        }));
+    }
+
+    for(size_t size : {20, 1024, 1024 * 1024}){
+        string data(size, 'a');
+        for(size_t i = 0; i < size; ++i) data[i] = (char)(i * 131);
+
+        auto name = iLogger::format("minio_base64_encode/%d", (int)size);
+        if(want(name)){
+            add(run_bench(name, size > 4096 ? 4 : 1000, [&]{
+                g_sink += minio_base64_encode(data.data(), data.size()).size();
+            }));
+        }
+
+        name = iLogger::format("iLogger::base64_encode/%d", (int)size);
+        if(want(name)){
+            add(run_bench(name, size > 4096 ? 4 : 1000, [&]{
+                g_sink += iLogger::base64_encode(data.data(), data.size()).size();
+            }));
+        }
+    }
+
+    for(int num_buckets : {10, 10000}){
+        auto name = iLogger::format("minio_extract_buckets/%d", num_buckets);
+        if(!want(name)) continue;
+
+        auto xml = make_bucket_list_xml(num_buckets);
+        add(run_bench(name, num_buckets > 100 ? 2 : 1000, [&]{
+            g_sink += minio_extract_buckets(xml).size();
+        }));
+    }
+
+    // 响应头由CURLOPT_HEADERFUNCTION逐行交给解析函数，响应体不经过这里，与对象大小无关
+    if(want("http_parse_headers")){
+        auto response = make_http_headers();
+        vector<string> raw_lines;
+        for(size_t begin = 0, end; (end = response.find("\r\n", begin)) != string::npos; begin = end + 2)
+            raw_lines.emplace_back(response.substr(begin, end + 2 - begin));
+
+        string header_string;
+        vector<string> lines;
+        unordered_map<string, string> headers;
+        add(run_bench("http_parse_headers", 100, [&]{
+            for(auto& line : raw_lines)
+                http_parse_header_line(line.data(), line.size(), header_string, lines, headers);
+            g_sink += headers.size();
+        }));
+    }
+
+    // 日志：打印重定向到/dev/null，同时写日志文件，测的是调用线程上的开销
+    //   __log_func  调用线程上vsnprintf
+    //   INFOE       宏，调用线程只拷贝参数，后台线程格式化
+    //   binary      宏 + 二进制日志文件
+    char log_dir[] = "/tmp/minio-bench-log-XXXXXX";
+    bool has_log_bench = false;
+    const char* log_modes[] = {"iLogger::__log_func", "iLogger::INFOE", "iLogger::INFOE_binary"};
+    for(int mode = 0; mode < 3; ++mode){
+    for(int threads : {1, 4, 16}){
+        auto name = iLogger::format("%s/threads=%d", log_modes[mode], threads);
+        if(!want(name)) continue;
+
+        if(!has_log_bench){
+            if(mkdtemp(log_dir) == nullptr) break;
+            iLogger::set_logger_save_directory(log_dir);
+            has_log_bench = true;
+        }
+        iLogger::set_logger_binary_mode(mode == 2);
+
+        fflush(stdout);
+        fflush(stderr);
+        int saved_stdout = dup(1);
+        int saved_stderr = dup(2);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+
+        auto r = run_contention_bench(name, threads, 20000, [mode]{
+            if(mode == 0)
+                iLogger::__log_func(__FILE__, __LINE__, ILOGGER_ERROR, "post failed: %s, code = %d, path = %s", "Curl error, code is 28, Timeout was reached", 503, "/test-bucket/wish/wish235.txt");
+            else
+                INFOE("post failed: %s, code = %d, path = %s", "Curl error, code is 28, Timeout was reached", 503, "/test-bucket/wish/wish235.txt");
+        });
+
+        // 后台线程可能还没写完，先等队列清空，否则剩下的日志会打到恢复后的终端上
+        iLogger::flush_logger();
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_stdout, 1);
+        dup2(saved_stderr, 2);
+        close(saved_stdout);
+        close(saved_stderr);
+        close(devnull);
+        add(r);
+    }
+    }
+
+    if(has_log_bench){
+        // 先让flush线程把剩余的日志写完，再删目录
+        iLogger::destroy_logger();
+        system(iLogger::format("rm -rf %s", log_dir).c_str());
+    }
+    return results;
+}
+
+static bool save_json(const string& file, const vector<BenchResult>& results){
+
+    string json = "[\n";
+    for(size_t i = 0; i < results.size(); ++i){
+        auto& r = results[i];
+        json += iLogger::format(
+            "  {\"name\": \"%s\", \"operations\": %lld, \"ns_per_op\": %.2f, \"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}%s\n",
+            r.name.c_str(), r.operations, r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.allocs_per_op, r.bytes_per_op,
+            i + 1 == results.size() ? "" : ","
+        );
+    }
+    json += "]\n";
+    return iLogger::save_file(file, json);
+}
+
+int main(int argc, char** argv){
+
+    string filter;
+    string json_file;
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_file = argv[++i];
+        else
+            filter = argv[i];
+    }
+
+    auto results = run_all(filter);
+    if(!json_file.empty() && !save_json(json_file, results)){
+        fprintf(stderr, "Save %s failed\n", json_file.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,532 @@
+#include "async_engine.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+extern "C"{
+	#include <curl/curl.h>
+}
+
+using namespace std;
+
+struct AsyncJob{
+    uint64_t id = 0;
+    shared_ptr<HttpClient> http;
+    CURL* curl = nullptr;
+    AsyncCallback callback;
+    long long deadline_us = 0;      // timestamp_steady_us，0表示不限时
+};
+
+// 两种引擎共用的部分：排队、挂到curl_multi、收集结果、取消和超时，只在驱动引擎的线程上访问
+class AsyncTransfers{
+public:
+    virtual ~AsyncTransfers(){
+        if(multi_)
+            curl_multi_cleanup(multi_);
+    }
+
+    bool init(const AsyncEngineOptions& options){
+        http_global_init();
+        max_transfers_ = max(1, options.max_transfers);
+        multi_ = curl_multi_init();
+        if(multi_ == nullptr){
+            INFOE("curl_multi_init failed");
+            return false;
+        }
+
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, options.multiplex ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        curl_multi_setopt(multi_, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)max(1, options.max_streams_per_connection));
+        if(options.max_host_connections > 0)
+            curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, (long)options.max_host_connections);
+        return true;
+    }
+
+    CURLM* multi() const{
+        return multi_;
+    }
+
+    // 配置失败时直接回调并返回nullptr
+    static shared_ptr<AsyncJob> new_job(
+        const shared_ptr<HttpClient>& http, QueryType type, const HttpBodyData& body,
+        int timeout_ms, const AsyncCallback& callback
+    ){
+        shared_ptr<AsyncJob> job(new AsyncJob());
+        job->http = http;
+        job->callback = callback;
+        if(timeout_ms > 0)
+            job->deadline_us = iLogger::timestamp_steady_us() + timeout_ms * 1000LL;
+
+        job->curl = (CURL*)http->prepare_transfer(type, body);
+        if(job->curl == nullptr){
+            callback(false);
+            return nullptr;
+        }
+        curl_easy_setopt(job->curl, CURLOPT_PRIVATE, job.get());
+        return job;
+    }
+
+    void add(const shared_ptr<AsyncJob>& job){
+        pending_.push_back(job);
+    }
+
+    void start_pending(){
+
+        while((int)active_.size() < max_transfers_ && !pending_.empty()){
+            auto job = pending_.front();
+            pending_.pop_front();
+
+            // 排队的时间也算在超时里
+            if(job->deadline_us > 0){
+                long long remain_ms = (job->deadline_us - iLogger::timestamp_steady_us()) / 1000;
+                curl_easy_setopt(job->curl, CURLOPT_TIMEOUT_MS, (long)max(1LL, remain_ms));
+            }
+
+            active_[job->id] = job;
+            curl_multi_add_handle(multi_, job->curl);
+        }
+    }
+
+    // 返回完成的请求数
+    int collect_done(){
+        CURLMsg* msg = nullptr;
+        int left = 0;
+        int done = 0;
+        while((msg = curl_multi_info_read(multi_, &left)) != nullptr){
+            if(msg->msg != CURLMSG_DONE)
+                continue;
+
+            AsyncJob* job = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&job);
+            CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi_, msg->easy_handle);
+
+            auto it = active_.find(job->id);
+            auto holder = it->second;
+            active_.erase(it);
+            complete(holder, result);
+            done++;
+        }
+        return done;
+    }
+
+    bool cancel_job(uint64_t id){
+
+        auto it = active_.find(id);
+        if(it != active_.end()){
+            auto job = it->second;
+            active_.erase(it);
+            curl_multi_remove_handle(multi_, job->curl);
+            complete(job, CURLE_ABORTED_BY_CALLBACK);
+            return true;
+        }
+
+        for(auto p = pending_.begin(); p != pending_.end(); ++p){
+            if((*p)->id == id){
+                auto job = *p;
+                pending_.erase(p);
+                complete(job, CURLE_ABORTED_BY_CALLBACK);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 还没开始传输就超时的请求，已经在传输的由curl自己的CURLOPT_TIMEOUT_MS处理
+    void expire_pending(){
+        if(pending_.empty())
+            return;
+
+        auto now = iLogger::timestamp_steady_us();
+        deque<shared_ptr<AsyncJob>> keep;
+        for(auto& job : pending_){
+            if(job->deadline_us > 0 && job->deadline_us <= now)
+                complete(job, CURLE_OPERATION_TIMEDOUT);
+            else
+                keep.push_back(job);
+        }
+        pending_.swap(keep);
+    }
+
+    void abort_all(){
+        auto active = move(active_);
+        active_.clear();
+        for(auto& item : active){
+            curl_multi_remove_handle(multi_, item.second->curl);
+            complete(item.second, CURLE_ABORTED_BY_CALLBACK);
+        }
+
+        auto pending = move(pending_);
+        pending_.clear();
+        for(auto& job : pending)
+            complete(job, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    // 排队中最早的超时时刻，没有时返回0
+    long long pending_deadline_us() const{
+        long long deadline = 0;
+        for(auto& job : pending_){
+            if(job->deadline_us > 0 && (deadline == 0 || job->deadline_us < deadline))
+                deadline = job->deadline_us;
+        }
+        return deadline;
+    }
+
+    int inflight() const{
+        return inflight_.load();
+    }
+
+    void add_inflight(){
+        inflight_++;
+    }
+
+protected:
+    // 回调之前调用，引擎据此维护自己的状态
+    virtual void finished(uint64_t){}
+
+private:
+    void complete(const shared_ptr<AsyncJob>& job, CURLcode result){
+        finished(job->id);
+        bool success = job->http->finish_transfer(result);
+        inflight_--;
+        job->callback(success);
+    }
+
+private:
+    CURLM* multi_ = nullptr;
+    int max_transfers_ = 256;
+    atomic<int> inflight_{0};
+    deque<shared_ptr<AsyncJob>> pending_;
+    unordered_map<uint64_t, shared_ptr<AsyncJob>> active_;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class AsyncEngineImpl : public AsyncEngine, private AsyncTransfers{
+public:
+    virtual ~AsyncEngineImpl(){
+        stop();
+    }
+
+    bool start(const AsyncEngineOptions& options){
+        if(!init(options))
+            return false;
+
+        running_ = true;
+        worker_ = thread(&AsyncEngineImpl::worker, this);
+        return true;
+    }
+
+    virtual uint64_t submit(
+        const shared_ptr<HttpClient>& http, QueryType type, const HttpBodyData& body,
+        int timeout_ms, const AsyncCallback& callback
+    ) override{
+
+        auto job = new_job(http, type, body, timeout_ms, callback);
+        if(job == nullptr)
+            return 0;
+
+        {
+            lock_guard<mutex> l(lock_);
+            if(running_){
+                job->id = ++next_id_;
+                live_.insert(job->id);
+                submitted_.push_back(job);
+                add_inflight();
+            }
+        }
+
+        if(job->id == 0){
+            http->finish_transfer(CURLE_ABORTED_BY_CALLBACK);
+            callback(false);
+            return 0;
+        }
+
+        curl_multi_wakeup(multi());
+        return job->id;
+    }
+
+    virtual bool cancel(uint64_t id) override{
+        {
+            lock_guard<mutex> l(lock_);
+            if(live_.find(id) == live_.end())
+                return false;
+            cancels_.push_back(id);
+        }
+        curl_multi_wakeup(multi());
+        return true;
+    }
+
+    virtual int inflight() const override{
+        return AsyncTransfers::inflight();
+    }
+
+    virtual void stop() override{
+        {
+            lock_guard<mutex> l(lock_);
+            if(!running_) return;
+            running_ = false;
+        }
+
+        curl_multi_wakeup(multi());
+        if(worker_.joinable())
+            worker_.join();
+    }
+
+private:
+    void worker(){
+
+        while(true){
+            deque<shared_ptr<AsyncJob>> incoming;
+            vector<uint64_t> cancels;
+            bool running;
+            {
+                lock_guard<mutex> l(lock_);
+                incoming.swap(submitted_);
+                cancels.swap(cancels_);
+                running = running_;
+            }
+
+            for(auto& job : incoming)
+                add(job);
+
+            for(auto id : cancels)
+                cancel_job(id);
+
+            if(!running){
+                abort_all();
+                break;
+            }
+
+            expire_pending();
+            start_pending();
+
+            int still_running = 0;
+            curl_multi_perform(multi(), &still_running);
+
+            // 有请求结束时，等待同一个连接（HTTP/2多路复用或者max_host_connections）的请求可以马上开始，
+            // 不进入poll，否则它们要等到下一个socket事件或者poll超时才会被curl推进
+            if(collect_done() > 0)
+                continue;
+
+            curl_multi_poll(multi(), nullptr, 0, poll_timeout_ms(), nullptr);
+        }
+    }
+
+    int poll_timeout_ms(){
+        // 排队中的请求需要按时检查超时，其他情况curl_multi_poll会按curl自己的定时器提前返回
+        int timeout_ms = 1000;
+        auto deadline = pending_deadline_us();
+        if(deadline > 0)
+            timeout_ms = min(timeout_ms, (int)max(0LL, (deadline - iLogger::timestamp_steady_us()) / 1000 + 1));
+        return timeout_ms;
+    }
+
+    virtual void finished(uint64_t id) override{
+        lock_guard<mutex> l(lock_);
+        live_.erase(id);
+    }
+
+private:
+    thread worker_;
+    mutex lock_;
+    bool running_ = false;
+    uint64_t next_id_ = 0;
+    deque<shared_ptr<AsyncJob>> submitted_;
+    vector<uint64_t> cancels_;
+    unordered_set<uint64_t> live_;
+};
+
+shared_ptr<AsyncEngine> newAsyncEngine(const AsyncEngineOptions& options){
+    shared_ptr<AsyncEngineImpl> instance(new AsyncEngineImpl());
+    if(!instance->start(options))
+        instance.reset();
+    return instance;
+}
+
+shared_ptr<AsyncEngine> newAsyncEngine(int max_transfers){
+    AsyncEngineOptions options;
+    options.max_transfers = max_transfers;
+    return newAsyncEngine(options);
+}
+
+shared_ptr<AsyncEngine> default_async_engine(){
+    static shared_ptr<AsyncEngine> instance = newAsyncEngine();
+    return instance;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ExternalAsyncEngineImpl : public ExternalAsyncEngine, private AsyncTransfers{
+public:
+    virtual ~ExternalAsyncEngineImpl(){
+        stop();
+    }
+
+    bool start(AsyncEventLoop* loop, const AsyncEngineOptions& options){
+        if(loop == nullptr || !init(options))
+            return false;
+
+        loop_ = loop;
+        curl_multi_setopt(multi(), CURLMOPT_SOCKETFUNCTION, socket_callback);
+        curl_multi_setopt(multi(), CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi(), CURLMOPT_TIMERFUNCTION, timer_callback);
+        curl_multi_setopt(multi(), CURLMOPT_TIMERDATA, this);
+        running_ = true;
+        return true;
+    }
+
+    virtual uint64_t submit(
+        const shared_ptr<HttpClient>& http, QueryType type, const HttpBodyData& body,
+        int timeout_ms, const AsyncCallback& callback
+    ) override{
+
+        auto job = new_job(http, type, body, timeout_ms, callback);
+        if(job == nullptr)
+            return 0;
+
+        if(!running_){
+            http->finish_transfer(CURLE_ABORTED_BY_CALLBACK);
+            callback(false);
+            return 0;
+        }
+
+        job->id = ++next_id_;
+        add_inflight();
+        add(job);
+        drive();
+        return job->id;
+    }
+
+    virtual bool cancel(uint64_t id) override{
+        if(!cancel_job(id))
+            return false;
+
+        drive();
+        return true;
+    }
+
+    virtual int inflight() const override{
+        return AsyncTransfers::inflight();
+    }
+
+    virtual void stop() override{
+        if(!running_)
+            return;
+
+        running_ = false;
+        abort_all();
+        if(timer_deadline_us_ != 0){
+            timer_deadline_us_ = 0;
+            loop_->set_timer(-1);
+        }
+    }
+
+    virtual void on_socket(int fd, int events) override{
+        int mask = 0;
+        if(events & AsyncSocketEvent_Read)  mask |= CURL_CSELECT_IN;
+        if(events & AsyncSocketEvent_Write) mask |= CURL_CSELECT_OUT;
+
+        int still_running = 0;
+        curl_multi_socket_action(multi(), fd, mask, &still_running);
+        drive();
+    }
+
+    virtual void on_timeout() override{
+
+        // 定时器已经触发，curl需要新的定时器时会在socket_action里重新设置
+        timer_deadline_us_ = 0;
+        curl_deadline_us_ = 0;
+
+        int still_running = 0;
+        curl_multi_socket_action(multi(), CURL_SOCKET_TIMEOUT, 0, &still_running);
+        drive();
+    }
+
+private:
+    // 收集完成的请求、检查排队超时、补充新的传输，最后把需要的定时器告诉事件循环
+    // 回调里可以继续submit或者cancel，这时只排队，由外层的drive统一处理
+    void drive(){
+        if(driving_)
+            return;
+
+        driving_ = true;
+        collect_done();
+        expire_pending();
+        start_pending();
+        driving_ = false;
+        update_timer();
+    }
+
+    void update_timer(){
+        if(!running_)
+            return;
+
+        long long deadline = curl_deadline_us_;
+        auto pending_deadline = pending_deadline_us();
+        if(pending_deadline > 0 && (deadline == 0 || pending_deadline < deadline))
+            deadline = pending_deadline;
+
+        if(deadline == timer_deadline_us_)
+            return;
+
+        timer_deadline_us_ = deadline;
+        if(deadline == 0){
+            loop_->set_timer(-1);
+            return;
+        }
+
+        auto remain_us = deadline - iLogger::timestamp_steady_us();
+        loop_->set_timer(remain_us <= 0 ? 0 : (int)((remain_us + 999) / 1000));
+    }
+
+    static int socket_callback(CURL*, curl_socket_t fd, int what, void* userp, void*){
+        auto self = (ExternalAsyncEngineImpl*)userp;
+        int events = AsyncSocketEvent_None;
+        switch(what){
+        case CURL_POLL_IN:    events = AsyncSocketEvent_Read; break;
+        case CURL_POLL_OUT:   events = AsyncSocketEvent_Write; break;
+        case CURL_POLL_INOUT: events = AsyncSocketEvent_Read | AsyncSocketEvent_Write; break;
+        case CURL_POLL_REMOVE:events = AsyncSocketEvent_Remove; break;
+        default: return 0;
+        }
+        self->loop_->watch_socket((int)fd, events);
+        return 0;
+    }
+
+    static int timer_callback(CURLM*, long timeout_ms, void* userp){
+        auto self = (ExternalAsyncEngineImpl*)userp;
+        self->curl_deadline_us_ = timeout_ms < 0 ? 0 : iLogger::timestamp_steady_us() + timeout_ms * 1000LL;
+
+        // add_handle等不经过drive的调用也要及时把定时器交给事件循环
+        if(!self->driving_)
+            self->update_timer();
+        return 0;
+    }
+
+private:
+    AsyncEventLoop* loop_ = nullptr;
+    bool running_ = false;
+    bool driving_ = false;
+    uint64_t next_id_ = 0;
+    long long curl_deadline_us_ = 0;     // curl要求的定时器，0表示没有
+    long long timer_deadline_us_ = 0;    // 已经交给事件循环的定时器，0表示没有
+};
+
+shared_ptr<ExternalAsyncEngine> newExternalAsyncEngine(AsyncEventLoop* loop, const AsyncEngineOptions& options){
+    shared_ptr<ExternalAsyncEngineImpl> instance(new ExternalAsyncEngineImpl());
+    if(!instance->start(loop, options))
+        instance.reset();
+    return instance;
+}
+
+shared_ptr<ExternalAsyncEngine> newExternalAsyncEngine(AsyncEventLoop* loop, int max_transfers){
+    AsyncEngineOptions options;
+    options.max_transfers = max_transfers;
+    return newExternalAsyncEngine(loop, options);
+}
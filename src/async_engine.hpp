@@ -0,0 +1,97 @@
+#ifndef ASYNC_ENGINE_HPP
+#define ASYNC_ENGINE_HPP
+
+#include <memory>
+#include <functional>
+#include <stdint.h>
+#include "http_client.hpp"
+
+/**
+ * @brief 基于curl_multi的异步传输引擎，一个线程驱动任意多个在途请求
+ *     newAsyncEngine自带一个引擎线程，newExternalAsyncEngine不创建线程，由调用方的事件循环驱动
+ *     submit在调用线程上配置好curl句柄后交给引擎线程，完成、超时或者取消时在引擎线程上回调
+ *     回调里不要做耗时的事情，会拖慢其他请求的收发；可以在回调里继续submit
+ *     同一个引擎上的请求共享curl_multi的连接缓存
+ */
+typedef std::function<void(bool success)> AsyncCallback;
+
+class AsyncEngine{
+public:
+    /**
+     * @brief 提交请求
+     * @param timeout_ms  从提交开始算，包括排队时间，<=0表示只用HttpClient自己的超时
+     * @return 请求id，用于cancel。配置请求失败时在调用线程上直接回调并返回0
+     */
+    virtual uint64_t submit(
+        const std::shared_ptr<HttpClient>& http, QueryType type, const HttpBodyData& body,
+        int timeout_ms, const AsyncCallback& callback
+    ) = 0;
+
+    // 取消未完成的请求，回调仍然会被调用（success为false）。请求已经结束时返回false
+    virtual bool cancel(uint64_t id) = 0;
+
+    // 已经提交还没有回调的请求数，包括排队中的
+    virtual int inflight() const = 0;
+
+    // 停止引擎线程，未完成的请求全部按取消回调
+    virtual void stop() = 0;
+};
+
+/**
+ * @brief HTTP/2下同一个host的请求复用少量连接并发多路传输，小对象不再需要成千上万个连接
+ *     请求需要用HttpVersion_2（https通过ALPN协商）或者HttpVersion_2_PriorKnowledge（明文h2c），
+ *     见MinioClient::set_http_version。服务端只支持HTTP/1.1时自动回落，每个连接同一时刻一个请求
+ */
+struct AsyncEngineOptions{
+    int max_transfers = 256;                 // 同时挂在curl_multi上的请求数，超过的排队等待
+    int max_host_connections = 0;            // 每个host最多的连接数，0不限。HTTP/2时可以设得很小
+    int max_streams_per_connection = 100;    // HTTP/2每个连接最多的并发流，超过时新开连接（受max_host_connections限制）
+    bool multiplex = true;                   // 关闭后HTTP/2连接上也只跑一个请求
+};
+
+// max_transfers：同时挂在curl_multi上的请求数，超过的排队等待
+std::shared_ptr<AsyncEngine> newAsyncEngine(int max_transfers = 256);
+std::shared_ptr<AsyncEngine> newAsyncEngine(const AsyncEngineOptions& options);
+
+
+enum AsyncSocketEvent : int{
+    AsyncSocketEvent_None   = 0,
+    AsyncSocketEvent_Read   = 1,
+    AsyncSocketEvent_Write  = 2,
+    AsyncSocketEvent_Remove = 4        // 不再关注这个socket，从epoll中删除
+};
+
+/**
+ * @brief 调用方的事件循环（epoll等），由ExternalAsyncEngine通过它登记socket和定时器
+ *     两个函数在引擎内部调用curl的过程中被调用，只登记，不要在里面回调引擎
+ */
+class AsyncEventLoop{
+public:
+    // 关注fd的events（AsyncSocketEvent_Read|AsyncSocketEvent_Write），或者AsyncSocketEvent_Remove取消关注
+    virtual void watch_socket(int fd, int events) = 0;
+
+    // timeout_ms后调用一次on_timeout，覆盖之前的定时器，-1表示取消定时器，0表示尽快
+    virtual void set_timer(int timeout_ms) = 0;
+};
+
+/**
+ * @brief 不创建线程的引擎，基于curl_multi_socket_action由调用方的事件循环驱动
+ *     事件循环把socket就绪和定时器到期通过on_socket、on_timeout告诉引擎，请求完成的回调就在这两个调用里执行
+ *     submit、cancel、stop、on_socket、on_timeout都必须在事件循环线程上调用，MinioCancellation::cancel同样如此
+ *     例如：minio.set_async_engine(newExternalAsyncEngine(&loop)); 之后get_file_async等接口全部在循环线程上完成
+ */
+class ExternalAsyncEngine : public AsyncEngine{
+public:
+    // events为AsyncSocketEvent_Read|AsyncSocketEvent_Write，epoll报告错误时两个都带上
+    virtual void on_socket(int fd, int events) = 0;
+    virtual void on_timeout() = 0;
+};
+
+// loop由调用方保证比引擎活得久
+std::shared_ptr<ExternalAsyncEngine> newExternalAsyncEngine(AsyncEventLoop* loop, int max_transfers = 256);
+std::shared_ptr<ExternalAsyncEngine> newExternalAsyncEngine(AsyncEventLoop* loop, const AsyncEngineOptions& options);
+
+// 进程内共享的引擎，第一次使用时创建
+std::shared_ptr<AsyncEngine> default_async_engine();
+
+#endif // ASYNC_ENGINE_HPP
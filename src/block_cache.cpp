@@ -0,0 +1,341 @@
+#include "block_cache.hpp"
+#include "ilogger.hpp"
+#include <set>
+#include <map>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace std;
+
+typedef shared_ptr<const string> BlockData;
+
+class BlockCacheImpl : public BlockCache{
+public:
+    BlockCacheImpl(const BlockCacheOptions& options):options_(options){
+        options_.block_size = max(options_.block_size, (size_t)1);
+        options_.max_request_bytes = max(options_.max_request_bytes, options_.block_size);
+        options_.max_gap_blocks = max(options_.max_gap_blocks, 0);
+    }
+
+    virtual string read(MinioClient& minio, const string& remote_path, long long offset, long long size, bool* pointer_success) override{
+        auto output = read_ranges(minio, remote_path, {make_pair(offset, size)}, pointer_success);
+        return move(output[0]);
+    }
+
+    virtual vector<string> read_ranges(
+        MinioClient& minio, const string& remote_path,
+        const vector<pair<long long, long long>>& ranges, bool* pointer_success
+    ) override{
+
+        vector<string> output;
+        bool success = false;
+        for(int attempt = 0; attempt < 2; ++attempt){
+            bool changed = false;
+            output = read_once(minio, remote_path, ranges, success, changed);
+            if(!changed)
+                break;
+
+            // 对象被覆盖了，丢掉旧版本的块整个重读一次
+            INFOW("%s changed while cached, reload", remote_path.c_str());
+            invalidate(remote_path);
+        }
+
+        if(pointer_success)
+            *pointer_success = success;
+        return output;
+    }
+
+    virtual void invalidate(const string& remote_path) override{
+        lock_guard<mutex> l(lock_);
+        for(auto it = lru_.begin(); it != lru_.end();){
+            auto block = blocks_.find(*it);
+            if(block->second.path == remote_path){
+                cached_bytes_ -= block->second.data->size();
+                blocks_.erase(block);
+                it = lru_.erase(it);
+            }else{
+                ++it;
+            }
+        }
+        objects_.erase(remote_path);
+    }
+
+    virtual void clear() override{
+        lock_guard<mutex> l(lock_);
+        blocks_.clear();
+        lru_.clear();
+        objects_.clear();
+        cached_bytes_ = 0;
+    }
+
+    virtual BlockCacheStats stats() const override{
+        lock_guard<mutex> l(lock_);
+        BlockCacheStats s = stats_;
+        s.cached_bytes = cached_bytes_;
+        s.objects = (int)objects_.size();
+        return s;
+    }
+
+    virtual const BlockCacheOptions& options() const override{
+        return options_;
+    }
+
+private:
+    struct CachedBlock{
+        BlockData data;
+        string path;
+        list<string>::iterator lru;
+    };
+
+    struct CachedObject{
+        string etag;
+        long long size = -1;
+        int blocks = 0;
+    };
+
+    static string block_key(const string& path, long long index){
+        return path + "#" + to_string(index);
+    }
+
+    // 需要持有锁
+    void insert(const string& path, long long index, const BlockData& data){
+
+        auto key = block_key(path, index);
+        auto it = blocks_.find(key);
+        if(it != blocks_.end()){
+            cached_bytes_ += (long long)data->size() - (long long)it->second.data->size();
+            it->second.data = data;
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+        }else{
+            lru_.push_front(key);
+            CachedBlock& block = blocks_[key];
+            block.data = data;
+            block.path = path;
+            block.lru = lru_.begin();
+            cached_bytes_ += data->size();
+            objects_[path].blocks++;
+        }
+
+        while(cached_bytes_ > (long long)options_.capacity_bytes && lru_.size() > 1){
+            auto victim = blocks_.find(lru_.back());
+            cached_bytes_ -= victim->second.data->size();
+            auto object = objects_.find(victim->second.path);
+            if(object != objects_.end() && --object->second.blocks <= 0)
+                objects_.erase(object);
+
+            blocks_.erase(victim);
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+    }
+
+    // 请求owned里的块（已按下标排序、已经登记在inflight_），成功的放进缓存和got
+    bool fetch(
+        MinioClient& minio, const string& path, const vector<long long>& owned,
+        string& etag, long long& size, map<long long, BlockData>& got, bool& changed
+    ){
+        const long long block_size = options_.block_size;
+        const long long max_blocks = options_.max_request_bytes / block_size;
+
+        size_t i = 0;
+        while(i < owned.size()){
+            size_t j = i + 1;
+            while(j < owned.size() && owned[j] - owned[j - 1] - 1 <= options_.max_gap_blocks && owned[j] - owned[i] + 1 <= max_blocks)
+                j++;
+
+            long long first = owned[i];
+            long long last = owned[j - 1];
+            long long begin = first * block_size;
+            long long length = (last - first + 1) * block_size;
+            if(size >= 0)
+                length = min(length, size - begin);
+
+            bool ok = false;
+            int status_code = 0;
+            MinioObjectInfo info;
+            string data = minio.get_range(path, begin, length, &ok, &info, etag, &status_code);
+
+            unique_lock<mutex> l(lock_);
+            stats_.requests++;
+            stats_.bytes_fetched += data.size();
+
+            // 空对象上的Range返回416，没有块可读；不记录到objects_，对象之后写入数据时不会一直当作空的
+            if(!ok && status_code == 416 && begin == 0 && etag.empty()){
+                size = 0;
+                for(size_t k = i; k < owned.size(); ++k)
+                    inflight_.erase(block_key(path, owned[k]));
+                cv_.notify_all();
+                return true;
+            }
+
+            if(!ok){
+                // 只有412说明对象被覆盖了，需要整个重读；网络错误、5xx直接失败
+                changed = status_code == 412;
+                for(size_t k = i; k < owned.size(); ++k)
+                    inflight_.erase(block_key(path, owned[k]));
+                cv_.notify_all();
+                return false;
+            }
+
+            if(etag.empty()){
+                etag = info.etag;
+                size = info.size;
+                auto& object = objects_[path];
+                if(object.etag.empty()){
+                    object.etag = etag;
+                    object.size = size;
+                }
+            }
+
+            size_t next_owned = i;
+            for(long long index = first; index <= last; ++index){
+                size_t offset = (index - first) * block_size;
+                bool is_owned = next_owned < j && owned[next_owned] == index;
+                if(is_owned){
+                    inflight_.erase(block_key(path, index));
+                    next_owned++;
+                }
+
+                if(offset >= data.size())
+                    continue;
+
+                // 合并时顺带读回来的间隔块，已经缓存的不覆盖
+                auto key = block_key(path, index);
+                if(!is_owned && (blocks_.find(key) != blocks_.end() || inflight_.find(key) != inflight_.end()))
+                    continue;
+
+                BlockData block(new string(data, offset, block_size));
+                insert(path, index, block);
+                if(is_owned)
+                    got[index] = block;
+            }
+            cv_.notify_all();
+            i = j;
+        }
+        return true;
+    }
+
+    vector<string> read_once(
+        MinioClient& minio, const string& path,
+        const vector<pair<long long, long long>>& ranges, bool& success, bool& changed
+    ){
+        const long long block_size = options_.block_size;
+        vector<string> output(ranges.size());
+        success = false;
+
+        string etag;
+        long long size = -1;
+        {
+            lock_guard<mutex> l(lock_);
+            auto it = objects_.find(path);
+            if(it != objects_.end()){
+                etag = it->second.etag;
+                size = it->second.size;
+            }
+        }
+
+        set<long long> needed;
+        for(auto& range : ranges){
+            long long begin = range.first;
+            long long end = range.first + range.second;
+            if(size >= 0)
+                end = min(end, size);
+
+            for(long long index = begin / block_size; begin >= 0 && index * block_size < end; ++index)
+                needed.insert(index);
+        }
+
+        map<long long, BlockData> got;
+        set<long long> waited;
+        vector<long long> pending(needed.begin(), needed.end());
+        while(!pending.empty()){
+
+            vector<long long> owned;
+            vector<long long> waiting;
+            {
+                lock_guard<mutex> l(lock_);
+                for(auto index : pending){
+                    auto key = block_key(path, index);
+                    auto it = blocks_.find(key);
+                    if(it != blocks_.end()){
+                        got[index] = it->second.data;
+                        lru_.splice(lru_.begin(), lru_, it->second.lru);
+                        if(waited.find(index) == waited.end())
+                            stats_.hits++;
+                    }else if(inflight_.find(key) != inflight_.end()){
+                        waiting.push_back(index);
+                    }else{
+                        inflight_.insert(key);
+                        owned.push_back(index);
+                        stats_.misses++;
+                    }
+                }
+            }
+
+            if(!owned.empty() && !fetch(minio, path, owned, etag, size, got, changed))
+                return output;
+
+            if(waiting.empty())
+                break;
+
+            // 等其他线程请求完，再查一次缓存，它失败了就由自己请求
+            unique_lock<mutex> l(lock_);
+            for(auto index : waiting){
+                if(waited.insert(index).second)
+                    stats_.shared_misses++;
+            }
+
+            cv_.wait(l, [&]{
+                for(auto index : waiting){
+                    if(inflight_.find(block_key(path, index)) != inflight_.end())
+                        return false;
+                }
+                return true;
+            });
+            pending = waiting;
+        }
+
+        for(size_t i = 0; i < ranges.size(); ++i){
+            long long position = ranges[i].first;
+            long long end = ranges[i].first + ranges[i].second;
+            if(size >= 0)
+                end = min(end, size);
+
+            auto& result = output[i];
+            while(position >= 0 && position < end){
+                auto it = got.find(position / block_size);
+                if(it == got.end())
+                    break;
+
+                size_t offset = position - it->first * block_size;
+                if(offset >= it->second->size())
+                    break;
+
+                size_t n = min((size_t)(end - position), it->second->size() - offset);
+                result.append(*it->second, offset, n);
+                position += n;
+            }
+        }
+        success = true;
+        return output;
+    }
+
+private:
+    BlockCacheOptions options_;
+    mutable mutex lock_;
+    condition_variable cv_;
+    unordered_map<string, CachedBlock> blocks_;
+    list<string> lru_;                                  // 头部是最近使用的
+    unordered_map<string, CachedObject> objects_;
+    unordered_set<string> inflight_;
+    long long cached_bytes_ = 0;
+    BlockCacheStats stats_;
+};
+
+shared_ptr<BlockCache> newBlockCache(const BlockCacheOptions& options){
+    return shared_ptr<BlockCache>(new BlockCacheImpl(options));
+}
@@ -0,0 +1,55 @@
+#ifndef BLOCK_CACHE_HPP
+#define BLOCK_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "minio_client.hpp"
+
+struct BlockCacheOptions{
+    size_t block_size = 1024 * 1024;                // 按block_size对齐，整块读取和缓存
+    size_t capacity_bytes = 256 * 1024 * 1024;      // 超过后按LRU淘汰
+    size_t max_request_bytes = 16 * 1024 * 1024;    // 合并后单个Range请求的最大字节数
+    int max_gap_blocks = 1;                         // 缺失块之间隔着不超过这么多块时合并成一个请求，中间的块一起读回来
+};
+
+struct BlockCacheStats{
+    long long hits = 0;             // 直接命中的块
+    long long misses = 0;           // 需要请求的块
+    long long shared_misses = 0;    // 其他线程正在请求，等待它完成的块
+    long long requests = 0;         // 发出的Range请求数
+    long long bytes_fetched = 0;
+    long long evictions = 0;
+    long long cached_bytes = 0;
+    int objects = 0;
+};
+
+/**
+ * @brief MinioClient::read_at使用的块缓存，按(对象路径, 块下标)缓存，LRU淘汰
+ *     一次读取需要的缺失块按位置排序，相邻的合并成一个Range请求；
+ *     多个线程同时缺失同一个块时只有一个线程请求，其他线程等待结果
+ *     每个对象记录第一次读到的ETag，之后的请求都带If-Match，对象被覆盖时丢弃这个对象的所有块重新读取，不会混合两个版本
+ *     缓存按路径区分，不同集群的客户端不要共用一个缓存
+ */
+class BlockCache{
+public:
+    // 读取[offset, offset + size)，超出对象末尾的部分不返回
+    virtual std::string read(MinioClient& minio, const std::string& remote_path, long long offset, long long size, bool* pointer_success = nullptr) = 0;
+
+    // ranges为(offset, size)，结果按ranges的顺序返回
+    virtual std::vector<std::string> read_ranges(
+        MinioClient& minio, const std::string& remote_path,
+        const std::vector<std::pair<long long, long long>>& ranges, bool* pointer_success = nullptr
+    ) = 0;
+
+    // 丢弃对象的所有块，例如自己覆盖写了这个对象之后
+    virtual void invalidate(const std::string& remote_path) = 0;
+    virtual void clear() = 0;
+
+    virtual BlockCacheStats stats() const = 0;
+    virtual const BlockCacheOptions& options() const = 0;
+};
+
+std::shared_ptr<BlockCache> newBlockCache(const BlockCacheOptions& options = BlockCacheOptions());
+
+#endif // BLOCK_CACHE_HPP
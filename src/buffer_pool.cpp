@@ -0,0 +1,151 @@
+#include "buffer_pool.hpp"
+#include <stdlib.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+static const int MinClassShift = 12;    // 4KB
+static const int MaxClassCount = 40;
+
+class BufferPoolImpl : public BufferPool{
+public:
+    BufferPoolImpl(size_t max_cached_bytes, size_t max_buffer_bytes){
+        max_cached_bytes_ = max_cached_bytes;
+        num_classes_ = 1;
+        while(num_classes_ < MaxClassCount && class_size(num_classes_ - 1) < max_buffer_bytes)
+            num_classes_++;
+    }
+
+    virtual ~BufferPoolImpl(){
+        trim();
+    }
+
+    virtual void* allocate(size_t size) override{
+
+        int index = class_index(size);
+        if(index < 0){
+            misses_.fetch_add(1, memory_order_relaxed);
+            return malloc(size);
+        }
+
+        size_t bytes = class_size(index);
+        add_leased(bytes);
+
+        auto& c = classes_[index];
+        {
+            lock_guard<mutex> l(c.lock);
+            if(!c.free_list.empty()){
+                void* ptr = c.free_list.back();
+                c.free_list.pop_back();
+                cached_bytes_.fetch_sub(bytes, memory_order_relaxed);
+                hits_.fetch_add(1, memory_order_relaxed);
+                return ptr;
+            }
+        }
+
+        misses_.fetch_add(1, memory_order_relaxed);
+        void* ptr = malloc(bytes);
+        if(ptr == nullptr)
+            leased_bytes_.fetch_sub(bytes, memory_order_relaxed);
+        return ptr;
+    }
+
+    virtual void deallocate(void* ptr, size_t size) override{
+
+        if(ptr == nullptr)
+            return;
+
+        int index = class_index(size);
+        if(index < 0){
+            free(ptr);
+            return;
+        }
+
+        size_t bytes = class_size(index);
+        leased_bytes_.fetch_sub(bytes, memory_order_relaxed);
+
+        // 先占住缓存额度，超出就直接释放
+        if(cached_bytes_.fetch_add(bytes, memory_order_relaxed) + (long long)bytes > (long long)max_cached_bytes_){
+            cached_bytes_.fetch_sub(bytes, memory_order_relaxed);
+            discards_.fetch_add(1, memory_order_relaxed);
+            free(ptr);
+            return;
+        }
+
+        auto& c = classes_[index];
+        lock_guard<mutex> l(c.lock);
+        c.free_list.push_back(ptr);
+    }
+
+    virtual size_t round_up(size_t size) override{
+        int index = class_index(size);
+        return index < 0 ? size : class_size(index);
+    }
+
+    virtual BufferPoolStats stats() const override{
+        BufferPoolStats s;
+        s.hits = hits_.load(memory_order_relaxed);
+        s.misses = misses_.load(memory_order_relaxed);
+        s.discards = discards_.load(memory_order_relaxed);
+        s.cached_bytes = cached_bytes_.load(memory_order_relaxed);
+        s.leased_bytes = leased_bytes_.load(memory_order_relaxed);
+        s.high_water_bytes = high_water_bytes_.load(memory_order_relaxed);
+        return s;
+    }
+
+    virtual void trim() override{
+        for(int i = 0; i < num_classes_; ++i){
+            auto& c = classes_[i];
+            vector<void*> free_list;
+            {
+                lock_guard<mutex> l(c.lock);
+                free_list.swap(c.free_list);
+            }
+
+            for(void* ptr : free_list)
+                free(ptr);
+            cached_bytes_.fetch_sub(free_list.size() * class_size(i), memory_order_relaxed);
+        }
+    }
+
+private:
+    static size_t class_size(int index){
+        return (size_t)1 << (index + MinClassShift);
+    }
+
+    // 不进池时返回-1
+    int class_index(size_t size) const{
+        int index = 0;
+        while(index < num_classes_ && class_size(index) < size)
+            index++;
+        return index < num_classes_ ? index : -1;
+    }
+
+    void add_leased(size_t bytes){
+        long long leased = leased_bytes_.fetch_add(bytes, memory_order_relaxed) + bytes;
+        long long high_water = high_water_bytes_.load(memory_order_relaxed);
+        while(leased > high_water && !high_water_bytes_.compare_exchange_weak(high_water, leased, memory_order_relaxed));
+    }
+
+private:
+    struct SizeClass{
+        mutex lock;
+        vector<void*> free_list;
+    };
+
+    SizeClass classes_[MaxClassCount];
+    int num_classes_ = 0;
+    size_t max_cached_bytes_ = 0;
+    atomic<long long> hits_{0};
+    atomic<long long> misses_{0};
+    atomic<long long> discards_{0};
+    atomic<long long> cached_bytes_{0};
+    atomic<long long> leased_bytes_{0};
+    atomic<long long> high_water_bytes_{0};
+};
+
+shared_ptr<BufferPool> newBufferPool(size_t max_cached_bytes, size_t max_buffer_bytes){
+    return shared_ptr<BufferPool>(new BufferPoolImpl(max_cached_bytes, max_buffer_bytes));
+}
@@ -0,0 +1,35 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include "object_buffer.hpp"
+
+/**
+ * @brief 按2的幂分级的内存池，作为ObjectAllocator给get_file_buffer使用
+ *     ObjectBuffer析构时内存回到对应级别的空闲链表，下一次同级别的下载直接复用，
+ *     持续压测下不再反复malloc/free大块内存，避免堆碎片和分配器的锁竞争
+ *     最小一级4KB，超过max_buffer_bytes的请求不进池，直接malloc
+ */
+struct BufferPoolStats{
+    long long hits = 0;                 // 从空闲链表拿到的次数
+    long long misses = 0;               // 需要新分配的次数
+    long long discards = 0;             // 归还时缓存已满，直接释放的次数
+    long long cached_bytes = 0;         // 空闲链表里的字节数
+    long long leased_bytes = 0;         // 借出未归还的字节数（按级别大小计）
+    long long high_water_bytes = 0;     // leased_bytes的历史最大值
+};
+
+class BufferPool : public ObjectAllocator{
+public:
+    virtual BufferPoolStats stats() const = 0;
+
+    // 释放所有空闲内存
+    virtual void trim() = 0;
+};
+
+/**
+ * @param max_cached_bytes   空闲链表最多缓存的总字节数，超过后归还的内存直接释放
+ * @param max_buffer_bytes   进池的最大单块尺寸
+ */
+std::shared_ptr<BufferPool> newBufferPool(size_t max_cached_bytes = 256 * 1024 * 1024, size_t max_buffer_bytes = 64 * 1024 * 1024);
+
+#endif // BUFFER_POOL_HPP
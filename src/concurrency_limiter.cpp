@@ -0,0 +1,142 @@
+#include "concurrency_limiter.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace std;
+
+class ConcurrencyLimiterImpl : public ConcurrencyLimiter{
+public:
+    ConcurrencyLimiterImpl(int initial_limit, int min_limit, int max_limit){
+        set_range(min_limit, max_limit);
+        limit_ = clamp_limit(initial_limit);
+    }
+
+    virtual long long acquire() override{
+
+        unique_lock<mutex> l(lock_);
+        if(inflight_ < (int)limit_){
+            inflight_++;
+            return 0;
+        }
+
+        auto begin = iLogger::timestamp_steady_us();
+        total_waits_++;
+        cv_.wait(l, [&]{return inflight_ < (int)limit_;});
+        inflight_++;
+        return iLogger::timestamp_steady_us() - begin;
+    }
+
+    virtual void release(long long latency_us, LimiterOutcome outcome) override{
+
+        {
+            lock_guard<mutex> l(lock_);
+            int inflight_before = inflight_;
+            inflight_--;
+
+            if(outcome == LimiterOutcome_Dropped){
+                total_drops_++;
+                decrease(backoff_ratio_);
+            }else if(outcome == LimiterOutcome_Success){
+                update_latency(latency_us);
+
+                if(min_latency_us_ > 0 && smoothed_latency_us_ > min_latency_us_ * latency_tolerance_){
+                    // 延迟明显上升，说明服务端开始排队，轻微回退
+                    decrease(0.9);
+                }else if(inflight_before * 2 >= (int)limit_){
+                    // 只有许可真正被用满一半以上时才增长，避免空闲时limit无限膨胀
+                    limit_ = clamp_limit(limit_ + 1.0 / limit_);
+                }
+            }
+        }
+        cv_.notify_all();
+    }
+
+    virtual void set_range(int min_limit, int max_limit) override{
+        lock_guard<mutex> l(lock_);
+        min_limit_ = max(1, min_limit);
+        max_limit_ = max(min_limit_, max_limit);
+        limit_ = clamp_limit(limit_);
+    }
+
+    virtual void set_latency_tolerance(double tolerance) override{
+        lock_guard<mutex> l(lock_);
+        latency_tolerance_ = max(1.0, tolerance);
+    }
+
+    virtual void set_backoff_ratio(double ratio) override{
+        lock_guard<mutex> l(lock_);
+        backoff_ratio_ = min(max(ratio, 0.1), 1.0);
+    }
+
+    virtual LimiterState state() const override{
+        lock_guard<mutex> l(lock_);
+        LimiterState s;
+        s.limit = limit_;
+        s.inflight = inflight_;
+        s.min_latency_us = min_latency_us_;
+        s.smoothed_latency_us = smoothed_latency_us_;
+        s.total_drops = total_drops_;
+        s.total_waits = total_waits_;
+        return s;
+    }
+
+private:
+    double clamp_limit(double limit) const{
+        return min(max(limit, (double)min_limit_), (double)max_limit_);
+    }
+
+    // 一个延迟周期内只减一次，并发的多个失败属于同一次拥塞事件
+    void decrease(double ratio){
+        auto now = iLogger::timestamp_steady_us();
+        if(now - last_decrease_us_ < max(smoothed_latency_us_, 1000LL))
+            return;
+
+        last_decrease_us_ = now;
+        limit_ = clamp_limit(limit_ * ratio);
+    }
+
+    void update_latency(long long latency_us){
+
+        if(latency_us <= 0) return;
+
+        if(smoothed_latency_us_ == 0)
+            smoothed_latency_us_ = latency_us;
+        else
+            smoothed_latency_us_ = (smoothed_latency_us_ * 7 + latency_us) / 8;
+
+        // 最小延迟按窗口滚动，网络或服务端变化后可以重新收敛
+        window_min_us_ = window_min_us_ == 0 ? latency_us : min(window_min_us_, latency_us);
+        if(min_latency_us_ == 0 || latency_us < min_latency_us_)
+            min_latency_us_ = latency_us;
+
+        if(++window_samples_ >= min_latency_window_){
+            min_latency_us_ = window_min_us_;
+            window_min_us_ = 0;
+            window_samples_ = 0;
+        }
+    }
+
+private:
+    mutable mutex lock_;
+    condition_variable cv_;
+    double limit_ = 1;
+    int inflight_ = 0;
+    int min_limit_ = 1;
+    int max_limit_ = 256;
+    double latency_tolerance_ = 2.0;
+    double backoff_ratio_ = 0.7;
+    long long min_latency_us_ = 0;
+    long long smoothed_latency_us_ = 0;
+    long long window_min_us_ = 0;
+    int window_samples_ = 0;
+    int min_latency_window_ = 500;
+    long long last_decrease_us_ = 0;
+    long long total_drops_ = 0;
+    long long total_waits_ = 0;
+};
+
+shared_ptr<ConcurrencyLimiter> newConcurrencyLimiter(int initial_limit, int min_limit, int max_limit){
+    return shared_ptr<ConcurrencyLimiterImpl>(new ConcurrencyLimiterImpl(initial_limit, min_limit, max_limit));
+}
@@ -0,0 +1,41 @@
+#ifndef CONCURRENCY_LIMITER_HPP
+#define CONCURRENCY_LIMITER_HPP
+
+#include <memory>
+
+enum LimiterOutcome : int{
+    LimiterOutcome_Success,     // 正常完成，参与延迟梯度与加性增长
+    LimiterOutcome_Dropped,     // 服务端过载（503 SlowDown、超时、连接失败），触发乘性减小
+    LimiterOutcome_Ignore       // 与拥塞无关的失败（例如404、403），只归还许可
+};
+
+struct LimiterState{
+    double limit = 0;
+    int inflight = 0;
+    long long min_latency_us = 0;
+    long long smoothed_latency_us = 0;
+    long long total_drops = 0;
+    long long total_waits = 0;
+};
+
+/**
+ * @brief 自适应并发限制器（AIMD + 延迟梯度）
+ *     每个请求发送前acquire一个许可，完成后release并上报延迟和结果
+ *     - 成功且延迟没有明显超过最小延迟时，limit每轮增加约1
+ *     - 延迟超过 min_latency * latency_tolerance 时，认为服务端排队，limit乘0.9
+ *     - 出现过载错误时，limit乘backoff_ratio，同一个延迟周期内只减一次，避免并发的失败把limit打到底
+ */
+class ConcurrencyLimiter{
+public:
+    // 阻塞直到拿到许可，返回排队等待的时间(us)
+    virtual long long acquire() = 0;
+    virtual void release(long long latency_us, LimiterOutcome outcome) = 0;
+    virtual void set_range(int min_limit, int max_limit) = 0;
+    virtual void set_latency_tolerance(double tolerance) = 0;
+    virtual void set_backoff_ratio(double ratio) = 0;
+    virtual LimiterState state() const = 0;
+};
+
+std::shared_ptr<ConcurrencyLimiter> newConcurrencyLimiter(int initial_limit, int min_limit = 1, int max_limit = 256);
+
+#endif // CONCURRENCY_LIMITER_HPP
@@ -0,0 +1,213 @@
+#include "endpoint_router.hpp"
+#include "http_client.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace std;
+
+static uint64_t local_random(){
+    static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(size_t)&state) ^ (uint64_t)iLogger::timestamp_now_us();
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+class EndpointRouterImpl : public EndpointRouter{
+public:
+    virtual ~EndpointRouterImpl(){
+        stop();
+    }
+
+    bool start(const vector<string>& servers, const EndpointRouterOptions& options){
+
+        if(servers.empty()){
+            INFOE("Endpoint list is empty");
+            return false;
+        }
+
+        options_ = options;
+        options_.eject_after_failures = max(1, options_.eject_after_failures);
+        for(auto& server : servers){
+            Endpoint e;
+            e.state.server = server;
+            endpoints_.emplace_back(e);
+        }
+
+        if(options_.health_interval_ms > 0){
+            running_ = true;
+            probe_thread_ = thread(&EndpointRouterImpl::probe_job, this);
+        }
+        return true;
+    }
+
+    virtual int acquire(int exclude) override{
+
+        lock_guard<mutex> l(lock_);
+        auto now = iLogger::timestamp_steady_us();
+
+        // 可用节点，摘除到期的节点直接放回去，下一次失败会再次摘除
+        candidates_.clear();
+        for(int i = 0; i < (int)endpoints_.size(); ++i){
+            auto& e = endpoints_[i];
+            if(e.state.ejected && e.ejected_until_us <= now){
+                e.state.ejected = false;
+                e.state.consecutive_failures = 0;
+            }
+
+            if(!e.state.ejected && i != exclude)
+                candidates_.push_back(i);
+        }
+
+        if(candidates_.empty() && exclude >= 0 && exclude < (int)endpoints_.size() && !endpoints_[exclude].state.ejected)
+            candidates_.push_back(exclude);
+
+        int index = 0;
+        if(candidates_.empty()){
+            // 全部被摘除，选最早恢复的
+            for(int i = 1; i < (int)endpoints_.size(); ++i){
+                if(endpoints_[i].ejected_until_us < endpoints_[index].ejected_until_us)
+                    index = i;
+            }
+        }else if(options_.policy == EndpointPolicy_PowerOfTwo && candidates_.size() >= 2){
+            // 两个不同的随机位置
+            int n = (int)candidates_.size();
+            int ia = (int)(local_random() % n);
+            int ib = (int)((ia + 1 + local_random() % (n - 1)) % n);
+            int a = candidates_[ia];
+            int b = candidates_[ib];
+            index = endpoints_[b].state.outstanding < endpoints_[a].state.outstanding ? b : a;
+        }else{
+            int n = (int)candidates_.size();
+            int start = (int)(next_++ % n);
+            index = candidates_[start];
+            for(int k = 1; k < n; ++k){
+                int i = candidates_[(start + k) % n];
+                if(endpoints_[i].state.outstanding < endpoints_[index].state.outstanding)
+                    index = i;
+            }
+        }
+
+        auto& state = endpoints_[index].state;
+        state.outstanding++;
+        state.requests++;
+        return index;
+    }
+
+    virtual void release(int index, bool healthy) override{
+
+        if(index < 0 || index >= (int)endpoints_.size())
+            return;
+
+        lock_guard<mutex> l(lock_);
+        auto& e = endpoints_[index];
+        e.state.outstanding--;
+        if(healthy){
+            e.state.consecutive_failures = 0;
+            return;
+        }
+
+        e.state.failures++;
+        if(++e.state.consecutive_failures >= options_.eject_after_failures && !e.state.ejected)
+            eject(e);
+    }
+
+    virtual const string& server(int index) const override{
+        return endpoints_[index].state.server;
+    }
+
+    virtual int size() const override{
+        return (int)endpoints_.size();
+    }
+
+    virtual vector<EndpointState> states() const override{
+        lock_guard<mutex> l(lock_);
+        vector<EndpointState> output;
+        for(auto& e : endpoints_)
+            output.emplace_back(e.state);
+        return output;
+    }
+
+    virtual void stop() override{
+        {
+            lock_guard<mutex> l(lock_);
+            if(!running_) return;
+            running_ = false;
+        }
+
+        cv_.notify_all();
+        if(probe_thread_.joinable())
+            probe_thread_.join();
+    }
+
+private:
+    struct Endpoint{
+        EndpointState state;
+        long long ejected_until_us = 0;
+    };
+
+    void eject(Endpoint& e){
+        e.state.ejected = true;
+        e.state.ejections++;
+        e.ejected_until_us = iLogger::timestamp_steady_us() + options_.eject_ms * 1000LL;
+        INFOW("Eject endpoint %s for %d ms after %d consecutive failures", e.state.server.c_str(), options_.eject_ms, e.state.consecutive_failures);
+    }
+
+    // 节点有HTTP响应就认为进程活着，5xx和连接失败算不可用
+    bool probe(const string& server){
+        auto http = newHttp(server + options_.health_path);
+        http->timeout(options_.health_timeout_seconds)->get();
+        return http->state_code() > 0 && http->state_code() < 500;
+    }
+
+    void probe_job(){
+
+        while(true){
+            {
+                unique_lock<mutex> l(lock_);
+                cv_.wait_for(l, chrono::milliseconds(options_.health_interval_ms), [&]{return !running_;});
+                if(!running_) return;
+            }
+
+            for(int i = 0; i < (int)endpoints_.size(); ++i){
+                bool alive = probe(endpoints_[i].state.server);
+
+                lock_guard<mutex> l(lock_);
+                auto& e = endpoints_[i];
+                if(alive){
+                    if(e.state.ejected)
+                        INFO("Endpoint %s is back", e.state.server.c_str());
+                    e.state.ejected = false;
+                    e.state.consecutive_failures = 0;
+                }else if(!e.state.ejected){
+                    // 探活失败和请求失败一样累计，一次偶发的超时不摘除
+                    if(++e.state.consecutive_failures >= options_.eject_after_failures)
+                        eject(e);
+                }else{
+                    // 仍然不可用，延长摘除时间
+                    e.ejected_until_us = iLogger::timestamp_steady_us() + options_.eject_ms * 1000LL;
+                }
+            }
+        }
+    }
+
+private:
+    EndpointRouterOptions options_;
+    vector<Endpoint> endpoints_;
+    vector<int> candidates_;
+    uint64_t next_ = 0;
+    mutable mutex lock_;
+    condition_variable cv_;
+    bool running_ = false;
+    thread probe_thread_;
+};
+
+shared_ptr<EndpointRouter> newEndpointRouter(const vector<string>& servers, const EndpointRouterOptions& options){
+    shared_ptr<EndpointRouterImpl> instance(new EndpointRouterImpl());
+    if(!instance->start(servers, options))
+        instance.reset();
+    return instance;
+}
@@ -0,0 +1,58 @@
+#ifndef ENDPOINT_ROUTER_HPP
+#define ENDPOINT_ROUTER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+
+enum EndpointPolicy : int{
+    EndpointPolicy_LeastOutstanding,    // 选在途请求最少的节点，相同时轮转
+    EndpointPolicy_PowerOfTwo           // 随机取两个节点，选在途请求少的那个，节点多时开销更小、不会扎堆
+};
+
+struct EndpointRouterOptions{
+    EndpointPolicy policy = EndpointPolicy_PowerOfTwo;
+    int eject_after_failures = 3;                       // 连续失败多少次后摘除，请求失败和探活失败都计入
+    int eject_ms = 10000;                               // 摘除时长，到期或者探活成功后恢复
+    int health_interval_ms = 5000;                      // 后台探活间隔，<=0不探活
+    int health_timeout_seconds = 2;
+    std::string health_path = "/minio/health/live";     // MinIO的存活检查，不需要签名
+};
+
+struct EndpointState{
+    std::string server;
+    bool ejected = false;
+    int outstanding = 0;                // 在途请求数
+    int consecutive_failures = 0;
+    long long requests = 0;
+    long long failures = 0;
+    long long ejections = 0;
+};
+
+/**
+ * @brief 多个MinIO节点之间的客户端负载均衡，不需要额外的代理
+ *     每个请求acquire一个节点，结束后release并报告节点是否正常（连接失败、超时、5xx算节点故障，4xx不算）
+ *     连续失败的节点被临时摘除，后台线程定期探活，恢复后重新参与分配
+ *     所有节点都被摘除时仍然返回最早到期的那个，不会让请求无处可发
+ */
+class EndpointRouter{
+public:
+    // 返回节点下标，exclude用于故障转移时避开刚失败的节点，只有它可用时仍会返回它
+    virtual int acquire(int exclude = -1) = 0;
+    virtual void release(int index, bool healthy) = 0;
+
+    virtual const std::string& server(int index) const = 0;
+    virtual int size() const = 0;
+    virtual std::vector<EndpointState> states() const = 0;
+
+    // 停止后台探活
+    virtual void stop() = 0;
+};
+
+/**
+ * @param servers   节点地址列表，例如：{"http://10.0.0.1:9000", "http://10.0.0.2:9000"}，注意不要多斜杠
+ * @return 列表为空时返回nullptr
+ */
+std::shared_ptr<EndpointRouter> newEndpointRouter(const std::vector<std::string>& servers, const EndpointRouterOptions& options = EndpointRouterOptions());
+
+#endif // ENDPOINT_ROUTER_HPP
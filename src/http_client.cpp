@@ -1,6 +1,14 @@
 #include "http_client.hpp"
 #include "ilogger.hpp"
+#include "rate_limiter.hpp"
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <deque>
 #include <unordered_map>
 
 extern "C"{
@@ -20,30 +28,200 @@ HttpBodyData::HttpBodyData(const void* pdata, size_t size){
     this->size = size;
 }
 
-enum QueryType : int{
-    QueryType_PostFrom,
-    QueryType_PostBody,
-    QueryType_PutBody,
-    QueryType_PutFile,
-    QueryType_Get,
-    QueryType_Put
+int http_parse_header_line(
+    const char* line, size_t size, string& header_string,
+    vector<string>& header_lines, unordered_map<string, string>& headers
+){
+    while(size > 0 && (line[size - 1] == '\r' || line[size - 1] == '\n'))
+        size--;
+
+    if(size == 0)
+        return 0;
+
+    if(size > 5 && memcmp(line, "HTTP/", 5) == 0){
+        header_string.assign(line, size);
+        header_lines.clear();
+        header_lines.emplace_back(line, size);
+        headers.clear();
+
+        const char* code = (const char*)memchr(line, ' ', size);
+        return code ? atoi(code + 1) : 0;
+    }
+
+    header_string.append("\r\n");
+    header_string.append(line, size);
+    header_lines.emplace_back(line, size);
+
+    const char* token = (const char*)memchr(line, ':', size);
+    if(token == nullptr)
+        return 0;
+
+    const char* value = token + 1;
+    while(value < line + size && *value == ' ')
+        value++;
+
+    headers[string(line, token - line)].assign(value, line + size - value);
+    return 0;
+}
+
+void http_global_init(){
+    // curl_global_init不是线程安全的，只做一次
+    static once_flag global_init;
+    call_once(global_init, []{curl_global_init(CURL_GLOBAL_ALL);});
+}
+
+class HttpShareImpl : public HttpShare{
+public:
+    virtual ~HttpShareImpl(){
+        if(share_)
+            curl_share_cleanup(share_);
+    }
+
+    bool init(bool share_connections, int max_idle_connections){
+        http_global_init();
+        max_idle_connections_ = max(1, max_idle_connections);
+        share_ = curl_share_init();
+        if(share_ == nullptr){
+            INFOE("curl_share_init failed");
+            return false;
+        }
+
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_callback);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        if(share_connections)
+            curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        return true;
+    }
+
+    virtual void* handle() const override{
+        return share_;
+    }
+
+    virtual int max_idle_connections() const override{
+        return max_idle_connections_;
+    }
+
+    virtual HttpShareStats stats() const override{
+        HttpShareStats s;
+        s.transfers = transfers_.load(memory_order_relaxed);
+        s.new_connections = new_connections_.load(memory_order_relaxed);
+        s.tls_handshakes = tls_handshakes_.load(memory_order_relaxed);
+        return s;
+    }
+
+    void record(const HttpTiming& timing){
+        transfers_.fetch_add(1, memory_order_relaxed);
+        if(!timing.reused_connection){
+            new_connections_.fetch_add(1, memory_order_relaxed);
+            if(timing.appconnect_us > 0)
+                tls_handshakes_.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+private:
+    static void lock_callback(CURL*, curl_lock_data data, curl_lock_access, void* userp){
+        ((HttpShareImpl*)userp)->locks_[data].lock();
+    }
+
+    static void unlock_callback(CURL*, curl_lock_data data, void* userp){
+        ((HttpShareImpl*)userp)->locks_[data].unlock();
+    }
+
+private:
+    CURLSH* share_ = nullptr;
+    int max_idle_connections_ = 256;
+    mutex locks_[CURL_LOCK_DATA_LAST];
+    atomic<long long> transfers_{0};
+    atomic<long long> new_connections_{0};
+    atomic<long long> tls_handshakes_{0};
 };
 
+shared_ptr<HttpShare> newHttpShare(bool share_connections, int max_idle_connections){
+    shared_ptr<HttpShareImpl> instance(new HttpShareImpl());
+    if(!instance->init(share_connections, max_idle_connections))
+        instance.reset();
+    return instance;
+}
+
+shared_ptr<HttpShare> default_http_share(){
+    static shared_ptr<HttpShare> instance = newHttpShare();
+    return instance;
+}
+
+class HttpClientImpl;
+
+// name为小写
+static bool header_name_is(const char* line, size_t size, const char* name){
+    size_t length = strlen(name);
+    if(size < length)
+        return false;
+
+    for(size_t i = 0; i < length; ++i){
+        if(tolower((unsigned char)line[i]) != name[i])
+            return false;
+    }
+    return true;
+}
+
 struct HttpClientReadStream{
+    HttpClientImpl* owner = nullptr;
+    FILE* file = nullptr;
     const unsigned char* pdata = nullptr;
     size_t data_size = 0;
-    int curosr = 0;
+    size_t curosr = 0;
+    size_t total_read = 0;
 };
 
+// 请求头直接格式化到对象内部的缓冲区，用预先分配的curl_slist节点串起来交给curl，不需要逐个分配
+static const int HeaderArenaSize = 2048;
+static const int MaxHeaderCount = 32;
+
+// 响应缓冲区超过这个大小时，复用之前释放掉，避免线程一直占着一大块内存
+static const size_t MaxRetainedBodyBytes = 1024 * 1024;
+
 class HttpClientImpl : public HttpClient{
 public:
-    HttpClientImpl(const string& url){
+    HttpClientImpl(){
+        http_global_init();
+    }
+
+    HttpClientImpl(const string& url):HttpClientImpl(){
+        reset(url, "");
+    }
+
+    virtual ~HttpClientImpl(){
+        // 准备好但没有执行的请求
+        if(curl_)
+            finish_transfer(CURLE_ABORTED_BY_CALLBACK);
 
-        curl_global_init(CURL_GLOBAL_ALL);
+        if(handle_)
+            curl_easy_cleanup(handle_);
+    }
 
-        url_ = url;
-        add_header("Accept: */*");
-        add_header("Charset: utf-8");
+    void reset(const string& server, const string& path){
+
+        url_.assign(server).append(path);
+        params_.clear();
+        bandwidth_limiters_.clear();
+        header_count_ = 0;
+        header_arena_used_ = 0;
+        overflow_headers_.clear();
+        body_writer_ = nullptr;
+        body_ = HttpBodyData();
+        put_file_.clear();
+        verbose_ = false;
+        timeout_second_ = 60;
+        share_ = default_http_share();
+        http_version_ = HttpVersion_Default;
+
+        if(data_.capacity() > MaxRetainedBodyBytes)
+            string().swap(data_);
+
+        add_static_header("Accept: */*");
+        add_static_header("Charset: utf-8");
         //add_header("Expect:");
     }
 
@@ -61,10 +239,52 @@ public:
     }
 
     virtual HttpClient* add_header(const string& value) override{
-        headers_.emplace_back(value);
+        return add_header_format("%s", value.c_str());
+    }
+
+    virtual HttpClient* add_header_format(const char* fmt, ...) override{
+
+        va_list vl, retry;
+        va_start(vl, fmt);
+        va_copy(retry, vl);
+
+        char* p = header_arena_ + header_arena_used_;
+        size_t remain = HeaderArenaSize - header_arena_used_;
+        int n = vsnprintf(p, remain, fmt, vl);
+        if(n >= 0 && (size_t)n < remain && header_count_ < MaxHeaderCount){
+            header_arena_used_ += n + 1;
+            header_nodes_[header_count_++].data = p;
+        }else if(n >= 0){
+            // 放不下时退回到堆上
+            overflow_headers_.emplace_back(n + 1, '\0');
+            vsnprintf(&overflow_headers_.back()[0], n + 1, fmt, retry);
+        }
+
+        va_end(retry);
+        va_end(vl);
         return this;
     }
 
+    // 字面量直接引用，不拷贝
+    void add_static_header(const char* value){
+        if(header_count_ < MaxHeaderCount)
+            header_nodes_[header_count_++].data = (char*)value;
+        else
+            overflow_headers_.emplace_back(value);
+    }
+
+    // 把固定节点串成链表，溢出的部分用curl_slist_append接在后面，需要调用方curl_slist_free_all(*heap_headers)
+    curl_slist* build_header_list(curl_slist** heap_headers){
+
+        *heap_headers = nullptr;
+        for(auto& value : overflow_headers_)
+            *heap_headers = curl_slist_append(*heap_headers, value.c_str());
+
+        for(int i = 0; i < header_count_; ++i)
+            header_nodes_[i].next = i + 1 < header_count_ ? &header_nodes_[i + 1] : *heap_headers;
+        return header_count_ > 0 ? &header_nodes_[0] : *heap_headers;
+    }
+
     virtual HttpClient* add_param(const string& name, const string& value) override{
         params_[name] = value;
         return this;
@@ -75,6 +295,27 @@ public:
         return this;
     }
 
+    virtual HttpClient* add_bandwidth_limiter(const shared_ptr<TokenBucket>& bucket) override{
+        if(bucket)
+            bandwidth_limiters_.emplace_back(bucket);
+        return this;
+    }
+
+    virtual HttpClient* set_body_writer(HttpBodyWriter* writer) override{
+        body_writer_ = writer;
+        return this;
+    }
+
+    virtual HttpClient* set_share(const shared_ptr<HttpShare>& share) override{
+        share_ = share;
+        return this;
+    }
+
+    virtual HttpClient* set_http_version(HttpVersion version) override{
+        http_version_ = version;
+        return this;
+    }
+
     virtual bool post_body(const HttpBodyData& body) override{
         type_ = QueryType_PostBody;
         body_ = body;
@@ -108,19 +349,86 @@ public:
         return query();
     }
 
-    static size_t write_bytes(void *ptr, size_t size, size_t count, void *stream){
-        string* buffer = ((string*)stream);
-        buffer->insert(buffer->end(), (char*)ptr, (char*)ptr + size* count);
-        return size* count;
+    virtual bool del(){
+        type_ = QueryType_Delete;
+        return query();
+    }
+
+    // 在读写回调里按字节数扣令牌，超出速率时直接在传输线程上睡眠，curl会相应地放慢收发
+    void throttle(size_t bytes){
+        for(auto& bucket : bandwidth_limiters_)
+            bucket->acquire((double)bytes);
+    }
+
+    void mark_upload_end(){
+        if(timing_.upload_end_us == 0)
+            timing_.upload_end_us = max(1LL, iLogger::timestamp_steady_us() - perform_begin_us_);
+    }
+
+    static size_t write_bytes(void *ptr, size_t size, size_t count, void *userdata){
+        HttpClientImpl* self = ((HttpClientImpl*)userdata);
+        size_t bytes = size * count;
+        self->throttle(bytes);
+
+        if(self->writing_body_)
+            return self->body_writer_->write(ptr, bytes) ? bytes : 0;
+
+        self->data_.append((char*)ptr, bytes);
+        return bytes;
+    }
+
+    // curl每次给一行响应头，空行表示这一组响应头结束
+    static size_t header_bytes(char *ptr, size_t size, size_t count, void *userdata){
+        HttpClientImpl* self = ((HttpClientImpl*)userdata);
+        size_t bytes = size * count;
+        int code = http_parse_header_line(ptr, bytes, self->response_header_string_, self->response_header_lines_, self->response_header_);
+        if(code != 0){
+            // 新的一组响应头，之前收到的是重定向的响应体
+            self->response_code_ = code;
+            self->content_length_ = -1;
+            self->data_.clear();
+            return bytes;
+        }
+
+        if(header_name_is(ptr, bytes, "content-length:")){
+            self->content_length_ = atoll(ptr + 15);
+            return bytes;
+        }
+
+        // 100 Continue和重定向的响应体不是最终的数据
+        bool end_of_headers = bytes <= 2 && (ptr[0] == '\r' || ptr[0] == '\n');
+        if(!end_of_headers || self->response_code_ < 200 || self->response_code_ >= 300)
+            return bytes;
+
+        // 已知长度时一次分配到位
+        if(self->body_writer_){
+            if(!self->body_writer_->begin(self->content_length_))
+                return 0;
+            self->writing_body_ = true;
+        }else if(self->content_length_ > 0){
+            self->data_.reserve(self->content_length_);
+        }
+        return bytes;
     }
 
     static size_t read_bytes(void *ptr, size_t size, size_t count, void *userdata){
         HttpClientReadStream* stream = ((HttpClientReadStream*)userdata);
-        size_t remain = stream->data_size - stream->curosr;
-        size_t copyed_size = min(size * count, remain);
-        
-        memcpy(ptr, stream->pdata + stream->curosr, copyed_size);
-        stream->curosr += copyed_size;
+        size_t copyed_size = 0;
+
+        if(stream->file != nullptr){
+            copyed_size = fread(ptr, 1, size * count, stream->file);
+        }else{
+            size_t remain = stream->data_size - stream->curosr;
+            copyed_size = min(size * count, remain);
+            memcpy(ptr, stream->pdata + stream->curosr, copyed_size);
+            stream->curosr += copyed_size;
+        }
+
+        stream->total_read += copyed_size;
+        if(stream->total_read >= stream->data_size || copyed_size == 0)
+            stream->owner->mark_upload_end();
+
+        stream->owner->throttle(copyed_size);
         return copyed_size;
     }
 
@@ -145,55 +453,125 @@ public:
         return error_;
     }
 
+    virtual const HttpTiming& timing() const override{
+        return timing_;
+    }
+
+    void collect_timing(CURL* curl){
+
+        curl_off_t value = 0;
+        if(curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &value) == CURLE_OK) timing_.namelookup_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &value) == CURLE_OK) timing_.connect_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &value) == CURLE_OK) timing_.appconnect_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &value) == CURLE_OK) timing_.pretransfer_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &value) == CURLE_OK) timing_.starttransfer_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &value) == CURLE_OK) timing_.total_us = value;
+        if(curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &value) == CURLE_OK) timing_.bytes_up = value;
+        if(curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &value) == CURLE_OK) timing_.bytes_down = timing_.body_bytes_down = value;
+
+        long header_size = 0;
+        if(curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &header_size) == CURLE_OK) timing_.bytes_down += header_size;
+
+        // 没有新建连接，说明复用了连接池里的连接
+        long num_connects = 0;
+        if(curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &num_connects) == CURLE_OK)
+            timing_.reused_connection = num_connects == 0;
+    }
+
     bool query(){
+        CURL* curl = (CURL*)prepare_transfer(type_, body_);
+        if(curl == nullptr)
+            return false;
+        return finish_transfer(curl_easy_perform(curl));
+    }
 
+    virtual void* prepare_transfer(QueryType type, const HttpBodyData& body) override{
+
+        type_ = type;
+        body_ = body;
         state_code_ = 0;
+        timing_ = HttpTiming();
         data_.clear();
+        error_.clear();
+        response_header_string_.clear();
         response_header_lines_.clear();
         response_header_.clear();
+        response_code_ = 0;
+        content_length_ = -1;
+        writing_body_ = false;
 
-        curl_slist* headers = nullptr;
-        curl_httppost *formpost = nullptr;
-        curl_httppost *lastptr = nullptr;
-        CURL* curl = curl_easy_init();
-        FILE* fput_file_handle = nullptr;
         size_t put_file_size = 0;
-        HttpClientReadStream stream_put_body;
+        stream_put_body_ = HttpClientReadStream();
+        stream_put_body_.owner = this;
 
         if(type_ == QueryType_PutFile){
 
             put_file_size = iLogger::file_size(put_file_);
-            fput_file_handle = fopen(put_file_.c_str(), "rb");
-            if(fput_file_handle == nullptr){
-                INFOE("Open file %s failed.", put_file_.c_str());
-                return false;
+            put_file_handle_ = fopen(put_file_.c_str(), "rb");
+            if(put_file_handle_ == nullptr){
+                error_ = iLogger::format("Open file %s failed.", put_file_.c_str());
+                INFOE("%s", error_.c_str());
+                return nullptr;
             }
         }
 
+        curl_httppost *lastptr = nullptr;
         for (auto& k : params_){
-            curl_formadd(&formpost,
+            curl_formadd(&formpost_,
                 (curl_httppost**)&lastptr,
                 CURLFORM_COPYNAME, k.first.c_str(),
                 CURLFORM_COPYCONTENTS, k.second.c_str(),
                 CURLFORM_END);
         }
 
-        for(auto& value : headers_){
-            headers = curl_slist_append(headers, value.c_str());
-        }
+        // 句柄跨请求复用，curl_easy_reset清掉选项但保留连接，同一个线程的下一个请求直接复用
+        if(handle_ == nullptr)
+            handle_ = curl_easy_init();
+        else
+            curl_easy_reset(handle_);
 
-         if(iLogger::begin_with(url_, "https://")){
+        CURL* curl = handle_;
+        curl_ = curl;
+        if(iLogger::begin_with(url_, "https://")){
             curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
             curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 1);
         }
 
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        if(share_){
+            curl_easy_setopt(curl, CURLOPT_SHARE, share_->handle());
+            curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, (long)share_->max_idle_connections());
+        }
+
+        if(http_version_ == HttpVersion_1_1){
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+        }else if(http_version_ == HttpVersion_2){
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_0);
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }else if(http_version_ == HttpVersion_2_PriorKnowledge){
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }
+
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, build_header_list(&heap_headers_));
         curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_bytes);
-        curl_easy_setopt(curl, CURLOPT_HEADER, 1);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_bytes);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, this);
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data_);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_second_);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+        // 限速时传输时间取决于大小/速率，固定的总超时会让大文件必然超时，改为只在长时间几乎没有进展时中止
+        bool throttled = false;
+        for(auto& bucket : bandwidth_limiters_)
+            throttled = throttled || bucket->rate() > 0;
+
+        if(throttled){
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L);
+            curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)timeout_second_);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)timeout_second_);
+        }else{
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_second_);
+        }
         curl_easy_setopt(curl, CURLOPT_VERBOSE, verbose_ ? 1 : 0);
 
         if(type_ == QueryType_PostBody){
@@ -201,69 +579,71 @@ public:
             curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body_.pdata);
             curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body_.size);
         }else if(type_ == QueryType_PutBody){
-            stream_put_body.pdata  = static_cast<const unsigned char*>(body_.pdata);
-            stream_put_body.data_size = body_.size;
-            stream_put_body.curosr = 0;
+            stream_put_body_.pdata  = static_cast<const unsigned char*>(body_.pdata);
+            stream_put_body_.data_size = body_.size;
+            stream_put_body_.curosr = 0;
             curl_easy_setopt(curl, CURLOPT_PUT, 1);
-            curl_easy_setopt(curl, CURLOPT_INFILE, &stream_put_body);
+            curl_easy_setopt(curl, CURLOPT_INFILE, &stream_put_body_);
             curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_bytes);
             curl_easy_setopt(curl, CURLOPT_INFILESIZE, (long)body_.size);
         }else if(type_ == QueryType_PutFile){
+            stream_put_body_.file = put_file_handle_;
+            stream_put_body_.data_size = put_file_size;
             curl_easy_setopt(curl, CURLOPT_PUT, 1);
-            curl_easy_setopt(curl, CURLOPT_INFILE, fput_file_handle);
-            curl_easy_setopt(curl, CURLOPT_INFILESIZE, (long)put_file_size);
+            curl_easy_setopt(curl, CURLOPT_INFILE, &stream_put_body_);
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_bytes);
+            curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)put_file_size);
         }else if(type_ == QueryType_PostFrom){
-            curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
+            curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost_);
         }else if(type_ == QueryType_Put){
             curl_easy_setopt(curl, CURLOPT_PUT, 1);
             curl_easy_setopt(curl, CURLOPT_INFILE, nullptr);
             curl_easy_setopt(curl, CURLOPT_INFILESIZE, (long)0);
+        }else if(type_ == QueryType_Delete){
+            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
         }
 
+        perform_begin_us_ = iLogger::timestamp_steady_us();
+        timing_.start_timestamp_us = iLogger::timestamp_now_us();
+        return curl;
+    }
+
+    virtual bool finish_transfer(int curl_code) override{
+
+        if(curl_ == nullptr)
+            return false;
+
+        CURL* curl = curl_;
+        CURLcode res = (CURLcode)curl_code;
         bool ok = false;
-        CURLcode res = curl_easy_perform(curl);
+        collect_timing(curl);
+        // 用户自己实现的HttpShare不统计
+        auto share = dynamic_cast<HttpShareImpl*>(share_.get());
+        if(share)
+            share->record(timing_);
+
         if (res != CURLE_OK) {
             error_ = iLogger::format("Curl error, code is %d, %s", res, curl_easy_strerror(res));
-            goto err;
-        } 
-
-        // do curl query
-        {
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &state_code_);
+        }else{
+            long response_code = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+            state_code_ = (int)response_code;
             if (!(state_code_ >= 200 && state_code_ < 300)){
                 error_ = iLogger::format("Response code: %d\n", state_code_);
-                goto err;
-            }
-
-            int line_position = data_.find("\r\n\r\n");
-            if(line_position == -1){
-                error_ = iLogger::format("Worng http response, no line token, code: %d\n", state_code_);
-                goto err;
+            }else{
+                ok = true;
             }
-
-            response_header_string_ = data_.substr(0, line_position);
-            data_ = data_.substr(line_position + 4);
-            
-            response_header_lines_ = iLogger::split_string(response_header_string_, "\r\n");
-            for(auto& line : response_header_lines_){
-                int token_position = line.find(':');
-                if(token_position == -1) 
-                    continue;
-
-                auto key = line.substr(0, token_position);
-                auto value = line.substr(token_position + 2);
-                response_header_[key] = value;
-            }
-            ok = true;
         }
 
-    err:
-        curl_easy_cleanup(curl);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
+        curl_ = nullptr;
+        curl_formfree(formpost_);
+        formpost_ = nullptr;
+        curl_slist_free_all(heap_headers_);
+        heap_headers_ = nullptr;
 
-        if(fput_file_handle != nullptr){
-            fclose(fput_file_handle);
+        if(put_file_handle_ != nullptr){
+            fclose(put_file_handle_);
+            put_file_handle_ = nullptr;
         }
         return ok;
     }
@@ -275,20 +655,45 @@ public:
 private:
     string url_;
     unordered_map<string, string> params_;
-    vector<string> headers_;
+    char header_arena_[HeaderArenaSize];
+    int header_arena_used_ = 0;
+    curl_slist header_nodes_[MaxHeaderCount];
+    int header_count_ = 0;
+    deque<string> overflow_headers_;
+    vector<shared_ptr<TokenBucket>> bandwidth_limiters_;
     string response_header_string_;
     unordered_map<string, string> response_header_;
     vector<string> response_header_lines_;
     string data_;
+    HttpBodyWriter* body_writer_ = nullptr;
+    bool writing_body_ = false;
+    int response_code_ = 0;
+    long long content_length_ = -1;
     string error_;
-    QueryType type_;
+    QueryType type_ = QueryType_Get;
     HttpBodyData body_;
     string put_file_;
+    CURL* curl_ = nullptr;              // 正在进行的请求
+    CURL* handle_ = nullptr;            // 复用的句柄，连接缓存在它里面
+    curl_slist* heap_headers_ = nullptr;
+    curl_httppost* formpost_ = nullptr;
+    FILE* put_file_handle_ = nullptr;
+    HttpClientReadStream stream_put_body_;
     int state_code_ = 0;
+    HttpTiming timing_;
+    long long perform_begin_us_ = 0;
     bool verbose_ = false;
     int timeout_second_ = 60;
+    shared_ptr<HttpShare> share_;
+    HttpVersion http_version_ = HttpVersion_Default;
 };
 
 shared_ptr<HttpClient> newHttp(const string& url){
     return shared_ptr<HttpClientImpl>(new HttpClientImpl(url));
+}
+
+HttpClient* thread_local_http(const string& server, const string& path){
+    static thread_local HttpClientImpl instance;
+    instance.reset(server, path);
+    return &instance;
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+
+class TokenBucket;
+class HttpShare;
 
 struct HttpBodyData{
     HttpBodyData() = default;
@@ -14,18 +18,74 @@ struct HttpBodyData{
     size_t size = 0;
 };
 
+// 每次请求的耗时分解，单位us，都是从请求开始计时的累计值（与CURLINFO_*_TIME_T一致）
+struct HttpTiming{
+    long long start_timestamp_us = 0;   // curl开始执行的墙上时间
+    long long namelookup_us = 0;
+    long long connect_us = 0;
+    long long appconnect_us = 0;
+    long long pretransfer_us = 0;
+    long long starttransfer_us = 0;
+    long long total_us = 0;
+    long long upload_end_us = 0;      // 请求体最后一个字节交给curl的时刻，没有请求体时为0
+    long long bytes_up = 0;
+    long long bytes_down = 0;         // 包含响应头
+    long long body_bytes_down = 0;    // 只有响应体
+    bool reused_connection = false;
+};
+
+enum QueryType : int{
+    QueryType_PostFrom,
+    QueryType_PostBody,
+    QueryType_PutBody,
+    QueryType_PutFile,
+    QueryType_Get,
+    QueryType_Put,
+    QueryType_Delete
+};
+
+enum HttpVersion : int{
+    HttpVersion_Default,              // curl的默认行为：https上通过ALPN协商h2，http用1.1
+    HttpVersion_1_1,
+    HttpVersion_2,                    // 尽量使用h2，https通过ALPN协商，明文http尝试Upgrade，不支持时回落1.1
+    HttpVersion_2_PriorKnowledge      // 直接以h2c明文发起，服务端必须支持HTTP/2
+};
+
+// 响应体的写入目标，用来把数据直接下载到最终的内存里
+// 只有2xx响应的响应体会交给它，错误响应仍然写入response_body()，方便打印服务端返回的错误信息
+class HttpBodyWriter{
+public:
+    // 响应头结束时调用，content_length未知时为-1，返回false中止请求
+    virtual bool begin(long long content_length) = 0;
+
+    // 返回false中止请求
+    virtual bool write(const void* data, size_t size) = 0;
+};
+
 class HttpClient{
 public:
     virtual HttpClient* add_header(const std::string& value) = 0;
+
+    // 直接格式化到请求内部的缓冲区，例如add_header_format("Date: %s", date)，不产生临时字符串
+    virtual HttpClient* add_header_format(const char* fmt, ...) = 0;
     virtual HttpClient* add_param(const std::string& name, const std::string& value) = 0;
     virtual HttpClient* verbose() = 0;
     virtual HttpClient* timeout(int timeout_second) = 0;
+    virtual HttpClient* add_bandwidth_limiter(const std::shared_ptr<TokenBucket>& bucket) = 0;
+    virtual HttpClient* set_body_writer(HttpBodyWriter* writer) = 0;
+
+    // 默认使用default_http_share()，传入nullptr表示不共享
+    virtual HttpClient* set_share(const std::shared_ptr<HttpShare>& share) = 0;
+
+    // 使用h2时请求会等待已有连接完成协商后复用它（CURLOPT_PIPEWAIT），而不是并发新建连接
+    virtual HttpClient* set_http_version(HttpVersion version) = 0;
     virtual bool post() = 0;
     virtual bool post_body(const HttpBodyData& body) = 0;
     virtual bool put_body(const HttpBodyData& body) = 0;
     virtual bool put_file(const std::string& file) = 0;
     virtual bool get() = 0;
     virtual bool put() = 0;
+    virtual bool del() = 0;
     virtual const std::string& response_body() const = 0;
     virtual int state_code() const = 0;
     virtual const std::string& error_message() const = 0;
@@ -33,8 +93,60 @@ public:
     virtual const std::vector<std::string>& response_headers() const = 0;
     virtual bool has_response_header(const std::string& name) const = 0;
     virtual const std::string& response_header_string() const = 0;
+    virtual const HttpTiming& timing() const = 0;
+
+    // 供AsyncEngine使用：按type配置一个curl easy句柄（CURL*）交给curl_multi，失败返回nullptr
+    // 传输结束、取消或者超时后必须调用finish_transfer，收集结果并释放句柄，返回是否成功
+    virtual void* prepare_transfer(QueryType type, const HttpBodyData& body = HttpBodyData()) = 0;
+    virtual bool finish_transfer(int curl_code) = 0;
 };
 
 std::shared_ptr<HttpClient> newHttp(const std::string& url);
 
+
+struct HttpShareStats{
+    long long transfers = 0;          // 使用这个共享对象完成的请求数
+    long long new_connections = 0;    // 其中新建的连接数，其余的复用了连接池
+    long long tls_handshakes = 0;     // 新建连接里做了TLS握手的数量，会话恢复的握手也计算在内
+};
+
+/**
+ * @brief 跨请求、跨线程、跨MinioClient共享的DNS缓存、TLS会话缓存（curl_share），可选共享连接池
+ *     连接池默认不共享：libcurl不支持不同线程上同时运行的句柄共享连接，
+ *     同步请求的连接留在每个线程复用的curl句柄里，AsyncEngine的连接留在它的multi句柄里；
+ *     新连接可以恢复任意线程之前的TLS会话，省掉完整握手。内部为每类数据一把互斥锁
+ */
+class HttpShare{
+public:
+    // 返回CURLSH*
+    virtual void* handle() const = 0;
+    virtual int max_idle_connections() const = 0;
+    virtual HttpShareStats stats() const = 0;
+};
+
+/**
+ * @param share_connections      是否跨线程共享连接池，为false时只共享DNS和TLS会话。只有所有请求都在同一个线程上执行时才能开启
+ * @param max_idle_connections   连接池保留的连接数（CURLOPT_MAXCONNECTS），curl默认只留5个，并发高于它时连接会被反复关闭重建
+ */
+std::shared_ptr<HttpShare> newHttpShare(bool share_connections = false, int max_idle_connections = 256);
+
+// 进程内共享的对象，HttpClient默认使用
+std::shared_ptr<HttpShare> default_http_share();
+
+// curl_global_init，只执行一次，线程安全。创建HttpClient时会自动调用
+void http_global_init();
+
+// 当前线程复用的HttpClient，重置为server + path的新请求
+// url、响应缓冲区都保留上一次的容量，请求头在对象内部的固定缓冲区里，稳定状态下构造请求不分配内存
+// 返回的指针在本线程下一次调用thread_local_http之前有效，不能跨线程使用
+HttpClient* thread_local_http(const std::string& server, const std::string& path);
+
+// 解析CURLOPT_HEADERFUNCTION给出的一行响应头（带\r\n）
+// 状态行开始新的一组响应头（100 Continue、重定向之后都会再来一组），前面的清空；"key: value"按key建立索引
+// 返回状态行里的状态码，其他行返回0
+int http_parse_header_line(
+    const char* line, size_t size, std::string& header_string,
+    std::vector<std::string>& header_lines, std::unordered_map<std::string, std::string>& headers
+);
+
 #endif //HTTP_CLIENT_HPP
\ No newline at end of file
@@ -18,6 +18,15 @@
 #include <fstream>
 #include <stack>
 #include <signal.h>
+#include <functional>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <errno.h>
+#include <limits.h>
+#include <deque>
+#include <map>
+#include <zlib.h>
 
 #if defined(U_OS_WINDOWS)
 #	define HAS_UUID
@@ -38,9 +47,17 @@
 #	include <sys/stat.h>
 #	include <unistd.h>
 #   include <stdarg.h>
+#	include <sys/uio.h>
 #	define strtok_s  strtok_r
 #endif
 
+#if defined(U_OS_WINDOWS)
+struct iovec{
+    void* iov_base;
+    size_t iov_len;
+};
+#endif
+
 
 #if defined(U_OS_LINUX)
 #define __GetTimeBlock						\
@@ -102,6 +119,23 @@ namespace iLogger{
         return time_string;
     }
 
+    // 日志切分周期的起点，一天的周期就是日期本身，保持原来的文件名
+    static string period_stamp(int interval_seconds){
+        char time_string[32];
+        __GetTimeBlock;
+
+        if(interval_seconds <= 0 || interval_seconds >= 86400){
+            sprintf(time_string, "%04d-%02d-%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+            return time_string;
+        }
+
+        int seconds = t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec;
+        seconds -= seconds % interval_seconds;
+        sprintf(time_string, "%04d-%02d-%02d_%02d%02d%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+            seconds / 3600, seconds / 60 % 60, seconds % 60);
+        return time_string;
+    }
+
     string time_now(){
         char time_string[20];
         __GetTimeBlock;
@@ -113,7 +147,8 @@ namespace iLogger{
     size_t file_size(const string& file){
 #if defined(U_OS_LINUX)
         struct stat st;
-        stat(file.c_str(), &st);
+        if(stat(file.c_str(), &st) != 0)
+            return 0;
         return st.st_size;
 #elif defined(U_OS_WINDOWS)
         WIN32_FIND_DATAA find_data;
@@ -130,7 +165,8 @@ namespace iLogger{
 
 #if defined(U_OS_LINUX)
         struct stat st;
-        stat(file.c_str(), &st);
+        if(stat(file.c_str(), &st) != 0)
+            return 0;
         return st.st_mtim.tv_sec;
 #elif defined(U_OS_WINDOWS)
         INFOW("LastModify has not support on windows os");
@@ -352,83 +388,812 @@ namespace iLogger{
         return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
     }
 
+    long long timestamp_now_us() {
+        return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    long long timestamp_steady_us() {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 日志记录定长，队列预先分配，写日志的线程只做一次vsnprintf和几次原子操作，不加锁不分配内存
+    // 时间、级别、文件名的格式化和IO都放在后台线程，一批记录一次writev
+    static const int LogQueueCapacity = 2048;    // 必须是2的幂
+    static const int LogBatchSize = 256;         // 后台线程每批最多处理的记录数
+    static const int LogRecordSize = 2048;
+
+    // Text：message是格式化好的文本；Deferred：message是序列化的参数，由后台线程按fmt格式化
+    enum LogRecordKind : int{
+        LogRecordKind_Text,
+        LogRecordKind_Deferred
+    };
+
+    // 二进制日志文件：8字节magic，之后是若干条目，每条以1字节类型开头
+    //   String: id(4) length(4) 内容
+    //   Record: timestamp_us(8) fmt_id(4) file_id(4) line(4) level(4) args_size(4) 序列化的参数
+    static const char* LogBinaryMagic = "ILOGBIN1";
+    enum LogBinaryEntry : uint8_t{
+        LogBinaryEntry_String = 1,
+        LogBinaryEntry_Record = 2
+    };
+
+    struct LogRecordHeader{
+        atomic<size_t> sequence;
+        long long timestamp_us;
+        const char* file;
+        const char* fmt;
+        int line;
+        int level;
+        int kind;
+        int length;
+    };
+
+    struct LogRecord : LogRecordHeader{
+        char message[LogRecordSize - sizeof(LogRecordHeader)];
+    };
+
+    // 后台写日志、压缩清理的线程上为true。这些线程里的日志（包括mkdirs等工具函数打的）直接输出到控制台，
+    // 不能进队列：后台线程是唯一的消费者，队列满时等自己就死锁了
+    static thread_local bool t_logger_backend = false;
+
+    static void write_slices(FILE* stream, iovec* iov, int count){
+#if defined(U_OS_LINUX)
+        int fd = fileno(stream);
+        while(count > 0){
+            ssize_t n = ::writev(fd, iov, min(count, IOV_MAX));
+            if(n < 0){
+                if(errno == EINTR) continue;
+                return;
+            }
+
+            // 处理部分写入，跳过已经写完的片段
+            while(count > 0 && (size_t)n >= iov->iov_len){
+                n -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+
+            if(count > 0){
+                iov->iov_base = (char*)iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+        }
+#else
+        for(int i = 0; i < count; ++i)
+            fwrite(iov[i].iov_base, 1, iov[i].iov_len, stream);
+        fflush(stream);
+#endif
+    }
+
+    static void remove_color_text(char* buffer);
+
+    static const char* base_name(const char* file){
+        const char* p = file;
+        for(const char* s = file; *s; ++s){
+            if(*s == '/' || *s == '\\')
+                p = s + 1;
+        }
+        return p;
+    }
+
+    // 输出形如 [2021-07-28 17:56:02][info][minio_client.cpp:100]:
+    int format_log_prefix(char* buffer, int size, long long timestamp_us, int level, const char* file, int line, bool color){
+
+        time_t seconds = (time_t)(timestamp_us / 1000000);
+        tm t;
+#if defined(U_OS_LINUX)
+        localtime_r(&seconds, &t);
+#elif defined(U_OS_WINDOWS)
+        localtime_s(&t, &seconds);
+#endif
+
+        const char* level_color = "";
+        const char* reset_color = "";
+#if defined(U_OS_LINUX)
+        if(color){
+            reset_color = "\033[0m";
+            if (level == ILOGGER_FATAL || level == ILOGGER_ERROR)
+                level_color = "\033[31m";
+            else if (level == ILOGGER_WARNING)
+                level_color = "\033[33m";
+            else
+                level_color = "\033[32m";
+        }
+#endif
+
+        int n = snprintf(
+            buffer, size, "[%04d-%02d-%02d %02d:%02d:%02d][%s%s%s][%s:%d]:",
+            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+            level_color, level_string(level), reset_color, base_name(file), line
+        );
+        return min(max(n, 0), size - 1);
+    }
+
+    atomic<int> __log_level{ILOGGER_INFO};
+
+    struct LogArgReader{
+        const char* cursor;
+        const char* end;
+    };
+
+    struct LogArgValue{
+        LogArgType type = LogArgType_Int;
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d = 0;
+        const char* s = nullptr;
+        uint32_t length = 0;
+    };
+
+    static bool read_log_arg(LogArgReader& r, LogArgValue& v){
+
+        if(r.cursor >= r.end)
+            return false;
+
+        v.type = (LogArgType)*r.cursor++;
+        if(v.type == LogArgType_String){
+            if(r.cursor + 4 > r.end) return false;
+            memcpy(&v.length, r.cursor, 4);
+            r.cursor += 4;
+            if(r.cursor + v.length > r.end) return false;
+            v.s = r.cursor;
+            r.cursor += v.length;
+            return true;
+        }
+
+        if(r.cursor + 8 > r.end) return false;
+        switch(v.type){
+        case LogArgType_Int:     memcpy(&v.i, r.cursor, 8); v.u = (uint64_t)v.i; v.d = (double)v.i; break;
+        case LogArgType_UInt:
+        case LogArgType_Pointer: memcpy(&v.u, r.cursor, 8); v.i = (int64_t)v.u; v.d = (double)v.u; break;
+        case LogArgType_Double:  memcpy(&v.d, r.cursor, 8); v.i = (int64_t)v.d; v.u = (uint64_t)v.i; break;
+        default: return false;
+        }
+        r.cursor += 8;
+        return true;
+    }
+
+    // 与printf一致地处理flags、宽度、精度（包括*）和长度修饰，参数按转换说明需要的类型截断，
+    // 例如用%d打印size_t时与直接调用printf的结果相同
+    int format_log_args(const char* fmt, const char* args, int args_size, char* out, int out_size){
+
+        if(out_size <= 0) return 0;
+
+        LogArgReader reader{args, args + args_size};
+        int n = 0;
+        auto append = [&](const char* data, int size){
+            size = min(size, out_size - 1 - n);
+            if(size > 0){
+                memcpy(out + n, data, size);
+                n += size;
+            }
+        };
+
+        const char* p = fmt;
+        while(*p && n < out_size - 1){
+            if(*p != '%'){
+                const char* literal_end = strchr(p, '%');
+                if(literal_end == nullptr) literal_end = p + strlen(p);
+                append(p, (int)(literal_end - p));
+                p = literal_end;
+                continue;
+            }
+
+            if(p[1] == '%'){
+                append("%", 1);
+                p += 2;
+                continue;
+            }
+
+            // spec保存去掉长度修饰、展开*之后的转换说明
+            char spec[64];
+            int spec_length = 0;
+            auto spec_push = [&](const char* text, int size){
+                size = min(size, (int)sizeof(spec) - 8 - spec_length);
+                if(size > 0){
+                    memcpy(spec + spec_length, text, size);
+                    spec_length += size;
+                }
+            };
+
+            const char* q = p + 1;
+            spec_push("%", 1);
+            while(*q && strchr("-+ #0", *q)) spec_push(q++, 1);
+
+            auto width_or_star = [&]{
+                if(*q == '*'){
+                    LogArgValue v;
+                    char number[32];
+                    int size = snprintf(number, sizeof(number), "%d", read_log_arg(reader, v) ? (int)v.i : 0);
+                    spec_push(number, size);
+                    q++;
+                }else{
+                    while(*q >= '0' && *q <= '9') spec_push(q++, 1);
+                }
+            };
+
+            width_or_star();
+            if(*q == '.'){
+                spec_push(q++, 1);
+                width_or_star();
+            }
+
+            char length_modifier[3] = {0};
+            int length_size = 0;
+            while(*q && strchr("hlLqjzt", *q) && length_size < 2)
+                length_modifier[length_size++] = *q++;
+
+            char conversion = *q;
+            if(conversion == 0)
+                break;
+            p = q + 1;
+
+            if(conversion == 'n')
+                continue;
+
+            LogArgValue v;
+            if(!read_log_arg(reader, v)){
+                append("<missing>", 9);
+                continue;
+            }
+
+            char buffer[512];
+            int size = 0;
+            bool is_char = strcmp(length_modifier, "hh") == 0;
+            bool is_short = strcmp(length_modifier, "h") == 0;
+            bool is_long = length_size > 0 && !is_char && !is_short && !(length_size == 1 && length_modifier[0] == 'L');
+            bool is_32 = !is_char && !is_short && !is_long;
+            switch(conversion){
+            case 'd': case 'i':{
+                long long value = is_char ? (long long)(signed char)v.i : is_short ? (long long)(short)v.i : is_32 ? (long long)(int)v.i : (long long)v.i;
+                spec_push("ll", 2); spec_push(&conversion, 1); spec[spec_length] = 0;
+                size = snprintf(buffer, sizeof(buffer), spec, value);
+                break;
+            }
+            case 'u': case 'o': case 'x': case 'X':{
+                unsigned long long value = is_char ? (unsigned long long)(unsigned char)v.u : is_short ? (unsigned long long)(unsigned short)v.u : is_32 ? (unsigned long long)(unsigned int)v.u : (unsigned long long)v.u;
+                spec_push("ll", 2); spec_push(&conversion, 1); spec[spec_length] = 0;
+                size = snprintf(buffer, sizeof(buffer), spec, value);
+                break;
+            }
+            case 'c':
+                spec_push(&conversion, 1); spec[spec_length] = 0;
+                size = snprintf(buffer, sizeof(buffer), spec, (int)v.i);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec_push(&conversion, 1); spec[spec_length] = 0;
+                size = snprintf(buffer, sizeof(buffer), spec, v.d);
+                break;
+            case 'p':
+                spec_push(&conversion, 1); spec[spec_length] = 0;
+                size = snprintf(buffer, sizeof(buffer), spec, (void*)(uintptr_t)v.u);
+                break;
+            case 's':
+                if(v.type != LogArgType_String){
+                    append("<bad string>", 12);
+                    continue;
+                }
+
+                // 只有纯%s时直接拷贝，不受buffer大小限制
+                if(spec_length == 1){
+                    append(v.s, (int)v.length);
+                    continue;
+                }
+                spec[spec_length] = 0;
+                if(strchr(spec, '.')){
+                    // 已经指定了精度，需要0结尾的字符串
+                    string value(v.s, v.length);
+                    spec_push("s", 1); spec[spec_length] = 0;
+                    size = snprintf(buffer, sizeof(buffer), spec, value.c_str());
+                }else{
+                    spec_push(".*s", 3); spec[spec_length] = 0;
+                    size = snprintf(buffer, sizeof(buffer), spec, (int)v.length, v.s);
+                }
+                break;
+            default:
+                append("<bad format>", 12);
+                continue;
+            }
+            append(buffer, min(max(size, 0), (int)sizeof(buffer) - 1));
+        }
+        out[n] = 0;
+        return n;
+    }
+
     static struct Logger{
         mutex logger_lock_;
         string logger_directory;
-        int logger_level{ILOGGER_INFO};
-        vector<string> cache_, local_;
+        atomic<bool> binary_mode_{false};
+        atomic<int> overflow_policy_{LogOverflowPolicy_Block};
+
+        // Vyukov的有界队列，多生产者单消费者
+        unique_ptr<LogRecord[]> queue_;
+        alignas(64) atomic<size_t> enqueue_pos_{0};
+        alignas(64) size_t dequeue_pos_ = 0;
+        atomic<size_t> consumed_{0};
+
+        atomic<long long> written_{0};
+        atomic<long long> dropped_{0};
+        atomic<long long> blocked_{0};
+
         shared_ptr<thread> flush_thread_;
         atomic<bool> keep_run_{false};
-        shared_ptr<FILE> handler;
-        bool logger_shutdown{false};
+        atomic<bool> backend_sleeping_{false};
+        mutex wakeup_lock_;
+        condition_variable wakeup_;
+        atomic<bool> logger_shutdown{false};
+        atomic<int> waiting_producers_{0};
+        mutex space_lock_;
+        condition_variable space_cv_;
+
+        FILE* handler = nullptr;
+        string handler_stamp;
+        string handler_path;
+        int handler_segment = 0;
+        long long handler_bytes = 0;
+        bool handler_binary = false;
+        long long open_failed_us_ = 0;     // 最近一次打开日志文件失败的时间，失败后限频重试
+        LogRotation rotation_;
+
+        // 切走的文件由后台线程压缩和清理，不占用写日志的线程
+        struct MaintainJob{
+            string file;
+            string active;
+            string directory;
+            bool compress;
+            int max_files;
+        };
+        shared_ptr<thread> maintain_thread_;
+        mutex maintain_lock_;
+        condition_variable maintain_cv_;
+        deque<MaintainJob> maintain_jobs_;
+        bool maintain_stop_ = false;
+        unordered_map<const char*, uint32_t> string_ids_;
+        string binary_buffer_;
 
-        void write(const string& line) {
+        bool start(){
 
             lock_guard<mutex> l(logger_lock_);
-            if(logger_shutdown) 
-                return;
+            if(logger_shutdown)
+                return false;
+
+            if(keep_run_)
+                return true;
 
-            if (!keep_run_) {
+            queue_.reset(new LogRecord[LogQueueCapacity]);
+            for(int i = 0; i < LogQueueCapacity; ++i)
+                queue_[i].sequence.store(i, memory_order_relaxed);
 
-                if(flush_thread_) 
-                    return;
+            keep_run_ = true;
+            flush_thread_.reset(new thread(std::bind(&Logger::flush_job, this)));
+            return true;
+        }
 
-                cache_.reserve(1000);
-                keep_run_ = true;
-                flush_thread_.reset(new thread(std::bind(&Logger::flush_job, this)));
+        // 返回nullptr表示队列已满
+        LogRecord* try_claim(size_t& pos){
+            pos = enqueue_pos_.load(memory_order_relaxed);
+            while(true){
+                LogRecord* record = &queue_[pos & (LogQueueCapacity - 1)];
+                size_t sequence = record->sequence.load(memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+                if(diff == 0){
+                    if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                        return record;
+                }else if(diff < 0){
+                    return nullptr;
+                }else{
+                    pos = enqueue_pos_.load(memory_order_relaxed);
+                }
             }
-            cache_.emplace_back(line);
         }
 
-        void flush() {
+        // 返回nullptr表示日志已经关闭，或者按Drop策略丢弃了
+        LogRecord* claim(size_t& pos, bool must_wait){
 
-            if (cache_.empty())
-                return;
+            if(!keep_run_.load(memory_order_acquire) && !start())
+                return nullptr;
 
+            LogRecord* record = try_claim(pos);
+            if(record)
+                return record;
+
+            if(!must_wait && overflow_policy_.load(memory_order_relaxed) == LogOverflowPolicy_Drop){
+                dropped_.fetch_add(1, memory_order_relaxed);
+                return nullptr;
+            }
+
+            // 等后台线程写完一批、归还槽位
+            blocked_.fetch_add(1, memory_order_relaxed);
+            waiting_producers_.fetch_add(1);
+            while(keep_run_.load(memory_order_acquire)){
+                size_t seen = consumed_.load();
+                if((record = try_claim(pos)) != nullptr)
+                    break;
+
+                wake(true);
+                unique_lock<mutex> l(space_lock_);
+                space_cv_.wait_for(l, chrono::milliseconds(10), [&]{
+                    return consumed_.load() != seen || !keep_run_.load(memory_order_acquire);
+                });
+            }
+            waiting_producers_.fetch_sub(1);
+            return record;
+        }
+
+        void publish(LogRecord* record, size_t pos){
+            record->sequence.store(pos + 1, memory_order_release);
+            wake(false);
+        }
+
+        void wake(bool force){
+            atomic_thread_fence(memory_order_seq_cst);
+            if(force || backend_sleeping_.load(memory_order_relaxed)){
+                lock_guard<mutex> l(wakeup_lock_);
+                wakeup_.notify_one();
+            }
+        }
+
+        // 等待pos之前的记录全部写出，fatal和flush_logger时使用
+        void wait_consumed(size_t pos){
+            waiting_producers_.fetch_add(1);
+            while(keep_run_.load(memory_order_acquire) && consumed_.load() < pos){
+                wake(true);
+                unique_lock<mutex> l(space_lock_);
+                space_cv_.wait_for(l, chrono::milliseconds(10), [&]{
+                    return consumed_.load() >= pos || !keep_run_.load(memory_order_acquire);
+                });
+            }
+            waiting_producers_.fetch_sub(1);
+        }
+
+        // 后台线程归还槽位之后调用
+        void notify_space(){
+            if(waiting_producers_.load() > 0){
+                lock_guard<mutex> l(space_lock_);
+                space_cv_.notify_all();
+            }
+        }
+
+        bool ready(){
+            LogRecord* record = &queue_[dequeue_pos_ & (LogQueueCapacity - 1)];
+            return record->sequence.load(memory_order_acquire) == dequeue_pos_ + 1;
+        }
+
+        int collect(LogRecord** batch){
+            int n = 0;
+            while(n < LogBatchSize && ready()){
+                batch[n++] = &queue_[dequeue_pos_ & (LogQueueCapacity - 1)];
+                dequeue_pos_++;
+            }
+            return n;
+        }
+
+        // 二进制日志：格式串和文件名第一次出现时写一条定义，之后只写id
+        uint32_t intern_string(const char* value, string& out){
+            auto it = string_ids_.find(value);
+            if(it != string_ids_.end())
+                return it->second;
+
+            uint32_t id = (uint32_t)string_ids_.size() + 1;
+            uint32_t length = (uint32_t)strlen(value);
+            string_ids_[value] = id;
+
+            out.push_back((char)LogBinaryEntry_String);
+            out.append((const char*)&id, 4);
+            out.append((const char*)&length, 4);
+            out.append(value, length);
+            return id;
+        }
+
+        void append_binary_record(LogRecord* r, string& out){
+
+            const char* fmt = r->kind == LogRecordKind_Deferred ? r->fmt : "%s";
+            uint32_t fmt_id = intern_string(fmt, out);
+            uint32_t file_id = intern_string(r->file, out);
+
+            // Text记录按一个字符串参数保存
+            uint32_t args_size = r->kind == LogRecordKind_Deferred ? r->length : 5 + r->length;
+            int32_t line = r->line;
+            int32_t level = r->level;
+            int64_t timestamp = r->timestamp_us;
+
+            out.push_back((char)LogBinaryEntry_Record);
+            out.append((const char*)&timestamp, 8);
+            out.append((const char*)&fmt_id, 4);
+            out.append((const char*)&file_id, 4);
+            out.append((const char*)&line, 4);
+            out.append((const char*)&level, 4);
+            out.append((const char*)&args_size, 4);
+            if(r->kind == LogRecordKind_Text){
+                uint32_t length = r->length;
+                out.push_back((char)LogArgType_String);
+                out.append((const char*)&length, 4);
+            }
+            out.append(r->message, r->length);
+        }
+
+        static string segment_path(const string& directory, const string& stamp, int segment, bool binary){
+            const char* suffix = binary ? "binlog" : "txt";
+            if(segment == 0)
+                return format("%s%s.%s", directory.c_str(), stamp.c_str(), suffix);
+            return format("%s%s.%d.%s", directory.c_str(), stamp.c_str(), segment, suffix);
+        }
+
+        // 准备写入incoming字节，需要时切到新文件。返回true表示换了文件
+        bool open_log_file(const string& directory, bool binary, size_t incoming){
+
+            LogRotation rotation;
             {
-                std::lock_guard<mutex> l(logger_lock_);
-                std::swap(local_, cache_);
+                lock_guard<mutex> l(logger_lock_);
+                rotation = rotation_;
+            }
+
+            auto stamp = period_stamp(rotation.interval_seconds);
+            bool switched = handler == nullptr || stamp != handler_stamp || binary != handler_binary ||
+                handler_path.compare(0, directory.size(), directory) != 0;
+            bool full = !switched && rotation.max_file_bytes > 0 && handler_bytes > 0 &&
+                handler_bytes + (long long)incoming > rotation.max_file_bytes;
+
+            if(!switched && !full)
+                return false;
+
+            // 目录建不出来时每批都重试没有意义，这期间的日志只输出到控制台
+            auto now = timestamp_steady_us();
+            if(handler == nullptr && open_failed_us_ != 0 && now - open_failed_us_ < 1000 * 1000)
+                return false;
+
+            string rotated;
+            if(handler){
+                rotated = handler_path;
+                fclose(handler);
+                handler = nullptr;
+            }
+
+            // 进程重启时接着最后一段写，写满了再往后开新的一段
+            int segment = full ? handler_segment + 1 : 0;
+            while(exists(segment_path(directory, stamp, segment + 1, binary)) || exists(segment_path(directory, stamp, segment + 1, binary) + ".gz"))
+                segment++;
+
+            string path = segment_path(directory, stamp, segment, binary);
+            while(rotation.max_file_bytes > 0 && (exists(path + ".gz") ||
+                (exists(path) && file_size(path) > 0 && (long long)(file_size(path) + incoming) > rotation.max_file_bytes))){
+                path = segment_path(directory, stamp, ++segment, binary);
+            }
+
+            handler = fopen_mkdirs(path, "ab");
+            if(handler == nullptr){
+                // 不能用INFOE，见t_logger_backend
+                if(open_failed_us_ == 0)
+                    fprintf(stderr, "ilogger: open log file %s failed: %s, retry every second\n", path.c_str(), strerror(errno));
+                open_failed_us_ = now;
+            }else{
+                open_failed_us_ = 0;
+            }
+            handler_stamp = stamp;
+            handler_path = path;
+            handler_segment = segment;
+            handler_binary = binary;
+            handler_bytes = 0;
+            string_ids_.clear();
+
+            if(handler && fseek(handler, 0, SEEK_END) == 0)
+                handler_bytes = ftell(handler);
+
+            // 新文件先写magic；文件内容都经过write_slices写入，不能混用带缓冲的fwrite
+            if(handler && binary && handler_bytes == 0){
+                iovec iov = {(void*)LogBinaryMagic, 8};
+                write_slices(handler, &iov, 1);
+                handler_bytes = 8;
+            }
+
+            if(!rotated.empty() && rotated != path && (rotation.compress || rotation.max_files > 0))
+                submit_maintain({rotated, path, directory, rotation.compress, rotation.max_files});
+            return true;
+        }
+
+        void write_file(iovec* iov, int count){
+            if(handler == nullptr) return;
+
+            for(int i = 0; i < count; ++i)
+                handler_bytes += iov[i].iov_len;
+            write_slices(handler, iov, count);
+        }
+
+        void submit_maintain(const MaintainJob& job){
+            lock_guard<mutex> l(maintain_lock_);
+            maintain_jobs_.push_back(job);
+            if(maintain_thread_ == nullptr)
+                maintain_thread_.reset(new thread(std::bind(&Logger::maintain_job, this)));
+            maintain_cv_.notify_one();
+        }
+
+        void maintain_job(){
+            t_logger_backend = true;
+            while(true){
+                MaintainJob job;
+                {
+                    unique_lock<mutex> l(maintain_lock_);
+                    maintain_cv_.wait(l, [&]{return !maintain_jobs_.empty() || maintain_stop_;});
+                    if(maintain_jobs_.empty()) return;
+
+                    job = maintain_jobs_.front();
+                    maintain_jobs_.pop_front();
+                }
+
+                if(job.compress && exists(job.file) && compress_file(job.file, job.file + ".gz"))
+                    ::remove(job.file.c_str());
+
+                if(job.max_files > 0)
+                    remove_old_files(job.directory, job.active, job.max_files);
+            }
+        }
+
+        static bool compress_file(const string& file, const string& gzfile){
+
+            FILE* input = fopen(file.c_str(), "rb");
+            if(input == nullptr) return false;
+
+            gzFile output = gzopen(gzfile.c_str(), "wb");
+            if(output == nullptr){
+                fclose(input);
+                return false;
+            }
+
+            bool ok = true;
+            char buffer[64 * 1024];
+            size_t n;
+            while(ok && (n = fread(buffer, 1, sizeof(buffer), input)) > 0)
+                ok = gzwrite(output, buffer, (unsigned)n) == (int)n;
+
+            ok = !ferror(input) && gzclose(output) == Z_OK && ok;
+            fclose(input);
+            if(!ok) ::remove(gzfile.c_str());
+            return ok;
+        }
+
+        // 按文件名里的周期和段号排序，保留最新的max_files个（包括正在写的active）
+        static void remove_old_files(const string& directory, const string& active, int max_files){
+
+            map<pair<string, int>, vector<string>> groups;
+            for(auto& file : find_files(directory, "*.txt;*.txt.gz;*.binlog;*.binlog.gz")){
+                string name = file_name(file, true);
+                if(file == active || name.size() < 10 || name[4] != '-' || name[7] != '-')
+                    continue;
+
+                size_t dot = name.find('.');
+                int segment = dot != string::npos && isdigit((unsigned char)name[dot + 1]) ? atoi(name.c_str() + dot + 1) : 0;
+
+                // 压缩到一半时.txt和.txt.gz同时存在，算作同一个文件
+                groups[make_pair(name.substr(0, dot), segment)].push_back(file);
+            }
+
+            int excess = (int)groups.size() - (max_files - 1);
+            for(auto it = groups.begin(); excess > 0 && it != groups.end(); ++it, --excess){
+                for(auto& file : it->second)
+                    ::remove(file.c_str());
             }
+        }
 
-            if (!local_.empty() && !logger_directory.empty()) {
+        void write_batch(LogRecord** batch, int n){
 
-                auto now = date_now();
-                auto file = format("%s%s.txt", logger_directory.c_str(), now.c_str());
-                if (!exists(file)) {
-                    handler.reset(fopen_mkdirs(file, "wb"), fclose);
+            static const int PrefixSize = 128;
+            static char console_prefix[LogBatchSize][PrefixSize];
+            static char file_prefix[LogBatchSize][PrefixSize];
+            static iovec out_iov[LogBatchSize * 3], err_iov[LogBatchSize * 3], file_iov[LogBatchSize * 3];
+            static char newline[] = "\n";
+            static char formatted[sizeof(LogRecord::message)];
+
+            string directory;
+            {
+                lock_guard<mutex> l(logger_lock_);
+                directory = logger_directory;
+            }
+
+            bool binary = !directory.empty() && binary_mode_.load(memory_order_relaxed);
+            if(binary){
+                // 要用原始参数，所以在格式化之前写；整批拼好一次写入
+                binary_buffer_.clear();
+                for(int i = 0; i < n; ++i)
+                    append_binary_record(batch[i], binary_buffer_);
+
+                // 换了文件之后字符串表清空了，这一批要带上定义重新拼
+                if(open_log_file(directory, true, binary_buffer_.size())){
+                    binary_buffer_.clear();
+                    for(int i = 0; i < n; ++i)
+                        append_binary_record(batch[i], binary_buffer_);
                 }
-                else if (!handler) {
-                    handler.reset(fopen_mkdirs(file, "a+"), fclose);
+
+                iovec iov = {(void*)binary_buffer_.data(), binary_buffer_.size()};
+                write_file(&iov, 1);
+            }
+
+            int nout = 0, nerr = 0, nfile = 0;
+            for(int i = 0; i < n; ++i){
+                LogRecord* r = batch[i];
+                if(r->kind == LogRecordKind_Deferred){
+                    r->length = format_log_args(r->fmt, r->message, r->length, formatted, sizeof(formatted));
+                    memcpy(r->message, formatted, r->length + 1);
+                    r->kind = LogRecordKind_Text;
                 }
 
-                if (handler) {
-                    for (auto& line : local_)
-                        fprintf(handler.get(), "%s\n", line.c_str());
-                    fflush(handler.get());
-                    handler.reset();
+                int prefix_length = format_log_prefix(console_prefix[i], PrefixSize, r->timestamp_us, r->level, r->file, r->line, true);
+                bool is_error = r->level == ILOGGER_FATAL || r->level == ILOGGER_ERROR;
+                iovec* iov = is_error ? err_iov : out_iov;
+                int& count = is_error ? nerr : nout;
+                iov[count++] = {console_prefix[i], (size_t)prefix_length};
+                iov[count++] = {r->message, (size_t)r->length};
+                iov[count++] = {newline, 1};
+            }
+
+            // stdout上可能还有printf留在缓冲区里的内容，先刷出去保持顺序
+            fflush(stdout);
+            write_slices(stdout, out_iov, nout);
+            write_slices(stderr, err_iov, nerr);
+
+            if(!directory.empty() && !binary){
+                for(int i = 0; i < n; ++i){
+                    LogRecord* r = batch[i];
+#if defined(U_OS_LINUX)
+                    // 控制台已经写完，可以原地去掉颜色
+                    remove_color_text(r->message);
+                    r->length = strlen(r->message);
+#endif
+                    int prefix_length = format_log_prefix(file_prefix[i], PrefixSize, r->timestamp_us, r->level, r->file, r->line, false);
+                    file_iov[nfile++] = {file_prefix[i], (size_t)prefix_length};
+                    file_iov[nfile++] = {r->message, (size_t)r->length};
+                    file_iov[nfile++] = {newline, 1};
                 }
+
+                size_t incoming = 0;
+                for(int i = 0; i < nfile; ++i)
+                    incoming += file_iov[i].iov_len;
+
+                open_log_file(directory, false, incoming);
+                write_file(file_iov, nfile);
+            }
+
+            // 写完之后才归还槽位，writev直接引用了槽位里的消息
+            for(int i = 0; i < n; ++i){
+                size_t pos = dequeue_pos_ - n + i;
+                batch[i]->sequence.store(pos + LogQueueCapacity, memory_order_release);
             }
-            local_.clear();
+            written_.fetch_add(n, memory_order_relaxed);
+            consumed_.store(dequeue_pos_);
+            notify_space();
         }
 
         void flush_job() {
 
-            auto tick_begin = timestamp_now();
-            std::vector<string> local;
-            while (keep_run_) {
-
-                if (timestamp_now() - tick_begin < 1000) {
-                    this_thread::sleep_for(std::chrono::milliseconds(100));
+            t_logger_backend = true;
+            LogRecord* batch[LogBatchSize];
+            while(true){
+                int n = collect(batch);
+                if(n > 0){
+                    write_batch(batch, n);
                     continue;
                 }
 
-                tick_begin = timestamp_now();
-                flush();
+                if(!keep_run_)
+                    break;
+
+                backend_sleeping_.store(true, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                {
+                    unique_lock<mutex> l(wakeup_lock_);
+                    if(!ready() && keep_run_)
+                        wakeup_.wait_for(l, chrono::milliseconds(100));
+                }
+                backend_sleeping_.store(false, memory_order_relaxed);
+            }
+
+            if(handler){
+                fclose(handler);
+                handler = nullptr;
             }
-            flush();
         }
 
         void set_save_directory(const string& loggerDirectory) {
+            lock_guard<mutex> l(logger_lock_);
             logger_directory = loggerDirectory;
 
             if (logger_directory.empty())
@@ -447,8 +1212,13 @@ namespace iLogger{
 #endif
         }
 
+        bool has_directory(){
+            lock_guard<mutex> l(logger_lock_);
+            return !logger_directory.empty();
+        }
+
         void set_logger_level(int level){
-            logger_level = level;
+            __log_level = level;
         }
 
         void close(){
@@ -459,11 +1229,33 @@ namespace iLogger{
                 logger_shutdown = true;
             };
 
-            if (!keep_run_) return;
-            keep_run_ = false;
-            flush_thread_->join();
-            flush_thread_.reset();
-            handler.reset();
+            if (keep_run_){
+                keep_run_ = false;
+                wake(true);
+                {
+                    lock_guard<mutex> l(space_lock_);
+                    space_cv_.notify_all();
+                }
+                flush_thread_->join();
+                flush_thread_.reset();
+            }
+
+            // 等待已经切走的文件压缩完
+            {
+                lock_guard<mutex> l(maintain_lock_);
+                maintain_stop_ = true;
+                maintain_cv_.notify_one();
+            }
+
+            if(maintain_thread_){
+                maintain_thread_->join();
+                maintain_thread_.reset();
+            }
+        }
+
+        void set_rotation(const LogRotation& rotation){
+            lock_guard<mutex> l(logger_lock_);
+            rotation_ = rotation;
         }
 
         virtual ~Logger(){
@@ -475,6 +1267,29 @@ namespace iLogger{
         __g_logger.close();
     }
 
+    void flush_logger(){
+        if(t_logger_backend || !__g_logger.keep_run_.load(memory_order_acquire))
+            return;
+
+        __g_logger.wait_consumed(__g_logger.enqueue_pos_.load());
+    }
+
+    void set_logger_rotation(const LogRotation& rotation){
+        __g_logger.set_rotation(rotation);
+    }
+
+    void set_log_overflow_policy(LogOverflowPolicy policy){
+        __g_logger.overflow_policy_ = policy;
+    }
+
+    LoggerStats logger_stats(){
+        LoggerStats s;
+        s.written = __g_logger.written_;
+        s.dropped = __g_logger.dropped_;
+        s.blocked = __g_logger.blocked_;
+        return s;
+    }
+
     static void remove_color_text(char* buffer){
         
         //"\033[31m%s\033[0m"
@@ -512,66 +1327,167 @@ namespace iLogger{
         __g_logger.set_logger_level(level);
     }
 
+    // 日志已经关闭（destroy_logger或者进程退出析构之后），或者在日志自己的后台线程上时，在调用线程上直接输出到控制台
+    static void log_sync(const char* file, int line, int level, const char* message){
+        char prefix[128];
+        format_log_prefix(prefix, sizeof(prefix), timestamp_now_us(), level, file, line, true);
+        FILE* stream = (level == ILOGGER_FATAL || level == ILOGGER_ERROR) ? stderr : stdout;
+        fprintf(stream, "%s%s\n", prefix, message);
+    }
+
+    static void finish_record(LogRecord* record, size_t pos, int level){
+
+        __g_logger.publish(record, pos);
+        if (level == ILOGGER_FATAL) {
+            // fatal同步等待写出，之后进程可能马上退出
+            __g_logger.wait_consumed(pos + 1);
+            fflush(stdout);
+            if(__g_logger.has_directory())
+                abort();
+        }
+    }
+
     void __log_func(const char* file, int line, int level, const char* fmt, ...) {
 
-        if(level > __g_logger.logger_level)
+        if(!__log_enabled(level))
             return;
 
-        string now = time_now();
         va_list vl;
         va_start(vl, fmt);
-        
-        char buffer[2048];
-        string filename = file_name(file, true);
-        int n = snprintf(buffer, sizeof(buffer), "[%s]", now.c_str());
 
-#if defined(U_OS_WINDOWS)
-        if (level == ILOGGER_FATAL || level == ILOGGER_ERROR) {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[%s]", level_string(level));
-        }
-        else if (level == ILOGGER_WARNING) {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[%s]", level_string(level));
-        }
-        else {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[%s]", level_string(level));
-        }
-#elif defined(U_OS_LINUX)
-        if (level == ILOGGER_FATAL || level == ILOGGER_ERROR) {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[\033[31m%s\033[0m]", level_string(level));
-        }
-        else if (level == ILOGGER_WARNING) {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[\033[33m%s\033[0m]", level_string(level));
-        }
-        else {
-            n += snprintf(buffer + n, sizeof(buffer) - n, "[\033[32m%s\033[0m]", level_string(level));
+        size_t pos = 0;
+        LogRecord* record = t_logger_backend ? nullptr : __g_logger.claim(pos, level == ILOGGER_FATAL);
+        if(record == nullptr){
+            if(t_logger_backend || __g_logger.logger_shutdown){
+                char buffer[LogRecordSize];
+                vsnprintf(buffer, sizeof(buffer), fmt, vl);
+                log_sync(file, line, level, buffer);
+            }
+            va_end(vl);
+            return;
         }
-#endif
 
-        n += snprintf(buffer + n, sizeof(buffer) - n, "[%s:%d]:", filename.c_str(), line);
-        vsnprintf(buffer + n, sizeof(buffer) - n, fmt, vl);
+        record->timestamp_us = timestamp_now_us();
+        record->file = file;
+        record->fmt = fmt;
+        record->line = line;
+        record->level = level;
+        record->kind = LogRecordKind_Text;
+        int n = vsnprintf(record->message, sizeof(record->message), fmt, vl);
+        record->length = min(max(n, 0), (int)sizeof(record->message) - 1);
+        va_end(vl);
+        finish_record(record, pos, level);
+    }
 
-        if (level == ILOGGER_FATAL || level == ILOGGER_ERROR) {
-            fprintf(stderr, "%s\n", buffer);
+    // 日志关闭之后或者后台线程上，调用线程自己格式化输出，用线程局部的记录承接参数
+    static thread_local LogRecord t_sync_record;
+
+    void* __log_begin(int level, LogArgWriter& writer){
+
+        size_t pos = 0;
+        LogRecord* record = t_logger_backend ? nullptr : __g_logger.claim(pos, level == ILOGGER_FATAL);
+        if(record == nullptr){
+            if(!t_logger_backend && !__g_logger.logger_shutdown)
+                return nullptr;
+            record = &t_sync_record;
         }
-        else if (level == ILOGGER_WARNING) {
-            fprintf(stdout, "%s\n", buffer);
+
+        // 留一个字节，格式化成文本时需要0结尾
+        writer.cursor = record->message;
+        writer.end = record->message + sizeof(record->message) - 1;
+        return record;
+    }
+
+    void __log_commit(void* handle, const char* file, int line, int level, const char* fmt, const LogArgWriter& writer){
+
+        LogRecord* record = (LogRecord*)handle;
+        int args_size = (int)(writer.cursor - record->message);
+        if(record == &t_sync_record){
+            char buffer[LogRecordSize];
+            format_log_args(fmt, record->message, args_size, buffer, sizeof(buffer));
+            log_sync(file, line, level, buffer);
+            return;
         }
-        else {
-            fprintf(stdout, "%s\n", buffer);
+
+        // 未发布之前sequence就是申请到的位置
+        size_t pos = record->sequence.load(memory_order_relaxed);
+        record->timestamp_us = timestamp_now_us();
+        record->file = file;
+        record->fmt = fmt;
+        record->line = line;
+        record->level = level;
+        record->kind = LogRecordKind_Deferred;
+        record->length = args_size;
+        finish_record(record, pos, level);
+    }
+
+    void set_logger_binary_mode(bool enable){
+        __g_logger.binary_mode_ = enable;
+    }
+
+    bool decode_binary_log(const string& binlog_file, FILE* output, bool color){
+
+        auto data = load_file(binlog_file);
+        if(data.size() < 8 || memcmp(data.data(), LogBinaryMagic, 8) != 0){
+            INFOE("%s is not a binary log", binlog_file.c_str());
+            return false;
         }
 
-        if(!__g_logger.logger_directory.empty()){
-    #ifdef U_OS_LINUX
-            // remove save color txt
-            remove_color_text(buffer);
-    #endif 
-            __g_logger.write(buffer);
-            if (level == ILOGGER_FATAL) {
-                __g_logger.flush();
-                fflush(stdout);
-                abort();
+        const char* p = (const char*)data.data() + 8;
+        const char* end = (const char*)data.data() + data.size();
+        unordered_map<uint32_t, string> strings;
+        char prefix[256];
+        char message[LogRecordSize];
+
+        auto lookup = [&](uint32_t id) -> const char*{
+            auto it = strings.find(id);
+            return it == strings.end() ? "<unknow>" : it->second.c_str();
+        };
+
+        while(p < end){
+            uint8_t type = (uint8_t)*p++;
+            if(type == LogBinaryEntry_String){
+                uint32_t id, length;
+                if(end - p < 8) break;
+                memcpy(&id, p, 4);
+                memcpy(&length, p + 4, 4);
+                p += 8;
+                if((size_t)(end - p) < length) break;
+
+                strings[id].assign(p, length);
+                p += length;
+            }else if(type == LogBinaryEntry_Record){
+                int64_t timestamp;
+                uint32_t fmt_id, file_id, args_size;
+                int32_t line, level;
+                if(end - p < 28) break;
+                memcpy(&timestamp, p, 8);
+                memcpy(&fmt_id, p + 8, 4);
+                memcpy(&file_id, p + 12, 4);
+                memcpy(&line, p + 16, 4);
+                memcpy(&level, p + 20, 4);
+                memcpy(&args_size, p + 24, 4);
+                p += 28;
+                if((size_t)(end - p) < args_size) break;
+
+                format_log_prefix(prefix, sizeof(prefix), timestamp, level, lookup(file_id), line, color);
+                format_log_args(lookup(fmt_id), p, args_size, message, sizeof(message));
+#if defined(U_OS_LINUX)
+                if(!color)
+                    remove_color_text(message);
+#endif
+                fprintf(output, "%s%s\n", prefix, message);
+                p += args_size;
+            }else{
+                INFOE("Corrupted binary log %s at offset %lld", binlog_file.c_str(), (long long)(p - 1 - (const char*)data.data()));
+                return false;
             }
         }
+
+        if(p < end){
+            INFOW("Binary log %s is truncated", binlog_file.c_str());
+        }
+        return true;
     }
 
     string load_text_file(const string& file){
@@ -6,18 +6,39 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <atomic>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
 #include <time.h>
+#include <algorithm>
 
 #define ILOGGER_VERBOSE				4
 #define ILOGGER_INFO				3
 #define ILOGGER_WARNING			    2
 #define ILOGGER_ERROR				1
 #define ILOGGER_FATAL				0
-#define INFOV(...)			iLogger::__log_func(__FILE__, __LINE__, ILOGGER_VERBOSE, __VA_ARGS__)
-#define INFO(...)			iLogger::__log_func(__FILE__, __LINE__, ILOGGER_INFO, __VA_ARGS__)
-#define INFOW(...)			iLogger::__log_func(__FILE__, __LINE__, ILOGGER_WARNING, __VA_ARGS__)
-#define INFOE(...)			iLogger::__log_func(__FILE__, __LINE__, ILOGGER_ERROR, __VA_ARGS__)
-#define INFOF(...)			iLogger::__log_func(__FILE__, __LINE__, ILOGGER_FATAL, __VA_ARGS__)
+
+// 编译期的日志级别，高于它的日志调用在编译时整体去掉，参数也不会求值
+// 例如 -DILOGGER_MIN_LEVEL=ILOGGER_WARNING 去掉全部INFO和INFOV
+#ifndef ILOGGER_MIN_LEVEL
+#define ILOGGER_MIN_LEVEL			ILOGGER_VERBOSE
+#endif
+
+// fmt必须是字符串常量（后台线程格式化时才读取它），写成 "" fmt 让非常量在编译期报错
+// 运行期级别不满足时同样不会对参数求值
+#define __ILOGGER_LOG(level, fmt, ...)                                                                  \
+    do{                                                                                                 \
+        if((level) <= ILOGGER_MIN_LEVEL && iLogger::__log_enabled(level))                               \
+            iLogger::__log_deferred(__FILE__, __LINE__, level, "" fmt, ##__VA_ARGS__);                  \
+    }while(0)
+
+#define INFOV(...)			__ILOGGER_LOG(ILOGGER_VERBOSE, __VA_ARGS__)
+#define INFO(...)			__ILOGGER_LOG(ILOGGER_INFO, __VA_ARGS__)
+#define INFOW(...)			__ILOGGER_LOG(ILOGGER_WARNING, __VA_ARGS__)
+#define INFOE(...)			__ILOGGER_LOG(ILOGGER_ERROR, __VA_ARGS__)
+#define INFOF(...)			__ILOGGER_LOG(ILOGGER_FATAL, __VA_ARGS__)
 
 namespace iLogger{
 
@@ -39,6 +60,10 @@ namespace iLogger{
     string file_name(const string& path, bool include_suffix);
     string directory(const string& path);
     long long timestamp_now();
+    long long timestamp_now_us();
+
+    // 单调时钟，只用来计算耗时，不受NTP校时、手动改时间影响
+    long long timestamp_steady_us();
     time_t last_modify(const string& file);
     vector<uint8_t> load_file(const string& file);
     string load_text_file(const string& file);
@@ -80,6 +105,158 @@ namespace iLogger{
     void __log_func(const char* file, int line, int level, const char* fmt, ...);
     void destroy_logger();
 
+    // 等待调用之前写入队列的日志全部输出到控制台和文件，后台线程没有启动时直接返回
+    void flush_logger();
+
+    // 日志先写入预分配的无锁队列，由后台线程格式化前缀并批量写出
+    // 队列满时：Block等待后台线程腾出位置（默认，不丢日志），Drop直接丢弃并计数，适合错误风暴时保护请求线程
+    // fatal日志总是同步等待写出
+    enum LogOverflowPolicy : int{
+        LogOverflowPolicy_Block,
+        LogOverflowPolicy_Drop
+    };
+    void set_log_overflow_policy(LogOverflowPolicy policy);
+
+    struct LoggerStats{
+        long long written = 0;   // 已经写出的日志条数
+        long long dropped = 0;   // Drop策略下因为队列满丢弃的条数
+        long long blocked = 0;   // Block策略下因为队列满等待的次数
+    };
+    LoggerStats logger_stats();
+
+    // 日志文件的切分和保留，默认每天一个文件{date}.txt，不限大小，不删除
+    struct LogRotation{
+        long long max_file_bytes = 0;   // 文件超过这个大小后切到下一段{stamp}.1.txt、{stamp}.2.txt...，0表示不限
+        int interval_seconds = 86400;   // 按时间切分的周期，从本地零点对齐，小于一天时stamp带上周期的开始时间
+        int max_files = 0;              // 目录里最多保留的日志文件数（包括正在写的），多出的从最旧的开始删除，0表示不删除
+        bool compress = false;          // 切走的文件由后台线程压缩成.gz
+    };
+    void set_logger_rotation(const LogRotation& rotation);
+
+    // 二进制模式：日志文件不再写文本，而是写入格式串id和原始参数（{date}.binlog），
+    // 格式串、文件名只在第一次出现时写一次，用tools/log_decoder还原成文本。控制台输出不受影响
+    void set_logger_binary_mode(bool enable);
+
+    // 把二进制日志还原成与文本日志相同格式的文本，写到output
+    bool decode_binary_log(const string& binlog_file, FILE* output, bool color = false);
+
+    // 以下供日志宏、后台线程和log_decoder使用
+    // 参数的序列化格式：1字节类型 + 数据，整数和浮点固定8字节，字符串为4字节长度 + 内容
+    enum LogArgType : uint8_t{
+        LogArgType_Int,
+        LogArgType_UInt,
+        LogArgType_Double,
+        LogArgType_String,
+        LogArgType_Pointer
+    };
+
+    struct LogArgWriter{
+        char* cursor = nullptr;
+        char* end = nullptr;
+    };
+
+    extern atomic<int> __log_level;
+    inline bool __log_enabled(int level){
+        return level <= __log_level.load(memory_order_relaxed);
+    }
+
+    // 申请一条记录，返回nullptr表示被丢弃；writer指向可以写入参数的区域
+    void* __log_begin(int level, LogArgWriter& writer);
+    void __log_commit(void* record, const char* file, int line, int level, const char* fmt, const LogArgWriter& writer);
+
+    // 按fmt中的转换说明依次取出参数格式化，返回写入的长度
+    int format_log_args(const char* fmt, const char* args, int args_size, char* out, int out_size);
+    int format_log_prefix(char* out, int out_size, long long timestamp_us, int level, const char* file, int line, bool color);
+
+    inline void __log_pack_raw(LogArgWriter& w, LogArgType type, const void* value, size_t size){
+        if(w.cursor + 1 + size > w.end){
+            w.cursor = w.end;
+            return;
+        }
+        *w.cursor++ = (char)type;
+        memcpy(w.cursor, value, size);
+        w.cursor += size;
+    }
+
+    inline void __log_pack_string(LogArgWriter& w, const char* value, size_t length){
+        if(w.cursor + 5 > w.end){
+            w.cursor = w.end;
+            return;
+        }
+        // 放不下时截断
+        uint32_t n = (uint32_t)min(length, (size_t)(w.end - w.cursor - 5));
+        *w.cursor++ = (char)LogArgType_String;
+        memcpy(w.cursor, &n, 4);
+        memcpy(w.cursor + 4, value, n);
+        w.cursor += 4 + n;
+    }
+
+    template<typename T>
+    inline typename enable_if<(is_integral<T>::value && is_signed<T>::value) || is_enum<T>::value>::type
+    __log_pack_one(LogArgWriter& w, const T& value){
+        int64_t v = (int64_t)value;
+        __log_pack_raw(w, LogArgType_Int, &v, sizeof(v));
+    }
+
+    template<typename T>
+    inline typename enable_if<is_integral<T>::value && is_unsigned<T>::value>::type
+    __log_pack_one(LogArgWriter& w, const T& value){
+        uint64_t v = (uint64_t)value;
+        __log_pack_raw(w, LogArgType_UInt, &v, sizeof(v));
+    }
+
+    template<typename T>
+    inline typename enable_if<is_floating_point<T>::value>::type
+    __log_pack_one(LogArgWriter& w, const T& value){
+        double v = (double)value;
+        __log_pack_raw(w, LogArgType_Double, &v, sizeof(v));
+    }
+
+    template<typename T>
+    inline void __log_pack_one(LogArgWriter& w, T* const& value){
+        uint64_t v = (uint64_t)(uintptr_t)value;
+        __log_pack_raw(w, LogArgType_Pointer, &v, sizeof(v));
+    }
+
+    // 字符串在调用线程上拷贝，调用返回后原来的内存可以立即释放
+    inline void __log_pack_one(LogArgWriter& w, const char* const& value){
+        if(value == nullptr) __log_pack_string(w, "(null)", 6);
+        else __log_pack_string(w, value, strlen(value));
+    }
+
+    inline void __log_pack_one(LogArgWriter& w, char* const& value){
+        __log_pack_one(w, (const char*)value);
+    }
+
+    template<size_t N>
+    inline void __log_pack_one(LogArgWriter& w, const char (&value)[N]){
+        __log_pack_string(w, value, strnlen(value, N));
+    }
+
+    inline void __log_pack_one(LogArgWriter& w, const string& value){
+        __log_pack_string(w, value.data(), value.size());
+    }
+
+    inline void __log_pack(LogArgWriter&){}
+
+    template<typename T, typename... Args>
+    inline void __log_pack(LogArgWriter& w, const T& value, const Args&... args){
+        __log_pack_one(w, value);
+        __log_pack(w, args...);
+    }
+
+    // 调用线程只拷贝参数，不做格式化
+    template<typename... Args>
+    inline void __log_deferred(const char* file, int line, int level, const char* fmt, const Args&... args){
+        LogArgWriter writer;
+        void* record = __log_begin(level, writer);
+        if(record == nullptr)
+            return;
+
+        __log_pack(writer, args...);
+        __log_commit(record, file, line, level, fmt, writer);
+    }
+
     string base64_decode(const string& base64);
     string base64_encode(const void* data, size_t size);
 };
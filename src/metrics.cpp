@@ -0,0 +1,241 @@
+#include "metrics.hpp"
+#include "ilogger.hpp"
+#include <stdlib.h>
+#include <new>
+#include <algorithm>
+
+using namespace std;
+
+const char* metrics_phase_name(int phase){
+    switch(phase){
+    case MetricsPhase_Queue: return "queue";
+    case MetricsPhase_DNS: return "dns";
+    case MetricsPhase_Connect: return "connect";
+    case MetricsPhase_TLS: return "tls";
+    case MetricsPhase_FirstByte: return "first_byte";
+    case MetricsPhase_Transfer: return "transfer";
+    case MetricsPhase_Total: return "total";
+    default: return "unknow";
+    }
+}
+
+int64_t ShardedCounter::value() const{
+    int64_t sum = 0;
+    for(int i = 0; i < ShardCount; ++i)
+        sum += shards_[i].value.load(memory_order_relaxed);
+    return sum;
+}
+
+void ShardedCounter::reset(){
+    for(int i = 0; i < ShardCount; ++i)
+        shards_[i].value.store(0, memory_order_relaxed);
+}
+
+LatencyHistogram::LatencyHistogram(){
+    reset();
+}
+
+long long LatencyHistogram::bucket_lower(int index){
+    if(index < SubBucketCount)
+        return index;
+
+    int exponent = index / SubBucketCount + SubBucketBits - 1;
+    int sub = index % SubBucketCount;
+    return (long long)(SubBucketCount + sub) << (exponent - SubBucketBits);
+}
+
+long long LatencyHistogram::bucket_upper(int index){
+    if(index < SubBucketCount)
+        return index + 1;
+
+    int exponent = index / SubBucketCount + SubBucketBits - 1;
+    return bucket_lower(index) + (1LL << (exponent - SubBucketBits));
+}
+
+void LatencyHistogram::snapshot(vector<uint64_t>& counts, uint64_t& count, uint64_t& sum, uint64_t& max) const{
+    counts.resize(BucketCount);
+    for(int i = 0; i < BucketCount; ++i)
+        counts[i] = buckets_[i].load(memory_order_relaxed);
+
+    count = count_.load(memory_order_relaxed);
+    sum = sum_.load(memory_order_relaxed);
+    max = max_.load(memory_order_relaxed);
+}
+
+void LatencyHistogram::reset(){
+    for(int i = 0; i < BucketCount; ++i)
+        buckets_[i].store(0, memory_order_relaxed);
+
+    count_.store(0, memory_order_relaxed);
+    sum_.store(0, memory_order_relaxed);
+    max_.store(0, memory_order_relaxed);
+}
+
+double HistogramSnapshot::mean() const{
+    return count == 0 ? 0 : sum / (double)count;
+}
+
+long long HistogramSnapshot::percentile(double q) const{
+
+    uint64_t total = 0;
+    for(auto c : counts) total += c;
+    if(total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > total) rank = total;
+
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < counts.size(); ++i){
+        cumulative += counts[i];
+        if(cumulative >= rank){
+            // 取桶中点，最大值所在的桶不超过真实的max
+            long long lower = LatencyHistogram::bucket_lower(i);
+            long long upper = LatencyHistogram::bucket_upper(i);
+            long long mid = (lower + upper - 1) / 2;
+            return max > 0 && (uint64_t)mid > max ? (long long)max : mid;
+        }
+    }
+    return (long long)max;
+}
+
+// 需要单独计数的状态码，其余的归到-1
+static const int g_tracked_status_codes[] = {
+    0, 200, 204, 206, 304, 400, 403, 404, 409, 412, 416, 429, 500, 502, 503, 504, -1
+};
+static const int g_num_tracked_status_codes = sizeof(g_tracked_status_codes) / sizeof(g_tracked_status_codes[0]);
+
+static int status_code_slot(int code){
+    for(int i = 0; i < g_num_tracked_status_codes - 1; ++i){
+        if(g_tracked_status_codes[i] == code)
+            return i;
+    }
+    return g_num_tracked_status_codes - 1;
+}
+
+struct OperationCounters{
+    ShardedCounter requests;
+    ShardedCounter errors;
+    ShardedCounter retries;
+    ShardedCounter reused_connections;
+    ShardedCounter bytes_up;
+    ShardedCounter bytes_down;
+    ShardedCounter inflight;
+    ShardedCounter status_codes[g_num_tracked_status_codes];
+    LatencyHistogram phases[MetricsPhase_Count];
+};
+
+class ClientMetricsImpl : public ClientMetrics{
+public:
+    ClientMetricsImpl(const vector<string>& operation_names){
+        names_ = operation_names;
+
+        // C++11的new不保证超过16字节的对齐，ShardedCounter的分片要真正落在cache line边界上
+        void* memory = nullptr;
+        if(posix_memalign(&memory, alignof(OperationCounters), sizeof(OperationCounters) * max(names_.size(), (size_t)1)) != 0)
+            throw bad_alloc();
+
+        operations_ = (OperationCounters*)memory;
+        for(size_t i = 0; i < names_.size(); ++i)
+            new(&operations_[i]) OperationCounters();
+    }
+
+    virtual ~ClientMetricsImpl(){
+        for(size_t i = 0; i < names_.size(); ++i)
+            operations_[i].~OperationCounters();
+        free(operations_);
+    }
+
+    virtual void record(const RequestSample& sample) override{
+
+        if(!valid(sample.operation))
+            return;
+
+        auto& op = operations_[sample.operation];
+        op.requests.add(1);
+        if(!sample.success)
+            op.errors.add(1);
+
+        if(sample.reused_connection)
+            op.reused_connections.add(1);
+
+        op.status_codes[status_code_slot(sample.status_code)].add(1);
+        op.bytes_up.add(sample.bytes_up);
+        op.bytes_down.add(sample.bytes_down);
+        for(int i = 0; i < MetricsPhase_Count; ++i)
+            op.phases[i].record(sample.phase_us[i]);
+    }
+
+    virtual void record_retry(int operation) override{
+        if(valid(operation))
+            operations_[operation].retries.add(1);
+    }
+
+    virtual void add_inflight(int operation, int delta) override{
+        if(valid(operation))
+            operations_[operation].inflight.add(delta);
+    }
+
+    virtual MetricsSnapshot snapshot() const override{
+
+        MetricsSnapshot s;
+        s.timestamp_ms = iLogger::timestamp_now();
+        s.operations.resize(names_.size());
+
+        for(size_t i = 0; i < names_.size(); ++i){
+            auto& op  = operations_[i];
+            auto& out = s.operations[i];
+            out.name = names_[i];
+            out.requests = op.requests.value();
+            out.errors = op.errors.value();
+            out.retries = op.retries.value();
+            out.reused_connections = op.reused_connections.value();
+            out.bytes_up = op.bytes_up.value();
+            out.bytes_down = op.bytes_down.value();
+            out.inflight = op.inflight.value();
+
+            for(int k = 0; k < g_num_tracked_status_codes; ++k){
+                auto n = op.status_codes[k].value();
+                if(n > 0)
+                    out.status_codes.emplace_back(g_tracked_status_codes[k], (uint64_t)n);
+            }
+
+            for(int k = 0; k < MetricsPhase_Count; ++k){
+                auto& h = out.phases[k];
+                op.phases[k].snapshot(h.counts, h.count, h.sum, h.max);
+            }
+        }
+        return s;
+    }
+
+    // inflight是瞬时值，不清零
+    virtual void reset() override{
+        for(size_t i = 0; i < names_.size(); ++i){
+            auto& op = operations_[i];
+            op.requests.reset();
+            op.errors.reset();
+            op.retries.reset();
+            op.reused_connections.reset();
+            op.bytes_up.reset();
+            op.bytes_down.reset();
+            for(int k = 0; k < g_num_tracked_status_codes; ++k)
+                op.status_codes[k].reset();
+
+            for(int k = 0; k < MetricsPhase_Count; ++k)
+                op.phases[k].reset();
+        }
+    }
+
+private:
+    bool valid(int operation) const{
+        return operation >= 0 && operation < (int)names_.size();
+    }
+
+private:
+    vector<string> names_;
+    OperationCounters* operations_ = nullptr;
+};
+
+shared_ptr<ClientMetrics> newClientMetrics(const vector<string>& operation_names){
+    return shared_ptr<ClientMetricsImpl>(new ClientMetricsImpl(operation_names));
+}
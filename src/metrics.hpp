@@ -0,0 +1,158 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+/**
+ * @brief 按线程分片的计数器，每个分片独占一条cache line
+ *     热路径上只有一次relaxed的fetch_add，不同线程落在不同分片，互不争用；读取时把分片加起来
+ */
+class ShardedCounter{
+public:
+    static const int ShardCount = 16;
+
+    inline void add(int64_t value){
+        shards_[shard_index()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    int64_t value() const;
+    void reset();
+
+    // 每个线程第一次使用时轮流分配一个分片
+    static inline int shard_index(){
+        static std::atomic<int> next{0};
+        static thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+        return index;
+    }
+
+private:
+    struct alignas(64) Shard{
+        std::atomic<int64_t> value{0};
+    };
+    Shard shards_[ShardCount];
+};
+
+/**
+ * @brief 无锁的对数线性延迟直方图，单位us
+ *     每个2的幂区间再线性切成8份，相对误差不超过12.5%，覆盖1us到约25天
+ *     record只有几次relaxed原子操作，可以在任意线程并发调用
+ */
+class LatencyHistogram{
+public:
+    static const int SubBucketBits = 3;
+    static const int SubBucketCount = 1 << SubBucketBits;
+    static const int BucketCount = (40 - SubBucketBits + 2) * SubBucketCount;
+
+    LatencyHistogram();
+
+    inline void record(long long value){
+        if(value < 0) value = 0;
+        buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add((uint64_t)value, std::memory_order_relaxed);
+
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while((uint64_t)value > prev && !max_.compare_exchange_weak(prev, (uint64_t)value, std::memory_order_relaxed));
+    }
+
+    static inline int bucket_index(long long value){
+        if(value < SubBucketCount)
+            return (int)value;
+
+        int exponent = 63 - __builtin_clzll((unsigned long long)value);
+        int sub = (int)(value >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+        int index = (exponent - SubBucketBits + 1) * SubBucketCount + sub;
+        return index < BucketCount ? index : BucketCount - 1;
+    }
+
+    // 桶的下界和上界(不含)
+    static long long bucket_lower(int index);
+    static long long bucket_upper(int index);
+
+    void snapshot(std::vector<uint64_t>& counts, uint64_t& count, uint64_t& sum, uint64_t& max) const;
+    void reset();
+
+private:
+    std::atomic<uint64_t> buckets_[BucketCount];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+struct HistogramSnapshot{
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    double mean() const;
+
+    // q取值0-1，例如0.99
+    long long percentile(double q) const;
+};
+
+// 一次请求在各个阶段消耗的时间，来自curl的CURLINFO_*_TIME
+enum MetricsPhase : int{
+    MetricsPhase_Queue,        // 限速、并发许可的排队时间
+    MetricsPhase_DNS,          // 域名解析
+    MetricsPhase_Connect,      // TCP建连
+    MetricsPhase_TLS,          // TLS握手
+    MetricsPhase_FirstByte,    // 请求发出到收到首字节，近似服务端处理时间（PUT包含上传时间）
+    MetricsPhase_Transfer,     // 首字节到传输结束，近似带宽
+    MetricsPhase_Total,        // 不含排队的总时间
+    MetricsPhase_Count
+};
+
+const char* metrics_phase_name(int phase);
+
+struct RequestSample{
+    int operation = 0;
+    bool success = false;
+    int status_code = 0;
+    bool reused_connection = false;
+    long long bytes_up = 0;
+    long long bytes_down = 0;
+    long long phase_us[MetricsPhase_Count] = {0};
+};
+
+struct OperationStats{
+    std::string name;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t retries = 0;
+    uint64_t reused_connections = 0;
+    uint64_t bytes_up = 0;
+    uint64_t bytes_down = 0;
+    int64_t inflight = 0;
+
+    // (状态码, 次数)，状态码0表示传输层失败（超时、连接失败等），-1表示不在统计表里的其他状态码
+    std::vector<std::pair<int, uint64_t>> status_codes;
+    HistogramSnapshot phases[MetricsPhase_Count];
+};
+
+struct MetricsSnapshot{
+    long long timestamp_ms = 0;
+    std::vector<OperationStats> operations;
+};
+
+/**
+ * @brief 按操作分类的请求统计：计数器、吞吐量、每个阶段的延迟直方图
+ *     计数器按线程分片，直方图是原子桶，record全程无锁，snapshot随时可以调用，拿到的是一个近似一致的快照
+ */
+class ClientMetrics{
+public:
+    virtual void record(const RequestSample& sample) = 0;
+    virtual void record_retry(int operation) = 0;
+    virtual void add_inflight(int operation, int delta) = 0;
+    virtual MetricsSnapshot snapshot() const = 0;
+    virtual void reset() = 0;
+};
+
+std::shared_ptr<ClientMetrics> newClientMetrics(const std::vector<std::string>& operation_names);
+
+#endif // METRICS_HPP
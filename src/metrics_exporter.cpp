@@ -0,0 +1,377 @@
+#include "metrics_exporter.hpp"
+#include "metrics.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+string metrics_escape_label(const string& value){
+
+    string output;
+    output.reserve(value.size());
+    for(char c : value){
+        if(c == '\\')      output += "\\\\";
+        else if(c == '"')  output += "\\\"";
+        else if(c == '\n') output += "\\n";
+        else               output += c;
+    }
+    return output;
+}
+
+struct ClientEntry{
+    string name;
+    weak_ptr<ClientMetrics> metrics;
+};
+
+struct GaugeEntry{
+    string name;
+    string help;
+    string labels;
+    function<double()> getter;
+    weak_ptr<void> owner;
+    bool has_owner = false;
+    bool counter = false;
+};
+
+// 直方图输出的桶边界，单位us，取2的幂正好落在对数线性桶的边界上：64us, 256us, 1ms ... 4295s
+static vector<long long> histogram_bounds(){
+    vector<long long> bounds;
+    for(int k = 6; k <= 32; k += 2)
+        bounds.push_back(1LL << k);
+    return bounds;
+}
+
+static string format_double(double value){
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+class MetricsRegistryImpl : public MetricsRegistry{
+public:
+    virtual ~MetricsRegistryImpl(){
+        stop_http_listener();
+    }
+
+    virtual void add_client(const string& client_name, const shared_ptr<ClientMetrics>& metrics) override{
+        lock_guard<mutex> l(lock_);
+        ClientEntry entry;
+        entry.name = client_name;
+        entry.metrics = metrics;
+        clients_.emplace_back(entry);
+    }
+
+    virtual void add_gauge(
+        const string& name, const string& help, const string& labels,
+        const function<double()>& getter, const weak_ptr<void>& owner
+    ) override{
+        add_entry(name, help, labels, getter, owner, false);
+    }
+
+    virtual void add_counter(
+        const string& name, const string& help, const string& labels,
+        const function<double()>& getter, const weak_ptr<void>& owner
+    ) override{
+        add_entry(name, help, labels, getter, owner, true);
+    }
+
+    virtual string render_openmetrics() override{
+
+        vector<pair<string, MetricsSnapshot>> snapshots;
+        vector<GaugeEntry> gauges;
+        {
+            lock_guard<mutex> l(lock_);
+            collect_expired();
+            for(auto& client : clients_){
+                auto metrics = client.metrics.lock();
+                if(metrics)
+                    snapshots.emplace_back(client.name, metrics->snapshot());
+            }
+            gauges = gauges_;
+        }
+
+        string out;
+        out.reserve(64 * 1024);
+        render_clients(snapshots, out);
+        render_gauges(gauges, out);
+        out += "# EOF\n";
+        return out;
+    }
+
+    virtual bool start_http_listener(int port, const string& bind_address) override{
+
+        stop_http_listener();
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0){
+            INFOE("Create metrics listener socket failed: %s", strerror(errno));
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if(inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1){
+            INFOE("Invalid metrics listener address: %s", bind_address.c_str());
+            ::close(fd);
+            return false;
+        }
+
+        if(::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0){
+            INFOE("Metrics listener bind %s:%d failed: %s", bind_address.c_str(), port, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        listen_fd_ = fd;
+        keep_run_ = true;
+        listener_thread_.reset(new thread(std::bind(&MetricsRegistryImpl::listener_job, this)));
+        return true;
+    }
+
+    virtual void stop_http_listener() override{
+        if(!listener_thread_)
+            return;
+
+        keep_run_ = false;
+        listener_thread_->join();
+        listener_thread_.reset();
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+private:
+    void add_entry(
+        const string& name, const string& help, const string& labels,
+        const function<double()>& getter, const weak_ptr<void>& owner, bool counter
+    ){
+        lock_guard<mutex> l(lock_);
+        GaugeEntry entry;
+        entry.name = name;
+        entry.help = help;
+        entry.labels = labels;
+        entry.getter = getter;
+        entry.owner = owner;
+        entry.has_owner = !owner.expired();
+        entry.counter = counter;
+        gauges_.emplace_back(entry);
+    }
+
+    void collect_expired(){
+        for(auto it = clients_.begin(); it != clients_.end();){
+            if(it->metrics.expired()) it = clients_.erase(it);
+            else ++it;
+        }
+
+        for(auto it = gauges_.begin(); it != gauges_.end();){
+            if(it->has_owner && it->owner.expired()) it = gauges_.erase(it);
+            else ++it;
+        }
+    }
+
+    static void add_family(string& out, const char* name, const char* type, const char* help){
+        out += iLogger::format("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+    }
+
+    static string op_labels(const string& client, const OperationStats& op){
+        return iLogger::format("client=\"%s\",operation=\"%s\"", metrics_escape_label(client).c_str(), metrics_escape_label(op.name).c_str());
+    }
+
+    void render_clients(const vector<pair<string, MetricsSnapshot>>& snapshots, string& out){
+
+        struct CounterFamily{
+            const char* name;
+            const char* help;
+            uint64_t OperationStats::* field;
+        };
+
+        static const CounterFamily counters[] = {
+            {"minio_request_errors", "Requests that did not succeed.", &OperationStats::errors},
+            {"minio_retries", "Requests re-issued after a failure.", &OperationStats::retries},
+            {"minio_connections_reused", "Requests served on a reused connection.", &OperationStats::reused_connections},
+            {"minio_bytes_sent", "Bytes uploaded, including request headers.", &OperationStats::bytes_up},
+            {"minio_bytes_received", "Bytes downloaded, including response headers.", &OperationStats::bytes_down}
+        };
+
+        add_family(out, "minio_requests", "counter", "Requests by operation and status code, code 0 is a transport failure.");
+        for(auto& item : snapshots){
+            for(auto& op : item.second.operations){
+                for(auto& code : op.status_codes){
+                    out += iLogger::format("minio_requests_total{%s,code=\"%d\"} %llu\n",
+                        op_labels(item.first, op).c_str(), code.first, (unsigned long long)code.second);
+                }
+            }
+        }
+
+        for(auto& family : counters){
+            add_family(out, family.name, "counter", family.help);
+            for(auto& item : snapshots){
+                for(auto& op : item.second.operations){
+                    if(op.requests == 0) continue;
+                    out += iLogger::format("%s_total{%s} %llu\n",
+                        family.name, op_labels(item.first, op).c_str(), (unsigned long long)(op.*family.field));
+                }
+            }
+        }
+
+        add_family(out, "minio_inflight_requests", "gauge", "Requests currently holding a connection.");
+        for(auto& item : snapshots){
+            for(auto& op : item.second.operations){
+                if(op.requests == 0 && op.inflight == 0) continue;
+                out += iLogger::format("minio_inflight_requests{%s} %lld\n", op_labels(item.first, op).c_str(), (long long)op.inflight);
+            }
+        }
+
+        static const vector<long long> bounds = histogram_bounds();
+        add_family(out, "minio_request_duration_seconds", "histogram", "Request latency by phase.");
+        for(auto& item : snapshots){
+            for(auto& op : item.second.operations){
+                if(op.requests == 0) continue;
+
+                auto labels = op_labels(item.first, op);
+                for(int phase = 0; phase < MetricsPhase_Count; ++phase){
+                    auto& h = op.phases[phase];
+                    auto phase_labels = iLogger::format("%s,phase=\"%s\"", labels.c_str(), metrics_phase_name(phase));
+
+                    uint64_t cumulative = 0;
+                    size_t ibucket = 0;
+                    for(auto bound : bounds){
+                        while(ibucket < h.counts.size() && LatencyHistogram::bucket_upper(ibucket) <= bound)
+                            cumulative += h.counts[ibucket++];
+
+                        out += iLogger::format("minio_request_duration_seconds_bucket{%s,le=\"%s\"} %llu\n",
+                            phase_labels.c_str(), format_double(bound / 1e6).c_str(), (unsigned long long)cumulative);
+                    }
+
+                    // 各个桶和h.count是分别读取的，并发记录时会不一致；+Inf和_count用同一份桶的总和，保证单调
+                    while(ibucket < h.counts.size())
+                        cumulative += h.counts[ibucket++];
+
+                    out += iLogger::format("minio_request_duration_seconds_bucket{%s,le=\"+Inf\"} %llu\n", phase_labels.c_str(), (unsigned long long)cumulative);
+                    out += iLogger::format("minio_request_duration_seconds_sum{%s} %s\n", phase_labels.c_str(), format_double(h.sum / 1e6).c_str());
+                    out += iLogger::format("minio_request_duration_seconds_count{%s} %llu\n", phase_labels.c_str(), (unsigned long long)cumulative);
+                }
+            }
+        }
+    }
+
+    // 同名的gauge合并到同一个family下，family的类型取第一个注册项，counter的样本名加_total
+    void render_gauges(const vector<GaugeEntry>& gauges, string& out){
+
+        map<string, vector<const GaugeEntry*>> families;
+        vector<string> order;
+        for(auto& gauge : gauges){
+            if(families.find(gauge.name) == families.end())
+                order.push_back(gauge.name);
+            families[gauge.name].push_back(&gauge);
+        }
+
+        for(auto& name : order){
+            auto& entries = families[name];
+            bool counter = entries[0]->counter;
+            auto sample_name = counter ? name + "_total" : name;
+            add_family(out, name.c_str(), counter ? "counter" : "gauge", entries[0]->help.c_str());
+            for(auto entry : entries){
+                // 渲染期间保持owner存活，getter里才能安全访问它
+                auto owner = entry->owner.lock();
+                if(entry->has_owner && !owner)
+                    continue;
+
+                auto value = format_double(entry->getter());
+                if(entry->labels.empty())
+                    out += iLogger::format("%s %s\n", sample_name.c_str(), value.c_str());
+                else
+                    out += iLogger::format("%s{%s} %s\n", sample_name.c_str(), entry->labels.c_str(), value.c_str());
+            }
+        }
+    }
+
+    void serve(int fd){
+
+        char request[4096];
+        int received = 0;
+        while(received < (int)sizeof(request) - 1){
+            pollfd pfd{fd, POLLIN, 0};
+            if(poll(&pfd, 1, 1000) <= 0)
+                break;
+
+            int n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+            if(n <= 0) break;
+
+            received += n;
+            request[received] = 0;
+            if(strstr(request, "\r\n\r\n")) break;
+        }
+        request[received] = 0;
+
+        string status = "200 OK";
+        string body;
+        string content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        if(strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0){
+            body = render_openmetrics();
+        }else{
+            status = "404 Not Found";
+            content_type = "text/plain";
+            body = "not found\n";
+        }
+
+        auto response = iLogger::format(
+            "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+            status.c_str(), content_type.c_str(), (int)body.size()
+        ) + body;
+
+        size_t sent = 0;
+        while(sent < response.size()){
+            int n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0) break;
+            sent += n;
+        }
+    }
+
+    void listener_job(){
+
+        while(keep_run_){
+            pollfd pfd{listen_fd_, POLLIN, 0};
+            if(poll(&pfd, 1, 200) <= 0)
+                continue;
+
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if(fd < 0)
+                continue;
+
+            serve(fd);
+            ::close(fd);
+        }
+    }
+
+private:
+    mutex lock_;
+    vector<ClientEntry> clients_;
+    vector<GaugeEntry> gauges_;
+    int listen_fd_ = -1;
+    atomic<bool> keep_run_{false};
+    shared_ptr<thread> listener_thread_;
+};
+
+shared_ptr<MetricsRegistry> newMetricsRegistry(){
+    return shared_ptr<MetricsRegistryImpl>(new MetricsRegistryImpl());
+}
+
+shared_ptr<MetricsRegistry> default_metrics_registry(){
+    static shared_ptr<MetricsRegistry> registry = newMetricsRegistry();
+    return registry;
+}
@@ -0,0 +1,49 @@
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+#include <string>
+#include <memory>
+#include <functional>
+
+class ClientMetrics;
+
+/**
+ * @brief 指标注册表，按需输出OpenMetrics/Prometheus文本格式
+ *     - add_client注册一个ClientMetrics，输出请求数（按操作、状态码）、上下行字节、重试、连接复用、在途请求、分阶段延迟直方图
+ *     - add_gauge注册任意回调型指标，例如连接池占用、缓存命中率，owner释放后自动不再输出
+ *     - add_counter注册回调型的累计值，例如缓冲池命中次数，输出为counter，样本名自动加_total
+ *     注册表只持有弱引用，不影响客户端的生命周期；热路径上的计数都在ClientMetrics里按线程分片完成，
+ *     注册表只在渲染时读取
+ */
+class MetricsRegistry{
+public:
+    virtual void add_client(const std::string& client_name, const std::shared_ptr<ClientMetrics>& metrics) = 0;
+
+    // labels格式为 key="value",key2="value2"，可以为空，value需要用metrics_escape_label转义
+    virtual void add_gauge(
+        const std::string& name, const std::string& help, const std::string& labels,
+        const std::function<double()>& getter, const std::weak_ptr<void>& owner = std::weak_ptr<void>()
+    ) = 0;
+
+    // getter的返回值必须单调不减，name不要带_total后缀
+    virtual void add_counter(
+        const std::string& name, const std::string& help, const std::string& labels,
+        const std::function<double()>& getter, const std::weak_ptr<void>& owner = std::weak_ptr<void>()
+    ) = 0;
+
+    virtual std::string render_openmetrics() = 0;
+
+    // 启动一个极简的HTTP服务，GET /metrics 返回render_openmetrics的结果
+    virtual bool start_http_listener(int port, const std::string& bind_address = "0.0.0.0") = 0;
+    virtual void stop_http_listener() = 0;
+};
+
+std::shared_ptr<MetricsRegistry> newMetricsRegistry();
+
+// 进程内默认的注册表
+std::shared_ptr<MetricsRegistry> default_metrics_registry();
+
+// 按文本格式的要求转义标签值里的反斜杠、双引号和换行
+std::string metrics_escape_label(const std::string& value);
+
+#endif // METRICS_EXPORTER_HPP
@@ -1,141 +1,423 @@
 #include "minio_client.hpp"
 #include <string.h>
-#include <openssl/hmac.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <map>
 
+#include "minio_utils.hpp"
 #include "http_client.hpp"
+#include "concurrency_limiter.hpp"
+#include "rate_limiter.hpp"
+#include "metrics_exporter.hpp"
+#include "tracer.hpp"
+#include "workload_recorder.hpp"
+#include "buffer_pool.hpp"
+#include "async_engine.hpp"
+#include "endpoint_router.hpp"
+#include "block_cache.hpp"
 #include "ilogger.hpp"
 
 using namespace std;
 
-static string base64_encode(const void* data, size_t size) {
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    string encode_result;
-    encode_result.reserve(size / 3 * 4 + (size % 3 != 0 ? 4 : 0));
+const char* minio_operation_name(MinioOperation op){
+    switch(op){
+    case MinioOperation_UploadFile: return "upload_file";
+    case MinioOperation_UploadFileData: return "upload_filedata";
+    case MinioOperation_GetFile: return "get_file";
+    case MinioOperation_GetBucketList: return "get_bucket_list";
+    case MinioOperation_MakeBucket: return "make_bucket";
+    case MinioOperation_ListObjects: return "list_objects";
+    case MinioOperation_GetRange: return "get_range";
+    case MinioOperation_RemoveObject: return "remove_object";
+    case MinioOperation_UploadPart: return "upload_part";
+    case MinioOperation_Multipart: return "multipart";
+    default: return "unknow";
+    }
+}
 
-    const unsigned char * current = static_cast<const unsigned char*>(data);
-    static const char *base64_table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";  
-    while(size > 2) {
-        encode_result += base64_table[current[0] >> 2];
-        encode_result += base64_table[((current[0] & 0x03) << 4) + (current[1] >> 4)];
-        encode_result += base64_table[((current[1] & 0x0f) << 2) + (current[2] >> 6)];
-        encode_result += base64_table[current[2] & 0x3f];
+MinioOperationClass minio_operation_class(MinioOperation op){
+    switch(op){
+    case MinioOperation_UploadFile:
+    case MinioOperation_UploadFileData:
+    case MinioOperation_UploadPart:
+        return MinioOperationClass_Upload;
+    case MinioOperation_GetFile:
+    case MinioOperation_GetRange:
+        return MinioOperationClass_Download;
+    default:
+        return MinioOperationClass_List;
+    }
+}
 
-        current += 3;
-        size -= 3;
+static vector<string> minio_operation_names(){
+    vector<string> names;
+    for(int i = 0; i < MinioOperation_Count; ++i)
+        names.emplace_back(minio_operation_name((MinioOperation)i));
+    return names;
+}
+
+MinioClient::MinioClient(const string& server, const string& access_key, const string& secret_key, int correction_time)
+:server(server), access_key(access_key), secret_key(secret_key), correction_time(correction_time), http_version(HttpVersion_Default)
+{
+    for(int i = 0; i <= MinioOperationClass_Count; ++i){
+        byte_buckets.emplace_back(newTokenBucket());
+        request_buckets.emplace_back(newTokenBucket());
     }
+    metrics = newClientMetrics(minio_operation_names());
+    share = default_http_share();
+}
 
-    if(size > 0){
-        encode_result += base64_table[current[0] >> 2];
-        if(size%3 == 1) {
-            encode_result += base64_table[(current[0] & 0x03) << 4];
-            encode_result += "==";
-        } else if(size%3 == 2) {
-            encode_result += base64_table[((current[0] & 0x03) << 4) + (current[1] >> 4)];
-            encode_result += base64_table[(current[1] & 0x0f) << 2];
-            encode_result += "=";
-        }
+void MinioClient::set_concurrency_limit(int initial_limit, int min_limit, int max_limit){
+    if(initial_limit <= 0){
+        limiter.reset();
+        return;
+    }
+    limiter = newConcurrencyLimiter(initial_limit, min_limit, max_limit);
+}
+
+shared_ptr<ConcurrencyLimiter> MinioClient::concurrency_limiter() const{
+    return limiter;
+}
+
+void MinioClient::set_rate_limit(double bytes_per_second, double requests_per_second){
+    byte_buckets[MinioOperationClass_Count]->set_rate(bytes_per_second);
+    request_buckets[MinioOperationClass_Count]->set_rate(requests_per_second);
+}
+
+void MinioClient::set_rate_limit(MinioOperationClass op, double bytes_per_second, double requests_per_second){
+    if(op < 0 || op >= MinioOperationClass_Count){
+        INFOE("Invalid operation class %d", op);
+        return;
     }
-    return encode_result;
+    byte_buckets[op]->set_rate(bytes_per_second);
+    request_buckets[op]->set_rate(requests_per_second);
 }
 
-// 与date -R 结果一致
-static string gmtime_now(int correction_time){
-    time_t timet;
-    time(&timet);
-    timet += correction_time;
+static HttpClient* sign_http(
+    HttpClient* http, const string& access_key, const string& secret_key, int correction_time,
+    const char* method, const string& path, const char* content_type
+){
+    // 时间、签名都写在栈上，请求头直接格式化进请求对象
+    char time[64];
+    char signature[64];
+    minio_gmtime_now(correction_time, time, sizeof(time));
+
+    // 带查询参数时只有子资源参与签名
+    int ret = path.find('?') == string::npos
+        ? minio_hmac_sign(secret_key, method, content_type, time, path.c_str(), signature, sizeof(signature))
+        : minio_hmac_sign(secret_key, method, content_type, time, minio_canonical_resource(path).c_str(), signature, sizeof(signature));
+    if(ret < 0)
+        signature[0] = 0;
+
+    return http->add_header_format("Date: %s", time)
+        ->add_header_format("Content-Type: %s", content_type)
+        ->add_header_format("Authorization: AWS %s:%s", access_key.c_str(), signature);
+}
 
-    tm& t = *(tm*)localtime(&timet);
-    char timebuffer[100];
-    strftime(timebuffer, sizeof(timebuffer), "%a, %d %b %Y %X %z", &t);
-    return timebuffer;
+HttpClient* MinioClient::new_signed_http(const string& server, const char* method, const string& path, const char* content_type){
+    return sign_http(thread_local_http(server, path)->set_share(share)->set_http_version(http_version), access_key, secret_key, correction_time, method, path, content_type);
 }
 
-// openssl sha1 -hmac -binary
-static string hmac_encode_base64(const string& key, const void* data, size_t size){
+// 503、429、5xx网关错误以及curl层面的失败（超时、连接失败，state_code为0）视为过载信号
+static LimiterOutcome classify_outcome(bool success, int state_code){
+    if(success)
+        return LimiterOutcome_Success;
 
-    // SHA1 needed 20 characters.
-    unsigned int len = 20;
-    unsigned char result[20];
- 
-    HMAC_CTX* ctx = HMAC_CTX_new();
-    HMAC_Init_ex(ctx, key.data(), key.size(), EVP_sha1(), NULL);
-    HMAC_Update(ctx, (unsigned char*)data, size);
-    HMAC_Final(ctx, result, &len);
-    HMAC_CTX_free(ctx);
-    return base64_encode(result, len);
+    if(state_code == 0 || state_code == 429 || state_code == 502 || state_code == 503 || state_code == 504)
+        return LimiterOutcome_Dropped;
+    return LimiterOutcome_Ignore;
 }
 
-// echo -en ${_signature} | openssl sha1 -hmac ${s3_secret} -binary | base64
-static string minio_hmac_encode(
-    const string& hash_key,
-    const string& method,
-    const string& content_type, 
-    const string& time,
-    const string& path
+static void trace_request(MinioOperation op, uint64_t trace_id, long long op_begin_us, long long queue_us, long long sign_begin_us, long long sign_us, bool success, HttpClient* http){
+
+    auto& timing = http->timing();
+    auto t0 = timing.start_timestamp_us;
+    auto phase = [&](const char* name, long long begin, long long end){
+        if(t0 > 0 && end > begin)
+            trace_record(name, "minio.phase", t0 + begin, end - begin, trace_id);
+    };
+
+    trace_record("queue", "minio.phase", op_begin_us, queue_us, trace_id);
+    trace_record("sign", "minio.phase", sign_begin_us, sign_us, trace_id);
+
+    // 没有请求体时upload_end为0，上传阶段为空，首字节时间从pretransfer算起
+    auto upload_end = max(timing.upload_end_us, timing.pretransfer_us);
+    phase("dns", 0, timing.namelookup_us);
+    phase("connect", timing.namelookup_us, timing.connect_us);
+    phase("tls", timing.connect_us, timing.appconnect_us);
+    phase("upload", timing.pretransfer_us, upload_end);
+    phase("first_byte", upload_end, timing.starttransfer_us);
+    phase("body_receive", timing.starttransfer_us, timing.total_us);
+
+    TraceSpan span;
+    span.name = minio_operation_name(op);
+    span.category = "minio";
+    span.begin_us = op_begin_us;
+    span.duration_us = iLogger::timestamp_now_us() - op_begin_us;
+    span.request_id = trace_id;
+    span.status_code = success ? http->state_code() : (http->state_code() == 0 ? -1 : http->state_code());
+    span.bytes = timing.bytes_up + timing.bytes_down;
+    trace_record(span);
+}
+
+static void record_request(
+    ClientMetrics* metrics, WorkloadRecorder* recorder, MinioOperation op, const string& path,
+    long long queue_begin, long long queue_us, bool success, HttpClient* http
 ){
-    char buffer[1000];
-    int result_length = snprintf(
-        buffer, sizeof(buffer), 
-        "%s\n\n%s\n%s\n%s", 
-        method.c_str(),
-        content_type.c_str(), 
-        time.c_str(), 
-        path.c_str()
+    auto& timing = http->timing();
+    RequestSample sample;
+    sample.operation = op;
+    sample.success = success;
+    sample.status_code = http->state_code();
+    sample.reused_connection = timing.reused_connection;
+    sample.bytes_up = timing.bytes_up;
+    sample.bytes_down = timing.bytes_down;
+    sample.phase_us[MetricsPhase_Queue] = queue_us;
+    sample.phase_us[MetricsPhase_DNS] = timing.namelookup_us;
+    sample.phase_us[MetricsPhase_Connect] = max(0LL, timing.connect_us - timing.namelookup_us);
+    sample.phase_us[MetricsPhase_TLS] = timing.appconnect_us > 0 ? max(0LL, timing.appconnect_us - timing.connect_us) : 0;
+    sample.phase_us[MetricsPhase_FirstByte] = max(0LL, timing.starttransfer_us - timing.pretransfer_us);
+    sample.phase_us[MetricsPhase_Transfer] = max(0LL, timing.total_us - timing.starttransfer_us);
+    sample.phase_us[MetricsPhase_Total] = timing.total_us;
+    metrics->record(sample);
+
+    if(recorder){
+        auto size = minio_operation_class(op) == MinioOperationClass_Upload ? timing.bytes_up : timing.body_bytes_down;
+        recorder->record(op, path, size, queue_begin, iLogger::timestamp_now_us() - queue_begin, success, http->state_code());
+    }
+}
+
+// 没有收到响应时请求可能已经在原节点上执行了，只有重复执行结果不变的请求才能换节点重试
+// POST（创建、完成分片上传）不重试；PUT bucket重复执行会返回BucketAlreadyOwnedByYou，也不重试
+static bool idempotent_request(MinioOperation op, const char* method){
+    if(strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0 || strcmp(method, "DELETE") == 0)
+        return true;
+    return strcmp(method, "PUT") == 0 && op != MinioOperation_MakeBucket;
+}
+
+bool MinioClient::perform(
+    MinioOperation op, const char* method, const string& path, const char* content_type,
+    const function<bool(HttpClient*)>& send, HttpClient*& http
+){
+    auto trace_id = trace_sample();
+    auto op_class = minio_operation_class(op);
+    // 墙上时间只用于trace和录制的时间戳，耗时都用单调时钟计算
+    auto queue_begin = iLogger::timestamp_now_us();
+    auto queue_begin_steady = iLogger::timestamp_steady_us();
+
+    // 先过请求速率，再拿并发许可，避免被限速的请求占着并发名额
+    request_buckets[MinioOperationClass_Count]->acquire(1);
+    request_buckets[op_class]->acquire(1);
+    if(limiter)
+        limiter->acquire();
+
+    // 排队结束后再签名，Date头不会因为排队太久而和服务器时间偏差过大
+    auto sign_begin = iLogger::timestamp_now_us();
+    auto queue_us = iLogger::timestamp_steady_us() - queue_begin_steady;
+    long long sign_us = 0;
+    bool success = false;
+    int endpoint = -1;
+    bool failover = idempotent_request(op, method);
+    for(int attempt = 0; ; ++attempt){
+        const string* target = &server;
+        if(router){
+            endpoint = router->acquire(endpoint);
+            target = &router->server(endpoint);
+        }
+
+        sign_begin = iLogger::timestamp_now_us();
+        auto sign_begin_steady = iLogger::timestamp_steady_us();
+        http = new_signed_http(*target, method, path, content_type);
+        http->add_bandwidth_limiter(byte_buckets[MinioOperationClass_Count])
+            ->add_bandwidth_limiter(byte_buckets[op_class]);
+        sign_us = iLogger::timestamp_steady_us() - sign_begin_steady;
+
+        metrics->add_inflight(op, 1);
+        success = send(http);
+        metrics->add_inflight(op, -1);
+        if(!router)
+            break;
+
+        // 连接失败、5xx算节点故障；幂等的请求没有收到任何响应时换一个节点重试
+        int code = http->state_code();
+        router->release(endpoint, code > 0 && code < 500);
+        if(success || !failover || code != 0 || http->timing().body_bytes_down > 0 || attempt + 1 >= router->size())
+            break;
+        metrics->record_retry(op);
+    }
+    auto& timing = http->timing();
+
+    // 限制器用首字节时间作为延迟信号，避免大小不一的对象传输时间干扰拥塞判断
+    // 有请求体时服务端会先回100 Continue，首字节时间不含处理时间，改用请求体发完到响应结束的时间
+    if(limiter){
+        auto latency_us = timing.upload_end_us > 0 ? timing.total_us - timing.upload_end_us : timing.starttransfer_us - timing.pretransfer_us;
+        limiter->release(latency_us, classify_outcome(success, http->state_code()));
+    }
+
+    record_request(metrics.get(), recorder.get(), op, path, queue_begin, queue_us, success, http);
+    if(trace_id != 0)
+        trace_request(op, trace_id, queue_begin, queue_us, sign_begin, sign_us, success, http);
+    return success;
+}
+
+MetricsSnapshot MinioClient::metrics_snapshot() const{
+    return metrics->snapshot();
+}
+
+void MinioClient::reset_metrics(){
+    metrics->reset();
+}
+
+void MinioClient::register_metrics(const shared_ptr<MetricsRegistry>& registry, const string& client_name){
+
+    registry->add_client(client_name, metrics);
+    auto labels = iLogger::format("client=\"%s\"", metrics_escape_label(client_name).c_str());
+    if(pool){
+        BufferPool* ppool = pool.get();
+        registry->add_counter(
+            "minio_buffer_pool_hits", "Buffer pool allocations served from the free lists.", labels,
+            [ppool]{return (double)ppool->stats().hits;}, pool
+        );
+        registry->add_counter(
+            "minio_buffer_pool_misses", "Buffer pool allocations that needed a new block.", labels,
+            [ppool]{return (double)ppool->stats().misses;}, pool
+        );
+        registry->add_gauge(
+            "minio_buffer_pool_cached_bytes", "Bytes held in the buffer pool free lists.", labels,
+            [ppool]{return (double)ppool->stats().cached_bytes;}, pool
+        );
+        registry->add_gauge(
+            "minio_buffer_pool_leased_bytes", "Bytes currently leased to ObjectBuffers.", labels,
+            [ppool]{return (double)ppool->stats().leased_bytes;}, pool
+        );
+        registry->add_gauge(
+            "minio_buffer_pool_high_water_bytes", "Peak of leased bytes.", labels,
+            [ppool]{return (double)ppool->stats().high_water_bytes;}, pool
+        );
+    }
+
+    if(router){
+        EndpointRouter* prouter = router.get();
+        for(int i = 0; i < router->size(); ++i){
+            auto endpoint_labels = iLogger::format("%s,endpoint=\"%s\"", labels.c_str(), metrics_escape_label(router->server(i)).c_str());
+            registry->add_gauge(
+                "minio_endpoint_outstanding", "Requests in flight on the endpoint.", endpoint_labels,
+                [prouter, i]{return (double)prouter->states()[i].outstanding;}, router
+            );
+            registry->add_gauge(
+                "minio_endpoint_ejected", "1 while the endpoint is ejected for failing.", endpoint_labels,
+                [prouter, i]{return prouter->states()[i].ejected ? 1.0 : 0.0;}, router
+            );
+        }
+    }
+
+    if(share){
+        HttpShare* pshare = share.get();
+        registry->add_counter(
+            "minio_http_share_transfers", "Requests completed on the shared DNS/TLS/connection cache.", labels,
+            [pshare]{return (double)pshare->stats().transfers;}, share
+        );
+        registry->add_counter(
+            "minio_http_share_new_connections", "Requests that had to open a new connection.", labels,
+            [pshare]{return (double)pshare->stats().new_connections;}, share
+        );
+        registry->add_counter(
+            "minio_http_share_tls_handshakes", "New connections that performed a TLS handshake.", labels,
+            [pshare]{return (double)pshare->stats().tls_handshakes;}, share
+        );
+    }
+
+    if(cache){
+        BlockCache* pcache = cache.get();
+        registry->add_gauge(
+            "minio_block_cache_hit_ratio", "Fraction of read_at blocks served without a request of their own.", labels,
+            [pcache]{
+                auto s = pcache->stats();
+                long long total = s.hits + s.shared_misses + s.misses;
+                return total > 0 ? (double)(s.hits + s.shared_misses) / total : 0.0;
+            }, cache
+        );
+        registry->add_counter(
+            "minio_block_cache_requests", "Range requests issued by the block cache.", labels,
+            [pcache]{return (double)pcache->stats().requests;}, cache
+        );
+        registry->add_gauge(
+            "minio_block_cache_cached_bytes", "Bytes held in the block cache.", labels,
+            [pcache]{return (double)pcache->stats().cached_bytes;}, cache
+        );
+    }
+
+    if(!limiter)
+        return;
+
+    ConcurrencyLimiter* plimiter = limiter.get();
+    registry->add_gauge(
+        "minio_concurrency_limit", "Current adaptive concurrency limit.", labels,
+        [plimiter]{return plimiter->state().limit;}, limiter
+    );
+    registry->add_gauge(
+        "minio_concurrency_inflight", "Requests holding a concurrency permit.", labels,
+        [plimiter]{return (double)plimiter->state().inflight;}, limiter
     );
-    return hmac_encode_base64(hash_key, buffer, result_length);
 }
 
-static string extract_name(const string& response, int begin, int end){
-    
-    int p = response.find("<Name>", begin);
-    if(p == -1 || p >= end) return "";
-    p += 6;
+void MinioClient::set_buffer_pool(const shared_ptr<BufferPool>& pool){
+    this->pool = pool;
+}
 
-    int e = response.find("</Name>", p);
-    if(e == -1 || p >= e) return "";
-    return string(response.begin() + p, response.begin() + e);
+shared_ptr<BufferPool> MinioClient::buffer_pool() const{
+    return pool;
 }
 
-static vector<string> extract_buckets(const string& response){
+void MinioClient::set_http_share(const shared_ptr<HttpShare>& share){
+    this->share = share;
+}
 
-    string bucket_b_token = "<Bucket>";
-    string bucket_e_token = "</Bucket>";
-    vector<string> names;
-    int p = response.find(bucket_b_token);
-    while(p != -1){
-        int e = response.find(bucket_e_token, p + bucket_b_token.size());
-        if(e == -1)
-            break;
+shared_ptr<HttpShare> MinioClient::http_share() const{
+    return share;
+}
 
-        names.emplace_back(move(extract_name(response, p, e)));
-        p = response.find(bucket_b_token, e + bucket_e_token.size());
+void MinioClient::set_endpoints(const vector<string>& servers, const EndpointRouterOptions& options){
+    if(servers.empty()){
+        router.reset();
+        return;
     }
-    return names;
+    router = newEndpointRouter(servers, options);
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void MinioClient::set_endpoints(const vector<string>& servers){
+    set_endpoints(servers, EndpointRouterOptions());
+}
 
-MinioClient::MinioClient(const string& server, const string& access_key, const string& secret_key, int correction_time)
-:server(server), access_key(access_key), secret_key(secret_key), correction_time(correction_time)
-{}
+shared_ptr<EndpointRouter> MinioClient::endpoint_router() const{
+    return router;
+}
+
+void MinioClient::set_http_version(HttpVersion version){
+    http_version = version;
+}
+
+void MinioClient::set_workload_recorder(const shared_ptr<WorkloadRecorder>& recorder){
+    this->recorder = recorder;
+}
 
 bool MinioClient::upload_file(
     const string& remote_path,
     const string& file
 ){
-    const char* content_type = "application/octet-stream";
-    auto time = gmtime_now(correction_time);
-    auto signature = minio_hmac_encode(
-        secret_key, "PUT", content_type, time, remote_path
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_UploadFile, "PUT", remote_path, "application/octet-stream",
+        [&](HttpClient* h){return h->put_file(file);}, http
     );
 
-    auto http = newHttp(iLogger::format("%s%s", server.c_str(), remote_path.c_str()));
-    bool success = http
-        ->add_header(iLogger::format("Date: %s", time.c_str()))
-        ->add_header(iLogger::format("Content-Type: %s", content_type))
-        ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()))
-        ->put_file(file);
-
     if(!success){
         INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
     }
@@ -153,19 +435,12 @@ bool MinioClient::upload_filedata(
     const string& remote_path,
     const void* file_data, size_t data_size
 ){
-    const char* content_type = "application/octet-stream";
-    auto time = gmtime_now(correction_time);
-    auto signature = minio_hmac_encode(
-        secret_key, "PUT", content_type, time, remote_path
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_UploadFileData, "PUT", remote_path, "application/octet-stream",
+        [&](HttpClient* h){return h->put_body(HttpBodyData(file_data, data_size));}, http
     );
 
-    auto http = newHttp(iLogger::format("%s%s", server.c_str(), remote_path.c_str()));
-    bool success = http
-        ->add_header(iLogger::format("Date: %s", time.c_str()))
-        ->add_header(iLogger::format("Content-Type: %s", content_type))
-        ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()))
-        ->put_body(HttpBodyData(file_data, data_size));
-
     if(!success){
         INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
     }
@@ -174,20 +449,25 @@ bool MinioClient::upload_filedata(
 
 bool MinioClient::make_bucket(const std::string& name){
 
-    string path = "/" + name;
-    const char* content_type = "text/plane";
-
-    auto time = gmtime_now(correction_time);
-    auto signature = minio_hmac_encode(
-        secret_key, "PUT", content_type, time, path
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_MakeBucket, "PUT", "/" + name, "text/plane",
+        [&](HttpClient* h){return h->put();}, http
     );
 
-    auto http = newHttp(iLogger::format("%s%s", server.c_str(), path.c_str()));
-    bool success = http
-        ->add_header(iLogger::format("Date: %s", time.c_str()))
-        ->add_header(iLogger::format("Content-Type: %s", content_type))
-        ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()))
-        ->put();
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+    }
+    return success;
+}
+
+bool MinioClient::remove_object(const string& remote_path){
+
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_RemoveObject, "DELETE", remote_path, "text/plane",
+        [&](HttpClient* h){return h->del();}, http
+    );
 
     if(!success){
         INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
@@ -196,21 +476,13 @@ bool MinioClient::make_bucket(const std::string& name){
 }
 
 vector<string> MinioClient::get_bucket_list(bool* pointer_success){
-    const char* path = "/";
-    const char* content_type = "text/plane";
 
-    auto time = gmtime_now(correction_time);
-    auto signature = minio_hmac_encode(
-        secret_key, "GET", content_type, time, path
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetBucketList, "GET", "/", "text/plane",
+        [&](HttpClient* h){return h->get();}, http
     );
 
-    auto http = newHttp(iLogger::format("%s%s", server.c_str(), path));
-    bool success = http
-        ->add_header(iLogger::format("Date: %s", time.c_str()))
-        ->add_header(iLogger::format("Content-Type: %s", content_type))
-        ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()))
-        ->get();
-
     if(pointer_success)
         *pointer_success = success;
 
@@ -218,31 +490,1331 @@ vector<string> MinioClient::get_bucket_list(bool* pointer_success){
         INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
         return {};
     }
-    return extract_buckets(http->response_body());
+    return minio_extract_buckets(http->response_body());
 }
 
+// get_file系列的响应体直接写入最终的内存
+class StringBodyWriter : public HttpBodyWriter{
+public:
+    StringBodyWriter(string& output):output_(output){}
+
+    virtual bool begin(long long content_length) override{
+        if(content_length > 0)
+            output_.reserve(content_length);
+        return true;
+    }
+
+    virtual bool write(const void* data, size_t size) override{
+        output_.append((const char*)data, size);
+        return true;
+    }
+
+private:
+    string& output_;
+};
+
+class MemoryBodyWriter : public HttpBodyWriter{
+public:
+    MemoryBodyWriter(void* dst, size_t capacity):dst_((char*)dst), capacity_(capacity){}
+
+    virtual bool begin(long long content_length) override{
+        overflow_ = content_length > (long long)capacity_;
+        return !overflow_;
+    }
+
+    virtual bool write(const void* data, size_t size) override{
+        if(size > capacity_ - size_){
+            overflow_ = true;
+            return false;
+        }
+        memcpy(dst_ + size_, data, size);
+        size_ += size;
+        return true;
+    }
+
+    size_t size() const{return size_;}
+    bool overflow() const{return overflow_;}
+
+private:
+    char* dst_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    bool overflow_ = false;
+};
+
+class ObjectBufferBodyWriter : public HttpBodyWriter{
+public:
+    ObjectBufferBodyWriter(ObjectBuffer& output):output_(output){}
+
+    virtual bool begin(long long content_length) override{
+        return content_length <= 0 || output_.reserve(content_length);
+    }
+
+    virtual bool write(const void* data, size_t size) override{
+        return output_.append(data, size);
+    }
+
+private:
+    ObjectBuffer& output_;
+};
+
 string MinioClient::get_file(
     const string& remote_path, bool* pointer_success
 ){
-    const char* content_type = "application/octet-stream";
-    auto time = gmtime_now(correction_time);
-    auto signature = minio_hmac_encode(
-        secret_key, "GET", content_type, time, remote_path
+    string output;
+    StringBodyWriter writer(output);
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetFile, "GET", remote_path, "application/octet-stream",
+        [&](HttpClient* h){return h->set_body_writer(&writer)->get();}, http
+    );
+
+    if(pointer_success)
+        *pointer_success = success;
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+        return "";
+    }
+    return output;
+}
+
+bool MinioClient::get_file_into(
+    const string& remote_path, void* dst, size_t capacity, size_t* pointer_size
+){
+    MemoryBodyWriter writer(dst, capacity);
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetFile, "GET", remote_path, "application/octet-stream",
+        [&](HttpClient* h){return h->set_body_writer(&writer)->get();}, http
+    );
+
+    if(pointer_size)
+        *pointer_size = writer.size();
+
+    if(!success){
+        if(writer.overflow())
+            INFOE("get %s failed: object is larger than the buffer (%lld bytes)", remote_path.c_str(), (long long)capacity);
+        else
+            INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+    }
+    return success;
+}
+
+// h2的响应头是小写的，先按原样找，找不到再不区分大小写扫一遍
+static string response_header_nocase(HttpClient* http, const char* name){
+
+    auto value = http->response_header(name);
+    if(!value.empty())
+        return value;
+
+    size_t n = strlen(name);
+    for(auto& line : http->response_headers()){
+        if(line.size() > n && line[n] == ':' && strncasecmp(line.c_str(), name, n) == 0){
+            size_t p = n + 1;
+            while(p < line.size() && line[p] == ' ')
+                p++;
+            return line.substr(p);
+        }
+    }
+    return "";
+}
+
+static string range_header(long long offset, long long size){
+    if(offset < 0)
+        return iLogger::format("Range: bytes=-%lld", size);
+    return iLogger::format("Range: bytes=%lld-%lld", offset, offset + size - 1);
+}
+
+// 206时对象总大小在Content-Range: bytes a-b/total里；不支持Range的服务端返回200和整个对象，截取需要的部分
+static void finish_range(HttpClient* http, const string& remote_path, long long offset, long long size, string& output, MinioObjectInfo* info){
+
+    if(info){
+        info->key = remote_path;
+        info->size = output.size();
+        info->etag = response_header_nocase(http, "ETag");
+        if(info->etag.size() >= 2 && info->etag.front() == '"' && info->etag.back() == '"')
+            info->etag = info->etag.substr(1, info->etag.size() - 2);
+
+        auto content_range = response_header_nocase(http, "Content-Range");
+        auto slash = content_range.rfind('/');
+        if(slash != string::npos && content_range.compare(slash + 1, string::npos, "*") != 0)
+            info->size = atoll(content_range.c_str() + slash + 1);
+    }
+
+    if(http->state_code() == 200 && (long long)output.size() > size){
+        if(offset < 0)
+            output.erase(0, output.size() - size);
+        else
+            output = output.size() > (size_t)offset ? output.substr(offset, size) : string();
+    }
+}
+
+string MinioClient::get_range(
+    const string& remote_path, long long offset, long long size, bool* pointer_success, MinioObjectInfo* pointer_info, const string& if_match, int* pointer_status_code
+){
+    string output;
+    if(pointer_status_code)
+        *pointer_status_code = 0;
+
+    if(size <= 0){
+        if(pointer_success)
+            *pointer_success = size == 0;
+        return output;
+    }
+
+    StringBodyWriter writer(output);
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetRange, "GET", remote_path, "application/octet-stream",
+        [&](HttpClient* h){
+            h->add_header(range_header(offset, size));
+            if(!if_match.empty())
+                h->add_header("If-Match: \"" + if_match + "\"");
+            return h->set_body_writer(&writer)->get();
+        }, http
+    );
+
+    if(success)
+        finish_range(http, remote_path, offset, size, output, pointer_info);
+
+    if(pointer_success)
+        *pointer_success = success;
+
+    if(pointer_status_code)
+        *pointer_status_code = http->state_code();
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+        return "";
+    }
+    return output;
+}
+
+string MinioClient::read_at(const string& remote_path, long long offset, long long size, bool* pointer_success){
+    if(cache)
+        return cache->read(*this, remote_path, offset, size, pointer_success);
+    return get_range(remote_path, offset, size, pointer_success);
+}
+
+vector<string> MinioClient::read_ranges(const string& remote_path, const vector<pair<long long, long long>>& ranges, bool* pointer_success){
+
+    if(cache)
+        return cache->read_ranges(*this, remote_path, ranges, pointer_success);
+
+    bool success = true;
+    vector<string> output;
+    for(auto& range : ranges){
+        bool ok = false;
+        output.emplace_back(get_range(remote_path, range.first, range.second, &ok));
+        success = success && ok;
+    }
+
+    if(pointer_success)
+        *pointer_success = success;
+    return output;
+}
+
+void MinioClient::set_block_cache(const shared_ptr<BlockCache>& cache){
+    this->cache = cache;
+}
+
+shared_ptr<BlockCache> MinioClient::block_cache() const{
+    return cache;
+}
+
+ObjectBuffer MinioClient::get_file_buffer(
+    const string& remote_path, bool* pointer_success, const shared_ptr<ObjectAllocator>& allocator
+){
+    shared_ptr<ObjectAllocator> object_allocator = allocator;
+    if(object_allocator == nullptr)
+        object_allocator = pool ? pool : default_object_allocator();
+
+    ObjectBuffer output(object_allocator);
+    ObjectBufferBodyWriter writer(output);
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetFile, "GET", remote_path, "application/octet-stream",
+        [&](HttpClient* h){return h->set_body_writer(&writer)->get();}, http
     );
 
-    auto http = newHttp(iLogger::format("%s%s", server.c_str(), remote_path.c_str()));
-    bool success = http
-        ->add_header(iLogger::format("Date: %s", time.c_str()))
-        ->add_header(iLogger::format("Content-Type: %s", content_type))
-        ->add_header(iLogger::format("Authorization: AWS %s:%s", access_key.c_str(), signature.c_str()))
-        ->get();
+    if(pointer_success)
+        *pointer_success = success;
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+        output.release();
+    }
+    return output;
+}
+
+static string list_objects_path(const string& bucket, const string& prefix, const string& token){
+    string path = "/" + bucket + "?list-type=2";
+    if(!prefix.empty())
+        path += "&prefix=" + minio_url_encode(prefix);
+    if(!token.empty())
+        path += "&continuation-token=" + minio_url_encode(token);
+    return path;
+}
+
+vector<MinioObjectInfo> MinioClient::list_objects(const string& bucket, const string& prefix, bool* pointer_success){
+
+    vector<MinioObjectInfo> objects;
+    string token;
+    bool success = false;
+    while(true){
+        HttpClient* http = nullptr;
+        success = perform(
+            MinioOperation_ListObjects, "GET", list_objects_path(bucket, prefix, token), "text/plane",
+            [&](HttpClient* h){return h->get();}, http
+        );
+
+        if(!success){
+            INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+            objects.clear();
+            break;
+        }
+
+        bool truncated = false;
+        token.clear();
+        minio_extract_objects(http->response_body(), objects, &truncated, &token);
+        if(!truncated || token.empty())
+            break;
+    }
 
     if(pointer_success)
         *pointer_success = success;
+    return objects;
+}
+
+// sync里的一个任务：local_file非空时比较并按需上传，否则删除remote_path
+struct MinioSyncTask{
+    string local_file;
+    string remote_path;
+    const MinioObjectInfo* remote = nullptr;
+};
+
+static bool sync_unchanged(const MinioSyncTask& task, long long size, time_t mtime, MinioSyncCompare compare){
+
+    if(task.remote == nullptr || task.remote->size != size)
+        return false;
+
+    // 分片上传的ETag带"-分片数"，不是文件的MD5
+    if(compare == MinioSyncCompare_Checksum && task.remote->etag.find('-') == string::npos)
+        return minio_file_md5(task.local_file) == task.remote->etag;
+
+    return mtime <= minio_parse_iso8601(task.remote->last_modified);
+}
+
+MinioSyncResult MinioClient::sync(const string& local_dir, const string& remote_prefix, const MinioSyncOptions& options){
+
+    MinioSyncResult result;
+
+    // /bucket/dir -> bucket、dir/
+    string prefix = remote_prefix;
+    while(!prefix.empty() && prefix.front() == '/')
+        prefix.erase(0, 1);
+
+    auto slash = prefix.find('/');
+    string bucket = prefix.substr(0, slash);
+    prefix = slash == string::npos ? "" : prefix.substr(slash + 1);
+    if(!prefix.empty() && prefix.back() != '/')
+        prefix += "/";
+
+    if(bucket.empty()){
+        INFOE("Invalid remote prefix %s, expect /bucket/prefix", remote_prefix.c_str());
+        return result;
+    }
+
+    string root = local_dir.empty() ? "./" : local_dir;
+    if(root.back() != '/')
+        root += "/";
+
+    // 本地遍历和远端列举同时进行
+    vector<string> files;
+    thread walker([&]{files = iLogger::find_files(root, options.filter, false, true);});
+
+    bool listed = false;
+    auto objects = list_objects(bucket, prefix, &listed);
+    walker.join();
+
+    result.local_files = (int)files.size();
+    result.remote_objects = (int)objects.size();
+    if(!listed){
+        INFOE("List %s failed", remote_prefix.c_str());
+        return result;
+    }
+
+    unordered_map<string, const MinioObjectInfo*> remote;
+    for(auto& object : objects)
+        remote[object.key] = &object;
+
+    vector<MinioSyncTask> tasks;
+    tasks.reserve(files.size());
+    for(auto& file : files){
+        MinioSyncTask task;
+        task.local_file = file;
+        string key = prefix + file.substr(root.size());
+        task.remote_path = "/" + bucket + "/" + key;
+
+        auto it = remote.find(key);
+        if(it != remote.end()){
+            task.remote = it->second;
+            remote.erase(it);
+        }
+        tasks.emplace_back(task);
+    }
+
+    if(options.delete_extraneous){
+        for(auto& item : remote){
+            // 本地遍历只看匹配filter的文件，不匹配的对象不在比较范围内，不能当作本地已经删除
+            auto name = item.first.substr(item.first.rfind('/') + 1);
+            if(!iLogger::pattern_match(name.c_str(), options.filter.c_str()))
+                continue;
+
+            MinioSyncTask task;
+            task.remote_path = "/" + bucket + "/" + item.first;
+            tasks.emplace_back(task);
+        }
+    }
+
+    // 比较（可能要计算MD5）和上传都在工作线程上
+    atomic<size_t> next{0};
+    atomic<int> uploaded{0}, unchanged{0}, deleted{0}, skipped{0};
+    atomic<long long> uploaded_bytes{0};
+    mutex failed_lock;
+    auto worker = [&]{
+        while(true){
+            size_t i = next++;
+            if(i >= tasks.size())
+                break;
+
+            auto& task = tasks[i];
+            bool ok = true;
+            if(task.local_file.empty()){
+                ok = options.dry_run || remove_object(task.remote_path);
+                if(ok) deleted++;
+            }else{
+                // 遍历之后被删除的文件stat会失败，不能拿无效的大小去比较
+                struct stat st;
+                if(stat(task.local_file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)){
+                    INFOW("Skip %s, stat failed: %s", task.local_file.c_str(), strerror(errno));
+                    skipped++;
+                    continue;
+                }
+
+                long long size = st.st_size;
+                if(sync_unchanged(task, size, st.st_mtime, options.compare)){
+                    unchanged++;
+                    continue;
+                }
+
+                ok = options.dry_run || upload_file(task.remote_path, task.local_file);
+                if(ok){
+                    uploaded++;
+                    uploaded_bytes += size;
+                }
+            }
+
+            if(!ok){
+                lock_guard<mutex> l(failed_lock);
+                result.failed.emplace_back(task.remote_path);
+            }
+        }
+    };
+
+    vector<thread> workers;
+    int concurrency = max(1, min(options.concurrency, (int)tasks.size()));
+    for(int i = 0; i < concurrency; ++i)
+        workers.emplace_back(worker);
+
+    for(auto& t : workers)
+        t.join();
+
+    result.uploaded = uploaded;
+    result.unchanged = unchanged;
+    result.deleted = deleted;
+    result.skipped = skipped;
+    result.uploaded_bytes = uploaded_bytes;
+    result.success = result.failed.empty();
+    return result;
+}
+
+string MinioClient::create_multipart(const string& remote_path, int* status_code){
 
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_Multipart, "POST", remote_path + "?uploads", "application/octet-stream",
+        [&](HttpClient* h){return h->post_body(HttpBodyData("", 0));}, http
+    );
+
+    *status_code = http->state_code();
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+        return "";
+    }
+    return minio_extract_upload_id(http->response_body());
+}
+
+bool MinioClient::list_parts(const string& remote_path, const string& upload_id, vector<MinioPartInfo>& parts, int* status_code){
+
+    int marker = 0;
+    while(true){
+        string path = remote_path + "?uploadId=" + minio_url_encode(upload_id);
+        if(marker > 0)
+            path += "&part-number-marker=" + to_string(marker);
+
+        HttpClient* http = nullptr;
+        bool success = perform(
+            MinioOperation_Multipart, "GET", path, "text/plane",
+            [&](HttpClient* h){return h->get();}, http
+        );
+
+        *status_code = http->state_code();
+        if(!success){
+            INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+            return false;
+        }
+
+        bool truncated = false;
+        minio_extract_parts(http->response_body(), parts, &truncated, &marker);
+        if(!truncated || marker <= 0)
+            return true;
+    }
+}
+
+string MinioClient::upload_part(const string& remote_path, const string& upload_id, int number, const void* data, size_t size, int* status_code){
+
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_UploadPart, "PUT", remote_path + "?partNumber=" + to_string(number) + "&uploadId=" + minio_url_encode(upload_id), "application/octet-stream",
+        [&](HttpClient* h){return h->put_body(HttpBodyData(data, size));}, http
+    );
+
+    *status_code = http->state_code();
     if(!success){
         INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
         return "";
     }
-    return http->response_body();
-}
\ No newline at end of file
+
+    string etag = response_header_nocase(http, "ETag");
+    if(etag.size() >= 2 && etag.front() == '"' && etag.back() == '"')
+        etag = etag.substr(1, etag.size() - 2);
+    return etag;
+}
+
+bool MinioClient::complete_multipart(const string& remote_path, const string& upload_id, const vector<MinioPartInfo>& parts){
+
+    string body = "<CompleteMultipartUpload>";
+    for(auto& part : parts)
+        body += iLogger::format("<Part><PartNumber>%d</PartNumber><ETag>\"%s\"</ETag></Part>", part.number, part.etag.c_str());
+    body += "</CompleteMultipartUpload>";
+
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_Multipart, "POST", remote_path + "?uploadId=" + minio_url_encode(upload_id), "application/xml",
+        [&](HttpClient* h){return h->post_body(HttpBodyData(body));}, http
+    );
+
+    // 完成时服务端可能先返回200，合并失败时把错误写在响应体里
+    if(success && http->response_body().find("<Error>") != string::npos)
+        success = false;
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+    }
+    return success;
+}
+
+bool MinioClient::abort_multipart(const string& remote_path, const string& upload_id){
+
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_Multipart, "DELETE", remote_path + "?uploadId=" + minio_url_encode(upload_id), "text/plane",
+        [&](HttpClient* h){return h->del();}, http
+    );
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+    }
+    return success;
+}
+
+/**
+ * 断点续传的记录文件，文本格式，头部描述这次上传，之后每完成一个分片追加一行：
+ *     minio-upload 1
+ *     remote /bucket/key
+ *     file 1073741824 1700000000 67108864        文件大小、修改时间、分片大小
+ *     upload_id xxxx
+ *     part 1 etag
+ * 崩溃时最后一行可能只写了一半，读取时丢弃没有换行结尾的行
+ */
+struct UploadJournal{
+    string remote_path;
+    long long file_size = -1;
+    long long file_mtime = -1;
+    long long part_size = 0;
+    string upload_id;
+    map<int, string> parts;
+};
+
+static bool load_upload_journal(const string& path, UploadJournal& journal){
+
+    if(!iLogger::exists(path))
+        return false;
+
+    auto text = iLogger::load_text_file(path);
+    auto end = text.rfind('\n');
+    if(end == string::npos || text.compare(0, 15, "minio-upload 1\n") != 0)
+        return false;
+
+    auto lines = iLogger::split_string(text.substr(0, end), "\n");
+    for(auto& line : lines){
+        if(iLogger::begin_with(line, "remote ")){
+            journal.remote_path = line.substr(7);
+        }else if(iLogger::begin_with(line, "file ")){
+            sscanf(line.c_str() + 5, "%lld %lld %lld", &journal.file_size, &journal.file_mtime, &journal.part_size);
+        }else if(iLogger::begin_with(line, "upload_id ")){
+            journal.upload_id = line.substr(10);
+        }else if(iLogger::begin_with(line, "part ")){
+            char etag[128] = {0};
+            int number = 0;
+            if(sscanf(line.c_str() + 5, "%d %127s", &number, etag) == 2)
+                journal.parts[number] = etag;
+        }
+    }
+    return !journal.upload_id.empty();
+}
+
+/* 记录文件先完整写到path.tmp并fsync，再rename覆盖，任何时刻崩溃都只会看到旧记录或者完整的新记录
+ * commit_journal返回以追加方式打开的记录文件，后续的分片、区间逐行追加
+ */
+static FILE* open_journal_temp(const string& path){
+    FILE* f = iLogger::fopen_mkdirs(path + ".tmp", "wb");
+    if(f == nullptr)
+        INFOE("Create journal %s.tmp failed", path.c_str());
+    return f;
+}
+
+static FILE* commit_journal(FILE* f, const string& path){
+
+    string temp_path = path + ".tmp";
+    bool ok = !ferror(f) && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if(!ok || rename(temp_path.c_str(), path.c_str()) != 0){
+        INFOE("Write journal %s failed: %s", path.c_str(), strerror(errno));
+        remove(temp_path.c_str());
+        return nullptr;
+    }
+
+    f = fopen(path.c_str(), "ab");
+    if(f == nullptr)
+        INFOE("Open journal %s failed: %s", path.c_str(), strerror(errno));
+    return f;
+}
+
+static FILE* create_upload_journal(const string& path, const UploadJournal& journal){
+
+    FILE* f = open_journal_temp(path);
+    if(f == nullptr)
+        return nullptr;
+
+    fprintf(f, "minio-upload 1\nremote %s\nfile %lld %lld %lld\nupload_id %s\n",
+        journal.remote_path.c_str(), journal.file_size, journal.file_mtime, journal.part_size, journal.upload_id.c_str());
+    for(auto& part : journal.parts)
+        fprintf(f, "part %d %s\n", part.first, part.second.c_str());
+    return commit_journal(f, path);
+}
+
+static bool read_file_range(FILE* f, long long offset, size_t size, vector<char>& buffer){
+    buffer.resize(size);
+    if(fseeko(f, (off_t)offset, SEEK_SET) != 0)
+        return false;
+    return fread(buffer.data(), 1, size, f) == size;
+}
+
+bool MinioClient::upload_file_resumable(const string& remote_path, const string& file, const MinioResumableOptions& options){
+
+    if(!iLogger::isfile(file)){
+        INFOE("File %s not found", file.c_str());
+        return false;
+    }
+
+    const long long min_part_size = 5 * 1024 * 1024;
+    const long long max_parts = 10000;
+    UploadJournal expect;
+    expect.remote_path = remote_path;
+    expect.file_size = iLogger::file_size(file);
+    expect.file_mtime = (long long)iLogger::last_modify(file);
+    expect.part_size = max((long long)options.part_size, min_part_size);
+    expect.part_size = max(expect.part_size, (expect.file_size + max_parts - 1) / max_parts);
+
+    const int part_count = max(1, (int)((expect.file_size + expect.part_size - 1) / expect.part_size));
+    auto part_bytes = [&](int number){
+        return (size_t)min(expect.part_size, expect.file_size - (number - 1) * expect.part_size);
+    };
+
+    string journal_path = options.journal.empty() ? file + ".minio-upload" : options.journal;
+    UploadJournal journal;
+    map<int, string> done;
+    bool resume = load_upload_journal(journal_path, journal);
+    if(resume && (journal.remote_path != expect.remote_path || journal.file_size != expect.file_size ||
+        journal.file_mtime != expect.file_mtime || journal.part_size != expect.part_size)){
+        INFOW("Upload journal %s does not match %s, start over", journal_path.c_str(), file.c_str());
+        abort_multipart(journal.remote_path, journal.upload_id);
+        resume = false;
+    }
+
+    if(resume){
+        // 以服务端为准：记录里有但服务端没有的分片重传；服务端有但没来得及记录的分片，与本地MD5一致也算完成
+        vector<MinioPartInfo> uploaded;
+        int status_code = 0;
+        if(list_parts(remote_path, journal.upload_id, uploaded, &status_code)){
+            FILE* f = fopen(file.c_str(), "rb");
+            vector<char> buffer;
+            for(auto& part : uploaded){
+                if(part.number < 1 || part.number > part_count || part.size != (long long)part_bytes(part.number))
+                    continue;
+
+                auto it = journal.parts.find(part.number);
+                if(it != journal.parts.end() && it->second == part.etag){
+                    done[part.number] = part.etag;
+                }else if(f && read_file_range(f, (part.number - 1) * expect.part_size, part_bytes(part.number), buffer) &&
+                    minio_md5(buffer.data(), buffer.size()) == part.etag){
+                    done[part.number] = part.etag;
+                }
+            }
+            if(f) fclose(f);
+            INFO("Resume upload of %s, %d/%d parts already uploaded", file.c_str(), (int)done.size(), part_count);
+        }else if(status_code == 404){
+            INFOW("Upload %s expired on server, start over", journal.upload_id.c_str());
+            resume = false;
+        }else{
+            return false;
+        }
+    }
+
+    if(!resume){
+        int status_code = 0;
+        journal = expect;
+        journal.upload_id = create_multipart(remote_path, &status_code);
+        if(journal.upload_id.empty())
+            return false;
+    }
+
+    journal.parts = done;
+    FILE* journal_file = create_upload_journal(journal_path, journal);
+    if(journal_file == nullptr){
+        // 新建的上传没有记录就无法续传，不留给服务端占用空间
+        if(!resume)
+            abort_multipart(remote_path, journal.upload_id);
+        return false;
+    }
+
+    vector<int> missing;
+    for(int number = 1; number <= part_count; ++number){
+        if(done.find(number) == done.end())
+            missing.push_back(number);
+    }
+
+    atomic<size_t> next{0};
+    atomic<bool> failed{false};
+    mutex journal_lock;
+    auto worker = [&]{
+        FILE* f = fopen(file.c_str(), "rb");
+        if(f == nullptr){
+            failed = true;
+            return;
+        }
+
+        vector<char> buffer;
+        while(!failed){
+            size_t i = next++;
+            if(i >= missing.size())
+                break;
+
+            int number = missing[i];
+            if(!read_file_range(f, (number - 1) * expect.part_size, part_bytes(number), buffer)){
+                INFOE("Read part %d of %s failed", number, file.c_str());
+                failed = true;
+                break;
+            }
+
+            string etag;
+            for(int attempt = 0; attempt <= options.max_retries && etag.empty(); ++attempt){
+                int status_code = 0;
+                etag = upload_part(remote_path, journal.upload_id, number, buffer.data(), buffer.size(), &status_code);
+                if(status_code == 404)
+                    break;
+            }
+
+            if(etag.empty()){
+                failed = true;
+                break;
+            }
+
+            lock_guard<mutex> l(journal_lock);
+            fprintf(journal_file, "part %d %s\n", number, etag.c_str());
+            fflush(journal_file);
+            journal.parts[number] = etag;
+        }
+        fclose(f);
+    };
+
+    vector<thread> workers;
+    int concurrency = max(1, min(options.concurrency, (int)missing.size()));
+    for(int i = 0; i < concurrency && !missing.empty(); ++i)
+        workers.emplace_back(worker);
+
+    for(auto& t : workers)
+        t.join();
+
+    fclose(journal_file);
+    if(failed){
+        INFOE("Upload %s interrupted, %d/%d parts done, call again to resume", file.c_str(), (int)journal.parts.size(), part_count);
+        return false;
+    }
+
+    vector<MinioPartInfo> parts;
+    for(auto& item : journal.parts){
+        MinioPartInfo part;
+        part.number = item.first;
+        part.etag = item.second;
+        parts.emplace_back(part);
+    }
+
+    if(!complete_multipart(remote_path, journal.upload_id, parts))
+        return false;
+
+    remove(journal_path.c_str());
+    return true;
+}
+
+// 响应体按位置写入文件，服务端忽略Range返回整个对象时长度对不上，直接中止
+class FileRangeBodyWriter : public HttpBodyWriter{
+public:
+    FileRangeBodyWriter(int fd, long long offset, long long size):fd_(fd), offset_(offset), size_(size){}
+
+    virtual bool begin(long long content_length) override{
+        return content_length <= size_;
+    }
+
+    virtual bool write(const void* data, size_t size) override{
+        if((long long)size > size_ - written_)
+            return false;
+
+        const char* p = (const char*)data;
+        while(size > 0){
+            ssize_t n = pwrite(fd_, p, size, (off_t)(offset_ + written_));
+            if(n < 0 && errno == EINTR)
+                continue;
+
+            if(n <= 0)
+                return false;
+
+            p += n;
+            size -= n;
+            written_ += n;
+        }
+        return true;
+    }
+
+    long long written() const{return written_;}
+
+private:
+    int fd_ = -1;
+    long long offset_ = 0;
+    long long size_ = 0;
+    long long written_ = 0;
+};
+
+bool MinioClient::download_range(
+    const string& remote_path, int fd, long long offset, long long size, const string& if_match,
+    long long* received, int* status_code, MinioObjectInfo* info
+){
+    FileRangeBodyWriter writer(fd, offset, size);
+    HttpClient* http = nullptr;
+    bool success = perform(
+        MinioOperation_GetRange, "GET", remote_path, "application/octet-stream",
+        [&](HttpClient* h){
+            h->add_header(range_header(offset, size));
+            if(!if_match.empty())
+                h->add_header("If-Match: \"" + if_match + "\"");
+            return h->set_body_writer(&writer)->get();
+        }, http
+    );
+
+    *received = writer.written();
+    *status_code = http->state_code();
+    if(success && info){
+        info->key = remote_path;
+        info->size = writer.written();
+        info->etag = response_header_nocase(http, "ETag");
+        if(info->etag.size() >= 2 && info->etag.front() == '"' && info->etag.back() == '"')
+            info->etag = info->etag.substr(1, info->etag.size() - 2);
+
+        auto content_range = response_header_nocase(http, "Content-Range");
+        auto slash = content_range.rfind('/');
+        if(slash != string::npos && content_range.compare(slash + 1, string::npos, "*") != 0)
+            info->size = atoll(content_range.c_str() + slash + 1);
+    }
+
+    if(!success){
+        INFOE("post failed: %s\n%s", http->error_message().c_str(), http->response_body().c_str());
+    }
+    return success;
+}
+
+/**
+ * 断点下载的记录文件，文本格式，头部描述对象，之后每写完一段数据追加一行已完成的区间[begin, end)：
+ *     minio-download 1
+ *     remote /bucket/key
+ *     object 53687091200 etag           对象大小、ETag
+ *     range 0 16777216
+ * 区间可以重叠、乱序，读取时合并。数据先写入partial再追加记录，崩溃时最后一行可能只写了一半，读取时丢弃
+ */
+struct DownloadJournal{
+    string remote_path;
+    long long size = -1;
+    string etag;
+    map<long long, long long> ranges;     // begin -> end，互不相交
+};
+
+static void add_download_range(map<long long, long long>& ranges, long long begin, long long end){
+
+    if(begin >= end)
+        return;
+
+    auto it = ranges.upper_bound(begin);
+    if(it != ranges.begin() && prev(it)->second >= begin){
+        --it;
+        begin = it->first;
+        end = max(end, it->second);
+        it = ranges.erase(it);
+    }
+
+    while(it != ranges.end() && it->first <= end){
+        end = max(end, it->second);
+        it = ranges.erase(it);
+    }
+    ranges[begin] = end;
+}
+
+static bool load_download_journal(const string& path, DownloadJournal& journal){
+
+    if(!iLogger::exists(path))
+        return false;
+
+    auto text = iLogger::load_text_file(path);
+    auto end = text.rfind('\n');
+    if(end == string::npos || text.compare(0, 17, "minio-download 1\n") != 0)
+        return false;
+
+    auto lines = iLogger::split_string(text.substr(0, end), "\n");
+    for(auto& line : lines){
+        if(iLogger::begin_with(line, "remote ")){
+            journal.remote_path = line.substr(7);
+        }else if(iLogger::begin_with(line, "object ")){
+            char etag[128] = {0};
+            if(sscanf(line.c_str() + 7, "%lld %127s", &journal.size, etag) == 2)
+                journal.etag = etag;
+        }else if(iLogger::begin_with(line, "range ")){
+            long long begin = 0, end = 0;
+            if(sscanf(line.c_str() + 6, "%lld %lld", &begin, &end) == 2)
+                add_download_range(journal.ranges, max(begin, 0LL), min(end, journal.size));
+        }
+    }
+
+    // 没有ETag时续传无法保证一致性，重新开始
+    return journal.size >= 0 && !journal.etag.empty();
+}
+
+static FILE* create_download_journal(const string& path, const DownloadJournal& journal){
+
+    FILE* f = open_journal_temp(path);
+    if(f == nullptr)
+        return nullptr;
+
+    fprintf(f, "minio-download 1\nremote %s\nobject %lld %s\n", journal.remote_path.c_str(), journal.size, journal.etag.c_str());
+    for(auto& range : journal.ranges)
+        fprintf(f, "range %lld %lld\n", range.first, range.second);
+    return commit_journal(f, path);
+}
+
+bool MinioClient::download_to_file(const string& remote_path, const string& file, const MinioDownloadOptions& options){
+
+    const long long chunk_size = max((long long)options.chunk_size, 1LL);
+    string partial_path = options.partial.empty() ? file + ".partial" : options.partial;
+    string journal_path = partial_path + ".minio";
+
+    // 对象被覆盖时重新开始一次
+    for(int restart = 0; restart < 2; ++restart){
+
+        DownloadJournal journal;
+        bool resume = load_download_journal(journal_path, journal) && journal.remote_path == remote_path && iLogger::isfile(partial_path);
+        if(resume && !journal.ranges.empty() && (long long)iLogger::file_size(partial_path) < journal.ranges.rbegin()->second){
+            INFOW("Partial file %s is shorter than recorded, start over", partial_path.c_str());
+            resume = false;
+        }
+
+        FILE* data_file = iLogger::fopen_mkdirs(partial_path, resume ? "r+b" : "wb");
+        if(data_file == nullptr){
+            INFOE("Open %s failed", partial_path.c_str());
+            return false;
+        }
+        int fd = fileno(data_file);
+
+        if(resume){
+            long long done = 0;
+            for(auto& range : journal.ranges)
+                done += range.second - range.first;
+            INFO("Resume download of %s, %lld/%lld bytes already downloaded", remote_path.c_str(), done, journal.size);
+        }else{
+            // 第一个块同时拿到对象大小和ETag，之后的请求都带If-Match
+            journal = DownloadJournal();
+            journal.remote_path = remote_path;
+
+            MinioObjectInfo info;
+            long long received = 0;
+            int status_code = 0;
+            bool ok = false;
+            for(int attempt = 0; attempt <= options.max_retries && !ok; ++attempt){
+                ok = download_range(remote_path, fd, 0, chunk_size, "", &received, &status_code, &info);
+                if(status_code >= 400 && status_code < 500)
+                    break;
+            }
+
+            // 空对象上的Range返回416
+            if(!ok && status_code == 416){
+                ok = true;
+                info.size = 0;
+                received = 0;
+            }
+
+            if(!ok){
+                fclose(data_file);
+                return false;
+            }
+
+            journal.size = info.size;
+            journal.etag = info.etag;
+            add_download_range(journal.ranges, 0, min(received, journal.size));
+        }
+
+        FILE* journal_file = create_download_journal(journal_path, journal);
+        if(journal_file == nullptr){
+            fclose(data_file);
+            return false;
+        }
+
+        vector<pair<long long, long long>> missing;
+        long long position = 0;
+        auto add_missing = [&](long long begin, long long end){
+            for(long long offset = begin; offset < end; offset += chunk_size)
+                missing.emplace_back(offset, min(end, offset + chunk_size));
+        };
+
+        for(auto& range : journal.ranges){
+            add_missing(position, range.first);
+            position = max(position, range.second);
+        }
+        add_missing(position, journal.size);
+
+        atomic<size_t> next{0};
+        atomic<bool> failed{false};
+        atomic<bool> changed{false};
+        mutex journal_lock;
+        auto worker = [&]{
+            while(!failed){
+                size_t i = next++;
+                if(i >= missing.size())
+                    break;
+
+                long long offset = missing[i].first;
+                long long end = missing[i].second;
+                int attempts = 0;
+                while(offset < end && !failed){
+                    long long received = 0;
+                    int status_code = 0;
+                    bool ok = download_range(remote_path, fd, offset, end - offset, journal.etag, &received, &status_code, nullptr);
+                    if(received > 0){
+                        lock_guard<mutex> l(journal_lock);
+                        fprintf(journal_file, "range %lld %lld\n", offset, offset + received);
+                        fflush(journal_file);
+                        offset += received;
+                        attempts = 0;
+                    }
+
+                    if(status_code == 412){
+                        changed = true;
+                        failed = true;
+                    }else if(!ok && status_code >= 400 && status_code < 500){
+                        failed = true;
+                    }else if(received == 0 && ++attempts > options.max_retries){
+                        failed = true;
+                    }
+                }
+            }
+        };
+
+        vector<thread> workers;
+        int concurrency = max(1, min(options.concurrency, (int)missing.size()));
+        for(int i = 0; i < concurrency && !missing.empty(); ++i)
+            workers.emplace_back(worker);
+
+        for(auto& t : workers)
+            t.join();
+
+        fclose(journal_file);
+        fclose(data_file);
+        if(changed){
+            INFOW("%s changed during download, start over", remote_path.c_str());
+            remove(journal_path.c_str());
+            remove(partial_path.c_str());
+            continue;
+        }
+
+        if(failed){
+            INFOE("Download %s interrupted, call again to resume", remote_path.c_str());
+            return false;
+        }
+
+        if(rename(partial_path.c_str(), file.c_str()) != 0){
+            INFOE("Rename %s to %s failed", partial_path.c_str(), file.c_str());
+            return false;
+        }
+
+        remove(journal_path.c_str());
+        return true;
+    }
+
+    INFOE("%s keeps changing, download failed", remote_path.c_str());
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MinioCancellation::cancel(){
+    shared_ptr<AsyncEngine> engine;
+    uint64_t id = 0;
+    {
+        lock_guard<mutex> l(lock_);
+        if(cancelled_) return;
+        cancelled_ = true;
+        engine = engine_.lock();
+        id = id_;
+    }
+
+    if(engine && id != 0)
+        engine->cancel(id);
+}
+
+bool MinioCancellation::cancelled() const{
+    lock_guard<mutex> l(lock_);
+    return cancelled_;
+}
+
+void MinioCancellation::attach(const shared_ptr<AsyncEngine>& engine, uint64_t id){
+    bool cancel_now = false;
+    {
+        lock_guard<mutex> l(lock_);
+
+        // 翻页时下一页可能在上一页的submit返回之前就提交了，id小的是已经结束的请求
+        if(engine_.lock() == engine && id < id_)
+            return;
+
+        engine_ = engine;
+        id_ = id;
+        cancel_now = cancelled_;
+    }
+
+    if(cancel_now)
+        engine->cancel(id);
+}
+
+// 一次异步操作的全部状态，由引擎回调持有到操作结束
+struct MinioAsyncCall{
+    MinioAsyncResult result;
+    shared_ptr<HttpClient> http;
+    unique_ptr<HttpBodyWriter> writer;
+    string body;
+    string bucket;
+    string prefix;
+    vector<string> headers;
+    long long deadline_us = 0;
+    shared_ptr<MinioCancellation> cancellation;
+    MinioAsyncCallback callback;
+};
+
+static shared_ptr<MinioAsyncCall> new_async_call(const MinioAsyncCallback& callback, const MinioAsyncOptions& options){
+    shared_ptr<MinioAsyncCall> call(new MinioAsyncCall());
+    call->callback = callback;
+    call->cancellation = options.cancellation;
+    if(!options.if_match.empty())
+        call->headers.emplace_back("If-Match: \"" + options.if_match + "\"");
+    if(options.timeout_ms > 0)
+        call->deadline_us = iLogger::timestamp_now_us() + options.timeout_ms * 1000LL;
+    return call;
+}
+
+void MinioClient::set_async_engine(const shared_ptr<AsyncEngine>& engine){
+    this->engine = engine;
+}
+
+shared_ptr<AsyncEngine> MinioClient::async_engine() const{
+    return engine ? engine : default_async_engine();
+}
+
+void MinioClient::perform_async(
+    MinioOperation op, const char* method, const string& path, const char* content_type,
+    QueryType type, const shared_ptr<MinioAsyncCall>& call, const function<void(bool)>& done
+){
+    auto& result = call->result;
+    if(call->cancellation && call->cancellation->cancelled()){
+        result.cancelled = true;
+        result.error = "Operation cancelled";
+        done(false);
+        return;
+    }
+
+    auto begin_us = iLogger::timestamp_now_us();
+    int timeout_ms = 0;
+    if(call->deadline_us > 0){
+        timeout_ms = (int)((call->deadline_us - begin_us) / 1000);
+        if(timeout_ms <= 0){
+            result.error = "Operation timed out";
+            done(false);
+            return;
+        }
+    }
+
+    auto engine = async_engine();
+    if(engine == nullptr){
+        result.error = "No async engine";
+        done(false);
+        return;
+    }
+
+    int endpoint = -1;
+    auto router = this->router;
+    if(router)
+        endpoint = router->acquire();
+
+    call->http = newHttp((router ? router->server(endpoint) : server) + path);
+    call->http->set_share(share)->set_http_version(http_version);
+    sign_http(call->http.get(), access_key, secret_key, correction_time, method, path, content_type);
+    for(auto& header : call->headers)
+        call->http->add_header(header);
+
+    if(call->writer)
+        call->http->set_body_writer(call->writer.get());
+
+    auto metrics = this->metrics;
+    auto recorder = this->recorder;
+    metrics->add_inflight(op, 1);
+
+    auto id = engine->submit(call->http, type, HttpBodyData(call->body), timeout_ms, [=](bool success){
+        auto http = call->http.get();
+        metrics->add_inflight(op, -1);
+        if(router)
+            router->release(endpoint, http->state_code() > 0 && http->state_code() < 500);
+        record_request(metrics.get(), recorder.get(), op, path, begin_us, 0, success, http);
+
+        call->result.status_code = http->state_code();
+        if(!success){
+            call->result.cancelled = call->cancellation && call->cancellation->cancelled();
+            call->result.error = http->error_message();
+            if(!http->response_body().empty())
+                call->result.error += "\n" + http->response_body();
+        }
+        done(success);
+    });
+
+    if(id != 0 && call->cancellation)
+        call->cancellation->attach(engine, id);
+}
+
+void MinioClient::get_file_async(const string& remote_path, const MinioAsyncCallback& callback, const MinioAsyncOptions& options){
+
+    auto call = new_async_call(callback, options);
+    call->writer.reset(new StringBodyWriter(call->result.data));
+    perform_async(
+        MinioOperation_GetFile, "GET", remote_path, "application/octet-stream", QueryType_Get, call,
+        [call](bool success){
+            call->result.success = success;
+            if(!success)
+                call->result.data.clear();
+            call->callback(call->result);
+        }
+    );
+}
+
+void MinioClient::get_range_async(const string& remote_path, long long offset, long long size, const MinioAsyncCallback& callback, const MinioAsyncOptions& options){
+
+    auto call = new_async_call(callback, options);
+    if(size <= 0){
+        call->result.success = size == 0;
+        callback(call->result);
+        return;
+    }
+
+    call->headers.emplace_back(range_header(offset, size));
+    call->writer.reset(new StringBodyWriter(call->result.data));
+    perform_async(
+        MinioOperation_GetRange, "GET", remote_path, "application/octet-stream", QueryType_Get, call,
+        [call, remote_path, offset, size](bool success){
+            call->result.success = success;
+            if(success)
+                finish_range(call->http.get(), remote_path, offset, size, call->result.data, &call->result.object);
+            else
+                call->result.data.clear();
+            call->callback(call->result);
+        }
+    );
+}
+
+void MinioClient::upload_filedata_async(const string& remote_path, string file_data, const MinioAsyncCallback& callback, const MinioAsyncOptions& options){
+
+    auto call = new_async_call(callback, options);
+    call->body = move(file_data);
+    perform_async(
+        MinioOperation_UploadFileData, "PUT", remote_path, "application/octet-stream", QueryType_PutBody, call,
+        [call](bool success){
+            call->result.success = success;
+            call->callback(call->result);
+        }
+    );
+}
+
+void MinioClient::list_objects_async(const string& bucket, const string& prefix, const MinioAsyncCallback& callback, const MinioAsyncOptions& options){
+
+    auto call = new_async_call(callback, options);
+    call->bucket = bucket;
+    call->prefix = prefix;
+    list_objects_page(call, "");
+}
+
+void MinioClient::list_objects_page(const shared_ptr<MinioAsyncCall>& call, const string& token){
+
+    // 下一页在引擎线程上提交，持有客户端的拷贝（共享统计、录制器和引擎），不依赖调用方的对象还活着
+    MinioClient client = *this;
+    perform_async(
+        MinioOperation_ListObjects, "GET", list_objects_path(call->bucket, call->prefix, token), "text/plane", QueryType_Get, call,
+        [client, call](bool success) mutable{
+            if(success){
+                bool truncated = false;
+                string next_token;
+                minio_extract_objects(call->http->response_body(), call->result.objects, &truncated, &next_token);
+                if(truncated && !next_token.empty()){
+                    client.list_objects_page(call, next_token);
+                    return;
+                }
+            }else{
+                call->result.objects.clear();
+            }
+
+            call->result.success = success;
+            call->callback(call->result);
+        }
+    );
+}
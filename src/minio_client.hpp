@@ -25,6 +25,131 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include "metrics.hpp"
+#include "object_buffer.hpp"
+#include "minio_utils.hpp"
+
+class HttpClient;
+class ConcurrencyLimiter;
+class TokenBucket;
+class MetricsRegistry;
+class WorkloadRecorder;
+class BufferPool;
+class AsyncEngine;
+class HttpShare;
+class EndpointRouter;
+class BlockCache;
+struct EndpointRouterOptions;
+struct MinioAsyncCall;
+enum QueryType : int;
+enum HttpVersion : int;
+
+// 操作类别，用于分类限速
+enum MinioOperationClass : int{
+    MinioOperationClass_Upload,       // upload_file、upload_filedata
+    MinioOperationClass_Download,     // get_file
+    MinioOperationClass_List,         // get_bucket_list、make_bucket、list_objects等元数据操作
+    MinioOperationClass_Count
+};
+
+// 具体的操作，用于分操作统计
+enum MinioOperation : int{
+    MinioOperation_UploadFile,
+    MinioOperation_UploadFileData,
+    MinioOperation_GetFile,
+    MinioOperation_GetBucketList,
+    MinioOperation_MakeBucket,
+    MinioOperation_ListObjects,
+    MinioOperation_GetRange,
+    MinioOperation_RemoveObject,
+    MinioOperation_UploadPart,
+    MinioOperation_Multipart,           // 分片上传的创建、列举分片、完成、取消
+    MinioOperation_Count
+};
+
+const char* minio_operation_name(MinioOperation op);
+MinioOperationClass minio_operation_class(MinioOperation op);
+
+/**
+ * @brief 异步操作的取消句柄，可以在任意线程调用cancel
+ *     取消后回调仍然会被调用，MinioAsyncResult::cancelled为true
+ */
+class MinioCancellation{
+public:
+    void cancel();
+    bool cancelled() const;
+
+    // 由异步接口调用，把正在进行的请求关联到这个句柄上
+    void attach(const std::shared_ptr<AsyncEngine>& engine, uint64_t id);
+
+private:
+    mutable std::mutex lock_;
+    bool cancelled_ = false;
+    std::weak_ptr<AsyncEngine> engine_;
+    uint64_t id_ = 0;
+};
+
+struct MinioAsyncOptions{
+    int timeout_ms = 0;                                 // 整个操作的超时，包括排队时间，<=0不限
+    std::shared_ptr<MinioCancellation> cancellation;
+    std::string if_match;                               // 不带引号的ETag，非空时带If-Match，对象变了返回412，用于分段读取时保证读到同一个版本
+};
+
+struct MinioAsyncResult{
+    bool success = false;
+    bool cancelled = false;
+    int status_code = 0;
+    std::string error;                          // 失败时的curl错误信息或者服务端返回的错误
+    std::string data;                           // get_file_async下载的数据
+    std::vector<MinioObjectInfo> objects;       // list_objects_async的结果
+    MinioObjectInfo object;                     // get_range_async时对象的总大小和ETag
+};
+
+enum MinioSyncCompare : int{
+    MinioSyncCompare_SizeAndTime,     // 大小相同并且本地修改时间不晚于对象的上传时间则认为没有变化，不读文件内容
+    MinioSyncCompare_Checksum         // 大小相同时再比较文件MD5和ETag，分片上传的ETag不是MD5，这种对象回落到大小和时间
+};
+
+struct MinioSyncOptions{
+    MinioSyncCompare compare = MinioSyncCompare_SizeAndTime;
+    int concurrency = 16;                 // 同时比较、上传、删除的线程数
+    bool delete_extraneous = false;       // 删除本地已经不存在的对象，只删除文件名匹配filter的
+    bool dry_run = false;                 // 只统计需要上传、删除的文件，不实际执行
+    std::string filter = "*";             // 文件名的通配符，例如*.jpg
+};
+
+struct MinioSyncResult{
+    bool success = false;                 // 列举成功并且没有任何上传、删除失败
+    int local_files = 0;
+    int remote_objects = 0;
+    int uploaded = 0;
+    int unchanged = 0;
+    int deleted = 0;
+    int skipped = 0;                      // 遍历之后消失、无法stat的本地文件，不比较也不上传
+    long long uploaded_bytes = 0;
+    std::vector<std::string> failed;      // 上传或者删除失败的对象路径
+};
+
+struct MinioResumableOptions{
+    size_t part_size = 64 * 1024 * 1024;    // 分片大小，至少5MB，文件超过10000片时自动放大
+    int concurrency = 4;                    // 同时上传的分片数，内存占用约concurrency * part_size
+    int max_retries = 3;                    // 单个分片失败后的重试次数
+    std::string journal;                    // 记录文件，默认为file + ".minio-upload"
+};
+
+struct MinioDownloadOptions{
+    size_t chunk_size = 16 * 1024 * 1024;   // 每个Range请求的字节数，进程崩溃时最多重新下载这么多
+    int concurrency = 4;                    // 同时下载的块数
+    int max_retries = 3;                    // 连续失败、没有任何进展的重试次数，断开后从断开的位置继续
+    std::string partial;                    // 下载中的数据文件，默认为file + ".partial"，记录文件为partial + ".minio"
+};
+
+// 在AsyncEngine的线程上回调，不要在里面阻塞
+typedef std::function<void(MinioAsyncResult& result)> MinioAsyncCallback;
 
 class MinioClient{
 public:
@@ -89,6 +214,15 @@ public:
     bool make_bucket(const std::string& name);
 
 
+    /**
+     * @brief 列出bucket下指定前缀的所有对象（ListObjects V2），自动翻页
+     * 
+     * @param bucket          指定bucket的名字，例如：test-bucket
+     * @param prefix          key的前缀，例如：wish/，为空列出全部
+     */
+    std::vector<MinioObjectInfo> list_objects(const std::string& bucket, const std::string& prefix = "", bool* pointer_success = nullptr);
+
+
     /**
      * @brief 下载读取文件数据
      * 
@@ -97,11 +231,264 @@ public:
      */
     std::string get_file(const std::string& remote_path, bool* pointer_success=nullptr);
 
+
+    /**
+     * @brief 下载到调用方提供的内存（例如tensor、锁页内存），数据直接从curl写入dst，没有中间拷贝
+     * 
+     * @param remote_path     指定远程路径，bucket也包含在内，例如：/test-bucket/wish/wish235.txt
+     * @param dst             目标内存
+     * @param capacity        dst的字节数，对象比它大时返回false
+     * @param pointer_size    返回实际写入的字节数
+     */
+    bool get_file_into(const std::string& remote_path, void* dst, size_t capacity, size_t* pointer_size=nullptr);
+
+
+    /**
+     * @brief 下载到allocator分配的内存，已知Content-Length时一次分配到位
+     * 
+     * @param allocator       指定分配器，nullptr时使用set_buffer_pool设置的内存池，没有设置则用malloc
+     * @return ObjectBuffer   只能移动，析构时把内存还给allocator
+     */
+    ObjectBuffer get_file_buffer(const std::string& remote_path, bool* pointer_success=nullptr, const std::shared_ptr<ObjectAllocator>& allocator=nullptr);
+
+
+    /**
+     * @brief 读取对象的一段数据（Range: bytes=offset-(offset+size-1)），超出对象末尾的部分不返回
+     * 
+     * @param offset          起始位置，<0表示读取对象最后size个字节
+     * @param size            字节数
+     * @param pointer_info    不为空时返回对象的总大小（来自Content-Range）和ETag，不需要额外的HEAD请求
+     * @param if_match        不带引号的ETag，非空时对象已经变化则返回失败（412）
+     * @param pointer_status_code 不为空时返回HTTP状态码，0表示没有响应。空对象上的Range返回416
+     */
+    std::string get_range(const std::string& remote_path, long long offset, long long size, bool* pointer_success=nullptr, MinioObjectInfo* pointer_info=nullptr, const std::string& if_match="", int* pointer_status_code=nullptr);
+
+
+    /**
+     * @brief 可以断点续传的分片上传，适合长时间上传的大文件
+     *     UploadId、分片大小和已完成分片的ETag追加写入本地的记录文件，进程崩溃或者网络中断后用同样的参数再调用一次即可继续
+     *     继续时先向服务端列举已上传的分片，ETag与记录一致（或者与本地分片的MD5一致）的跳过，只上传缺少的分片
+     *     文件大小、修改时间或者分片大小变了时放弃旧的上传重新开始。全部完成后删除记录文件
+     */
+    bool upload_file_resumable(const std::string& remote_path, const std::string& file, const MinioResumableOptions& options = MinioResumableOptions());
+
+
+    /**
+     * @brief 可以断点续传的下载，适合长时间下载的大文件
+     *     数据按位置写入partial文件，对象的大小、ETag和已完成的区间（可以不连续）追加写入旁边的记录文件
+     *     连接断开时从断开的位置用Range继续，进程崩溃后用同样的参数再调用一次即可继续
+     *     所有后续请求都带If-Match，对象被覆盖（412）时丢弃已下载的数据重新开始一次，不会拼出两个版本混合的文件
+     *     全部完成后把partial重命名为file并删除记录文件
+     */
+    bool download_to_file(const std::string& remote_path, const std::string& file, const MinioDownloadOptions& options = MinioDownloadOptions());
+
+
+    /**
+     * @brief 删除对象，对象不存在也算成功
+     */
+    bool remove_object(const std::string& remote_path);
+
+
+    /**
+     * @brief 把本地目录增量同步到remote_prefix，例如：minio.sync("data/", "/test-bucket/backup/data")
+     *     本地目录遍历和远端分页列举同时进行，然后多线程比较并只上传有变化的文件，
+     *     大部分文件没有变化时只有列举的开销，不需要逐个HEAD或者重新上传
+     *     对象的key为remote_prefix下的相对路径
+     */
+    MinioSyncResult sync(const std::string& local_dir, const std::string& remote_prefix, const MinioSyncOptions& options = MinioSyncOptions());
+
+
+    /**
+     * @brief 随机读取对象的一段数据，经过set_block_cache设置的块缓存（默认没有缓存，每次都直接请求）
+     *     按块对齐整块读取，相邻的缺失块合并成一个Range请求，多个线程同时缺失同一个块时只请求一次
+     *     适合Parquet、ZIP这类先读footer再按索引小块读取的格式，工作集内每个块大约一个RTT
+     */
+    std::string read_at(const std::string& remote_path, long long offset, long long size, bool* pointer_success=nullptr);
+
+    // 多个区间一起读，缺失块统一排序合并后再请求，结果按ranges的顺序返回
+    std::vector<std::string> read_ranges(const std::string& remote_path, const std::vector<std::pair<long long, long long>>& ranges, bool* pointer_success=nullptr);
+
+
+    /**
+     * @brief 设置read_at使用的块缓存，多个客户端可以共享一个；nullptr时read_at直接请求，不缓存
+     */
+    void set_block_cache(const std::shared_ptr<BlockCache>& cache);
+    std::shared_ptr<BlockCache> block_cache() const;
+
+
+    /**
+     * @brief 设置get_file_buffer默认使用的内存池，下载的内存在ObjectBuffer释放后回到池里复用
+     *     例如：minio.set_buffer_pool(newBufferPool());  传入nullptr恢复为malloc
+     */
+    void set_buffer_pool(const std::shared_ptr<BufferPool>& pool);
+    std::shared_ptr<BufferPool> buffer_pool() const;
+
+
+    /**
+     * @brief 设置请求使用的DNS缓存和TLS会话，默认是进程共享的default_http_share()
+     *     所有客户端、所有线程的请求共享DNS和TLS会话，连接由每个线程各自复用；传入nullptr则不共享
+     */
+    void set_http_share(const std::shared_ptr<HttpShare>& share);
+    std::shared_ptr<HttpShare> http_share() const;
+
+
+    /**
+     * @brief 设置请求使用的HTTP版本，默认由curl决定（https上协商h2）
+     *     大量小对象时配合异步接口使用HttpVersion_2，同一个host的请求在少量连接上多路复用，
+     *     每个连接的并发流数、每个host的连接数见AsyncEngineOptions
+     *     同步接口每个线程各自发起请求，h2只能减少握手，不会在线程之间多路复用
+     */
+    void set_http_version(HttpVersion version);
+
+
+    /**
+     * @brief 把请求分散到多个节点，替代构造时的server，传入空列表恢复为单节点
+     *     按在途请求数（最少在途或者随机两选一）选择节点，连续失败的节点临时摘除，后台定期探活恢复
+     *     同步接口的幂等请求（GET、HEAD、DELETE、PUT对象）在没有收到任何响应时（连接失败、超时）自动换一个节点重试，POST等可能已经执行过的请求不重试；异步接口只分配节点，不重试
+     *     例如：minio.set_endpoints({"http://10.0.0.1:9000", "http://10.0.0.2:9000"});
+     */
+    void set_endpoints(const std::vector<std::string>& servers, const EndpointRouterOptions& options);
+    void set_endpoints(const std::vector<std::string>& servers);
+    std::shared_ptr<EndpointRouter> endpoint_router() const;
+
+
+    /**
+     * @brief 开启客户端级别的自适应并发限制（AIMD + 延迟梯度）
+     *     所有请求发送前都要拿到许可，limit根据观测到的延迟和过载错误（503 SlowDown等）自动调整，
+     *     批量操作直接开足线程即可，不需要自己去试最佳并发数。拷贝出来的MinioClient共享同一个限制器
+     * 
+     * @param initial_limit  初始并发数，<=0表示关闭限制（默认关闭）
+     * @param min_limit      并发数下限
+     * @param max_limit      并发数上限
+     */
+    void set_concurrency_limit(int initial_limit, int min_limit = 1, int max_limit = 256);
+
+
+    /**
+     * @brief 获取当前的并发限制器，可以查看state()或者调整参数，未开启时返回nullptr
+     */
+    std::shared_ptr<ConcurrencyLimiter> concurrency_limiter() const;
+
+
+
+    /**
+     * @brief 设置整个客户端的限速（令牌桶），对所有类别的操作共同生效
+     *     可以在运行时随时调整，拷贝出来的MinioClient共享同一组令牌桶
+     * 
+     * @param bytes_per_second     上传+下载的总字节速率，<=0表示不限
+     * @param requests_per_second  每秒请求数，<=0表示不限
+     */
+    void set_rate_limit(double bytes_per_second, double requests_per_second = 0);
+
+
+    /**
+     * @brief 设置某一类操作的限速，与客户端总限速同时生效
+     *     例如限制后台上传的带宽，避免挤占前台get_file：
+     *     minio.set_rate_limit(MinioOperationClass_Upload, 50 * 1024 * 1024);
+     */
+    void set_rate_limit(MinioOperationClass op, double bytes_per_second, double requests_per_second = 0);
+
+
+
+    /**
+     * @brief 获取按操作分类的统计快照：请求数、错误数、连接复用数、上下行字节数，
+     *     以及排队、DNS、TCP、TLS、首字节、传输、总耗时各阶段的延迟直方图
+     *     可以据此判断慢在DNS、TLS、服务端处理还是带宽。统计始终开启，记录过程无锁
+     */
+    MetricsSnapshot metrics_snapshot() const;
+
+
+    /**
+     * @brief 清空统计
+     */
+    void reset_metrics();
+
+
+    /**
+     * @brief 把本客户端的统计注册到指标注册表，由注册表输出OpenMetrics文本或者通过内置HTTP服务给Prometheus抓取
+     *     如果开启了并发限制，同时注册limit和在途数两个gauge；设置了内存池时注册池的命中、缓存和借出量；
+     *     同时注册连接共享的请求数、新建连接数和TLS握手数，因此要在set_concurrency_limit、set_buffer_pool、set_http_share之后调用
+     * 
+     * @param registry      指标注册表，例如default_metrics_registry()
+     * @param client_name   输出时的client标签，用于区分同一进程内的多个客户端
+     */
+    void register_metrics(const std::shared_ptr<MetricsRegistry>& registry, const std::string& client_name = "default");
+
+    /**
+     * @brief 录制每个操作（类型、路径哈希、字节数、开始时间、耗时）到二进制文件，用tools/replay回放
+     *     传入nullptr停止录制。需要在发起请求前设置，拷贝出来的MinioClient共享同一个录制器
+     *     例如：minio.set_workload_recorder(newWorkloadRecorder("workload.bin"));
+     */
+    void set_workload_recorder(const std::shared_ptr<WorkloadRecorder>& recorder);
+
+
+    /**
+     * @brief 非阻塞接口，请求交给AsyncEngine（curl_multi）驱动，调用立即返回，完成后在引擎线程上回调
+     *     少量线程就可以同时挂起成千上万个请求，C++20协程的co_await封装见minio_coroutine.hpp
+     *     统计和录制与同步接口一致；并发限制、令牌桶限速只作用于同步接口，异步请求的并发由引擎的max_transfers控制
+     */
+    void get_file_async(const std::string& remote_path, const MinioAsyncCallback& callback, const MinioAsyncOptions& options = MinioAsyncOptions());
+
+    // 与get_range相同，数据在result.data，对象信息在result.object
+    void get_range_async(const std::string& remote_path, long long offset, long long size, const MinioAsyncCallback& callback, const MinioAsyncOptions& options = MinioAsyncOptions());
+
+    // 数据会被移动到请求内部保存到上传结束
+    void upload_filedata_async(const std::string& remote_path, std::string file_data, const MinioAsyncCallback& callback, const MinioAsyncOptions& options = MinioAsyncOptions());
+
+    // 自动翻页，所有页都取完后回调一次。timeout_ms是所有页加起来的超时
+    void list_objects_async(const std::string& bucket, const std::string& prefix, const MinioAsyncCallback& callback, const MinioAsyncOptions& options = MinioAsyncOptions());
+
+
+    /**
+     * @brief 设置异步接口使用的引擎，不设置时使用进程共享的default_async_engine()
+     */
+    void set_async_engine(const std::shared_ptr<AsyncEngine>& engine);
+    std::shared_ptr<AsyncEngine> async_engine() const;
+
+private:
+    // 返回的是当前线程复用的请求对象，只在本线程下一次请求之前有效
+    HttpClient* new_signed_http(const std::string& server, const char* method, const std::string& path, const char* content_type);
+    bool perform(
+        MinioOperation op, const char* method, const std::string& path, const char* content_type,
+        const std::function<bool(HttpClient*)>& send, HttpClient*& http
+    );
+    void perform_async(
+        MinioOperation op, const char* method, const std::string& path, const char* content_type,
+        QueryType type, const std::shared_ptr<MinioAsyncCall>& call, const std::function<void(bool)>& done
+    );
+    void list_objects_page(const std::shared_ptr<MinioAsyncCall>& call, const std::string& token);
+
+    // 分片上传的各个步骤，status_code返回HTTP状态码，0表示没有响应
+    std::string create_multipart(const std::string& remote_path, int* status_code);
+    bool list_parts(const std::string& remote_path, const std::string& upload_id, std::vector<MinioPartInfo>& parts, int* status_code);
+    std::string upload_part(const std::string& remote_path, const std::string& upload_id, int number, const void* data, size_t size, int* status_code);
+    bool complete_multipart(const std::string& remote_path, const std::string& upload_id, const std::vector<MinioPartInfo>& parts);
+    bool abort_multipart(const std::string& remote_path, const std::string& upload_id);
+
+    // 把[offset, offset + size)写入fd的相同位置，received返回实际写入的字节数，请求失败时已写入的部分仍然有效
+    bool download_range(
+        const std::string& remote_path, int fd, long long offset, long long size, const std::string& if_match,
+        long long* received, int* status_code, MinioObjectInfo* info
+    );
+
 private:
     std::string server;
     std::string access_key;
     std::string secret_key;
     int correction_time = 0;
+    std::shared_ptr<ConcurrencyLimiter> limiter;
+
+    // 下标MinioOperationClass_Count为客户端总限速
+    std::vector<std::shared_ptr<TokenBucket>> byte_buckets;
+    std::vector<std::shared_ptr<TokenBucket>> request_buckets;
+    std::shared_ptr<ClientMetrics> metrics;
+    std::shared_ptr<WorkloadRecorder> recorder;
+    std::shared_ptr<BufferPool> pool;
+    std::shared_ptr<AsyncEngine> engine;
+    std::shared_ptr<HttpShare> share;
+    HttpVersion http_version;
+    std::shared_ptr<EndpointRouter> router;
+    std::shared_ptr<BlockCache> cache;
 };
 
 #endif // MINIO_CLIENT_HPP
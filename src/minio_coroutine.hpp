@@ -0,0 +1,75 @@
+#ifndef MINIO_COROUTINE_HPP
+#define MINIO_COROUTINE_HPP
+
+/**
+ * @brief MinioClient异步接口的C++20协程封装，需要-std=c++20，其他标准下这个头文件为空
+ *     在协程里直接写：
+ *         auto r = co_await co_get_file(minio, "/test-bucket/wish/wish235.txt");
+ *         if(r.success) ... r.data
+ *     挂起期间不占线程，请求完成后协程在AsyncEngine的线程上恢复执行，需要回到自己的调度器时在恢复后自行切换
+ *     超时和取消通过MinioAsyncOptions传入，被取消时结果的cancelled为true
+ *     minio对象在co_await返回之前必须保持有效
+ */
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <atomic>
+#include <utility>
+#include "minio_client.hpp"
+
+class MinioAwaitable{
+public:
+    typedef std::function<void(const MinioAsyncCallback& callback)> Starter;
+
+    explicit MinioAwaitable(Starter starter):starter_(std::move(starter)){}
+
+    bool await_ready() const noexcept{
+        return false;
+    }
+
+    // 回调可能在submit返回之前就在引擎线程（或者失败时在当前线程）上执行，
+    // 谁后到谁负责继续，await_suspend返回false表示结果已经就绪，不需要挂起
+    bool await_suspend(std::coroutine_handle<> handle){
+        handle_ = handle;
+        Starter starter = std::move(starter_);
+        starter([this](MinioAsyncResult& result){
+            result_ = std::move(result);
+            if(ready_.exchange(true, std::memory_order_acq_rel))
+                handle_.resume();
+        });
+        return !ready_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    MinioAsyncResult await_resume(){
+        return std::move(result_);
+    }
+
+private:
+    Starter starter_;
+    std::coroutine_handle<> handle_;
+    std::atomic<bool> ready_{false};
+    MinioAsyncResult result_;
+};
+
+inline MinioAwaitable co_get_file(MinioClient& minio, const std::string& remote_path, const MinioAsyncOptions& options = MinioAsyncOptions()){
+    return MinioAwaitable([&minio, remote_path, options](const MinioAsyncCallback& callback){
+        minio.get_file_async(remote_path, callback, options);
+    });
+}
+
+inline MinioAwaitable co_upload_filedata(MinioClient& minio, const std::string& remote_path, std::string file_data, const MinioAsyncOptions& options = MinioAsyncOptions()){
+    return MinioAwaitable([&minio, remote_path, file_data = std::move(file_data), options](const MinioAsyncCallback& callback) mutable{
+        minio.upload_filedata_async(remote_path, std::move(file_data), callback, options);
+    });
+}
+
+inline MinioAwaitable co_list_objects(MinioClient& minio, const std::string& bucket, const std::string& prefix = "", const MinioAsyncOptions& options = MinioAsyncOptions()){
+    return MinioAwaitable([&minio, bucket, prefix, options](const MinioAsyncCallback& callback){
+        minio.list_objects_async(bucket, prefix, callback, options);
+    });
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // MINIO_COROUTINE_HPP
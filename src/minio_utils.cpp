@@ -0,0 +1,395 @@
+#include "minio_utils.hpp"
+#include "ilogger.hpp"
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+using namespace std;
+
+// out至少要有(size + 2) / 3 * 4个字节，返回写入的长度
+static size_t base64_encode_to(const void* data, size_t size, char* out){
+
+    char* p = out;
+    const unsigned char * current = static_cast<const unsigned char*>(data);
+    static const char *base64_table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";  
+    while(size > 2) {
+        *p++ = base64_table[current[0] >> 2];
+        *p++ = base64_table[((current[0] & 0x03) << 4) + (current[1] >> 4)];
+        *p++ = base64_table[((current[1] & 0x0f) << 2) + (current[2] >> 6)];
+        *p++ = base64_table[current[2] & 0x3f];
+
+        current += 3;
+        size -= 3;
+    }
+
+    if(size > 0){
+        *p++ = base64_table[current[0] >> 2];
+        if(size%3 == 1) {
+            *p++ = base64_table[(current[0] & 0x03) << 4];
+            *p++ = '=';
+            *p++ = '=';
+        } else if(size%3 == 2) {
+            *p++ = base64_table[((current[0] & 0x03) << 4) + (current[1] >> 4)];
+            *p++ = base64_table[(current[1] & 0x0f) << 2];
+            *p++ = '=';
+        }
+    }
+    return p - out;
+}
+
+string minio_base64_encode(const void* data, size_t size) {
+
+    string encode_result;
+    encode_result.resize((size + 2) / 3 * 4);
+    encode_result.resize(base64_encode_to(data, size, &encode_result[0]));
+    return encode_result;
+}
+
+int minio_gmtime_now(int correction_time, char* out, size_t size){
+    time_t timet;
+    time(&timet);
+    timet += correction_time;
+
+    tm& t = *(tm*)localtime(&timet);
+    return (int)strftime(out, size, "%a, %d %b %Y %X %z", &t);
+}
+
+// 与date -R 结果一致
+string minio_gmtime_now(int correction_time){
+    char timebuffer[100];
+    minio_gmtime_now(correction_time, timebuffer, sizeof(timebuffer));
+    return timebuffer;
+}
+
+// 每个线程复用一个HMAC_CTX，签名时不再分配
+struct ThreadHmacContext{
+    HMAC_CTX* ctx = HMAC_CTX_new();
+    ~ThreadHmacContext(){HMAC_CTX_free(ctx);}
+};
+
+// openssl sha1 -hmac -binary | base64，out至少29个字节
+static int hmac_sign_base64(const string& key, const void* data, size_t size, char* out, size_t out_size){
+
+    // SHA1 needed 20 characters.
+    unsigned int len = 20;
+    unsigned char result[20];
+
+    static thread_local ThreadHmacContext context;
+    HMAC_CTX* ctx = context.ctx;
+    if(out_size < 29 || ctx == nullptr ||
+        !HMAC_Init_ex(ctx, key.data(), key.size(), EVP_sha1(), NULL) ||
+        !HMAC_Update(ctx, (const unsigned char*)data, size) ||
+        !HMAC_Final(ctx, result, &len))
+        return -1;
+
+    size_t n = base64_encode_to(result, len, out);
+    out[n] = 0;
+    return (int)n;
+}
+
+int minio_hmac_sign(
+    const string& hash_key, const char* method, const char* content_type,
+    const char* time, const char* path, char* out, size_t size
+){
+    char buffer[1000];
+    int result_length = snprintf(
+        buffer, sizeof(buffer), 
+        "%s\n\n%s\n%s\n%s", 
+        method,
+        content_type, 
+        time, 
+        path
+    );
+
+    if(result_length < 0)
+        return -1;
+
+    // 很长的路径放不下时才用堆上的内存
+    if(result_length >= (int)sizeof(buffer)){
+        string large(result_length + 1, 0);
+        snprintf(&large[0], large.size(), "%s\n\n%s\n%s\n%s", method, content_type, time, path);
+        return hmac_sign_base64(hash_key, large.data(), result_length, out, size);
+    }
+    return hmac_sign_base64(hash_key, buffer, result_length, out, size);
+}
+
+// echo -en ${_signature} | openssl sha1 -hmac ${s3_secret} -binary | base64
+string minio_hmac_encode(
+    const string& hash_key,
+    const string& method,
+    const string& content_type, 
+    const string& time,
+    const string& path
+){
+    char signature[64];
+    if(minio_hmac_sign(hash_key, method.c_str(), content_type.c_str(), time.c_str(), path.c_str(), signature, sizeof(signature)) < 0)
+        return "";
+    return signature;
+}
+
+static string extract_name(const string& response, int begin, int end){
+    
+    int p = response.find("<Name>", begin);
+    if(p == -1 || p >= end) return "";
+    p += 6;
+
+    int e = response.find("</Name>", p);
+    if(e == -1 || p >= e) return "";
+    return string(response.begin() + p, response.begin() + e);
+}
+
+vector<string> minio_extract_buckets(const string& response){
+
+    string bucket_b_token = "<Bucket>";
+    string bucket_e_token = "</Bucket>";
+    vector<string> names;
+    int p = response.find(bucket_b_token);
+    while(p != -1){
+        int e = response.find(bucket_e_token, p + bucket_b_token.size());
+        if(e == -1)
+            break;
+
+        names.emplace_back(move(extract_name(response, p, e)));
+        p = response.find(bucket_b_token, e + bucket_e_token.size());
+    }
+    return names;
+}
+
+static string xml_unescape(const string& value){
+
+    if(value.find('&') == string::npos)
+        return value;
+
+    static const struct{const char* entity; char c;} entities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}
+    };
+
+    string output;
+    output.reserve(value.size());
+    for(size_t i = 0; i < value.size(); ++i){
+        bool replaced = false;
+        if(value[i] == '&'){
+            for(auto& e : entities){
+                size_t length = strlen(e.entity);
+                if(value.compare(i, length, e.entity) == 0){
+                    output.push_back(e.c);
+                    i += length - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if(!replaced) output.push_back(value[i]);
+    }
+    return output;
+}
+
+// 在[begin, end)内找<tag>value</tag>
+static bool extract_tag(const string& response, size_t begin, size_t end, const string& tag, string& value){
+    size_t p = response.find("<" + tag + ">", begin);
+    if(p == string::npos || p >= end) return false;
+    p += tag.size() + 2;
+
+    size_t e = response.find("</" + tag + ">", p);
+    if(e == string::npos || e > end) return false;
+    value = xml_unescape(response.substr(p, e - p));
+    return true;
+}
+
+void minio_extract_objects(
+    const string& response, vector<MinioObjectInfo>& objects,
+    bool* truncated, string* next_token, vector<string>* common_prefixes
+){
+    size_t p = response.find("<Contents>");
+    while(p != string::npos){
+        size_t e = response.find("</Contents>", p);
+        if(e == string::npos)
+            break;
+
+        MinioObjectInfo info;
+        string size;
+        extract_tag(response, p, e, "Key", info.key);
+        extract_tag(response, p, e, "LastModified", info.last_modified);
+        extract_tag(response, p, e, "Size", size);
+        if(extract_tag(response, p, e, "ETag", info.etag) && info.etag.size() >= 2 && info.etag.front() == '"' && info.etag.back() == '"')
+            info.etag = info.etag.substr(1, info.etag.size() - 2);
+
+        info.size = atoll(size.c_str());
+        objects.emplace_back(move(info));
+        p = response.find("<Contents>", e);
+    }
+
+    if(common_prefixes){
+        p = response.find("<CommonPrefixes>");
+        while(p != string::npos){
+            size_t e = response.find("</CommonPrefixes>", p);
+            if(e == string::npos)
+                break;
+
+            string prefix;
+            if(extract_tag(response, p, e, "Prefix", prefix))
+                common_prefixes->emplace_back(move(prefix));
+            p = response.find("<CommonPrefixes>", e);
+        }
+    }
+
+    string value;
+    if(truncated)
+        *truncated = extract_tag(response, 0, response.size(), "IsTruncated", value) && value == "true";
+
+    if(next_token){
+        next_token->clear();
+        if(!extract_tag(response, 0, response.size(), "NextContinuationToken", *next_token))
+            extract_tag(response, 0, response.size(), "NextMarker", *next_token);
+    }
+}
+
+string minio_url_encode(const string& value){
+
+    static const char* hex = "0123456789ABCDEF";
+    string output;
+    output.reserve(value.size() * 3);
+    for(unsigned char c : value){
+        if(isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~'){
+            output.push_back(c);
+        }else{
+            output.push_back('%');
+            output.push_back(hex[c >> 4]);
+            output.push_back(hex[c & 15]);
+        }
+    }
+    return output;
+}
+
+string minio_canonical_resource(const string& path_and_query){
+
+    size_t q = path_and_query.find('?');
+    if(q == string::npos)
+        return path_and_query;
+
+    static const char* sub_resources[] = {
+        "acl", "delete", "lifecycle", "location", "logging", "notification", "partNumber", "policy",
+        "requestPayment", "tagging", "torrent", "uploadId", "uploads", "versionId", "versioning", "versions", "website"
+    };
+
+    vector<string> kept;
+    for(auto& item : iLogger::split_string(path_and_query.substr(q + 1), "&")){
+        string name = item.substr(0, item.find('='));
+        for(auto sub : sub_resources){
+            if(name == sub){
+                kept.push_back(item);
+                break;
+            }
+        }
+    }
+
+    string resource = path_and_query.substr(0, q);
+    if(kept.empty())
+        return resource;
+
+    sort(kept.begin(), kept.end());
+    for(size_t i = 0; i < kept.size(); ++i)
+        resource += (i == 0 ? "?" : "&") + kept[i];
+    return resource;
+}
+
+static string strip_quotes(const string& value){
+    if(value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        return value.substr(1, value.size() - 2);
+    return value;
+}
+
+string minio_extract_upload_id(const string& response){
+    string upload_id;
+    extract_tag(response, 0, response.size(), "UploadId", upload_id);
+    return upload_id;
+}
+
+void minio_extract_parts(const string& response, vector<MinioPartInfo>& parts, bool* truncated, int* next_marker){
+
+    size_t p = response.find("<Part>");
+    while(p != string::npos){
+        size_t e = response.find("</Part>", p);
+        if(e == string::npos)
+            break;
+
+        MinioPartInfo info;
+        string number, size;
+        extract_tag(response, p, e, "PartNumber", number);
+        extract_tag(response, p, e, "ETag", info.etag);
+        extract_tag(response, p, e, "Size", size);
+        info.number = atoi(number.c_str());
+        info.etag = strip_quotes(info.etag);
+        info.size = atoll(size.c_str());
+        parts.emplace_back(move(info));
+        p = response.find("<Part>", e);
+    }
+
+    string value;
+    if(truncated)
+        *truncated = extract_tag(response, 0, response.size(), "IsTruncated", value) && value == "true";
+
+    if(next_marker){
+        *next_marker = 0;
+        if(extract_tag(response, 0, response.size(), "NextPartNumberMarker", value))
+            *next_marker = atoi(value.c_str());
+    }
+}
+
+static string hex_string(const unsigned char* data, size_t size){
+    static const char* hex = "0123456789abcdef";
+    string output;
+    for(size_t i = 0; i < size; ++i){
+        output.push_back(hex[data[i] >> 4]);
+        output.push_back(hex[data[i] & 0xF]);
+    }
+    return output;
+}
+
+string minio_file_md5(const string& file){
+
+    FILE* f = fopen(file.c_str(), "rb");
+    if(f == nullptr)
+        return "";
+
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_md5(), nullptr);
+
+    vector<unsigned char> buffer(1024 * 1024);
+    size_t n = 0;
+    while((n = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+        EVP_DigestUpdate(ctx, buffer.data(), n);
+
+    bool ok = !ferror(f);
+    fclose(f);
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    EVP_DigestFinal_ex(ctx, digest, &digest_size);
+    EVP_MD_CTX_free(ctx);
+    return ok ? hex_string(digest, digest_size) : "";
+}
+
+string minio_md5(const void* data, size_t size){
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    EVP_Digest(data, size, digest, &digest_size, EVP_md5(), nullptr);
+    return hex_string(digest, digest_size);
+}
+
+time_t minio_parse_iso8601(const string& value){
+
+    tm date;
+    memset(&date, 0, sizeof(date));
+    if(sscanf(value.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d", &date.tm_year, &date.tm_mon, &date.tm_mday, &date.tm_hour, &date.tm_min, &date.tm_sec) != 6)
+        return 0;
+
+    date.tm_year -= 1900;
+    date.tm_mon -= 1;
+    return timegm(&date);
+}
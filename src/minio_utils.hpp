@@ -0,0 +1,79 @@
+#ifndef MINIO_UTILS_HPP
+#define MINIO_UTILS_HPP
+
+#include <string>
+#include <vector>
+#include <time.h>
+
+// 签名和响应解析用到的工具函数，MinioClient内部使用，单独放出来便于bench和复用
+
+std::string minio_base64_encode(const void* data, size_t size);
+
+// 与date -R 结果一致
+std::string minio_gmtime_now(int correction_time);
+
+// echo -en ${_signature} | openssl sha1 -hmac ${s3_secret} -binary | base64
+std::string minio_hmac_encode(
+    const std::string& hash_key,
+    const std::string& method,
+    const std::string& content_type,
+    const std::string& time,
+    const std::string& path
+);
+
+// 以下两个写入调用方的缓冲区，返回写入的长度（不含结尾的0），构造请求时不需要分配内存
+// size至少64字节
+int minio_gmtime_now(int correction_time, char* out, size_t size);
+
+// 签名的base64（28个字符），size至少29字节，失败返回-1
+int minio_hmac_sign(
+    const std::string& hash_key, const char* method, const char* content_type,
+    const char* time, const char* path, char* out, size_t size
+);
+
+// 从ListAllMyBucketsResult的XML里提取bucket名字
+std::vector<std::string> minio_extract_buckets(const std::string& response);
+
+struct MinioObjectInfo{
+    std::string key;
+    std::string etag;             // 去掉了引号
+    std::string last_modified;    // ISO8601，例如2021-07-28T09:56:02.000Z
+    long long size = 0;
+};
+
+// 从ListBucketResult（V1/V2）的XML里提取对象，追加到objects
+// truncated返回是否还有下一页，next_token返回NextContinuationToken（V2）或者NextMarker（V1）
+void minio_extract_objects(
+    const std::string& response, std::vector<MinioObjectInfo>& objects,
+    bool* truncated = nullptr, std::string* next_token = nullptr, std::vector<std::string>* common_prefixes = nullptr
+);
+
+struct MinioPartInfo{
+    int number = 0;
+    std::string etag;             // 去掉了引号
+    long long size = 0;
+};
+
+// 从InitiateMultipartUploadResult里提取UploadId，没有时返回空
+std::string minio_extract_upload_id(const std::string& response);
+
+// 从ListPartsResult里提取分片，追加到parts。next_marker返回NextPartNumberMarker，用于翻页
+void minio_extract_parts(const std::string& response, std::vector<MinioPartInfo>& parts, bool* truncated = nullptr, int* next_marker = nullptr);
+
+// 按RFC3986编码查询参数的值
+std::string minio_url_encode(const std::string& value);
+
+// V2签名用的CanonicalizedResource：路径 + 按字母序排列的子资源（uploads、uploadId、partNumber等），其他查询参数不参与签名
+// 例如 /bucket?list-type=2&prefix=a 得到 /bucket，/bucket/key?uploadId=x&partNumber=1 得到 /bucket/key?partNumber=1&uploadId=x
+std::string minio_canonical_resource(const std::string& path_and_query);
+
+// 文件内容的MD5（32个小写十六进制字符），单次上传的对象ETag就是它。打开失败返回空
+std::string minio_file_md5(const std::string& file);
+
+// 内存数据的MD5，分片上传的分片ETag就是它
+std::string minio_md5(const void* data, size_t size);
+
+// 解析ListObjects里的LastModified（ISO8601 UTC，例如2021-07-28T09:56:02.000Z），失败返回0
+time_t minio_parse_iso8601(const std::string& value);
+
+#endif // MINIO_UTILS_HPP
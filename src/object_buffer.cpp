@@ -0,0 +1,105 @@
+#include "object_buffer.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+class MallocAllocator : public ObjectAllocator{
+public:
+    virtual void* allocate(size_t size) override{
+        return malloc(size);
+    }
+
+    virtual void deallocate(void* ptr, size_t) override{
+        free(ptr);
+    }
+};
+
+shared_ptr<ObjectAllocator> default_object_allocator(){
+    static shared_ptr<ObjectAllocator> instance(new MallocAllocator());
+    return instance;
+}
+
+ObjectBuffer::ObjectBuffer(const shared_ptr<ObjectAllocator>& allocator)
+:allocator_(allocator)
+{
+}
+
+ObjectBuffer::ObjectBuffer(ObjectBuffer&& other){
+    *this = std::move(other);
+}
+
+ObjectBuffer& ObjectBuffer::operator=(ObjectBuffer&& other){
+    if(this == &other)
+        return *this;
+
+    release();
+    allocator_ = std::move(other.allocator_);
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+    return *this;
+}
+
+ObjectBuffer::~ObjectBuffer(){
+    release();
+}
+
+bool ObjectBuffer::reserve(size_t capacity){
+
+    if(capacity <= capacity_)
+        return true;
+
+    if(allocator_ == nullptr)
+        allocator_ = default_object_allocator();
+
+    capacity = allocator_->round_up(capacity);
+    uint8_t* data = (uint8_t*)allocator_->allocate(capacity);
+    if(data == nullptr)
+        return false;
+
+    if(size_ > 0)
+        memcpy(data, data_, size_);
+
+    if(data_)
+        allocator_->deallocate(data_, capacity_);
+
+    data_ = data;
+    capacity_ = capacity;
+    return true;
+}
+
+bool ObjectBuffer::append(const void* data, size_t size){
+
+    if(size_ + size > capacity_ && !reserve(max(size_ + size, max((size_t)4096, capacity_ * 2))))
+        return false;
+
+    memcpy(data_ + size_, data, size);
+    size_ += size;
+    return true;
+}
+
+bool ObjectBuffer::resize(size_t size){
+    if(size > capacity_)
+        return false;
+
+    size_ = size;
+    return true;
+}
+
+void ObjectBuffer::release(){
+    if(data_)
+        allocator_->deallocate(data_, capacity_);
+
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+string ObjectBuffer::to_string() const{
+    return string((const char*)data_, size_);
+}
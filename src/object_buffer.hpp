@@ -0,0 +1,68 @@
+#ifndef OBJECT_BUFFER_HPP
+#define OBJECT_BUFFER_HPP
+
+#include <string>
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief 下载对象的内存分配器，可以替换成锁页内存、显存映射、内存池等
+ *     deallocate会收到allocate时的size，方便按尺寸归还
+ */
+class ObjectAllocator{
+public:
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+
+    // allocate(size)实际可用的大小，例如按级别分配的内存池会向上取整，ObjectBuffer按它记容量，减少扩容
+    virtual size_t round_up(size_t size){return size;}
+};
+
+// malloc/free实现，进程内共享一个
+std::shared_ptr<ObjectAllocator> default_object_allocator();
+
+/**
+ * @brief 持有一段由ObjectAllocator分配的字节，只能移动不能拷贝，析构时归还给分配器
+ *     已知Content-Length时一次分配到位，下载的数据只写一次
+ */
+class ObjectBuffer{
+public:
+    ObjectBuffer() = default;
+    explicit ObjectBuffer(const std::shared_ptr<ObjectAllocator>& allocator);
+    ObjectBuffer(ObjectBuffer&& other);
+    ObjectBuffer& operator=(ObjectBuffer&& other);
+    ObjectBuffer(const ObjectBuffer&) = delete;
+    ObjectBuffer& operator=(const ObjectBuffer&) = delete;
+    ~ObjectBuffer();
+
+    uint8_t* data(){return data_;}
+    const uint8_t* data() const{return data_;}
+    size_t size() const{return size_;}
+    size_t capacity() const{return capacity_;}
+    bool empty() const{return size_ == 0;}
+
+    // 容量不小于capacity，保留已有数据。分配失败返回false
+    bool reserve(size_t capacity);
+
+    // 追加数据，容量不够时按2倍扩容
+    bool append(const void* data, size_t size);
+
+    // size不能超过capacity
+    bool resize(size_t size);
+    void clear(){size_ = 0;}
+
+    // 归还内存，之后可以继续使用
+    void release();
+
+    std::string to_string() const;
+    const std::shared_ptr<ObjectAllocator>& allocator() const{return allocator_;}
+
+private:
+    std::shared_ptr<ObjectAllocator> allocator_;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+#endif // OBJECT_BUFFER_HPP
@@ -0,0 +1,295 @@
+#include "object_pack.hpp"
+#include "ilogger.hpp"
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <zlib.h>
+
+using namespace std;
+
+static const char PackMagic[4] = {'M', 'P', 'K', '1'};
+static const size_t PackFooterSize = 24;
+
+static uint32_t pack_crc32(const void* data, size_t size){
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const Bytef* p = (const Bytef*)data;
+    while(size > 0){
+        uInt n = (uInt)min(size, (size_t)(1u << 30));
+        crc = crc32(crc, p, n);
+        p += n;
+        size -= n;
+    }
+    return (uint32_t)crc;
+}
+
+template<typename T>
+static void put_le(string& output, T value){
+    for(size_t i = 0; i < sizeof(T); ++i)
+        output.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+template<typename T>
+static bool get_le(const char*& p, const char* end, T& value){
+    if((size_t)(end - p) < sizeof(T))
+        return false;
+
+    value = 0;
+    for(size_t i = 0; i < sizeof(T); ++i)
+        value |= (T)(uint8_t)p[i] << (i * 8);
+    p += sizeof(T);
+    return true;
+}
+
+class PackWriterImpl : public PackWriter{
+public:
+    virtual bool add(const string& name, const void* data, size_t size) override{
+
+        if(finished_){
+            INFOE("Pack is finished");
+            return false;
+        }
+
+        if(name.size() > 0xFFFF || !names_.insert(make_pair(name, (int)entries_.size())).second){
+            INFOE("Invalid or duplicate pack entry name: %s", name.c_str());
+            return false;
+        }
+
+        PackEntry entry;
+        entry.name = name;
+        entry.offset = data_.size();
+        entry.size = size;
+        entry.crc32 = pack_crc32(data, size);
+        entries_.emplace_back(entry);
+        data_.append((const char*)data, size);
+        return true;
+    }
+
+    virtual bool add(const string& name, const string& data) override{
+        return add(name, data.data(), data.size());
+    }
+
+    virtual int count() const override{
+        return (int)entries_.size();
+    }
+
+    virtual size_t size() const override{
+        return finished_ ? index_offset_ : data_.size();
+    }
+
+    virtual string finish() override{
+
+        if(finished_)
+            return data_;
+
+        string index;
+        for(auto& e : entries_){
+            put_le<uint16_t>(index, (uint16_t)e.name.size());
+            index.append(e.name);
+            put_le<uint64_t>(index, e.offset);
+            put_le<uint64_t>(index, e.size);
+            put_le<uint32_t>(index, e.crc32);
+        }
+
+        index_offset_ = data_.size();
+        data_.append(index);
+        put_le<uint64_t>(data_, (uint64_t)index_offset_);
+        put_le<uint32_t>(data_, (uint32_t)index.size());
+        put_le<uint32_t>(data_, (uint32_t)entries_.size());
+        put_le<uint32_t>(data_, pack_crc32(index.data(), index.size()));
+        data_.append(PackMagic, sizeof(PackMagic));
+        finished_ = true;
+        return data_;
+    }
+
+    virtual bool upload(MinioClient& minio, const string& remote_path) override{
+        finish();
+        return minio.upload_filedata(remote_path, data_.data(), data_.size());
+    }
+
+private:
+    string data_;
+    vector<PackEntry> entries_;
+    unordered_map<string, int> names_;
+    size_t index_offset_ = 0;
+    bool finished_ = false;
+};
+
+shared_ptr<PackWriter> newPackWriter(){
+    return shared_ptr<PackWriter>(new PackWriterImpl());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class PackReaderImpl : public PackReader{
+public:
+    PackReaderImpl(const MinioClient& minio):minio_(minio){}
+
+    bool open(const string& remote_path, const PackReaderOptions& options){
+
+        remote_path_ = remote_path;
+        options_ = options;
+
+        bool ok = false;
+        string tail = minio_.get_range(remote_path, -1, (long long)max(options.tail_bytes, PackFooterSize), &ok);
+        if(!ok)
+            return false;
+
+        if(tail.size() < PackFooterSize || memcmp(tail.data() + tail.size() - 4, PackMagic, 4) != 0){
+            INFOE("%s is not a pack", remote_path.c_str());
+            return false;
+        }
+
+        // tail覆盖的是对象的最后tail.size()字节，只有对象比tail短时才能知道对象总长
+        const char* p = tail.data() + tail.size() - PackFooterSize;
+        const char* end = p + PackFooterSize - 4;
+        uint64_t index_offset = 0;
+        uint32_t index_size = 0, entry_count = 0, index_crc = 0;
+        get_le(p, end, index_offset);
+        get_le(p, end, index_size);
+        get_le(p, end, entry_count);
+        get_le(p, end, index_crc);
+
+        string index;
+        size_t tail_index_end = tail.size() - PackFooterSize;
+        if(index_size <= tail_index_end){
+            index = tail.substr(tail_index_end - index_size, index_size);
+        }else{
+            index = minio_.get_range(remote_path, (long long)index_offset, index_size, &ok);
+            if(!ok)
+                return false;
+        }
+
+        if(index.size() != index_size || pack_crc32(index.data(), index.size()) != index_crc){
+            INFOE("Pack index of %s is corrupted", remote_path.c_str());
+            return false;
+        }
+
+        p = index.data();
+        end = index.data() + index.size();
+        entries_.reserve(entry_count);
+        for(uint32_t i = 0; i < entry_count; ++i){
+            PackEntry e;
+            uint16_t name_size = 0;
+            if(!get_le(p, end, name_size) || (size_t)(end - p) < name_size){
+                INFOE("Pack index of %s is truncated", remote_path.c_str());
+                return false;
+            }
+
+            e.name.assign(p, name_size);
+            p += name_size;
+            if(!get_le(p, end, e.offset) || !get_le(p, end, e.size) || !get_le(p, end, e.crc32) || e.offset + e.size > index_offset){
+                INFOE("Pack index of %s is truncated", remote_path.c_str());
+                return false;
+            }
+
+            names_[e.name] = (int)entries_.size();
+            entries_.emplace_back(move(e));
+        }
+        return true;
+    }
+
+    virtual const vector<PackEntry>& entries() const override{
+        return entries_;
+    }
+
+    virtual bool contains(const string& name) const override{
+        return names_.find(name) != names_.end();
+    }
+
+    virtual string read(const string& name, bool* pointer_success) override{
+        auto output = read_many({name}, pointer_success);
+        return move(output[0]);
+    }
+
+    virtual vector<string> read_many(const vector<string>& names, bool* pointer_success) override{
+
+        vector<string> output(names.size());
+        bool success = true;
+
+        // (entry下标, 结果下标)按offset排序
+        vector<pair<int, int>> wanted;
+        wanted.reserve(names.size());
+        for(int i = 0; i < (int)names.size(); ++i){
+            auto it = names_.find(names[i]);
+            if(it == names_.end()){
+                INFOE("%s not found in pack %s", names[i].c_str(), remote_path_.c_str());
+                success = false;
+                continue;
+            }
+            wanted.emplace_back(it->second, i);
+        }
+
+        sort(wanted.begin(), wanted.end(), [&](const pair<int, int>& a, const pair<int, int>& b){
+            return entries_[a.first].offset < entries_[b.first].offset;
+        });
+
+        size_t i = 0;
+        while(i < wanted.size()){
+
+            // 向后合并，直到间隔或者总长度超限
+            uint64_t begin = entries_[wanted[i].first].offset;
+            uint64_t end = begin + entries_[wanted[i].first].size;
+            size_t j = i + 1;
+            for(; j < wanted.size(); ++j){
+                auto& e = entries_[wanted[j].first];
+                uint64_t e_end = max(end, e.offset + e.size);
+                if(e.offset > end + options_.max_gap || e_end - begin > options_.max_span)
+                    break;
+                end = e_end;
+            }
+
+            bool ok = true;
+            string span = end > begin ? minio_.get_range(remote_path_, (long long)begin, (long long)(end - begin), &ok) : string();
+            range_requests_++;
+            bytes_fetched_ += span.size();
+            if(!ok || span.size() != end - begin){
+                success = false;
+                i = j;
+                continue;
+            }
+
+            for(size_t k = i; k < j; ++k){
+                auto& e = entries_[wanted[k].first];
+                const char* data = span.data() + (e.offset - begin);
+                if(pack_crc32(data, e.size) != e.crc32){
+                    INFOE("Checksum mismatch of %s in pack %s", e.name.c_str(), remote_path_.c_str());
+                    success = false;
+                    continue;
+                }
+                output[wanted[k].second].assign(data, e.size);
+                blobs_++;
+            }
+            i = j;
+        }
+
+        if(pointer_success)
+            *pointer_success = success;
+        return output;
+    }
+
+    virtual PackReaderStats stats() const override{
+        PackReaderStats s;
+        s.range_requests = range_requests_.load();
+        s.blobs = blobs_.load();
+        s.bytes_fetched = bytes_fetched_.load();
+        return s;
+    }
+
+private:
+    MinioClient minio_;
+    string remote_path_;
+    PackReaderOptions options_;
+    vector<PackEntry> entries_;
+    unordered_map<string, int> names_;
+    atomic<long long> range_requests_{0};
+    atomic<long long> blobs_{0};
+    atomic<long long> bytes_fetched_{0};
+};
+
+shared_ptr<PackReader> newPackReader(const MinioClient& minio, const string& remote_path, const PackReaderOptions& options){
+    shared_ptr<PackReaderImpl> instance(new PackReaderImpl(minio));
+    if(!instance->open(remote_path, options))
+        instance.reset();
+    return instance;
+}
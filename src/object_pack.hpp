@@ -0,0 +1,77 @@
+#ifndef OBJECT_PACK_HPP
+#define OBJECT_PACK_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "minio_client.hpp"
+
+/**
+ * @brief 小文件打包：大量小blob拼接成一个大对象，末尾带索引，读取时用Range只取需要的部分
+ *     每个小文件不再单独占一个对象，省掉逐个请求的开销和MinIO的元数据压力
+ *
+ *     格式（整数均为小端）：
+ *         [blob 0][blob 1]...[blob n-1][索引][footer 24字节]
+ *         索引每项：u16 名字长度、名字、u64 offset、u64 size、u32 crc32
+ *         footer：u64 索引offset、u32 索引字节数、u32 条目数、u32 索引crc32、"MPK1"
+ */
+struct PackEntry{
+    std::string name;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t crc32 = 0;
+};
+
+class PackWriter{
+public:
+    // 名字重复或者超过65535字节时返回false
+    virtual bool add(const std::string& name, const void* data, size_t size) = 0;
+    virtual bool add(const std::string& name, const std::string& data) = 0;
+
+    virtual int count() const = 0;
+
+    // 已经写入的blob字节数，不含索引
+    virtual size_t size() const = 0;
+
+    // 追加索引和footer，返回完整的pack数据。之后不能再add
+    virtual std::string finish() = 0;
+
+    // finish并上传到remote_path
+    virtual bool upload(MinioClient& minio, const std::string& remote_path) = 0;
+};
+
+std::shared_ptr<PackWriter> newPackWriter();
+
+
+struct PackReaderOptions{
+    size_t tail_bytes = 64 * 1024;           // 打开时一次读取的末尾字节数，索引较小时footer和索引一个请求就拿到
+    size_t max_gap = 64 * 1024;              // read_many时间隔不超过它的blob合并成一个Range请求，多读的间隔直接丢弃
+    size_t max_span = 8 * 1024 * 1024;       // 合并后单个请求的最大字节数
+};
+
+struct PackReaderStats{
+    long long range_requests = 0;    // 不含打开时读取索引的请求
+    long long blobs = 0;
+    long long bytes_fetched = 0;     // 包括合并时多读的间隔
+};
+
+class PackReader{
+public:
+    virtual const std::vector<PackEntry>& entries() const = 0;
+    virtual bool contains(const std::string& name) const = 0;
+
+    // 一个Range请求读取一个blob，并校验crc32
+    virtual std::string read(const std::string& name, bool* pointer_success = nullptr) = 0;
+
+    // 按offset排序后把相邻的blob合并成尽量少的Range请求，结果按names的顺序返回
+    // 任意一个不存在或者读取失败时pointer_success为false，对应的结果为空
+    virtual std::vector<std::string> read_many(const std::vector<std::string>& names, bool* pointer_success = nullptr) = 0;
+
+    virtual PackReaderStats stats() const = 0;
+};
+
+// 读取footer和索引，失败返回nullptr。minio会被拷贝一份，共享原客户端的统计、限速等设置
+std::shared_ptr<PackReader> newPackReader(const MinioClient& minio, const std::string& remote_path, const PackReaderOptions& options = PackReaderOptions());
+
+#endif // OBJECT_PACK_HPP
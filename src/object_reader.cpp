@@ -0,0 +1,301 @@
+#include "object_reader.hpp"
+#include "ilogger.hpp"
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace std;
+
+struct ReaderChunk{
+    bool done = false;
+    bool success = false;
+    int status_code = 0;
+    int attempts = 0;
+    long long submit_us = 0;
+    string data;
+    shared_ptr<MinioCancellation> cancellation;
+};
+
+// 回调在引擎线程上执行，持有的是这份共享状态，reader析构之后在途的块仍然可以安全结束
+struct ReaderShared{
+    mutex lock;
+    condition_variable cv;
+    map<long long, shared_ptr<ReaderChunk>> chunks;     // 块下标 -> 块
+    double fetch_us = 0;                                // 块下载耗时的滑动平均
+    long long requests = 0;
+    long long bytes = 0;
+};
+
+class ObjectReaderImpl : public ObjectReader{
+public:
+    ObjectReaderImpl(const MinioClient& minio):minio_(minio){}
+
+    virtual ~ObjectReaderImpl(){
+        drop(0, -1);
+    }
+
+    bool open(const string& remote_path, const ObjectReaderOptions& options){
+
+        remote_path_ = remote_path;
+        options_ = options;
+        options_.chunk_size = max(options_.chunk_size, (size_t)1);
+        options_.min_read_ahead = max(options_.min_read_ahead, 1);
+        options_.max_read_ahead = max(options_.max_read_ahead, options_.min_read_ahead);
+        depth_ = options_.min_read_ahead;
+
+        bool ok = false;
+        int status_code = 0;
+        MinioObjectInfo info;
+        auto begin_us = iLogger::timestamp_now_us();
+        current_ = minio_.get_range(remote_path, 0, options_.chunk_size, &ok, &info, "", &status_code);
+
+        // 空对象上的Range返回416，当作大小为0，第一次read就到达末尾
+        if(!ok && status_code == 416){
+            ok = true;
+            info = MinioObjectInfo();
+            current_.clear();
+        }
+
+        if(!ok)
+            return false;
+
+        size_ = info.size;
+        etag_ = info.etag;
+        current_index_ = 0;
+        current_ready_us_ = iLogger::timestamp_now_us();
+        shared_->fetch_us = current_ready_us_ - begin_us;
+        shared_->requests = 1;
+        shared_->bytes = current_.size();
+        schedule(1);
+        return true;
+    }
+
+    virtual size_t read(void* buffer, size_t size, bool* pointer_success) override{
+
+        if(pointer_success)
+            *pointer_success = true;
+
+        if(position_ >= size_ || size == 0)
+            return 0;
+
+        long long index = position_ / options_.chunk_size;
+        if(index != current_index_ && !load(index)){
+            if(pointer_success)
+                *pointer_success = false;
+            return 0;
+        }
+
+        size_t offset = position_ - index * options_.chunk_size;
+        size_t n = min(size, current_.size() - offset);
+        memcpy(buffer, current_.data() + offset, n);
+        position_ += n;
+        return n;
+    }
+
+    virtual bool seek(long long offset) override{
+
+        if(offset < 0 || offset > size_)
+            return false;
+
+        position_ = offset;
+        long long index = offset / options_.chunk_size;
+        drop(index, index + depth_);
+        return true;
+    }
+
+    virtual long long tell() const override{
+        return position_;
+    }
+
+    virtual long long size() const override{
+        return size_;
+    }
+
+    virtual const string& etag() const override{
+        return etag_;
+    }
+
+    virtual ObjectReaderStats stats() const override{
+        ObjectReaderStats s;
+        lock_guard<mutex> l(shared_->lock);
+        s.chunks = shared_->requests;
+        s.bytes = shared_->bytes;
+        s.stalls = stalls_;
+        s.stall_us = stall_us_;
+        s.read_ahead = depth_;
+        return s;
+    }
+
+private:
+    long long chunk_count() const{
+        return (size_ + options_.chunk_size - 1) / options_.chunk_size;
+    }
+
+    // 取消并丢弃[first, last]以外的块，last < 0时全部丢弃。取消可能同步回调，在锁外进行
+    void drop(long long first, long long last){
+
+        vector<shared_ptr<MinioCancellation>> cancels;
+        {
+            lock_guard<mutex> l(shared_->lock);
+            auto& chunks = shared_->chunks;
+            for(auto it = chunks.begin(); it != chunks.end();){
+                if(last < 0 || it->first < first || it->first > last){
+                    if(!it->second->done)
+                        cancels.emplace_back(it->second->cancellation);
+                    it = chunks.erase(it);
+                }else{
+                    ++it;
+                }
+            }
+        }
+
+        for(auto& cancellation : cancels)
+            cancellation->cancel();
+    }
+
+    // 保证[from, from + depth_)的块都已经提交，在锁外提交，避免提交失败时同步回调重入
+    void schedule(long long from){
+
+        vector<pair<long long, shared_ptr<ReaderChunk>>> submits;
+        {
+            lock_guard<mutex> l(shared_->lock);
+            auto& chunks = shared_->chunks;
+            long long end = min(from + depth_, chunk_count());
+            for(long long i = from; i < end; ++i){
+                if(chunks.find(i) != chunks.end())
+                    continue;
+
+                shared_ptr<ReaderChunk> chunk(new ReaderChunk());
+                chunks[i] = chunk;
+                submits.emplace_back(i, chunk);
+            }
+        }
+
+        for(auto& item : submits)
+            submit(item.first, item.second);
+    }
+
+    void submit(long long index, const shared_ptr<ReaderChunk>& chunk){
+
+        long long offset = index * options_.chunk_size;
+        long long length = min((long long)options_.chunk_size, size_ - offset);
+        chunk->attempts++;
+        chunk->submit_us = iLogger::timestamp_now_us();
+        chunk->cancellation = make_shared<MinioCancellation>();
+
+        MinioAsyncOptions options;
+        options.timeout_ms = options_.timeout_ms;
+        options.cancellation = chunk->cancellation;
+        options.if_match = etag_;
+
+        auto shared = shared_;
+        minio_.get_range_async(remote_path_, offset, length, [shared, chunk, length](MinioAsyncResult& result){
+            lock_guard<mutex> l(shared->lock);
+            chunk->done = true;
+            chunk->success = result.success && (long long)result.data.size() == length;
+            chunk->status_code = result.status_code;
+            chunk->data = move(result.data);
+
+            double elapsed = (double)(iLogger::timestamp_now_us() - chunk->submit_us);
+            shared->fetch_us = shared->fetch_us * 0.75 + elapsed * 0.25;
+            shared->requests++;
+            shared->bytes += chunk->data.size();
+            shared->cv.notify_all();
+        }, options);
+    }
+
+    bool load(long long index){
+
+        // 顺序读时，上一个块从拿到到读完的时间就是消费速度，不含等待网络的时间
+        auto now = iLogger::timestamp_now_us();
+        if(index == current_index_ + 1){
+            double elapsed = (double)(now - current_ready_us_);
+            consume_us_ = consume_us_ <= 0 ? elapsed : consume_us_ * 0.75 + elapsed * 0.25;
+        }
+
+        current_.clear();
+        current_index_ = -1;
+        schedule(index);
+
+        shared_ptr<ReaderChunk> chunk;
+        while(true){
+            unique_lock<mutex> l(shared_->lock);
+            auto it = shared_->chunks.find(index);
+            if(it == shared_->chunks.end()){
+                l.unlock();
+                schedule(index);
+                continue;
+            }
+
+            chunk = it->second;
+            if(!chunk->done){
+                stalls_++;
+                auto wait_begin = iLogger::timestamp_now_us();
+                shared_->cv.wait(l, [&]{return chunk->done;});
+                stall_us_ += iLogger::timestamp_now_us() - wait_begin;
+            }
+
+            if(chunk->success){
+                current_ = move(chunk->data);
+                shared_->chunks.erase(it);
+                break;
+            }
+
+            // 4xx（对象被删除、412被覆盖）重试也没用
+            bool retryable = chunk->status_code == 0 || chunk->status_code >= 500;
+            if(!retryable || chunk->attempts > options_.max_retries){
+                INFOE("Read %s at %lld failed, status code %d", remote_path_.c_str(), index * (long long)options_.chunk_size, chunk->status_code);
+                shared_->chunks.erase(it);
+                return false;
+            }
+
+            chunk->done = false;
+            l.unlock();
+            submit(index, chunk);
+        }
+
+        current_index_ = index;
+        current_ready_us_ = iLogger::timestamp_now_us();
+
+        // 需要在途的块数 ≈ 下载耗时 / 消费耗时，多留一个余量
+        if(consume_us_ > 0){
+            double fetch_us = 0;
+            {
+                lock_guard<mutex> l(shared_->lock);
+                fetch_us = shared_->fetch_us;
+            }
+            int depth = (int)ceil(fetch_us / max(consume_us_, 1.0)) + 1;
+            depth_ = max(options_.min_read_ahead, min(options_.max_read_ahead, depth));
+        }
+
+        schedule(index + 1);
+        return true;
+    }
+
+private:
+    MinioClient minio_;
+    string remote_path_;
+    ObjectReaderOptions options_;
+    string etag_;
+    long long size_ = 0;
+    long long position_ = 0;
+
+    string current_;
+    long long current_index_ = -1;
+    long long current_ready_us_ = 0;
+    double consume_us_ = 0;
+    int depth_ = 1;
+    long long stalls_ = 0;
+    long long stall_us_ = 0;
+    shared_ptr<ReaderShared> shared_ = make_shared<ReaderShared>();
+};
+
+shared_ptr<ObjectReader> newObjectReader(const MinioClient& minio, const string& remote_path, const ObjectReaderOptions& options){
+    shared_ptr<ObjectReaderImpl> instance(new ObjectReaderImpl(minio));
+    if(!instance->open(remote_path, options))
+        instance.reset();
+    return instance;
+}
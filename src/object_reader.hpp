@@ -0,0 +1,51 @@
+#ifndef OBJECT_READER_HPP
+#define OBJECT_READER_HPP
+
+#include <string>
+#include <memory>
+#include "minio_client.hpp"
+
+struct ObjectReaderOptions{
+    size_t chunk_size = 4 * 1024 * 1024;    // 每个Range请求的字节数
+    int min_read_ahead = 1;                 // 预读的块数下限
+    int max_read_ahead = 16;                // 预读的块数上限，内存最多占用(max_read_ahead + 1) * chunk_size
+    int max_retries = 2;                    // 单个块失败后的重试次数，对象被修改（412）时不重试
+    int timeout_ms = 0;                     // 单个块的超时，<=0不限
+};
+
+struct ObjectReaderStats{
+    long long chunks = 0;           // 发出的Range请求数，包括重试
+    long long bytes = 0;            // 下载的字节数
+    long long stalls = 0;           // read时块还没到、需要等待的次数
+    long long stall_us = 0;         // 等待的总时长
+    int read_ahead = 0;             // 当前的预读深度
+};
+
+/**
+ * @brief 顺序读取对象的流，read之前已经有若干个后续块的Range请求在途，计算不用等网络
+ *     预读深度按 块的下载耗时 / 消费一个块的耗时 自适应：消费得快就多预读，消费得慢就少占内存
+ *     块由MinioClient的AsyncEngine下载，不额外创建线程；引擎必须由其他线程驱动（默认引擎即可），
+ *     不能在驱动引擎的线程上read
+ *     后续块都带If-Match，读取过程中对象被覆盖时read失败，不会拼出两个版本混合的数据
+ *     一个ObjectReader只能在一个线程上使用
+ */
+class ObjectReader{
+public:
+    virtual ~ObjectReader() = default;
+
+    // 读取最多size字节，返回实际读到的字节数，到达末尾返回0。失败时返回0并且pointer_success为false
+    virtual size_t read(void* buffer, size_t size, bool* pointer_success = nullptr) = 0;
+
+    // 移动读取位置，丢弃不再需要的预读块
+    virtual bool seek(long long offset) = 0;
+
+    virtual long long tell() const = 0;
+    virtual long long size() const = 0;
+    virtual const std::string& etag() const = 0;
+    virtual ObjectReaderStats stats() const = 0;
+};
+
+// 同步读取第一个块，同时得到对象大小和ETag，失败返回nullptr。minio会被拷贝一份
+std::shared_ptr<ObjectReader> newObjectReader(const MinioClient& minio, const std::string& remote_path, const ObjectReaderOptions& options = ObjectReaderOptions());
+
+#endif // OBJECT_READER_HPP
@@ -0,0 +1,77 @@
+#include "rate_limiter.hpp"
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+class TokenBucketImpl : public TokenBucket{
+public:
+    TokenBucketImpl(double rate_per_second, double burst){
+        set_rate(rate_per_second, burst);
+    }
+
+    virtual void set_rate(double rate_per_second, double burst) override{
+        lock_guard<mutex> l(lock_);
+        refill(chrono::steady_clock::now());
+
+        rate_  = max(rate_per_second, 0.0);
+        // 默认允许1秒的突发量
+        burst_ = burst > 0 ? burst : rate_;
+
+        // 从不限速切换过来时桶是满的，否则保留当前的余额/透支
+        tokens_ = unlimited_ ? burst_ : min(tokens_, burst_);
+        unlimited_ = rate_ <= 0;
+    }
+
+    virtual double rate() const override{
+        lock_guard<mutex> l(lock_);
+        return rate_;
+    }
+
+    virtual long long acquire(double tokens) override{
+
+        if(unlimited_)
+            return 0;
+
+        double wait_seconds = 0;
+        {
+            lock_guard<mutex> l(lock_);
+            if(rate_ <= 0)
+                return 0;
+
+            refill(chrono::steady_clock::now());
+            tokens_ -= tokens;
+            if(tokens_ < 0)
+                wait_seconds = -tokens_ / rate_;
+        }
+
+        if(wait_seconds <= 0)
+            return 0;
+
+        auto wait_us = (long long)(wait_seconds * 1e6);
+        this_thread::sleep_for(chrono::microseconds(wait_us));
+        return wait_us;
+    }
+
+private:
+    void refill(chrono::steady_clock::time_point now){
+        double elapsed = chrono::duration<double>(now - last_).count();
+        last_ = now;
+        tokens_ = min(burst_, tokens_ + elapsed * rate_);
+    }
+
+private:
+    mutable mutex lock_;
+    atomic<bool> unlimited_{true};
+    double rate_ = 0;
+    double burst_ = 0;
+    double tokens_ = 0;
+    chrono::steady_clock::time_point last_ = chrono::steady_clock::now();
+};
+
+shared_ptr<TokenBucket> newTokenBucket(double rate_per_second, double burst){
+    return shared_ptr<TokenBucketImpl>(new TokenBucketImpl(rate_per_second, burst));
+}
@@ -0,0 +1,23 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <memory>
+
+/**
+ * @brief 令牌桶限速器，可以用来限制字节/秒或者请求/秒
+ *     rate <= 0 表示不限速，此时acquire几乎没有开销
+ *     允许透支：令牌不够时先扣成负数再按缺口睡眠，多个线程并发acquire时按到达顺序排队，不会饿死
+ *     set_rate可以在运行时随时调用，正在等待的请求下一次acquire就按新速率计算
+ */
+class TokenBucket{
+public:
+    virtual void set_rate(double rate_per_second, double burst = 0) = 0;
+    virtual double rate() const = 0;
+
+    // 阻塞直到拿到tokens个令牌，返回等待的时间(us)
+    virtual long long acquire(double tokens) = 0;
+};
+
+std::shared_ptr<TokenBucket> newTokenBucket(double rate_per_second = 0, double burst = 0);
+
+#endif // RATE_LIMITER_HPP
@@ -0,0 +1,199 @@
+#include "tracer.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+struct TraceSlot{
+    atomic<uint64_t> sequence{0};
+    TraceSpan span;
+};
+
+// 只有所属线程写，导出线程读；每个槽位用sequence做seqlock，读到写了一半的槽位直接跳过
+// 线程退出后ring放回空闲状态，由之后新建的线程接着写，ring的数量不超过同时存在的线程数
+struct TraceRing{
+    unique_ptr<TraceSlot[]> slots;
+    int capacity = 0;
+    int tid = 0;
+    bool in_use = false;
+    atomic<uint64_t> head{0};
+    atomic<uint64_t> cleared{0};
+};
+
+static atomic<bool> g_trace_enabled{false};
+static atomic<uint64_t> g_sample_threshold{0};
+static atomic<int> g_ring_capacity{8192};
+static atomic<uint64_t> g_next_request_id{1};
+static atomic<int> g_next_tid{1};
+static mutex g_rings_lock;
+static vector<shared_ptr<TraceRing>> g_rings;
+
+struct LocalRing{
+    shared_ptr<TraceRing> ring;
+
+    ~LocalRing(){
+        if(!ring) return;
+
+        lock_guard<mutex> l(g_rings_lock);
+        ring->in_use = false;
+    }
+};
+
+static TraceRing* local_ring(){
+
+    static thread_local LocalRing local;
+    if(local.ring)
+        return local.ring.get();
+
+    int capacity = max(16, g_ring_capacity.load());
+    lock_guard<mutex> l(g_rings_lock);
+    for(auto it = g_rings.begin(); it != g_rings.end();){
+        auto& ring = *it;
+        if(ring->in_use){
+            ++it;
+            continue;
+        }
+
+        // 容量已经改过的空闲ring直接释放，里面的span随之丢弃
+        if(ring->capacity != capacity){
+            it = g_rings.erase(it);
+            continue;
+        }
+
+        ring->in_use = true;
+        local.ring = ring;
+        return ring.get();
+    }
+
+    local.ring.reset(new TraceRing());
+    local.ring->capacity = capacity;
+    local.ring->slots.reset(new TraceSlot[capacity]);
+    local.ring->tid = g_next_tid.fetch_add(1);
+    local.ring->in_use = true;
+    g_rings.push_back(local.ring);
+    return local.ring.get();
+}
+
+static uint64_t local_random(){
+    static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(size_t)&state) ^ (uint64_t)iLogger::timestamp_now_us();
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+void trace_enable(double sample_rate, int ring_capacity){
+    sample_rate = min(max(sample_rate, 0.0), 1.0);
+    g_sample_threshold = (uint64_t)(sample_rate * 4294967296.0);
+    g_ring_capacity = ring_capacity;
+    g_trace_enabled = true;
+}
+
+void trace_disable(){
+    g_trace_enabled = false;
+}
+
+bool trace_enabled(){
+    return g_trace_enabled.load(memory_order_relaxed);
+}
+
+uint64_t trace_sample(){
+
+    if(!g_trace_enabled.load(memory_order_relaxed))
+        return 0;
+
+    if((local_random() & 0xFFFFFFFFULL) >= g_sample_threshold.load(memory_order_relaxed))
+        return 0;
+
+    return g_next_request_id.fetch_add(1, memory_order_relaxed);
+}
+
+void trace_record(const TraceSpan& span){
+
+    auto ring = local_ring();
+    uint64_t index = ring->head.load(memory_order_relaxed);
+    auto& slot = ring->slots[index % ring->capacity];
+
+    uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+    slot.sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.span = span;
+    slot.sequence.store(sequence + 2, memory_order_release);
+    ring->head.store(index + 1, memory_order_release);
+}
+
+void trace_record(const char* name, const char* category, long long begin_us, long long duration_us, uint64_t request_id){
+    TraceSpan span;
+    span.name = name;
+    span.category = category;
+    span.begin_us = begin_us;
+    span.duration_us = duration_us;
+    span.request_id = request_id;
+    trace_record(span);
+}
+
+static void append_span(string& out, const TraceSpan& span, int tid, bool& first){
+    if(!first) out += ",\n";
+    first = false;
+
+    out += iLogger::format(
+        "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,"
+        "\"args\":{\"request_id\":%llu,\"status\":%d,\"bytes\":%lld}}",
+        span.name, span.category, span.begin_us, span.duration_us, (int)getpid(), tid,
+        (unsigned long long)span.request_id, span.status_code, span.bytes
+    );
+}
+
+string trace_export_json(){
+
+    vector<shared_ptr<TraceRing>> rings;
+    {
+        lock_guard<mutex> l(g_rings_lock);
+        rings = g_rings;
+    }
+
+    string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for(auto& ring : rings){
+
+        if(!first) out += ",\n";
+        first = false;
+        out += iLogger::format(
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"minio-thread-%d\"}}",
+            (int)getpid(), ring->tid, ring->tid
+        );
+
+        uint64_t head = ring->head.load(memory_order_acquire);
+        uint64_t begin = head > (uint64_t)ring->capacity ? head - ring->capacity : 0;
+        begin = max(begin, ring->cleared.load(memory_order_relaxed));
+
+        for(uint64_t i = begin; i < head; ++i){
+            auto& slot = ring->slots[i % ring->capacity];
+            uint64_t s1 = slot.sequence.load(memory_order_acquire);
+            if(s1 & 1) continue;
+
+            TraceSpan span = slot.span;
+            atomic_thread_fence(memory_order_acquire);
+            if(slot.sequence.load(memory_order_relaxed) != s1 || span.name == nullptr)
+                continue;
+
+            append_span(out, span, ring->tid, first);
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool trace_save(const string& file){
+    return iLogger::save_file(file, trace_export_json());
+}
+
+void trace_clear(){
+    lock_guard<mutex> l(g_rings_lock);
+    for(auto& ring : g_rings)
+        ring->cleared.store(ring->head.load(memory_order_acquire), memory_order_relaxed);
+}
@@ -0,0 +1,39 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief 请求生命周期的追踪，导出为Chrome trace_event JSON，可以直接拖进 https://ui.perfetto.dev 查看
+ *     - 每个线程一个环形缓冲区，写入时不加锁，缓冲区满了覆盖最旧的记录；线程退出后缓冲区留给新线程复用
+ *     - 按操作采样，没开启或者没采中时只有一次原子读的开销，可以长期在线上打开
+ *     - name和category必须是字符串常量（只保存指针）
+ */
+struct TraceSpan{
+    const char* name = nullptr;
+    const char* category = nullptr;
+    long long begin_us = 0;
+    long long duration_us = 0;
+    uint64_t request_id = 0;
+    int status_code = 0;
+    long long bytes = 0;
+};
+
+// sample_rate取值0-1，表示多大比例的操作会被记录；ring_capacity是每个线程保留的最近span数量
+void trace_enable(double sample_rate = 1.0, int ring_capacity = 8192);
+void trace_disable();
+bool trace_enabled();
+
+// 在操作开始时调用，返回0表示这个操作不记录，否则返回本次操作的请求id
+uint64_t trace_sample();
+
+void trace_record(const TraceSpan& span);
+void trace_record(const char* name, const char* category, long long begin_us, long long duration_us, uint64_t request_id);
+
+// 导出当前所有线程缓冲区里的span
+std::string trace_export_json();
+bool trace_save(const std::string& file);
+void trace_clear();
+
+#endif // TRACER_HPP
@@ -0,0 +1,154 @@
+#include "workload_recorder.hpp"
+#include "ilogger.hpp"
+#include <mutex>
+#include <atomic>
+#include <string.h>
+#include <stdio.h>
+
+using namespace std;
+
+static const char* WorkloadTraceMagic = "MWTRACE1";
+static const uint32_t WorkloadTraceVersion = 1;
+
+uint64_t workload_key_hash(const string& path){
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for(unsigned char c : path){
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+class WorkloadRecorderImpl : public WorkloadRecorder{
+public:
+    virtual ~WorkloadRecorderImpl(){
+        close();
+    }
+
+    bool open(const string& file, int buffer_records){
+
+        handle_ = fopen(file.c_str(), "wb");
+        if(handle_ == nullptr){
+            INFOE("Open %s failed", file.c_str());
+            return false;
+        }
+
+        capacity_ = max(16, buffer_records);
+        buffer_.reserve(capacity_);
+        start_us_ = iLogger::timestamp_now_us();
+
+        WorkloadTraceHeader header;
+        memcpy(header.magic, WorkloadTraceMagic, sizeof(header.magic));
+        header.version = WorkloadTraceVersion;
+        header.record_size = sizeof(WorkloadRecord);
+        header.start_timestamp_us = start_us_;
+        return fwrite(&header, sizeof(header), 1, handle_) == 1;
+    }
+
+    virtual void record(int operation, const string& path, uint64_t size, long long begin_us, long long latency_us, bool success, int status_code) override{
+
+        WorkloadRecord r;
+        r.timestamp_us = (uint64_t)max(0LL, begin_us - start_us_);
+        r.key_hash = workload_key_hash(path);
+        r.size = size;
+        r.latency_us = (uint32_t)min(max(0LL, latency_us), (long long)UINT32_MAX);
+        r.operation = (uint8_t)operation;
+        r.success = success ? 1 : 0;
+        r.status_code = (uint16_t)max(0, status_code);
+
+        vector<WorkloadRecord> full;
+        {
+            lock_guard<mutex> l(buffer_lock_);
+            if(closed_) return;
+
+            buffer_.push_back(r);
+            records_++;
+            if((int)buffer_.size() < capacity_)
+                return;
+
+            // 满了就换一块新的缓冲区，写文件放在锁外面，不阻塞其他线程记录
+            full.reserve(capacity_);
+            full.swap(buffer_);
+        }
+        write(full);
+    }
+
+    virtual bool flush() override{
+        vector<WorkloadRecord> pending;
+        {
+            lock_guard<mutex> l(buffer_lock_);
+            pending.swap(buffer_);
+            buffer_.reserve(capacity_);
+        }
+        return write(pending);
+    }
+
+    virtual void close() override{
+        {
+            lock_guard<mutex> l(buffer_lock_);
+            if(closed_) return;
+            closed_ = true;
+        }
+
+        flush();
+        lock_guard<mutex> l(file_lock_);
+        if(handle_){
+            fclose(handle_);
+            handle_ = nullptr;
+        }
+    }
+
+    virtual long long records() const override{
+        return records_;
+    }
+
+private:
+    // 多个批次可能同时写文件，用file_lock_保证批次内记录连续；批次之间的先后不重要，回放时按时间戳排序
+    bool write(const vector<WorkloadRecord>& records){
+        if(records.empty()) return true;
+
+        lock_guard<mutex> l(file_lock_);
+        if(handle_ == nullptr) return false;
+
+        bool ok = fwrite(records.data(), sizeof(WorkloadRecord), records.size(), handle_) == records.size();
+        fflush(handle_);
+        return ok;
+    }
+
+private:
+    FILE* handle_ = nullptr;
+    mutex buffer_lock_;
+    mutex file_lock_;
+    vector<WorkloadRecord> buffer_;
+    int capacity_ = 0;
+    bool closed_ = false;
+    long long start_us_ = 0;
+    atomic<long long> records_{0};
+};
+
+shared_ptr<WorkloadRecorder> newWorkloadRecorder(const string& file, int buffer_records){
+    shared_ptr<WorkloadRecorderImpl> instance(new WorkloadRecorderImpl());
+    if(!instance->open(file, buffer_records))
+        instance.reset();
+    return instance;
+}
+
+bool load_workload_trace(const string& file, WorkloadTraceHeader& header, vector<WorkloadRecord>& records){
+
+    auto data = iLogger::load_file(file);
+    if(data.size() < sizeof(WorkloadTraceHeader)){
+        INFOE("Invalid workload trace %s", file.c_str());
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+    if(memcmp(header.magic, WorkloadTraceMagic, sizeof(header.magic)) != 0 || header.record_size != sizeof(WorkloadRecord)){
+        INFOE("Invalid workload trace %s, magic or record size mismatch", file.c_str());
+        return false;
+    }
+
+    size_t count = (data.size() - sizeof(header)) / sizeof(WorkloadRecord);
+    records.resize(count);
+    memcpy(records.data(), data.data() + sizeof(header), count * sizeof(WorkloadRecord));
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef WORKLOAD_RECORDER_HPP
+#define WORKLOAD_RECORDER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * @brief 线上访问模式的录制，用来回放评估缓存、连接池、并发参数的改动
+ *     每个操作记录一条32字节的定长记录：操作类型、key的哈希（不保存真实路径）、字节数、开始时间、耗时
+ *     文件格式：WorkloadTraceHeader + N * WorkloadRecord，小端
+ *     记录先写入内存缓冲区，攒够一批再写文件，record本身只有一次加锁和拷贝
+ *     与tracer不同，这里要求完整记录每个操作，不采样，也不是环形覆盖
+ */
+#pragma pack(push, 1)
+struct WorkloadTraceHeader{
+    char magic[8];                  // "MWTRACE1"
+    uint32_t version;
+    uint32_t record_size;
+    int64_t start_timestamp_us;     // 录制开始的墙上时间
+};
+
+struct WorkloadRecord{
+    uint64_t timestamp_us;          // 相对录制开始的时间
+    uint64_t key_hash;              // 路径的FNV-1a哈希，回放时映射为新的路径
+    uint64_t size;                  // 上传或者下载的字节数
+    uint32_t latency_us;
+    uint8_t  operation;             // MinioOperation
+    uint8_t  success;
+    uint16_t status_code;
+};
+#pragma pack(pop)
+
+class WorkloadRecorder{
+public:
+    virtual void record(int operation, const std::string& path, uint64_t size, long long begin_us, long long latency_us, bool success, int status_code) = 0;
+
+    // 把缓冲区写入文件
+    virtual bool flush() = 0;
+
+    // flush并关闭文件，之后的record会被忽略；析构时自动调用
+    virtual void close() = 0;
+
+    virtual long long records() const = 0;
+};
+
+// 创建文件失败返回nullptr
+std::shared_ptr<WorkloadRecorder> newWorkloadRecorder(const std::string& file, int buffer_records = 4096);
+
+uint64_t workload_key_hash(const std::string& path);
+
+// 读取整个录制文件，格式不对返回false
+bool load_workload_trace(const std::string& file, WorkloadTraceHeader& header, std::vector<WorkloadRecord>& records);
+
+#endif // WORKLOAD_RECORDER_HPP
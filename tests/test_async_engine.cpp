@@ -0,0 +1,81 @@
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+
+#include "unit_test.hpp"
+#include "async_engine.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+// 等待异步回调，返回false表示等待超时
+struct AsyncWaiter{
+    mutex lock;
+    condition_variable cv;
+    bool done = false;
+    MinioAsyncResult result;
+
+    MinioAsyncCallback callback(){
+        return [this](MinioAsyncResult& r){
+            lock_guard<mutex> l(lock);
+            result = r;
+            done = true;
+            cv.notify_all();
+        };
+    }
+
+    bool wait(int timeout_ms){
+        unique_lock<mutex> l(lock);
+        return cv.wait_for(l, chrono::milliseconds(timeout_ms), [this]{return done;});
+    }
+};
+
+TEST(async_get_and_put){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "a.txt", "hello async");
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    minio.set_async_engine(newAsyncEngine(8));
+
+    AsyncWaiter get;
+    minio.get_file_async("/bucket/a.txt", get.callback());
+    REQUIRE(get.wait(5000));
+    CHECK(get.result.success);
+    CHECK(get.result.data == "hello async");
+
+    AsyncWaiter put;
+    minio.upload_filedata_async("/bucket/b.txt", "uploaded", put.callback());
+    REQUIRE(put.wait(5000));
+    CHECK(put.result.success);
+
+    string data;
+    CHECK(server->get_object("bucket", "b.txt", data) && data == "uploaded");
+}
+
+TEST(async_timeout_fires_on_time){
+
+    MockS3Options options;
+    options.latency_ms = 1000;
+    auto server = newMockS3Server(options);
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "slow.txt", "slow");
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    minio.set_async_engine(newAsyncEngine(8));
+
+    MinioAsyncOptions async_options;
+    async_options.timeout_ms = 200;
+    AsyncWaiter waiter;
+    auto begin = iLogger::timestamp_steady_us();
+    minio.get_file_async("/bucket/slow.txt", waiter.callback(), async_options);
+    REQUIRE(waiter.wait(5000));
+    auto cost_ms = (iLogger::timestamp_steady_us() - begin) / 1000;
+
+    CHECK(!waiter.result.success);
+    CHECK(cost_ms >= 150 && cost_ms < 800);
+}
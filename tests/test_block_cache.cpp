@@ -0,0 +1,219 @@
+#include <thread>
+#include <vector>
+#include <string>
+
+#include "unit_test.hpp"
+#include "block_cache.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+static const long long BlockSize = 64 * 1024;
+
+static string make_object_data(size_t size, int seed){
+    string data(size, 0);
+    for(size_t i = 0; i < size; ++i)
+        data[i] = (char)((i * 131 + seed * 7919) >> 3);
+    return data;
+}
+
+static BlockCacheOptions cache_options(){
+    BlockCacheOptions options;
+    options.block_size = BlockSize;
+    options.max_request_bytes = 4 * BlockSize;
+    options.max_gap_blocks = 1;
+    return options;
+}
+
+TEST(block_cache_coalesces_adjacent_misses){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = make_object_data(16 * BlockSize, 1);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto cache = newBlockCache(cache_options());
+
+    // 块0和2之间只隔一块，合并成一个请求；块5单独请求
+    vector<pair<long long, long long>> ranges = {{10, 100}, {2 * BlockSize + 5, 100}, {5 * BlockSize, 100}};
+    long long requests_before = server->stats().requests;
+    bool ok = false;
+    auto result = cache->read_ranges(minio, "/bucket/data.bin", ranges, &ok);
+    REQUIRE(ok);
+    REQUIRE(result.size() == ranges.size());
+    for(size_t i = 0; i < ranges.size(); ++i)
+        CHECK(result[i] == data.substr(ranges[i].first, ranges[i].second));
+
+    auto s = cache->stats();
+    CHECK(s.requests == 2);
+    CHECK(s.misses == 3);
+    CHECK(server->stats().requests - requests_before == 2);
+
+    // 合并时顺带读回来的块1也已经缓存
+    CHECK(cache->read(minio, "/bucket/data.bin", BlockSize, 10, &ok) == data.substr(BlockSize, 10));
+    CHECK(ok);
+    s = cache->stats();
+    CHECK(s.requests == 2);
+    CHECK(s.hits == 1);
+    CHECK(server->stats().requests - requests_before == 2);
+}
+
+TEST(block_cache_splits_large_requests){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = make_object_data(16 * BlockSize + 100, 2);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto cache = newBlockCache(cache_options());
+
+    // 17块，每个请求最多4块
+    bool ok = false;
+    auto result = cache->read(minio, "/bucket/data.bin", 0, data.size() + 1000, &ok);
+    CHECK(ok);
+    CHECK(result == data);
+    CHECK(cache->stats().requests == 5);
+
+    // 块之间隔得太远时不合并
+    cache->clear();
+    vector<pair<long long, long long>> ranges = {{0, 1}, {3 * BlockSize, 1}, {6 * BlockSize, 1}};
+    cache->read_ranges(minio, "/bucket/data.bin", ranges, &ok);
+    CHECK(ok);
+    CHECK(cache->stats().requests == 5 + 3);
+}
+
+TEST(block_cache_concurrent_miss_fetched_once){
+
+    MockS3Options options;
+    options.latency_ms = 100;
+    auto server = newMockS3Server(options);
+    REQUIRE(server != nullptr);
+    auto data = make_object_data(4 * BlockSize, 3);
+    server->put_object("bucket", "data.bin", data);
+
+    auto cache = newBlockCache(cache_options());
+    vector<thread> readers;
+    vector<string> results(8);
+    for(size_t i = 0; i < results.size(); ++i){
+        readers.emplace_back([&, i]{
+            MinioClient minio(server->endpoint(), "access", "secret");
+            results[i] = cache->read(minio, "/bucket/data.bin", 100, 1000);
+        });
+    }
+    for(auto& t : readers)
+        t.join();
+
+    for(auto& r : results)
+        CHECK(r == data.substr(100, 1000));
+
+    auto s = cache->stats();
+    CHECK(s.requests == 1);
+    CHECK(s.misses == 1);
+    CHECK(s.shared_misses + s.hits == 7);
+}
+
+TEST(block_cache_never_mixes_versions){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto old_data = make_object_data(8 * BlockSize, 4);
+    auto new_data = make_object_data(8 * BlockSize, 5);
+    server->put_object("bucket", "data.bin", old_data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto cache = newBlockCache(cache_options());
+
+    bool ok = false;
+    CHECK(cache->read(minio, "/bucket/data.bin", 0, 100, &ok) == old_data.substr(0, 100));
+
+    // 对象被覆盖后，缺失块的请求带If-Match失败，整个对象丢弃重读
+    server->put_object("bucket", "data.bin", new_data);
+    vector<pair<long long, long long>> ranges = {{0, 100}, {6 * BlockSize, 100}};
+    auto result = cache->read_ranges(minio, "/bucket/data.bin", ranges, &ok);
+    CHECK(ok);
+    REQUIRE(result.size() == 2);
+    CHECK(result[0] == new_data.substr(0, 100));
+    CHECK(result[1] == new_data.substr(6 * BlockSize, 100));
+}
+
+TEST(block_cache_empty_object){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "empty.bin", "");
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto cache = newBlockCache(cache_options());
+
+    // 空对象上的Range返回416，当作读到末尾
+    bool ok = false;
+    CHECK(cache->read(minio, "/bucket/empty.bin", 0, 100, &ok).empty());
+    CHECK(ok);
+
+    vector<pair<long long, long long>> ranges = {{0, 10}, {BlockSize, 10}};
+    auto result = cache->read_ranges(minio, "/bucket/empty.bin", ranges, &ok);
+    CHECK(ok);
+    REQUIRE(result.size() == 2);
+    CHECK(result[0].empty() && result[1].empty());
+
+    // 之后写入了数据，不会一直当作空对象
+    auto data = make_object_data(100, 6);
+    server->put_object("bucket", "empty.bin", data);
+    CHECK(cache->read(minio, "/bucket/empty.bin", 0, 100, &ok) == data);
+    CHECK(ok);
+}
+
+TEST(block_cache_transient_error_keeps_cached_blocks){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = make_object_data(8 * BlockSize, 7);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto cache = newBlockCache(cache_options());
+
+    bool ok = false;
+    CHECK(cache->read(minio, "/bucket/data.bin", 0, 100, &ok) == data.substr(0, 100));
+    CHECK(ok);
+
+    // 5xx不是对象被覆盖，不丢弃已经缓存的块，也不整个重读
+    auto options = server->options();
+    options.error_rate = 1.0;
+    server->set_options(options);
+    long long requests_before = cache->stats().requests;
+    cache->read(minio, "/bucket/data.bin", 6 * BlockSize, 100, &ok);
+    CHECK(!ok);
+    CHECK(cache->stats().requests - requests_before == 1);
+    CHECK(cache->stats().objects == 1);
+
+    CHECK(cache->read(minio, "/bucket/data.bin", 0, 100, &ok) == data.substr(0, 100));
+    CHECK(ok);
+    CHECK(cache->stats().requests - requests_before == 1);
+}
+
+TEST(block_cache_is_opt_in){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = make_object_data(2 * BlockSize, 8);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    CHECK(minio.block_cache() == nullptr);
+
+    bool ok = false;
+    CHECK(minio.read_at("/bucket/data.bin", 10, 100, &ok) == data.substr(10, 100));
+    CHECK(ok);
+
+    auto cache = newBlockCache(cache_options());
+    minio.set_block_cache(cache);
+    CHECK(minio.read_at("/bucket/data.bin", 10, 100, &ok) == data.substr(10, 100));
+    CHECK(minio.read_at("/bucket/data.bin", 200, 100, &ok) == data.substr(200, 100));
+    CHECK(ok);
+    CHECK(cache->stats().requests == 1);
+    CHECK(cache->stats().hits == 1);
+}
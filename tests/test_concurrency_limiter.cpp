@@ -0,0 +1,123 @@
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "unit_test.hpp"
+#include "concurrency_limiter.hpp"
+
+using namespace std;
+
+// 用满许可再全部成功归还，在途不少于一半时每次归还增加1/limit，一轮增加0.5到1
+static void run_full_round(shared_ptr<ConcurrencyLimiter>& limiter, long long latency_us){
+    int n = (int)limiter->state().limit;
+    for(int i = 0; i < n; ++i)
+        limiter->acquire();
+    for(int i = 0; i < n; ++i)
+        limiter->release(latency_us, LimiterOutcome_Success);
+}
+
+TEST(limiter_additive_increase){
+
+    auto limiter = newConcurrencyLimiter(4, 1, 16);
+    for(int round = 0; round < 8; ++round)
+        run_full_round(limiter, 1000);
+
+    auto s = limiter->state();
+    CHECK(s.limit > 4 + 8 * 0.5 && s.limit <= 4 + 8);
+    CHECK(s.inflight == 0);
+    CHECK(s.min_latency_us == 1000);
+
+    // 不会超过max_limit
+    for(int round = 0; round < 64; ++round)
+        run_full_round(limiter, 1000);
+    CHECK(limiter->state().limit == 16);
+}
+
+TEST(limiter_idle_does_not_grow){
+
+    // 许可没有用满一半时，成功不增长limit
+    auto limiter = newConcurrencyLimiter(10, 1, 64);
+    for(int i = 0; i < 200; ++i){
+        limiter->acquire();
+        limiter->release(1000, LimiterOutcome_Success);
+    }
+    CHECK(limiter->state().limit == 10);
+}
+
+TEST(limiter_decrease_once_per_latency_window){
+
+    auto limiter = newConcurrencyLimiter(20, 2, 64);
+
+    // 平滑延迟为1秒，1秒内并发的多个失败只算一次拥塞
+    limiter->acquire();
+    limiter->release(1000000, LimiterOutcome_Success);
+
+    for(int i = 0; i < 3; ++i){
+        limiter->acquire();
+        limiter->release(0, LimiterOutcome_Dropped);
+    }
+
+    auto s = limiter->state();
+    CHECK(s.total_drops == 3);
+    CHECK(s.limit > 13.9 && s.limit < 14.1);
+}
+
+TEST(limiter_clamps_to_min){
+
+    auto limiter = newConcurrencyLimiter(8, 3, 64);
+    limiter->set_backoff_ratio(0.1);
+    limiter->acquire();
+    limiter->release(0, LimiterOutcome_Dropped);
+    CHECK(limiter->state().limit == 3);
+
+    // 与拥塞无关的失败只归还许可
+    limiter->acquire();
+    limiter->release(0, LimiterOutcome_Ignore);
+    auto s = limiter->state();
+    CHECK(s.limit == 3);
+    CHECK(s.inflight == 0);
+    CHECK(s.total_drops == 1);
+}
+
+TEST(limiter_latency_gradient_backs_off){
+
+    auto limiter = newConcurrencyLimiter(10, 1, 64);
+    limiter->set_latency_tolerance(2.0);
+    limiter->acquire();
+    limiter->release(1000, LimiterOutcome_Success);
+
+    // 延迟升到最小延迟的5倍，平滑延迟超过2倍后开始回退
+    for(int i = 0; i < 20; ++i){
+        limiter->acquire();
+        limiter->release(5000, LimiterOutcome_Success);
+    }
+
+    auto s = limiter->state();
+    CHECK(s.min_latency_us == 1000);
+    CHECK(s.smoothed_latency_us > 2000);
+    CHECK(s.limit < 10);
+}
+
+TEST(limiter_acquire_blocks_until_release){
+
+    auto limiter = newConcurrencyLimiter(1, 1, 1);
+    limiter->acquire();
+
+    atomic<bool> acquired{false};
+    thread waiter([&]{
+        limiter->acquire();
+        acquired = true;
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(50));
+    CHECK(!acquired);
+
+    limiter->release(1000, LimiterOutcome_Success);
+    waiter.join();
+    CHECK(acquired);
+
+    auto s = limiter->state();
+    CHECK(s.inflight == 1);
+    CHECK(s.total_waits == 1);
+    limiter->release(1000, LimiterOutcome_Success);
+}
@@ -0,0 +1,138 @@
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "unit_test.hpp"
+#include "endpoint_router.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+static EndpointRouterOptions router_options(){
+    EndpointRouterOptions options;
+    options.policy = EndpointPolicy_LeastOutstanding;
+    options.eject_after_failures = 3;
+    options.eject_ms = 100;
+    options.health_interval_ms = 0;
+    return options;
+}
+
+// 启动后马上停掉，得到一个拒绝连接的地址
+static string dead_endpoint(){
+    auto server = newMockS3Server();
+    if(server == nullptr) return "";
+    auto endpoint = server->endpoint();
+    server->stop();
+    return endpoint;
+}
+
+TEST(router_ejects_after_consecutive_failures){
+
+    auto router = newEndpointRouter({"http://a", "http://b"}, router_options());
+    REQUIRE(router != nullptr);
+
+    // 中间有一次成功，连续失败次数重新计
+    router->release(router->acquire(1), false);
+    router->release(router->acquire(1), false);
+    router->release(router->acquire(1), true);
+    router->release(router->acquire(1), false);
+    router->release(router->acquire(1), false);
+    CHECK(!router->states()[0].ejected);
+
+    router->release(router->acquire(1), false);
+    auto states = router->states();
+    CHECK(states[0].ejected);
+    CHECK(states[0].ejections == 1);
+    CHECK(states[0].failures == 5);
+
+    // 摘除期间只分配另一个节点，即使要求避开它
+    for(int i = 0; i < 10; ++i){
+        int index = router->acquire(1);
+        CHECK(index == 1);
+        router->release(index, true);
+    }
+
+    // 到期后重新参与分配
+    this_thread::sleep_for(chrono::milliseconds(150));
+    int index = router->acquire(1);
+    CHECK(index == 0);
+    router->release(index, true);
+    CHECK(!router->states()[0].ejected);
+}
+
+TEST(router_all_ejected_returns_earliest){
+
+    auto router = newEndpointRouter({"http://a", "http://b"}, router_options());
+    REQUIRE(router != nullptr);
+
+    for(int i = 0; i < 3; ++i)
+        router->release(router->acquire(1), false);
+    this_thread::sleep_for(chrono::milliseconds(10));
+    for(int i = 0; i < 3; ++i)
+        router->release(router->acquire(0), false);
+
+    auto states = router->states();
+    REQUIRE(states[0].ejected && states[1].ejected);
+
+    int index = router->acquire();
+    CHECK(index == 0);
+    router->release(index, true);
+}
+
+TEST(router_probe_failures_count_toward_ejection){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto dead = dead_endpoint();
+    REQUIRE(!dead.empty());
+
+    auto options = router_options();
+    options.health_interval_ms = 10;
+    options.health_timeout_seconds = 1;
+    options.eject_after_failures = 1000;
+    auto router = newEndpointRouter({server->endpoint(), dead}, options);
+    REQUIRE(router != nullptr);
+
+    // 探活失败多次，但没到阈值，不摘除
+    for(int i = 0; i < 200 && router->states()[1].consecutive_failures < 3; ++i)
+        this_thread::sleep_for(chrono::milliseconds(5));
+
+    auto states = router->states();
+    CHECK(states[1].consecutive_failures >= 3);
+    CHECK(!states[1].ejected);
+    CHECK(!states[0].ejected);
+    CHECK(states[0].consecutive_failures == 0);
+    router->stop();
+
+    // 阈值很小时探活失败会摘除
+    options.eject_after_failures = 2;
+    router = newEndpointRouter({server->endpoint(), dead}, options);
+    REQUIRE(router != nullptr);
+    for(int i = 0; i < 200 && !router->states()[1].ejected; ++i)
+        this_thread::sleep_for(chrono::milliseconds(5));
+    CHECK(router->states()[1].ejected);
+    CHECK(!router->states()[0].ejected);
+}
+
+TEST(router_client_fails_over_to_live_endpoint){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "a.txt", "failover");
+    auto dead = dead_endpoint();
+    REQUIRE(!dead.empty());
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    minio.set_endpoints({dead, server->endpoint()}, router_options());
+
+    // 连接失败的GET换到另一个节点重试，每次都能成功
+    for(int i = 0; i < 10; ++i){
+        bool ok = false;
+        auto data = minio.get_file("/bucket/a.txt", &ok);
+        CHECK(ok);
+        CHECK(data == "failover");
+    }
+    CHECK(minio.endpoint_router()->states()[0].ejected);
+}
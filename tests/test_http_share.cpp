@@ -0,0 +1,50 @@
+#include <thread>
+#include <vector>
+#include <string>
+
+#include "unit_test.hpp"
+#include "http_client.hpp"
+#include "minio_client.hpp"
+#include "metrics_exporter.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+TEST(http_share_counts_transfers_and_connections){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "a.txt", "shared");
+
+    auto share = newHttpShare();
+    MinioClient minio(server->endpoint(), "access", "secret");
+    minio.set_http_share(share);
+    CHECK(minio.http_share() == share);
+
+    // 每个线程复用自己的连接，新建连接数不随请求数增长
+    vector<thread> threads;
+    for(int t = 0; t < 4; ++t){
+        threads.emplace_back([&]{
+            for(int i = 0; i < 10; ++i){
+                bool ok = false;
+                CHECK(minio.get_file("/bucket/a.txt", &ok) == "shared");
+                CHECK(ok);
+            }
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+
+    auto s = share->stats();
+    CHECK(s.transfers == 40);
+    CHECK(s.new_connections >= 1 && s.new_connections <= 8);
+    CHECK(s.tls_handshakes == 0);
+    CHECK(server->stats().connections == s.new_connections);
+
+    // 统计以counter导出
+    auto registry = newMetricsRegistry();
+    minio.register_metrics(registry, "share-test");
+    auto text = registry->render_openmetrics();
+    CHECK(text.find("# TYPE minio_http_share_transfers counter\n") != string::npos);
+    CHECK(text.find("minio_http_share_transfers_total{client=\"share-test\"} 40\n") != string::npos);
+}
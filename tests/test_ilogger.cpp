@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "unit_test.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+// 与日志宏相同的方式序列化参数，再由format_log_args还原
+template<typename... Args>
+static string format_packed(const char* fmt, const Args&... args){
+    char packed[1024];
+    iLogger::LogArgWriter writer;
+    writer.cursor = packed;
+    writer.end = packed + sizeof(packed);
+    iLogger::__log_pack(writer, args...);
+
+    char out[1024];
+    int n = iLogger::format_log_args(fmt, packed, (int)(writer.cursor - packed), out, sizeof(out));
+    return string(out, n);
+}
+
+template<typename... Args>
+static string format_printf(const char* fmt, const Args&... args){
+    char out[1024];
+    snprintf(out, sizeof(out), fmt, args...);
+    return out;
+}
+
+#define CHECK_SAME_AS_PRINTF(fmt, ...) \
+    CHECK(format_packed(fmt, __VA_ARGS__) == format_printf(fmt, __VA_ARGS__))
+
+TEST(format_log_args_matches_printf){
+
+    int i = -42;
+    unsigned int u = 3000000000u;
+    long long ll = -1234567890123LL;
+    size_t z = 123456789;
+    double d = 3.14159265;
+    const char* s = "bucket/key.txt";
+    void* p = (void*)0x7f00dead;
+
+    CHECK_SAME_AS_PRINTF("%d %i", i, i);
+    CHECK_SAME_AS_PRINTF("%u %x %X %o", u, u, u, u);
+    CHECK_SAME_AS_PRINTF("%lld %llu", ll, (unsigned long long)ll);
+    CHECK_SAME_AS_PRINTF("%zu %ld", z, (long)z);
+    CHECK_SAME_AS_PRINTF("%f %.2f %10.3f %-10.1f| %e %g", d, d, d, d, d, d);
+    CHECK_SAME_AS_PRINTF("%s %20s %-20s| %.5s", s, s, s, s);
+    CHECK_SAME_AS_PRINTF("%c%c %5d %-5d| %05d %+d", 'o', 'k', i, i, i, 42);
+    CHECK_SAME_AS_PRINTF("%*d %-*d| %.*f", 8, i, 8, i, 3, d);
+    CHECK_SAME_AS_PRINTF("%p", p);
+    CHECK_SAME_AS_PRINTF("100%% done %s", s);
+
+    // 参数类型和转换说明不一致时按转换说明截断，与printf一致
+    CHECK(format_packed("%d", (size_t)0x100000005ULL) == "5");
+    CHECK(format_packed("%hhu", 258) == "2");
+}
+
+TEST(format_log_args_strings){
+
+    string text = "std::string value";
+    char array[16] = "char array";
+    CHECK(format_packed("%s|%s|%s", text, array, (const char*)nullptr) == "std::string value|char array|(null)");
+
+    // 参数不够时不越界
+    string out = format_packed("%d %s %d", 1);
+    CHECK(iLogger::begin_with(out, "1 "));
+}
+
+TEST(format_log_args_truncates){
+
+    char packed[64];
+    iLogger::LogArgWriter writer;
+    writer.cursor = packed;
+    writer.end = packed + sizeof(packed);
+    iLogger::__log_pack(writer, "0123456789abcdef", 12345);
+
+    char out[8];
+    int n = iLogger::format_log_args("%s-%d", packed, (int)(writer.cursor - packed), out, sizeof(out));
+    CHECK(n < (int)sizeof(out));
+    CHECK(out[n] == 0);
+    CHECK(strncmp(out, "0123456789abcdef", n) == 0);
+}
+
+static string find_binlog(const string& directory){
+    auto files = iLogger::find_files(directory, "*.binlog");
+    return files.empty() ? "" : files[0];
+}
+
+TEST(decode_binary_log_roundtrip){
+
+    // 日志目录在测试入口里设置为临时目录下的logs
+    string log_directory = unit_test_directory() + "../logs/";
+    iLogger::set_log_level(ILOGGER_INFO);
+    iLogger::set_logger_binary_mode(true);
+
+    long long written = iLogger::logger_stats().written;
+    INFO("upload %s part %d of %zu, %.2f MB/s", "/bucket/big.bin", 7, (size_t)12, 85.5);
+    INFOW("retry %d/%d after %lld us", 1, 3, 250000LL);
+    INFOE("error %s", string("NoSuchKey"));
+
+    iLogger::flush_logger();
+    iLogger::set_logger_binary_mode(false);
+    iLogger::set_log_level(ILOGGER_FATAL);
+    REQUIRE(iLogger::logger_stats().written >= written + 3);
+
+    string binlog = find_binlog(log_directory);
+    REQUIRE(!binlog.empty());
+
+    string decoded_file = unit_test_directory() + "decoded.txt";
+    FILE* f = fopen(decoded_file.c_str(), "wb");
+    REQUIRE(f != nullptr);
+    bool ok = iLogger::decode_binary_log(binlog, f);
+    fclose(f);
+    CHECK(ok);
+
+    auto text = iLogger::load_text_file(decoded_file);
+    CHECK(text.find("upload /bucket/big.bin part 7 of 12, 85.50 MB/s\n") != string::npos);
+    CHECK(text.find("retry 1/3 after 250000 us\n") != string::npos);
+    CHECK(text.find("error NoSuchKey\n") != string::npos);
+    CHECK(text.find("test_ilogger.cpp") != string::npos);
+
+    // 文件尾部被截断（例如进程崩溃）时，已经完整的记录照常还原
+    auto data = iLogger::load_file(binlog);
+    REQUIRE(data.size() > 16);
+    data.resize(data.size() - 5);
+    string truncated = unit_test_directory() + "truncated.binlog";
+    REQUIRE(iLogger::save_file(truncated, data));
+    f = fopen(decoded_file.c_str(), "wb");
+    REQUIRE(f != nullptr);
+    CHECK(iLogger::decode_binary_log(truncated, f));
+    fclose(f);
+    CHECK(iLogger::load_text_file(decoded_file).find("upload /bucket/big.bin part 7 of 12") != string::npos);
+
+    // 不是二进制日志
+    iLogger::save_file(truncated, string("plain text log\n"));
+    f = fopen(decoded_file.c_str(), "wb");
+    REQUIRE(f != nullptr);
+    CHECK(!iLogger::decode_binary_log(truncated, f));
+    fclose(f);
+}
+
+TEST(rotation_splits_by_size_and_keeps_newest){
+
+    // 单独的日志目录，控制台输出重定向到/dev/null
+    string log_directory = unit_test_directory() + "rotation/";
+    iLogger::LogRotation rotation;
+    rotation.max_file_bytes = 1024;
+    rotation.max_files = 3;
+    iLogger::set_logger_rotation(rotation);
+    iLogger::set_logger_save_directory(log_directory);
+    iLogger::set_log_level(ILOGGER_INFO);
+
+    fflush(stdout);
+    int saved_stdout = dup(1);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 1);
+
+    string payload(300, 'x');
+    for(int i = 0; i < 40; ++i){
+        INFO("line %03d %s", i, payload.c_str());
+        // 每条日志单独成批，切分点落在记录之间
+        iLogger::flush_logger();
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, 1);
+    close(saved_stdout);
+    close(devnull);
+
+    iLogger::set_log_level(ILOGGER_FATAL);
+    iLogger::set_logger_rotation(iLogger::LogRotation());
+    iLogger::set_logger_save_directory(unit_test_directory() + "../logs/");
+
+    // 多出的文件由后台线程删除
+    vector<string> files;
+    for(int i = 0; i < 500; ++i){
+        files = iLogger::find_files(log_directory, "*.txt");
+        if(files.size() <= 3) break;
+        this_thread::sleep_for(chrono::milliseconds(2));
+    }
+    REQUIRE(files.size() == 3);
+
+    bool has_last = false;
+    for(auto& file : files){
+        auto text = iLogger::load_text_file(file);
+        CHECK((long long)text.size() <= rotation.max_file_bytes);
+        CHECK(text.find("line 000 ") == string::npos);
+        if(text.find("line 039 ") != string::npos)
+            has_last = true;
+    }
+    CHECK(has_last);
+}
@@ -0,0 +1,89 @@
+/**
+ * 单元测试入口
+ *   make test                     全部运行
+ *   ./unit_test limiter           只运行名字里包含limiter的用例
+ *
+ * 日志级别设为fatal，避免错误注入的用例刷屏；日志文件写到临时目录，结束时删除
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "unit_test.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+struct UnitTestCase{
+    const char* name;
+    UnitTestFunction fn;
+};
+
+static vector<UnitTestCase>& all_cases(){
+    static vector<UnitTestCase> cases;
+    return cases;
+}
+
+static int g_failures = 0;
+static string g_directory;
+
+UnitTestRegistrar::UnitTestRegistrar(const char* name, UnitTestFunction fn){
+    all_cases().push_back({name, fn});
+}
+
+void unit_test_fail(const char* file, int line, const char* expression){
+    fprintf(stderr, "    %s:%d: %s failed\n", file, line, expression);
+    g_failures++;
+}
+
+string unit_test_directory(){
+    return g_directory;
+}
+
+int main(int argc, char** argv){
+
+    string filter = argc > 1 ? argv[1] : "";
+
+    char root[] = "/tmp/minio-unit-test-XXXXXX";
+    if(mkdtemp(root) == nullptr){
+        fprintf(stderr, "Create temp directory failed\n");
+        return 1;
+    }
+
+    iLogger::set_logger_save_directory(iLogger::format("%s/logs", root));
+    iLogger::set_log_level(ILOGGER_FATAL);
+
+    int passed = 0;
+    int failed = 0;
+    for(auto& item : all_cases()){
+        if(!filter.empty() && strstr(item.name, filter.c_str()) == nullptr)
+            continue;
+
+        g_failures = 0;
+        g_directory = iLogger::format("%s/%s/", root, item.name);
+        iLogger::mkdirs(g_directory);
+
+        auto begin = chrono::steady_clock::now();
+        item.fn();
+        auto cost = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin).count();
+
+        if(g_failures == 0){
+            printf("[  OK  ] %s (%d ms)\n", item.name, (int)cost);
+            passed++;
+        }else{
+            printf("[FAILED] %s (%d ms)\n", item.name, (int)cost);
+            failed++;
+        }
+        fflush(stdout);
+        system(iLogger::format("rm -rf %s", g_directory.c_str()).c_str());
+    }
+
+    printf("%d passed, %d failed\n", passed, failed);
+    iLogger::destroy_logger();
+    system(iLogger::format("rm -rf %s", root).c_str());
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <thread>
+#include <vector>
+
+#include "unit_test.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+TEST(histogram_bucket_bounds){
+
+    for(long long value = 0; value < (1LL << 36); value = value < 64 ? value + 1 : value * 9 / 8 + 1){
+        int index = LatencyHistogram::bucket_index(value);
+        long long lower = LatencyHistogram::bucket_lower(index);
+        long long upper = LatencyHistogram::bucket_upper(index);
+        CHECK(lower <= value && value < upper);
+
+        // 对数线性分桶的相对误差不超过1/8
+        CHECK((upper - lower) * 8 <= max(lower, 1LL) || upper - lower == 1);
+    }
+}
+
+TEST(histogram_percentile){
+
+    LatencyHistogram histogram;
+    for(int value = 1; value <= 1000; ++value)
+        histogram.record(value);
+
+    HistogramSnapshot s;
+    histogram.snapshot(s.counts, s.count, s.sum, s.max);
+    CHECK(s.count == 1000);
+    CHECK(s.sum == 500500);
+    CHECK(s.max == 1000);
+
+    long long p50 = s.percentile(0.5);
+    long long p99 = s.percentile(0.99);
+    CHECK(p50 >= 500 * 7 / 8 && p50 <= 500 * 9 / 8);
+    CHECK(p99 >= 990 * 7 / 8 && p99 <= 1000);
+    CHECK(s.percentile(1.0) <= 1000);
+}
+
+TEST(client_metrics_counts_across_threads){
+
+    auto metrics = newClientMetrics({"GetObject", "PutObject"});
+
+    // 多个线程落在不同的分片上，汇总后不能丢计数
+    vector<thread> threads;
+    for(int t = 0; t < 8; ++t){
+        threads.emplace_back([&, t]{
+            for(int i = 0; i < 1000; ++i){
+                RequestSample sample;
+                sample.operation = t % 2;
+                sample.success = i % 10 != 0;
+                sample.status_code = sample.success ? 200 : 503;
+                sample.reused_connection = i > 0;
+                sample.bytes_down = 100;
+                sample.phase_us[MetricsPhase_Total] = 1000 + i;
+                metrics->record(sample);
+            }
+            metrics->record_retry(t % 2);
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+
+    auto snapshot = metrics->snapshot();
+    REQUIRE(snapshot.operations.size() == 2);
+    for(auto& op : snapshot.operations){
+        CHECK(op.requests == 4000);
+        CHECK(op.errors == 400);
+        CHECK(op.retries == 4);
+        CHECK(op.reused_connections == 4000 - 4);
+        CHECK(op.bytes_down == 400000);
+        CHECK(op.phases[MetricsPhase_Total].count == 4000);
+
+        uint64_t ok = 0, unavailable = 0;
+        for(auto& code : op.status_codes){
+            if(code.first == 200) ok = code.second;
+            if(code.first == 503) unavailable = code.second;
+        }
+        CHECK(ok == 3600);
+        CHECK(unavailable == 400);
+    }
+    CHECK(snapshot.operations[0].name == "GetObject");
+
+    metrics->reset();
+    CHECK(metrics->snapshot().operations[0].requests == 0);
+}
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+
+#include "unit_test.hpp"
+#include "metrics.hpp"
+#include "metrics_exporter.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+TEST(metrics_escape_label){
+    CHECK(metrics_escape_label("plain") == "plain");
+    CHECK(metrics_escape_label("a\"b") == "a\\\"b");
+    CHECK(metrics_escape_label("a\\b") == "a\\\\b");
+    CHECK(metrics_escape_label("a\nb") == "a\\nb");
+}
+
+// 按序列（去掉le的标签）收集直方图的桶，检查累计值单调、+Inf与_count相等
+static bool check_histograms(const string& text, int* series_count){
+
+    map<string, unsigned long long> last_bucket;
+    map<string, unsigned long long> inf_bucket;
+    map<string, unsigned long long> counts;
+    bool ok = true;
+
+    auto lines = iLogger::split_string(text, "\n");
+    for(auto& line : lines){
+        const char* bucket_prefix = "minio_request_duration_seconds_bucket{";
+        const char* count_prefix = "minio_request_duration_seconds_count{";
+
+        if(iLogger::begin_with(line, bucket_prefix)){
+            auto le = line.find(",le=\"");
+            auto close = line.rfind("} ");
+            if(le == string::npos || close == string::npos)
+                return false;
+
+            string series = line.substr(strlen(bucket_prefix), le - strlen(bucket_prefix));
+            string bound = line.substr(le + 5, close - le - 6);
+            unsigned long long value = strtoull(line.c_str() + close + 2, nullptr, 10);
+
+            auto it = last_bucket.find(series);
+            if(it != last_bucket.end() && value < it->second)
+                ok = false;
+            last_bucket[series] = value;
+            if(bound == "+Inf")
+                inf_bucket[series] = value;
+        }else if(iLogger::begin_with(line, count_prefix)){
+            auto close = line.rfind("} ");
+            string series = line.substr(strlen(count_prefix), close - strlen(count_prefix));
+            counts[series] = strtoull(line.c_str() + close + 2, nullptr, 10);
+        }
+    }
+
+    for(auto& item : counts){
+        auto it = inf_bucket.find(item.first);
+        if(it == inf_bucket.end() || it->second != item.second)
+            ok = false;
+    }
+    *series_count = (int)counts.size();
+    return ok && inf_bucket.size() == counts.size();
+}
+
+static RequestSample make_sample(int operation, long long total_us){
+    RequestSample sample;
+    sample.operation = operation;
+    sample.success = true;
+    sample.status_code = 200;
+    sample.bytes_down = 1024;
+    for(int phase = 0; phase < MetricsPhase_Count; ++phase)
+        sample.phase_us[phase] = total_us / (phase + 1);
+    return sample;
+}
+
+TEST(exporter_histogram_consistent){
+
+    auto metrics = newClientMetrics({"GetObject", "PutObject"});
+    auto registry = newMetricsRegistry();
+    registry->add_client("main", metrics);
+
+    for(int i = 0; i < 1000; ++i)
+        metrics->record(make_sample(i % 2, 100 + i * 37));
+
+    int series = 0;
+    auto text = registry->render_openmetrics();
+    CHECK(check_histograms(text, &series));
+    CHECK(series == 2 * MetricsPhase_Count);
+    CHECK(text.find("minio_request_duration_seconds_count{client=\"main\",operation=\"GetObject\",phase=\"total\"} 500\n") != string::npos);
+}
+
+// 模拟并发记录时读到的不一致快照：桶先读、count后读，count比桶的总和大
+class TornClientMetrics : public ClientMetrics{
+public:
+    virtual void record(const RequestSample&) override{}
+    virtual void record_retry(int) override{}
+    virtual void add_inflight(int, int) override{}
+    virtual void reset() override{}
+
+    virtual MetricsSnapshot snapshot() const override{
+        MetricsSnapshot s;
+        OperationStats op;
+        op.name = "GetObject";
+        op.requests = 12;
+        for(auto& h : op.phases){
+            h.counts.assign(LatencyHistogram::BucketCount, 0);
+            h.counts[LatencyHistogram::bucket_index(500)] = 6;
+            h.counts[LatencyHistogram::bucket_index(50000000)] = 4;
+            h.count = 12;
+            h.sum = 6 * 500 + 4 * 50000000LL;
+        }
+        s.operations.push_back(op);
+        return s;
+    }
+};
+
+TEST(exporter_histogram_torn_snapshot){
+
+    auto metrics = make_shared<TornClientMetrics>();
+    auto registry = newMetricsRegistry();
+    registry->add_client("main", metrics);
+
+    int series = 0;
+    auto text = registry->render_openmetrics();
+    CHECK(check_histograms(text, &series));
+    CHECK(series == MetricsPhase_Count);
+    CHECK(text.find("minio_request_duration_seconds_bucket{client=\"main\",operation=\"GetObject\",phase=\"total\",le=\"+Inf\"} 10\n") != string::npos);
+}
+
+TEST(exporter_histogram_monotonic_under_load){
+
+    // 渲染的同时不停记录，每次渲染的+Inf都要等于_count，桶累计值单调
+    auto metrics = newClientMetrics({"GetObject"});
+    auto registry = newMetricsRegistry();
+    registry->add_client("main", metrics);
+
+    atomic<bool> stop{false};
+    vector<thread> writers;
+    for(int t = 0; t < 4; ++t){
+        writers.emplace_back([&, t]{
+            long long value = t + 1;
+            while(!stop){
+                metrics->record(make_sample(0, value));
+                value = value * 7 % 1000003 + 1;
+            }
+        });
+    }
+
+    bool ok = true;
+    for(int i = 0; i < 200 && ok; ++i){
+        int series = 0;
+        ok = check_histograms(registry->render_openmetrics(), &series);
+    }
+    stop = true;
+    for(auto& t : writers)
+        t.join();
+    CHECK(ok);
+}
+
+TEST(exporter_escapes_labels){
+
+    auto metrics = newClientMetrics({"GetObject"});
+    auto registry = newMetricsRegistry();
+    registry->add_client("bad\"name\\with\nnewline", metrics);
+    metrics->record(make_sample(0, 1000));
+
+    auto text = registry->render_openmetrics();
+    CHECK(text.find("client=\"bad\\\"name\\\\with\\nnewline\"") != string::npos);
+    CHECK(text.find("bad\"name") == string::npos);
+
+    // 每一行都是完整的一条样本，标签值里的换行不会把一行拆开
+    for(auto& line : iLogger::split_string(text, "\n")){
+        if(line.empty() || line[0] == '#') continue;
+        CHECK(iLogger::begin_with(line, "minio_"));
+    }
+}
+
+TEST(exporter_counters_and_gauges){
+
+    auto registry = newMetricsRegistry();
+    auto owner = make_shared<int>(0);
+    registry->add_counter("minio_test_hits", "Test hits.", "client=\"a\"", []{return 3.0;}, owner);
+    registry->add_counter("minio_test_hits", "Test hits.", "client=\"b\"", []{return 5.0;}, owner);
+    registry->add_gauge("minio_test_bytes", "Test bytes.", "", []{return 7.0;});
+
+    auto text = registry->render_openmetrics();
+    CHECK(text.find("# TYPE minio_test_hits counter\n") != string::npos);
+    CHECK(text.find("minio_test_hits_total{client=\"a\"} 3\n") != string::npos);
+    CHECK(text.find("minio_test_hits_total{client=\"b\"} 5\n") != string::npos);
+    CHECK(text.find("# TYPE minio_test_bytes gauge\n") != string::npos);
+    CHECK(text.find("minio_test_bytes 7\n") != string::npos);
+
+    // owner释放后counter不再输出，family一起消失
+    owner.reset();
+    text = registry->render_openmetrics();
+    CHECK(text.find("minio_test_hits") == string::npos);
+    CHECK(text.find("minio_test_bytes 7\n") != string::npos);
+}
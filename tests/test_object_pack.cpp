@@ -0,0 +1,133 @@
+#include <string>
+#include <vector>
+
+#include "unit_test.hpp"
+#include "object_pack.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+static string blob_data(int index, size_t size){
+    string data(size, 0);
+    for(size_t i = 0; i < size; ++i)
+        data[i] = (char)(i * 31 + index * 17);
+    return data;
+}
+
+// 10个1000字节的blob，外加一个空blob
+static void upload_pack(MinioClient& minio, const string& remote_path){
+    auto writer = newPackWriter();
+    for(int i = 0; i < 10; ++i)
+        writer->add(iLogger::format("blob%d", i), blob_data(i, 1000));
+    writer->add("empty", string());
+    writer->upload(minio, remote_path);
+}
+
+TEST(pack_roundtrip){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+
+    auto writer = newPackWriter();
+    CHECK(writer->add("a", "first"));
+    CHECK(!writer->add("a", "duplicate"));
+    CHECK(!writer->add(string(70000, 'n'), "name too long"));
+    CHECK(writer->add("b", string()));
+    CHECK(writer->add("c", blob_data(3, 100000)));
+    CHECK(writer->count() == 3);
+    CHECK(writer->size() == 5 + 100000);
+    REQUIRE(writer->upload(minio, "/bucket/test.pack"));
+
+    auto reader = newPackReader(minio, "/bucket/test.pack");
+    REQUIRE(reader != nullptr);
+    REQUIRE(reader->entries().size() == 3);
+    CHECK(reader->contains("c"));
+    CHECK(!reader->contains("d"));
+
+    bool ok = false;
+    CHECK(reader->read("a", &ok) == "first" && ok);
+    CHECK(reader->read("b", &ok).empty() && ok);
+    CHECK(reader->read("c", &ok) == blob_data(3, 100000) && ok);
+
+    reader->read("d", &ok);
+    CHECK(!ok);
+
+    // 不是pack的对象打不开
+    server->put_object("bucket", "plain.txt", "not a pack");
+    CHECK(newPackReader(minio, "/bucket/plain.txt") == nullptr);
+}
+
+TEST(pack_read_many_coalesces){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+    upload_pack(minio, "/bucket/test.pack");
+
+    // 间隔不超过max_gap的合并成一个请求，结果按传入的顺序返回
+    auto reader = newPackReader(minio, "/bucket/test.pack");
+    REQUIRE(reader != nullptr);
+    long long requests_before = server->stats().requests;
+    bool ok = false;
+    auto output = reader->read_many({"blob7", "blob1", "empty", "blob3"}, &ok);
+    CHECK(ok);
+    REQUIRE(output.size() == 4);
+    CHECK(output[0] == blob_data(7, 1000));
+    CHECK(output[1] == blob_data(1, 1000));
+    CHECK(output[2].empty());
+    CHECK(output[3] == blob_data(3, 1000));
+    CHECK(reader->stats().range_requests == 1);
+    CHECK(server->stats().requests - requests_before == 1);
+
+    // 不允许间隔时，只有首尾相接的blob合并
+    PackReaderOptions options;
+    options.max_gap = 0;
+    reader = newPackReader(minio, "/bucket/test.pack", options);
+    REQUIRE(reader != nullptr);
+    output = reader->read_many({"blob1", "blob2", "blob5"}, &ok);
+    CHECK(ok);
+    CHECK(output[2] == blob_data(5, 1000));
+    CHECK(reader->stats().range_requests == 2);
+    CHECK(reader->stats().bytes_fetched == 3000);
+
+    // 单个请求不超过max_span
+    options = PackReaderOptions();
+    options.max_span = 2500;
+    reader = newPackReader(minio, "/bucket/test.pack", options);
+    REQUIRE(reader != nullptr);
+    output = reader->read_many({"blob0", "blob1", "blob2", "blob3", "blob4"}, &ok);
+    CHECK(ok);
+    CHECK(output[4] == blob_data(4, 1000));
+    CHECK(reader->stats().range_requests == 3);
+
+    // 有一个不存在时其余的照常返回
+    output = reader->read_many({"blob0", "missing"}, &ok);
+    CHECK(!ok);
+    CHECK(output[0] == blob_data(0, 1000));
+    CHECK(output[1].empty());
+}
+
+TEST(pack_detects_corruption){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+    upload_pack(minio, "/bucket/test.pack");
+
+    string data;
+    REQUIRE(server->get_object("bucket", "test.pack", data));
+    data[2500] ^= 1;
+    server->put_object("bucket", "test.pack", data);
+
+    auto reader = newPackReader(minio, "/bucket/test.pack");
+    REQUIRE(reader != nullptr);
+    bool ok = true;
+    auto output = reader->read_many({"blob1", "blob2", "blob3"}, &ok);
+    CHECK(!ok);
+    CHECK(output[0] == blob_data(1, 1000));
+    CHECK(output[1].empty());
+    CHECK(output[2] == blob_data(3, 1000));
+}
@@ -0,0 +1,99 @@
+#include <string>
+
+#include "unit_test.hpp"
+#include "object_reader.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+static string object_data(size_t size, int seed){
+    string data(size, 0);
+    for(size_t i = 0; i < size; ++i)
+        data[i] = (char)(i * 131 + seed * 7);
+    return data;
+}
+
+static ObjectReaderOptions small_chunks(){
+    ObjectReaderOptions options;
+    options.chunk_size = 4096;
+    options.min_read_ahead = 1;
+    options.max_read_ahead = 4;
+    return options;
+}
+
+TEST(object_reader_sequential_and_seek){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = object_data(10 * 4096 + 123, 1);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto reader = newObjectReader(minio, "/bucket/data.bin", small_chunks());
+    REQUIRE(reader != nullptr);
+    CHECK(reader->size() == (long long)data.size());
+    CHECK(!reader->etag().empty());
+
+    // 每次读的长度和块大小不对齐
+    string output;
+    char buffer[1000];
+    bool ok = false;
+    size_t n = 0;
+    while((n = reader->read(buffer, sizeof(buffer), &ok)) > 0)
+        output.append(buffer, n);
+    CHECK(ok);
+    CHECK(output == data);
+    CHECK(reader->tell() == (long long)data.size());
+    CHECK(reader->stats().chunks == 11);
+
+    REQUIRE(reader->seek(5 * 4096 - 10));
+    n = reader->read(buffer, 100, &ok);
+    CHECK(ok);
+    CHECK(n == 10);
+    CHECK(string(buffer, n) == data.substr(5 * 4096 - 10, 10));
+    CHECK(!reader->seek((long long)data.size() + 1));
+}
+
+TEST(object_reader_empty_object){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    server->put_object("bucket", "empty.bin", "");
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto reader = newObjectReader(minio, "/bucket/empty.bin", small_chunks());
+    REQUIRE(reader != nullptr);
+    CHECK(reader->size() == 0);
+
+    char buffer[16];
+    bool ok = false;
+    CHECK(reader->read(buffer, sizeof(buffer), &ok) == 0);
+    CHECK(ok);
+
+    // 不存在的对象仍然打开失败
+    CHECK(newObjectReader(minio, "/bucket/missing.bin", small_chunks()) == nullptr);
+}
+
+TEST(object_reader_fails_when_object_changes){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    auto data = object_data(10 * 4096, 2);
+    server->put_object("bucket", "data.bin", data);
+
+    MinioClient minio(server->endpoint(), "access", "secret");
+    auto options = small_chunks();
+    options.max_read_ahead = 1;
+    auto reader = newObjectReader(minio, "/bucket/data.bin", options);
+    REQUIRE(reader != nullptr);
+
+    // 覆盖之后，跳到还没有预读的块，带If-Match的请求返回412
+    server->put_object("bucket", "data.bin", object_data(10 * 4096, 3));
+    REQUIRE(reader->seek(8 * 4096));
+
+    char buffer[100];
+    bool ok = true;
+    CHECK(reader->read(buffer, sizeof(buffer), &ok) == 0);
+    CHECK(!ok);
+}
@@ -0,0 +1,40 @@
+#include <chrono>
+
+#include "unit_test.hpp"
+#include "rate_limiter.hpp"
+
+using namespace std;
+
+TEST(token_bucket_unlimited){
+
+    auto bucket = newTokenBucket();
+    CHECK(bucket->rate() == 0);
+    for(int i = 0; i < 1000; ++i)
+        CHECK(bucket->acquire(1e9) == 0);
+}
+
+TEST(token_bucket_burst_then_wait){
+
+    // 桶初始是满的，burst以内不等待，透支的部分按速率等待
+    auto bucket = newTokenBucket(1000, 100);
+    CHECK(bucket->acquire(100) == 0);
+
+    long long wait_us = bucket->acquire(50);
+    CHECK(wait_us > 40000 && wait_us <= 50000);
+}
+
+TEST(token_bucket_rate){
+
+    auto bucket = newTokenBucket(10000, 1000);
+    bucket->acquire(1000);
+
+    auto begin = chrono::steady_clock::now();
+    for(int i = 0; i < 5; ++i)
+        bucket->acquire(1000);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    CHECK(seconds >= 0.45);
+
+    // 运行时切回不限速
+    bucket->set_rate(0);
+    CHECK(bucket->acquire(1e9) == 0);
+}
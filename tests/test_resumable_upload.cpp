@@ -0,0 +1,150 @@
+#include <string>
+
+#include "unit_test.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+static const long long PartSize = 5 * 1024 * 1024;
+
+static string make_file_data(size_t size, int seed){
+    string data(size, 0);
+    for(size_t i = 0; i < size; ++i)
+        data[i] = (char)((i * 2654435761u + seed) >> 7);
+    return data;
+}
+
+static MinioResumableOptions resumable_options(){
+    MinioResumableOptions options;
+    options.part_size = PartSize;
+    options.concurrency = 2;
+    return options;
+}
+
+// 与upload_file_resumable写出的格式相同
+static string upload_journal_header(const string& remote_path, const string& file, long long part_size, const string& upload_id){
+    return iLogger::format("minio-upload 1\nremote %s\nfile %lld %lld %lld\nupload_id %s\n",
+        remote_path.c_str(), iLogger::file_size(file), (long long)iLogger::last_modify(file), part_size, upload_id.c_str());
+}
+
+TEST(resumable_upload_skips_uploaded_parts){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+
+    string file = unit_test_directory() + "big.bin";
+    auto data = make_file_data(2 * PartSize + 1000, 1);
+    REQUIRE(iLogger::save_file(file, data));
+
+    // 模拟崩溃：分片1、2都已经上传，但记录里只来得及写下分片1，最后一行只写了一半
+    auto upload_id = server->create_upload("bucket", "big.bin");
+    auto etag1 = server->put_part(upload_id, 1, data.substr(0, PartSize));
+    server->put_part(upload_id, 2, data.substr(PartSize, PartSize));
+    string journal = upload_journal_header("/bucket/big.bin", file, PartSize, upload_id) +
+        "part 1 " + etag1 + "\npart 3 0123";
+    REQUIRE(iLogger::save_file(file + ".minio-upload", journal));
+
+    long long received_before = server->stats().bytes_received;
+    CHECK(minio.upload_file_resumable("/bucket/big.bin", file, resumable_options()));
+
+    // 只重传了最后一片
+    long long received = server->stats().bytes_received - received_before;
+    CHECK(received >= 1000 && received < 64 * 1024);
+
+    string uploaded;
+    CHECK(server->get_object("bucket", "big.bin", uploaded));
+    CHECK(uploaded == data);
+    CHECK(!server->has_upload(upload_id));
+    CHECK(!iLogger::exists(file + ".minio-upload"));
+    CHECK(!iLogger::exists(file + ".minio-upload.tmp"));
+}
+
+TEST(resumable_upload_reuploads_mismatched_parts){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+
+    string file = unit_test_directory() + "big.bin";
+    auto data = make_file_data(2 * PartSize + 1000, 2);
+    REQUIRE(iLogger::save_file(file, data));
+
+    // 服务端的分片2内容不对（例如文件在两次上传之间被改过又改回大小），MD5不一致要重传
+    auto upload_id = server->create_upload("bucket", "big.bin");
+    auto etag1 = server->put_part(upload_id, 1, data.substr(0, PartSize));
+    server->put_part(upload_id, 2, string(PartSize, 'x'));
+    REQUIRE(iLogger::save_file(file + ".minio-upload",
+        upload_journal_header("/bucket/big.bin", file, PartSize, upload_id) + "part 1 " + etag1 + "\n"));
+
+    long long received_before = server->stats().bytes_received;
+    CHECK(minio.upload_file_resumable("/bucket/big.bin", file, resumable_options()));
+    CHECK(server->stats().bytes_received - received_before > PartSize);
+
+    string uploaded;
+    CHECK(server->get_object("bucket", "big.bin", uploaded));
+    CHECK(uploaded == data);
+}
+
+TEST(resumable_upload_discards_stale_journal){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+
+    string file = unit_test_directory() + "big.bin";
+    auto data = make_file_data(PartSize + 1000, 3);
+    REQUIRE(iLogger::save_file(file, data));
+
+    // 记录对应的分片大小不同，旧的上传要abort，不留在服务端
+    auto stale_id = server->create_upload("bucket", "big.bin");
+    server->put_part(stale_id, 1, data.substr(0, 2 * PartSize));
+    REQUIRE(iLogger::save_file(file + ".minio-upload", upload_journal_header("/bucket/big.bin", file, 2 * PartSize, stale_id)));
+
+    CHECK(minio.upload_file_resumable("/bucket/big.bin", file, resumable_options()));
+    CHECK(!server->has_upload(stale_id));
+
+    string uploaded;
+    CHECK(server->get_object("bucket", "big.bin", uploaded));
+    CHECK(uploaded == data);
+
+    // 服务端已经没有这个上传（过期或者被清理），重新开始
+    REQUIRE(iLogger::save_file(file + ".minio-upload", upload_journal_header("/bucket/big.bin", file, PartSize, "mock-upload-expired")));
+    CHECK(minio.upload_file_resumable("/bucket/big.bin", file, resumable_options()));
+    CHECK(server->get_object("bucket", "big.bin", uploaded));
+    CHECK(uploaded == data);
+    CHECK(!iLogger::exists(file + ".minio-upload"));
+}
+
+TEST(resumable_upload_interrupted_then_resumed){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+
+    string file = unit_test_directory() + "big.bin";
+    auto data = make_file_data(2 * PartSize + 1000, 4);
+    REQUIRE(iLogger::save_file(file, data));
+
+    // 服务端全部失败：记录保留，已经创建的上传留给下一次续传
+    auto upload_id = server->create_upload("bucket", "big.bin");
+    REQUIRE(iLogger::save_file(file + ".minio-upload", upload_journal_header("/bucket/big.bin", file, PartSize, upload_id)));
+
+    auto opt = resumable_options();
+    opt.max_retries = 0;
+    MockS3Options failing;
+    failing.error_rate = 1;
+    server->set_options(failing);
+    CHECK(!minio.upload_file_resumable("/bucket/big.bin", file, opt));
+    CHECK(iLogger::exists(file + ".minio-upload"));
+    CHECK(server->has_upload(upload_id));
+
+    server->set_options(MockS3Options());
+    CHECK(minio.upload_file_resumable("/bucket/big.bin", file, opt));
+
+    string uploaded;
+    CHECK(server->get_object("bucket", "big.bin", uploaded));
+    CHECK(uploaded == data);
+}
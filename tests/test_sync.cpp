@@ -0,0 +1,116 @@
+#include <unistd.h>
+#include <string>
+
+#include "unit_test.hpp"
+#include "minio_client.hpp"
+#include "mock_s3_server.hpp"
+#include "ilogger.hpp"
+
+using namespace std;
+
+TEST(sync_uploads_changed_files){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+    REQUIRE(minio.make_bucket("bucket"));
+
+    auto dir = unit_test_directory() + "d/";
+    REQUIRE(iLogger::save_file(dir + "a.jpg", string("jpeg data")));
+    REQUIRE(iLogger::save_file(dir + "sub/b.txt", string("text")));
+
+    auto result = minio.sync(dir, "/bucket/m");
+    CHECK(result.success);
+    CHECK(result.local_files == 2);
+    CHECK(result.uploaded == 2);
+    CHECK(result.uploaded_bytes == 9 + 4);
+
+    string data;
+    CHECK(server->get_object("bucket", "m/a.jpg", data) && data == "jpeg data");
+    CHECK(server->get_object("bucket", "m/sub/b.txt", data) && data == "text");
+
+    // 没有变化的不再上传，大小变了的重新上传
+    result = minio.sync(dir, "/bucket/m");
+    CHECK(result.success);
+    CHECK(result.remote_objects == 2);
+    CHECK(result.unchanged == 2);
+    CHECK(result.uploaded == 0);
+
+    REQUIRE(iLogger::save_file(dir + "a.jpg", string("new jpeg data")));
+    MinioSyncOptions options;
+    options.compare = MinioSyncCompare_Checksum;
+    result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.success);
+    CHECK(result.uploaded == 1);
+    CHECK(result.unchanged == 1);
+    CHECK(server->get_object("bucket", "m/a.jpg", data) && data == "new jpeg data");
+}
+
+TEST(sync_deletes_extraneous_objects){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+    REQUIRE(minio.make_bucket("bucket"));
+
+    auto dir = unit_test_directory() + "d/";
+    REQUIRE(iLogger::save_file(dir + "a.txt", string("a")));
+    REQUIRE(iLogger::save_file(dir + "b.txt", string("b")));
+    server->put_object("bucket", "other/c.txt", "outside the prefix");
+    REQUIRE(minio.sync(dir, "/bucket/m").uploaded == 2);
+
+    unlink((dir + "b.txt").c_str());
+
+    // 不开delete_extraneous时不删除；dry_run只统计
+    MinioSyncOptions options;
+    auto result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.deleted == 0);
+
+    options.delete_extraneous = true;
+    options.dry_run = true;
+    result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.deleted == 1);
+
+    string data;
+    CHECK(server->get_object("bucket", "m/b.txt", data));
+
+    options.dry_run = false;
+    result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.success);
+    CHECK(result.deleted == 1);
+    CHECK(!server->get_object("bucket", "m/b.txt", data));
+    CHECK(server->get_object("bucket", "m/a.txt", data));
+    CHECK(server->get_object("bucket", "other/c.txt", data));
+}
+
+TEST(sync_filter_limits_deletion){
+
+    auto server = newMockS3Server();
+    REQUIRE(server != nullptr);
+    MinioClient minio(server->endpoint(), "access", "secret");
+    REQUIRE(minio.make_bucket("bucket"));
+
+    auto dir = unit_test_directory() + "d/";
+    REQUIRE(iLogger::save_file(dir + "a.jpg", string("jpeg")));
+    REQUIRE(iLogger::save_file(dir + "b.txt", string("text")));
+    REQUIRE(minio.sync(dir, "/bucket/m").uploaded == 2);
+
+    // 本地的b.txt还在，只是不匹配filter，不能被当作多余的对象删除
+    MinioSyncOptions options;
+    options.filter = "*.jpg";
+    options.delete_extraneous = true;
+    auto result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.success);
+    CHECK(result.local_files == 1);
+    CHECK(result.deleted == 0);
+
+    string data;
+    CHECK(server->get_object("bucket", "m/b.txt", data));
+
+    // 匹配filter的多余对象照常删除
+    server->put_object("bucket", "m/gone.jpg", "stale");
+    result = minio.sync(dir, "/bucket/m", options);
+    CHECK(result.deleted == 1);
+    CHECK(!server->get_object("bucket", "m/gone.jpg", data));
+    CHECK(server->get_object("bucket", "m/b.txt", data));
+}
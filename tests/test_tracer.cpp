@@ -0,0 +1,35 @@
+#include <thread>
+#include <string>
+
+#include "unit_test.hpp"
+#include "tracer.hpp"
+
+using namespace std;
+
+static int count_of(const string& text, const string& pattern){
+    int count = 0;
+    for(size_t pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos + 1))
+        count++;
+    return count;
+}
+
+TEST(tracer_recycles_rings_of_exited_threads){
+
+    trace_enable(1.0, 64);
+    trace_clear();
+    int rings_before = count_of(trace_export_json(), "\"thread_name\"");
+
+    // 依次起100个短线程，同时最多只有一个线程存活，ring的数量只能增加1
+    for(int i = 0; i < 100; ++i){
+        thread([]{
+            trace_record("unit_test_span", "test", 0, 1, trace_sample());
+        }).join();
+    }
+
+    auto json = trace_export_json();
+    trace_disable();
+    CHECK(count_of(json, "\"thread_name\"") <= rings_before + 1);
+
+    // 退出线程写下的span还在，直到被覆盖
+    CHECK(count_of(json, "\"unit_test_span\"") == 64);
+}
@@ -0,0 +1,35 @@
+#ifndef UNIT_TEST_HPP
+#define UNIT_TEST_HPP
+
+#include <string>
+
+/**
+ * 极简的单元测试，不依赖第三方库
+ *   TEST(name){ ... }     定义并注册一个用例
+ *   CHECK(cond)           失败时打印位置，当前用例记为失败并继续执行
+ *   REQUIRE(cond)         失败时打印位置并结束当前用例
+ * 需要服务端的用例在进程内启动tools/mock_s3_server，不依赖网络和真实集群
+ */
+typedef void (*UnitTestFunction)();
+
+struct UnitTestRegistrar{
+    UnitTestRegistrar(const char* name, UnitTestFunction fn);
+};
+
+void unit_test_fail(const char* file, int line, const char* expression);
+
+// 每个用例独立的临时目录，用例结束后删除
+std::string unit_test_directory();
+
+#define TEST(name)                                                                      \
+    static void unit_test_##name();                                                     \
+    static UnitTestRegistrar unit_test_registrar_##name(#name, unit_test_##name);       \
+    static void unit_test_##name()
+
+#define CHECK(cond)                                                                     \
+    do{ if(!(cond)) unit_test_fail(__FILE__, __LINE__, #cond); }while(0)
+
+#define REQUIRE(cond)                                                                   \
+    do{ if(!(cond)){ unit_test_fail(__FILE__, __LINE__, #cond); return; } }while(0)
+
+#endif // UNIT_TEST_HPP
@@ -0,0 +1,296 @@
+/**
+ * 端到端压测：多线程驱动MinioClient，按比例混合上传和下载，输出吞吐和延迟分位数
+ *   make loadgen                                          默认启动进程内的mock服务器
+ *   ./loadgen --size 1M --concurrency 32 --read-ratio 0.8 --duration 10
+ *   ./loadgen --latency-ms 20 --bandwidth 100M --error-rate 0.01 --limiter 8
+ *   ./loadgen --endpoint http://127.0.0.1:9000 --access-key xxx --secret-key xxx --bucket test
+ *   ./loadgen --record workload.bin                       同时录制访问记录，用replay回放
+ *   ./loadgen --read-ratio 1 --buffer-pool 256M           GET改用get_file_buffer，内存从池里复用
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <random>
+
+#include "minio_client.hpp"
+#include "concurrency_limiter.hpp"
+#include "metrics.hpp"
+#include "workload_recorder.hpp"
+#include "buffer_pool.hpp"
+#include "ilogger.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+struct LoadgenConfig{
+    string endpoint;
+    string access_key = "loadgen";
+    string secret_key = "loadgen";
+    string bucket = "loadgen";
+    size_t object_size = 64 * 1024;
+    int concurrency = 16;
+    double duration_seconds = 10;
+    long long max_ops = 0;
+    double read_ratio = 0.5;
+    int objects = 64;
+    int limiter = 0;
+    string record_file;
+    double buffer_pool_bytes = 0;
+    MockS3Options mock;
+};
+
+enum LoadgenOp : int{
+    LoadgenOp_Put,
+    LoadgenOp_Get,
+    LoadgenOp_Count
+};
+
+static const char* loadgen_op_name(int op){
+    return op == LoadgenOp_Put ? "PUT" : "GET";
+}
+
+struct LoadgenStats{
+    LatencyHistogram latency_us;
+    atomic<long long> errors{0};
+    atomic<long long> bytes{0};
+};
+
+// 支持K/M/G后缀，按1024计算
+static double parse_size(const char* value){
+    char* end = nullptr;
+    double size = strtod(value, &end);
+    switch(end ? toupper(*end) : 0){
+    case 'K': size *= 1024; break;
+    case 'M': size *= 1024 * 1024; break;
+    case 'G': size *= 1024 * 1024 * 1024; break;
+    default: break;
+    }
+    return size;
+}
+
+static void print_usage(){
+    printf(
+        "Usage: loadgen [options]\n"
+        "  --endpoint URL         压测指定的服务器，不指定则启动进程内的mock服务器\n"
+        "  --access-key KEY       默认loadgen\n"
+        "  --secret-key KEY       默认loadgen\n"
+        "  --bucket NAME          默认loadgen\n"
+        "  --size N[K|M|G]        对象大小，默认64K\n"
+        "  --concurrency N        并发线程数，默认16\n"
+        "  --duration SECONDS     压测时长，默认10\n"
+        "  --ops N                总操作数，达到后提前结束，默认不限\n"
+        "  --read-ratio R         GET所占比例0-1，默认0.5\n"
+        "  --objects N            预先写入并循环读写的对象数，默认64\n"
+        "  --limiter N            开启自适应并发限制，初始并发为N\n"
+        "  --record FILE          把压测期间的操作录制到FILE\n"
+        "  --buffer-pool N[K|M|G] GET下载到内存池，N为池最多缓存的字节数\n"
+        "  mock服务器参数：\n"
+        "  --latency-ms N         每个请求的首字节延迟\n"
+        "  --jitter-ms N          叠加的随机延迟\n"
+        "  --bandwidth N[K|M|G]   每个连接的带宽（字节/秒）\n"
+        "  --error-rate R         按概率返回503 SlowDown\n"
+    );
+}
+
+static bool parse_args(int argc, char** argv, LoadgenConfig& config){
+
+    for(int i = 1; i < argc; ++i){
+        string name = argv[i];
+        if(name == "-h" || name == "--help")
+            return false;
+
+        if(i + 1 >= argc){
+            fprintf(stderr, "Missing value for %s\n", name.c_str());
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if(name == "--endpoint")            config.endpoint = value;
+        else if(name == "--access-key")     config.access_key = value;
+        else if(name == "--secret-key")     config.secret_key = value;
+        else if(name == "--bucket")         config.bucket = value;
+        else if(name == "--size")           config.object_size = (size_t)parse_size(value);
+        else if(name == "--concurrency")    config.concurrency = max(1, atoi(value));
+        else if(name == "--duration")       config.duration_seconds = atof(value);
+        else if(name == "--ops")            config.max_ops = atoll(value);
+        else if(name == "--read-ratio")     config.read_ratio = atof(value);
+        else if(name == "--objects")        config.objects = max(1, atoi(value));
+        else if(name == "--limiter")        config.limiter = atoi(value);
+        else if(name == "--record")         config.record_file = value;
+        else if(name == "--buffer-pool")    config.buffer_pool_bytes = parse_size(value);
+        else if(name == "--latency-ms")     config.mock.latency_ms = atoi(value);
+        else if(name == "--jitter-ms")      config.mock.latency_jitter_ms = atoi(value);
+        else if(name == "--bandwidth")      config.mock.bandwidth_bytes_per_second = parse_size(value);
+        else if(name == "--error-rate")     config.mock.error_rate = atof(value);
+        else{
+            fprintf(stderr, "Unknown option %s\n", name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_histogram(const char* name, const LoadgenStats& stats, double seconds){
+
+    HistogramSnapshot h;
+    stats.latency_us.snapshot(h.counts, h.count, h.sum, h.max);
+    if(h.count == 0 && stats.errors == 0)
+        return;
+
+    printf("%-4s %10lld ops %9.1f ops/s %9.2f MB/s  errors %-6lld  mean %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  p999 %8.2f  max %8.2f ms\n",
+        name, (long long)h.count, h.count / seconds, stats.bytes / seconds / 1024 / 1024, stats.errors.load(),
+        h.mean() / 1000.0, h.percentile(0.5) / 1000.0, h.percentile(0.9) / 1000.0,
+        h.percentile(0.99) / 1000.0, h.percentile(0.999) / 1000.0, h.max / 1000.0
+    );
+}
+
+int main(int argc, char** argv){
+
+    LoadgenConfig config;
+    if(!parse_args(argc, argv, config)){
+        print_usage();
+        return 1;
+    }
+
+    // 注入错误时每个失败请求都会打印日志，压测时只保留fatal，失败数在报告里统计
+    iLogger::set_log_level(ILOGGER_FATAL);
+
+    shared_ptr<MockS3Server> mock;
+    if(config.endpoint.empty()){
+        mock = newMockS3Server(config.mock);
+        if(mock == nullptr){
+            fprintf(stderr, "Start mock server failed\n");
+            return 1;
+        }
+        config.endpoint = mock->endpoint();
+    }
+
+    MinioClient minio(config.endpoint, config.access_key, config.secret_key);
+    if(config.limiter > 0)
+        minio.set_concurrency_limit(config.limiter);
+
+    if(config.buffer_pool_bytes > 0)
+        minio.set_buffer_pool(newBufferPool((size_t)config.buffer_pool_bytes));
+
+    // 预先写入对象，GET一开始就有数据可读
+    string payload(config.object_size, 0);
+    mt19937 fill_random(7);
+    for(auto& c : payload)
+        c = (char)fill_random();
+
+    auto object_path = [&](int index){
+        return iLogger::format("/%s/loadgen/object-%05d", config.bucket.c_str(), index);
+    };
+
+    if(mock){
+        // 直接写入mock的存储，不受注入的延迟和错误影响
+        for(int i = 0; i < config.objects; ++i)
+            mock->put_object(config.bucket, object_path(i).substr(config.bucket.size() + 2), payload);
+    }else{
+        minio.make_bucket(config.bucket);
+        for(int i = 0; i < config.objects; ++i){
+            if(!minio.upload_filedata(object_path(i), payload)){
+                fprintf(stderr, "Prepare %s failed\n", object_path(i).c_str());
+                return 1;
+            }
+        }
+    }
+
+    shared_ptr<WorkloadRecorder> recorder;
+    if(!config.record_file.empty()){
+        recorder = newWorkloadRecorder(config.record_file);
+        if(recorder == nullptr){
+            fprintf(stderr, "Create %s failed\n", config.record_file.c_str());
+            return 1;
+        }
+        minio.set_workload_recorder(recorder);
+    }
+
+    printf("endpoint %s, object size %lld bytes, concurrency %d, read ratio %.2f, objects %d\n",
+        config.endpoint.c_str(), (long long)config.object_size, config.concurrency, config.read_ratio, config.objects);
+
+    LoadgenStats stats[LoadgenOp_Count];
+    atomic<long long> issued{0};
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds((long long)(config.duration_seconds * 1e6));
+
+    auto worker = [&](int thread_index){
+        mt19937_64 random(thread_index * 7919 + 1);
+        uniform_real_distribution<double> mix(0, 1);
+        uniform_int_distribution<int> pick(0, config.objects - 1);
+
+        while(chrono::steady_clock::now() < deadline){
+            if(config.max_ops > 0 && issued.fetch_add(1) >= config.max_ops)
+                break;
+
+            int op = mix(random) < config.read_ratio ? LoadgenOp_Get : LoadgenOp_Put;
+            auto path = object_path(pick(random));
+
+            bool success = false;
+            size_t bytes = 0;
+            auto begin = chrono::steady_clock::now();
+            if(op == LoadgenOp_Get && minio.buffer_pool()){
+                auto data = minio.get_file_buffer(path, &success);
+                bytes = data.size();
+            }else if(op == LoadgenOp_Get){
+                auto data = minio.get_file(path, &success);
+                bytes = data.size();
+            }else{
+                success = minio.upload_filedata(path, payload.data(), payload.size());
+                bytes = payload.size();
+            }
+            auto latency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+
+            auto& s = stats[op];
+            if(success){
+                s.latency_us.record(latency);
+                s.bytes += bytes;
+            }else{
+                s.errors++;
+            }
+        }
+    };
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> threads;
+    for(int i = 0; i < config.concurrency; ++i)
+        threads.emplace_back(worker, i);
+
+    for(auto& t : threads)
+        t.join();
+
+    double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count() / 1e6;
+    printf("elapsed %.2f s\n", seconds);
+    for(int op = 0; op < LoadgenOp_Count; ++op)
+        print_histogram(loadgen_op_name(op), stats[op], seconds);
+
+    if(recorder){
+        recorder->close();
+        printf("recorded %lld operations to %s\n", recorder->records(), config.record_file.c_str());
+    }
+
+    if(config.limiter > 0){
+        auto state = minio.concurrency_limiter()->state();
+        printf("limiter: limit %.1f, min latency %.2f ms, drops %lld, waits %lld\n",
+            state.limit, state.min_latency_us / 1000.0, state.total_drops, state.total_waits);
+    }
+
+    if(minio.buffer_pool()){
+        auto s = minio.buffer_pool()->stats();
+        printf("buffer pool: %lld hits, %lld misses, %lld discards, %.2f MB cached, high water %.2f MB\n",
+            s.hits, s.misses, s.discards, s.cached_bytes / 1024.0 / 1024.0, s.high_water_bytes / 1024.0 / 1024.0);
+    }
+
+    if(mock){
+        auto s = mock->stats();
+        printf("mock: %lld requests, %lld connections, %lld injected errors, %.2f MB received, %.2f MB sent\n",
+            s.requests, s.connections, s.injected_errors, s.bytes_received / 1024.0 / 1024.0, s.bytes_sent / 1024.0 / 1024.0);
+        mock->stop();
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * 把iLogger二进制模式（set_logger_binary_mode）写出的.binlog还原成文本
+ *   make log_decoder
+ *   ./log_decoder logs/2021-07-28.binlog             输出到stdout
+ *   ./log_decoder logs/2021-07-28.binlog --color     保留控制台颜色
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ilogger.hpp"
+
+int main(int argc, char** argv){
+
+    const char* file = nullptr;
+    bool color = false;
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "--color") == 0)
+            color = true;
+        else
+            file = argv[i];
+    }
+
+    if(file == nullptr){
+        printf("Usage: log_decoder file.binlog [--color]\n");
+        return 1;
+    }
+    return iLogger::decode_binary_log(file, stdout, color) ? 0 : 1;
+}
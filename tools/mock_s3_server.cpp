@@ -0,0 +1,989 @@
+#include "mock_s3_server.hpp"
+#include "ilogger.hpp"
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/evp.h>
+
+using namespace std;
+
+struct MockObject{
+    string data;
+    string etag;
+    time_t last_modified = 0;
+};
+
+struct MockUpload{
+    string bucket;
+    string key;
+    map<int, MockObject> parts;
+};
+
+struct MockRequest{
+    string method;
+    string path;                        // 已经url解码，不含query
+    map<string, string> query;          // 已经url解码
+    map<string, string> headers;        // key为小写
+    string body;
+    bool keep_alive = true;
+};
+
+struct MockResponse{
+    int status = 200;
+    vector<pair<string, string>> headers;
+    string body;
+    bool head_only = false;            // HEAD请求，Content-Length为body大小但不发送body
+    bool truncate = false;             // 注入故障，发送一半响应体后断开
+};
+
+static string md5_hex(const void* data, size_t size){
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_Digest(data, size, digest, &length, EVP_md5(), nullptr);
+
+    static const char* hex = "0123456789abcdef";
+    string out;
+    for(unsigned int i = 0; i < length; ++i){
+        out.push_back(hex[digest[i] >> 4]);
+        out.push_back(hex[digest[i] & 0xF]);
+    }
+    return out;
+}
+
+static string md5_binary(const string& data){
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_Digest(data.data(), data.size(), digest, &length, EVP_md5(), nullptr);
+    return string((char*)digest, length);
+}
+
+static string http_date(time_t t){
+    tm g;
+    gmtime_r(&t, &g);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &g);
+    return buffer;
+}
+
+static string iso8601(time_t t){
+    tm g;
+    gmtime_r(&t, &g);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S.000Z", &g);
+    return buffer;
+}
+
+static string url_decode(const string& value){
+    string out;
+    out.reserve(value.size());
+    for(size_t i = 0; i < value.size(); ++i){
+        char c = value[i];
+        if(c == '%' && i + 2 < value.size()){
+            char hex[3] = {value[i + 1], value[i + 2], 0};
+            out.push_back((char)strtol(hex, nullptr, 16));
+            i += 2;
+        }else if(c == '+'){
+            out.push_back(' ');
+        }else{
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+static string xml_escape(const string& value){
+    string out;
+    out.reserve(value.size());
+    for(char c : value){
+        switch(c){
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        case '\'': out += "&apos;"; break;
+        default: out.push_back(c); break;
+        }
+    }
+    return out;
+}
+
+static string lower(string value){
+    for(auto& c : value) c = (char)tolower(c);
+    return value;
+}
+
+static MockResponse error_response(int status, const char* code, const string& message, const string& resource){
+    MockResponse r;
+    r.status = status;
+    r.headers.emplace_back("Content-Type", "application/xml");
+    r.body = iLogger::format(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Error><Code>%s</Code><Message>%s</Message><Resource>%s</Resource><RequestId>mock</RequestId></Error>",
+        code, xml_escape(message).c_str(), xml_escape(resource).c_str()
+    );
+    return r;
+}
+
+static const char* status_text(int status){
+    switch(status){
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 412: return "Precondition Failed";
+    case 416: return "Requested Range Not Satisfiable";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+class MockS3ServerImpl : public MockS3Server{
+public:
+    virtual ~MockS3ServerImpl(){
+        stop();
+    }
+
+    bool start(const MockS3Options& options){
+
+        options_ = options;
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if(listen_fd_ < 0){
+            INFOE("Mock S3 create socket failed: %s", strerror(errno));
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(options.port);
+        inet_pton(AF_INET, options.bind_address.c_str(), &addr.sin_addr);
+        if(::bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd_, 512) != 0){
+            INFOE("Mock S3 bind %s:%d failed: %s", options.bind_address.c_str(), options.port, strerror(errno));
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, (sockaddr*)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+
+        keep_run_ = true;
+        accept_thread_ = thread(&MockS3ServerImpl::accept_job, this);
+        return true;
+    }
+
+    virtual int port() const override{
+        return port_;
+    }
+
+    virtual string endpoint() const override{
+        lock_guard<mutex> l(options_lock_);
+        return iLogger::format("http://%s:%d", options_.bind_address.c_str(), port_);
+    }
+
+    virtual void set_options(const MockS3Options& options) override{
+        lock_guard<mutex> l(options_lock_);
+        options_.latency_ms = options.latency_ms;
+        options_.latency_jitter_ms = options.latency_jitter_ms;
+        options_.bandwidth_bytes_per_second = options.bandwidth_bytes_per_second;
+        options_.error_rate = options.error_rate;
+        options_.error_status = options.error_status;
+        options_.truncate_rate = options.truncate_rate;
+        options_.auto_create_bucket = options.auto_create_bucket;
+    }
+
+    virtual MockS3Options options() const override{
+        lock_guard<mutex> l(options_lock_);
+        return options_;
+    }
+
+    virtual void put_object(const string& bucket, const string& key, const string& data) override{
+        lock_guard<mutex> l(store_lock_);
+        buckets_[bucket][key] = make_object(data);
+    }
+
+    virtual bool get_object(const string& bucket, const string& key, string& data) override{
+        lock_guard<mutex> l(store_lock_);
+        auto b = buckets_.find(bucket);
+        if(b == buckets_.end()) return false;
+
+        auto o = b->second.find(key);
+        if(o == b->second.end()) return false;
+
+        data = o->second.data;
+        return true;
+    }
+
+    virtual string create_upload(const string& bucket, const string& key) override{
+        lock_guard<mutex> l(store_lock_);
+        buckets_[bucket];
+
+        auto upload_id = iLogger::format("mock-upload-%lld-%lld", (long long)time(nullptr), ++upload_sequence_);
+        MockUpload& upload = uploads_[upload_id];
+        upload.bucket = bucket;
+        upload.key = key;
+        return upload_id;
+    }
+
+    virtual string put_part(const string& upload_id, int number, const string& data) override{
+        lock_guard<mutex> l(store_lock_);
+        auto it = uploads_.find(upload_id);
+        if(it == uploads_.end())
+            return "";
+
+        it->second.parts[number] = make_object(data);
+        return md5_hex(data.data(), data.size());
+    }
+
+    virtual bool has_upload(const string& upload_id) override{
+        lock_guard<mutex> l(store_lock_);
+        return uploads_.count(upload_id) > 0;
+    }
+
+    virtual MockS3Stats stats() const override{
+        MockS3Stats s;
+        s.requests = requests_;
+        s.injected_errors = injected_errors_;
+        s.truncated_responses = truncated_responses_;
+        s.bytes_received = bytes_received_;
+        s.bytes_sent = bytes_sent_;
+        s.connections = connections_;
+        return s;
+    }
+
+    virtual void stop() override{
+
+        if(!keep_run_.exchange(false))
+            return;
+
+        accept_thread_.join();
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+
+        vector<thread> workers;
+        {
+            lock_guard<mutex> l(connection_lock_);
+            for(int fd : connection_fds_)
+                shutdown(fd, SHUT_RDWR);
+            workers.swap(workers_);
+        }
+
+        for(auto& t : workers)
+            t.join();
+    }
+
+private:
+    static MockObject make_object(const string& data){
+        MockObject o;
+        o.data = data;
+        o.etag = "\"" + md5_hex(data.data(), data.size()) + "\"";
+        o.last_modified = time(nullptr);
+        return o;
+    }
+
+    void accept_job(){
+
+        while(keep_run_){
+            pollfd pfd{listen_fd_, POLLIN, 0};
+            if(poll(&pfd, 1, 100) <= 0)
+                continue;
+
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if(fd < 0)
+                continue;
+
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            connections_++;
+
+            lock_guard<mutex> l(connection_lock_);
+            connection_fds_.insert(fd);
+            workers_.emplace_back(&MockS3ServerImpl::connection_job, this, fd);
+        }
+    }
+
+    void connection_job(int fd){
+
+        string buffer;
+        while(keep_run_){
+            MockRequest request;
+            if(!read_request(fd, buffer, request))
+                break;
+
+            requests_++;
+            auto response = handle(request);
+            if(!send_response(fd, request, response) || !request.keep_alive)
+                break;
+        }
+
+        {
+            lock_guard<mutex> l(connection_lock_);
+            connection_fds_.erase(fd);
+        }
+        ::close(fd);
+    }
+
+    // 读够n个字节到buffer里，带宽限制也作用于上行
+    bool fill(int fd, string& buffer, size_t n){
+        char chunk[64 * 1024];
+        while(buffer.size() < n){
+            pollfd pfd{fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, 200);
+            if(!keep_run_) return false;
+            if(ready <= 0) continue;
+
+            size_t want = min(sizeof(chunk), throttle_chunk());
+            int got = recv(fd, chunk, want, 0);
+            if(got <= 0) return false;
+
+            buffer.append(chunk, got);
+            bytes_received_ += got;
+            throttle(got);
+        }
+        return true;
+    }
+
+    bool read_line(int fd, string& buffer, size_t& offset, string& line){
+        while(true){
+            auto p = buffer.find("\r\n", offset);
+            if(p != string::npos){
+                line = buffer.substr(offset, p - offset);
+                offset = p + 2;
+                return true;
+            }
+            if(!fill(fd, buffer, buffer.size() + 1))
+                return false;
+        }
+    }
+
+    bool read_request(int fd, string& buffer, MockRequest& request){
+
+        size_t header_end;
+        while((header_end = buffer.find("\r\n\r\n")) == string::npos){
+            if(buffer.size() > 64 * 1024 || !fill(fd, buffer, buffer.size() + 1))
+                return false;
+        }
+
+        auto lines = iLogger::split_string(buffer.substr(0, header_end), "\r\n");
+        buffer.erase(0, header_end + 4);
+        if(lines.empty()) return false;
+
+        auto request_line = iLogger::split_string(lines[0], " ");
+        if(request_line.size() < 3) return false;
+
+        request.method = request_line[0];
+        auto target = request_line[1];
+        auto q = target.find('?');
+        request.path = url_decode(target.substr(0, q));
+        if(q != string::npos){
+            for(auto& item : iLogger::split_string(target.substr(q + 1), "&")){
+                if(item.empty()) continue;
+                auto e = item.find('=');
+                if(e == string::npos) request.query[url_decode(item)] = "";
+                else request.query[url_decode(item.substr(0, e))] = url_decode(item.substr(e + 1));
+            }
+        }
+
+        for(size_t i = 1; i < lines.size(); ++i){
+            auto p = lines[i].find(':');
+            if(p == string::npos) continue;
+
+            auto value = lines[i].substr(p + 1);
+            while(!value.empty() && value[0] == ' ') value.erase(0, 1);
+            request.headers[lower(lines[i].substr(0, p))] = value;
+        }
+
+        request.keep_alive = lower(header(request, "connection")) != "close";
+        if(lower(header(request, "expect")) == "100-continue"){
+            const char* interim = "HTTP/1.1 100 Continue\r\n\r\n";
+            send_all(fd, interim, strlen(interim), false);
+        }
+
+        if(lower(header(request, "transfer-encoding")) == "chunked")
+            return read_chunked_body(fd, buffer, request);
+
+        size_t content_length = (size_t)atoll(header(request, "content-length").c_str());
+        if(!fill(fd, buffer, content_length))
+            return false;
+
+        request.body = buffer.substr(0, content_length);
+        buffer.erase(0, content_length);
+        return true;
+    }
+
+    bool read_chunked_body(int fd, string& buffer, MockRequest& request){
+        size_t offset = 0;
+        string line;
+        while(true){
+            if(!read_line(fd, buffer, offset, line)) return false;
+
+            size_t size = strtoul(line.c_str(), nullptr, 16);
+            if(size == 0){
+                // 跳过trailer直到空行
+                do{
+                    if(!read_line(fd, buffer, offset, line)) return false;
+                }while(!line.empty());
+                break;
+            }
+
+            if(!fill(fd, buffer, offset + size + 2)) return false;
+            request.body.append(buffer, offset, size);
+            offset += size + 2;
+        }
+        buffer.erase(0, offset);
+        return true;
+    }
+
+    static string header(const MockRequest& request, const string& name){
+        auto it = request.headers.find(name);
+        return it == request.headers.end() ? "" : it->second;
+    }
+
+    size_t throttle_chunk(){
+        lock_guard<mutex> l(options_lock_);
+        if(options_.bandwidth_bytes_per_second <= 0)
+            return 64 * 1024;
+        return max((size_t)1024, min((size_t)(64 * 1024), (size_t)(options_.bandwidth_bytes_per_second / 20)));
+    }
+
+    void throttle(size_t bytes){
+        double rate;
+        {
+            lock_guard<mutex> l(options_lock_);
+            rate = options_.bandwidth_bytes_per_second;
+        }
+        if(rate > 0)
+            this_thread::sleep_for(chrono::microseconds((long long)(bytes / rate * 1e6)));
+    }
+
+    bool send_all(int fd, const char* data, size_t size, bool throttled){
+        size_t sent = 0;
+        while(sent < size){
+            size_t want = throttled ? min(size - sent, throttle_chunk()) : size - sent;
+            int n = send(fd, data + sent, want, MSG_NOSIGNAL);
+            if(n <= 0) return false;
+
+            sent += n;
+            bytes_sent_ += n;
+            if(throttled) throttle(n);
+        }
+        return true;
+    }
+
+    bool send_response(int fd, const MockRequest& request, const MockResponse& response){
+
+        string head = iLogger::format("HTTP/1.1 %d %s\r\n", response.status, status_text(response.status));
+        for(auto& h : response.headers)
+            head += h.first + ": " + h.second + "\r\n";
+
+        head += iLogger::format("Content-Length: %lld\r\n", (long long)response.body.size());
+        head += "Server: MockS3\r\n";
+        head += "Date: " + http_date(time(nullptr)) + "\r\n";
+        head += request.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+        if(!send_all(fd, head.data(), head.size(), false))
+            return false;
+
+        if(response.head_only || response.body.empty())
+            return true;
+
+        if(response.truncate){
+            send_all(fd, response.body.data(), response.body.size() / 2, true);
+            return false;
+        }
+        return send_all(fd, response.body.data(), response.body.size(), true);
+    }
+
+    void inject_latency(){
+        int latency, jitter;
+        {
+            lock_guard<mutex> l(options_lock_);
+            latency = options_.latency_ms;
+            jitter = options_.latency_jitter_ms;
+        }
+
+        if(jitter > 0)
+            latency += random_int(jitter);
+
+        if(latency > 0)
+            this_thread::sleep_for(chrono::milliseconds(latency));
+    }
+
+    int random_int(int upper){
+        lock_guard<mutex> l(random_lock_);
+        return uniform_int_distribution<int>(0, upper - 1)(random_);
+    }
+
+    bool random_hit(double rate){
+        if(rate <= 0) return false;
+        lock_guard<mutex> l(random_lock_);
+        return uniform_real_distribution<double>(0, 1)(random_) < rate;
+    }
+
+    MockResponse handle(const MockRequest& request){
+
+        inject_latency();
+
+        MockOptionsView opt = options_view();
+        if(random_hit(opt.error_rate)){
+            injected_errors_++;
+            if(opt.error_status == 503)
+                return error_response(503, "SlowDown", "Please reduce your request rate.", request.path);
+            return error_response(opt.error_status, "InternalError", "Injected error.", request.path);
+        }
+
+        // /bucket/key... 拆分
+        string path = request.path;
+        if(path.empty() || path[0] != '/')
+            return error_response(400, "InvalidURI", "Invalid path", path);
+
+        auto slash = path.find('/', 1);
+        string bucket = path.substr(1, slash == string::npos ? string::npos : slash - 1);
+        string key = slash == string::npos ? "" : path.substr(slash + 1);
+
+        if(bucket.empty()){
+            if(request.method == "GET")
+                return list_buckets();
+            return error_response(405, "MethodNotAllowed", "Method not allowed", path);
+        }
+
+        if(key.empty()){
+            if(request.method == "PUT") return create_bucket(bucket);
+            if(request.method == "DELETE") return delete_bucket(bucket);
+            if(request.method == "GET") return list_objects(bucket, request);
+            if(request.method == "HEAD") return head_bucket(bucket);
+            return error_response(405, "MethodNotAllowed", "Method not allowed", path);
+        }
+
+        bool has_upload_id = request.query.count("uploadId") > 0;
+        if(request.method == "POST" && request.query.count("uploads"))
+            return initiate_upload(bucket, key, opt.auto_create_bucket);
+        if(request.method == "PUT" && has_upload_id)
+            return upload_part(request);
+        if(request.method == "POST" && has_upload_id)
+            return complete_upload(bucket, key, request);
+        if(request.method == "DELETE" && has_upload_id)
+            return abort_upload(request);
+        if(request.method == "GET" && has_upload_id)
+            return list_parts(request);
+
+        if(request.method == "PUT") return put_object(bucket, key, request, opt.auto_create_bucket);
+        if(request.method == "GET") return get_object(bucket, key, request, false, opt.truncate_rate);
+        if(request.method == "HEAD") return get_object(bucket, key, request, true, 0);
+        if(request.method == "DELETE") return delete_object(bucket, key);
+        return error_response(405, "MethodNotAllowed", "Method not allowed", path);
+    }
+
+    struct MockOptionsView{
+        double error_rate;
+        int error_status;
+        double truncate_rate;
+        bool auto_create_bucket;
+    };
+
+    MockOptionsView options_view(){
+        lock_guard<mutex> l(options_lock_);
+        MockOptionsView v;
+        v.error_rate = options_.error_rate;
+        v.error_status = options_.error_status;
+        v.truncate_rate = options_.truncate_rate;
+        v.auto_create_bucket = options_.auto_create_bucket;
+        return v;
+    }
+
+    MockResponse list_buckets(){
+        MockResponse r;
+        r.headers.emplace_back("Content-Type", "application/xml");
+        r.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ListAllMyBucketsResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">"
+                 "<Owner><ID>mock</ID><DisplayName>mock</DisplayName></Owner><Buckets>";
+
+        lock_guard<mutex> l(store_lock_);
+        for(auto& b : buckets_){
+            r.body += "<Bucket><Name>" + xml_escape(b.first) + "</Name><CreationDate>" + iso8601(time(nullptr)) + "</CreationDate></Bucket>";
+        }
+        r.body += "</Buckets></ListAllMyBucketsResult>";
+        return r;
+    }
+
+    MockResponse create_bucket(const string& bucket){
+        lock_guard<mutex> l(store_lock_);
+        if(buckets_.count(bucket))
+            return error_response(409, "BucketAlreadyOwnedByYou", "Your previous request to create the named bucket succeeded and you already own it.", "/" + bucket);
+
+        buckets_[bucket];
+        MockResponse r;
+        r.headers.emplace_back("Location", "/" + bucket);
+        return r;
+    }
+
+    MockResponse delete_bucket(const string& bucket){
+        lock_guard<mutex> l(store_lock_);
+        auto it = buckets_.find(bucket);
+        if(it == buckets_.end())
+            return error_response(404, "NoSuchBucket", "The specified bucket does not exist", "/" + bucket);
+        if(!it->second.empty())
+            return error_response(409, "BucketNotEmpty", "The bucket you tried to delete is not empty", "/" + bucket);
+
+        buckets_.erase(it);
+        MockResponse r;
+        r.status = 204;
+        return r;
+    }
+
+    MockResponse head_bucket(const string& bucket){
+        lock_guard<mutex> l(store_lock_);
+        MockResponse r;
+        r.head_only = true;
+        if(!buckets_.count(bucket))
+            r.status = 404;
+        return r;
+    }
+
+    MockResponse list_objects(const string& bucket, const MockRequest& request){
+
+        auto get = [&](const char* name){
+            auto it = request.query.find(name);
+            return it == request.query.end() ? string() : it->second;
+        };
+
+        bool v2 = get("list-type") == "2";
+        string prefix = get("prefix");
+        string delimiter = get("delimiter");
+        string start_after = v2 ? (get("continuation-token").empty() ? get("start-after") : get("continuation-token")) : get("marker");
+        int max_keys = get("max-keys").empty() ? 1000 : max(1, atoi(get("max-keys").c_str()));
+
+        lock_guard<mutex> l(store_lock_);
+        auto bit = buckets_.find(bucket);
+        if(bit == buckets_.end())
+            return error_response(404, "NoSuchBucket", "The specified bucket does not exist", "/" + bucket);
+
+        string contents;
+        set<string> common_prefixes;
+        string last_key;
+        int count = 0;
+        bool truncated = false;
+        for(auto it = bit->second.upper_bound(start_after); it != bit->second.end(); ++it){
+            auto& key = it->first;
+            if(key.compare(0, prefix.size(), prefix) != 0) continue;
+
+            // 已经输出过的CommonPrefix下的key直接跳过，不占max-keys
+            string common_prefix;
+            if(!delimiter.empty()){
+                auto d = key.find(delimiter, prefix.size());
+                if(d != string::npos){
+                    common_prefix = key.substr(0, d + delimiter.size());
+                    if(common_prefixes.count(common_prefix)){
+                        last_key = key;
+                        continue;
+                    }
+                }
+            }
+
+            if(count >= max_keys){
+                truncated = true;
+                break;
+            }
+
+            last_key = key;
+            count++;
+            if(!common_prefix.empty()){
+                common_prefixes.insert(common_prefix);
+                continue;
+            }
+
+            auto& o = it->second;
+            contents += "<Contents><Key>" + xml_escape(key) + "</Key><LastModified>" + iso8601(o.last_modified) +
+                "</LastModified><ETag>" + xml_escape(o.etag) + "</ETag><Size>" + to_string(o.data.size()) +
+                "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+        }
+
+        MockResponse r;
+        r.headers.emplace_back("Content-Type", "application/xml");
+        r.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">";
+        r.body += "<Name>" + xml_escape(bucket) + "</Name><Prefix>" + xml_escape(prefix) + "</Prefix>";
+        r.body += iLogger::format("<MaxKeys>%d</MaxKeys><IsTruncated>%s</IsTruncated>", max_keys, truncated ? "true" : "false");
+        if(truncated){
+            if(v2) r.body += "<NextContinuationToken>" + xml_escape(last_key) + "</NextContinuationToken>";
+            else   r.body += "<NextMarker>" + xml_escape(last_key) + "</NextMarker>";
+        }
+        if(v2) r.body += iLogger::format("<KeyCount>%d</KeyCount>", count);
+
+        r.body += contents;
+        for(auto& cp : common_prefixes)
+            r.body += "<CommonPrefixes><Prefix>" + xml_escape(cp) + "</Prefix></CommonPrefixes>";
+        r.body += "</ListBucketResult>";
+        return r;
+    }
+
+    MockResponse put_object(const string& bucket, const string& key, const MockRequest& request, bool auto_create){
+        auto object = make_object(request.body);
+
+        lock_guard<mutex> l(store_lock_);
+        auto it = buckets_.find(bucket);
+        if(it == buckets_.end()){
+            if(!auto_create)
+                return error_response(404, "NoSuchBucket", "The specified bucket does not exist", "/" + bucket);
+            it = buckets_.insert(make_pair(bucket, map<string, MockObject>())).first;
+        }
+
+        MockResponse r;
+        r.headers.emplace_back("ETag", object.etag);
+        it->second[key] = move(object);
+        return r;
+    }
+
+    // 支持 bytes=a-b、bytes=a-、bytes=-n 三种单区间Range
+    static bool parse_range(const string& range, size_t size, size_t& begin, size_t& end){
+        if(range.compare(0, 6, "bytes=") != 0) return false;
+
+        auto spec = range.substr(6);
+        auto dash = spec.find('-');
+        if(dash == string::npos || spec.find(',') != string::npos) return false;
+
+        auto a = spec.substr(0, dash);
+        auto b = spec.substr(dash + 1);
+        if(a.empty()){
+            size_t suffix = strtoull(b.c_str(), nullptr, 10);
+            if(suffix == 0) return false;
+            begin = size > suffix ? size - suffix : 0;
+            end = size;
+        }else{
+            begin = strtoull(a.c_str(), nullptr, 10);
+            end = b.empty() ? size : min(size, (size_t)strtoull(b.c_str(), nullptr, 10) + 1);
+        }
+        return begin < end && begin < size;
+    }
+
+    MockResponse get_object(const string& bucket, const string& key, const MockRequest& request, bool head_only, double truncate_rate){
+
+        MockObject object;
+        {
+            lock_guard<mutex> l(store_lock_);
+            auto bit = buckets_.find(bucket);
+            if(bit == buckets_.end())
+                return error_response(404, "NoSuchBucket", "The specified bucket does not exist", request.path);
+
+            auto it = bit->second.find(key);
+            if(it == bit->second.end()){
+                auto r = error_response(404, "NoSuchKey", "The specified key does not exist.", request.path);
+                r.head_only = head_only;
+                return r;
+            }
+            object = it->second;
+        }
+
+        auto if_match = header(request, "if-match");
+        if(!if_match.empty() && if_match != "*" && if_match != object.etag){
+            auto r = error_response(412, "PreconditionFailed", "At least one of the pre-conditions you specified did not hold", request.path);
+            r.head_only = head_only;
+            return r;
+        }
+
+        MockResponse r;
+        r.head_only = head_only;
+        r.headers.emplace_back("Content-Type", "application/octet-stream");
+        r.headers.emplace_back("ETag", object.etag);
+        r.headers.emplace_back("Last-Modified", http_date(object.last_modified));
+        r.headers.emplace_back("Accept-Ranges", "bytes");
+
+        auto range = header(request, "range");
+        if(!range.empty()){
+            size_t begin = 0, end = 0;
+            if(!parse_range(range, object.data.size(), begin, end)){
+                auto e = error_response(416, "InvalidRange", "The requested range is not satisfiable", request.path);
+                e.headers.emplace_back("Content-Range", iLogger::format("bytes */%lld", (long long)object.data.size()));
+                e.head_only = head_only;
+                return e;
+            }
+
+            r.status = 206;
+            r.headers.emplace_back("Content-Range", iLogger::format("bytes %lld-%lld/%lld", (long long)begin, (long long)end - 1, (long long)object.data.size()));
+            r.body = object.data.substr(begin, end - begin);
+        }else{
+            r.body = move(object.data);
+        }
+
+        if(!head_only && random_hit(truncate_rate)){
+            truncated_responses_++;
+            r.truncate = true;
+        }
+        return r;
+    }
+
+    MockResponse delete_object(const string& bucket, const string& key){
+        lock_guard<mutex> l(store_lock_);
+        auto bit = buckets_.find(bucket);
+        if(bit != buckets_.end())
+            bit->second.erase(key);
+
+        MockResponse r;
+        r.status = 204;
+        return r;
+    }
+
+    MockResponse initiate_upload(const string& bucket, const string& key, bool auto_create){
+
+        lock_guard<mutex> l(store_lock_);
+        if(!buckets_.count(bucket)){
+            if(!auto_create)
+                return error_response(404, "NoSuchBucket", "The specified bucket does not exist", "/" + bucket);
+            buckets_[bucket];
+        }
+
+        auto upload_id = iLogger::format("mock-upload-%lld-%lld", (long long)time(nullptr), ++upload_sequence_);
+        MockUpload& upload = uploads_[upload_id];
+        upload.bucket = bucket;
+        upload.key = key;
+
+        MockResponse r;
+        r.headers.emplace_back("Content-Type", "application/xml");
+        r.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<InitiateMultipartUploadResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Bucket>" +
+            xml_escape(bucket) + "</Bucket><Key>" + xml_escape(key) + "</Key><UploadId>" + upload_id + "</UploadId></InitiateMultipartUploadResult>";
+        return r;
+    }
+
+    MockResponse upload_part(const MockRequest& request){
+
+        auto number = request.query.find("partNumber");
+        int part_number = number == request.query.end() ? 0 : atoi(number->second.c_str());
+        if(part_number < 1 || part_number > 10000)
+            return error_response(400, "InvalidArgument", "Part number must be an integer between 1 and 10000, inclusive", request.path);
+
+        auto part = make_object(request.body);
+        lock_guard<mutex> l(store_lock_);
+        auto it = uploads_.find(request.query.at("uploadId"));
+        if(it == uploads_.end())
+            return error_response(404, "NoSuchUpload", "The specified multipart upload does not exist.", request.path);
+
+        MockResponse r;
+        r.headers.emplace_back("ETag", part.etag);
+        it->second.parts[part_number] = move(part);
+        return r;
+    }
+
+    MockResponse list_parts(const MockRequest& request){
+
+        lock_guard<mutex> l(store_lock_);
+        auto it = uploads_.find(request.query.at("uploadId"));
+        if(it == uploads_.end())
+            return error_response(404, "NoSuchUpload", "The specified multipart upload does not exist.", request.path);
+
+        MockResponse r;
+        r.headers.emplace_back("Content-Type", "application/xml");
+        r.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ListPartsResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Bucket>" +
+            xml_escape(it->second.bucket) + "</Bucket><Key>" + xml_escape(it->second.key) + "</Key><UploadId>" + it->first +
+            "</UploadId><IsTruncated>false</IsTruncated>";
+
+        for(auto& part : it->second.parts){
+            r.body += iLogger::format("<Part><PartNumber>%d</PartNumber>", part.first) + "<LastModified>" + iso8601(part.second.last_modified) +
+                "</LastModified><ETag>" + xml_escape(part.second.etag) + "</ETag><Size>" + to_string(part.second.data.size()) + "</Size></Part>";
+        }
+        r.body += "</ListPartsResult>";
+        return r;
+    }
+
+    MockResponse complete_upload(const string& bucket, const string& key, const MockRequest& request){
+
+        // 按请求体里列出的PartNumber顺序拼接
+        vector<int> part_numbers;
+        size_t p = 0;
+        while((p = request.body.find("<PartNumber>", p)) != string::npos){
+            p += 12;
+            part_numbers.push_back(atoi(request.body.c_str() + p));
+        }
+
+        lock_guard<mutex> l(store_lock_);
+        auto it = uploads_.find(request.query.at("uploadId"));
+        if(it == uploads_.end())
+            return error_response(404, "NoSuchUpload", "The specified multipart upload does not exist.", request.path);
+
+        string data;
+        string etags;
+        for(int number : part_numbers){
+            auto part = it->second.parts.find(number);
+            if(part == it->second.parts.end())
+                return error_response(400, "InvalidPart", iLogger::format("Part %d has not been uploaded", number), request.path);
+
+            data += part->second.data;
+            etags += md5_binary(part->second.data);
+        }
+
+        MockObject object;
+        object.data = move(data);
+        object.etag = iLogger::format("\"%s-%d\"", md5_hex(etags.data(), etags.size()).c_str(), (int)part_numbers.size());
+        object.last_modified = time(nullptr);
+
+        MockResponse r;
+        r.headers.emplace_back("Content-Type", "application/xml");
+        r.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<CompleteMultipartUploadResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Bucket>" +
+            xml_escape(bucket) + "</Bucket><Key>" + xml_escape(key) + "</Key><ETag>" + xml_escape(object.etag) + "</ETag></CompleteMultipartUploadResult>";
+
+        buckets_[bucket][key] = move(object);
+        uploads_.erase(it);
+        return r;
+    }
+
+    MockResponse abort_upload(const MockRequest& request){
+        lock_guard<mutex> l(store_lock_);
+        uploads_.erase(request.query.at("uploadId"));
+        MockResponse r;
+        r.status = 204;
+        return r;
+    }
+
+private:
+    MockS3Options options_;
+    mutable mutex options_lock_;
+    int listen_fd_ = -1;
+    int port_ = 0;
+    atomic<bool> keep_run_{false};
+    thread accept_thread_;
+
+    mutex connection_lock_;
+    set<int> connection_fds_;
+    vector<thread> workers_;
+
+    mutex store_lock_;
+    map<string, map<string, MockObject>> buckets_;
+    map<string, MockUpload> uploads_;
+    long long upload_sequence_ = 0;
+
+    mutex random_lock_;
+    mt19937_64 random_{20210728};
+
+    atomic<long long> requests_{0};
+    atomic<long long> injected_errors_{0};
+    atomic<long long> truncated_responses_{0};
+    atomic<long long> bytes_received_{0};
+    atomic<long long> bytes_sent_{0};
+    atomic<long long> connections_{0};
+};
+
+shared_ptr<MockS3Server> newMockS3Server(const MockS3Options& options){
+    shared_ptr<MockS3ServerImpl> instance(new MockS3ServerImpl());
+    if(!instance->start(options))
+        instance.reset();
+    return instance;
+}
@@ -0,0 +1,62 @@
+#ifndef MOCK_S3_SERVER_HPP
+#define MOCK_S3_SERVER_HPP
+
+#include <string>
+#include <memory>
+
+/**
+ * @brief 进程内的S3替身，用于离线验证性能和功能，不依赖play.min.io或者真实集群
+ *     支持：ListBuckets、PUT/DELETE bucket、PUT/GET/HEAD/DELETE object、Range、If-Match、
+ *          ListObjects(V1/V2，prefix/marker/continuation-token分页)、Multipart(initiate/upload part/list parts/complete/abort)
+ *     不校验签名，数据全部放在内存里
+ *     可以注入首字节延迟、每连接带宽限制、按概率返回错误或者在响应中途断开连接
+ */
+struct MockS3Options{
+    std::string bind_address = "127.0.0.1";
+    int port = 0;                          // 0表示由系统分配端口
+    int latency_ms = 0;                    // 每个请求的固定首字节延迟
+    int latency_jitter_ms = 0;             // 在固定延迟上叠加[0, jitter)的随机延迟
+    double bandwidth_bytes_per_second = 0; // 每个连接的收发速率，<=0不限
+    double error_rate = 0;                 // 按概率直接返回error_status，模拟SlowDown等
+    int error_status = 503;
+    double truncate_rate = 0;              // 按概率在GET响应体发送一半时断开连接
+    bool auto_create_bucket = true;        // PUT对象时bucket不存在则自动创建
+};
+
+struct MockS3Stats{
+    long long requests = 0;
+    long long injected_errors = 0;
+    long long truncated_responses = 0;
+    long long bytes_received = 0;
+    long long bytes_sent = 0;
+    long long connections = 0;
+};
+
+class MockS3Server{
+public:
+    virtual int port() const = 0;
+
+    // 例如 http://127.0.0.1:9000
+    virtual std::string endpoint() const = 0;
+
+    // 运行时调整延迟、带宽、错误注入
+    virtual void set_options(const MockS3Options& options) = 0;
+    virtual MockS3Options options() const = 0;
+
+    // 直接写入/读取存储，不经过HTTP，便于准备测试数据
+    virtual void put_object(const std::string& bucket, const std::string& key, const std::string& data) = 0;
+    virtual bool get_object(const std::string& bucket, const std::string& key, std::string& data) = 0;
+
+    // 直接创建分片上传、写入分片，模拟上一次上传中途崩溃时服务端留下的状态，put_part返回分片的ETag（不含引号）
+    virtual std::string create_upload(const std::string& bucket, const std::string& key) = 0;
+    virtual std::string put_part(const std::string& upload_id, int number, const std::string& data) = 0;
+    virtual bool has_upload(const std::string& upload_id) = 0;
+
+    virtual MockS3Stats stats() const = 0;
+    virtual void stop() = 0;
+};
+
+// 启动失败返回nullptr
+std::shared_ptr<MockS3Server> newMockS3Server(const MockS3Options& options = MockS3Options());
+
+#endif // MOCK_S3_SERVER_HPP
@@ -0,0 +1,327 @@
+/**
+ * 回放MinioClient::set_workload_recorder录制的访问记录，保留原始的key热度分布、对象大小和突发
+ *   make replay
+ *   ./replay workload.bin                         原速回放到进程内的mock服务器
+ *   ./replay workload.bin --speed 4               4倍速回放，--speed 0表示不等待，尽快发出
+ *   ./replay workload.bin --latency-ms 5 --concurrency 128 --limiter 16
+ *   ./replay workload.bin --endpoint http://127.0.0.1:9000 --access-key xxx --secret-key xxx
+ *
+ * 按记录的时间戳开环发出请求（不等前一个请求完成），输出每种操作回放时的延迟分位数和录制时的对比，
+ * 以及实际发出时间相对计划时间的滞后，滞后明显说明--concurrency不够
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <condition_variable>
+
+#include "minio_client.hpp"
+#include "workload_recorder.hpp"
+#include "concurrency_limiter.hpp"
+#include "metrics.hpp"
+#include "ilogger.hpp"
+#include "mock_s3_server.hpp"
+
+using namespace std;
+
+struct ReplayConfig{
+    string trace_file;
+    string endpoint;
+    string access_key = "replay";
+    string secret_key = "replay";
+    string bucket = "replay";
+    double speed = 1.0;
+    int concurrency = 32;
+    int limiter = 0;
+    MockS3Options mock;
+};
+
+struct ReplayStats{
+    LatencyHistogram replay_latency_us;
+    LatencyHistogram recorded_latency_us;
+    atomic<long long> errors{0};
+    atomic<long long> bytes{0};
+};
+
+static double parse_size(const char* value){
+    char* end = nullptr;
+    double size = strtod(value, &end);
+    switch(end ? toupper(*end) : 0){
+    case 'K': size *= 1024; break;
+    case 'M': size *= 1024 * 1024; break;
+    case 'G': size *= 1024 * 1024 * 1024; break;
+    default: break;
+    }
+    return size;
+}
+
+static void print_usage(){
+    printf(
+        "Usage: replay trace_file [options]\n"
+        "  --endpoint URL         回放到指定的服务器，不指定则启动进程内的mock服务器\n"
+        "  --access-key KEY       默认replay\n"
+        "  --secret-key KEY       默认replay\n"
+        "  --bucket NAME          默认replay\n"
+        "  --speed S              回放速度倍数，默认1，0表示尽快发出\n"
+        "  --concurrency N        执行请求的线程数，默认32\n"
+        "  --limiter N            开启自适应并发限制，初始并发为N\n"
+        "  mock服务器参数：\n"
+        "  --latency-ms N         每个请求的首字节延迟\n"
+        "  --jitter-ms N          叠加的随机延迟\n"
+        "  --bandwidth N[K|M|G]   每个连接的带宽（字节/秒）\n"
+        "  --error-rate R         按概率返回503 SlowDown\n"
+    );
+}
+
+static bool parse_args(int argc, char** argv, ReplayConfig& config){
+
+    for(int i = 1; i < argc; ++i){
+        string name = argv[i];
+        if(name == "-h" || name == "--help")
+            return false;
+
+        if(name.compare(0, 2, "--") != 0){
+            config.trace_file = name;
+            continue;
+        }
+
+        if(i + 1 >= argc){
+            fprintf(stderr, "Missing value for %s\n", name.c_str());
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if(name == "--endpoint")            config.endpoint = value;
+        else if(name == "--access-key")     config.access_key = value;
+        else if(name == "--secret-key")     config.secret_key = value;
+        else if(name == "--bucket")         config.bucket = value;
+        else if(name == "--speed")          config.speed = max(0.0, atof(value));
+        else if(name == "--concurrency")    config.concurrency = max(1, atoi(value));
+        else if(name == "--limiter")        config.limiter = atoi(value);
+        else if(name == "--latency-ms")     config.mock.latency_ms = atoi(value);
+        else if(name == "--jitter-ms")      config.mock.latency_jitter_ms = atoi(value);
+        else if(name == "--bandwidth")      config.mock.bandwidth_bytes_per_second = parse_size(value);
+        else if(name == "--error-rate")     config.mock.error_rate = atof(value);
+        else{
+            fprintf(stderr, "Unknown option %s\n", name.c_str());
+            return false;
+        }
+    }
+    return !config.trace_file.empty();
+}
+
+static HistogramSnapshot snapshot_of(const LatencyHistogram& histogram){
+    HistogramSnapshot h;
+    histogram.snapshot(h.counts, h.count, h.sum, h.max);
+    return h;
+}
+
+int main(int argc, char** argv){
+
+    ReplayConfig config;
+    if(!parse_args(argc, argv, config)){
+        print_usage();
+        return 1;
+    }
+
+    WorkloadTraceHeader header;
+    vector<WorkloadRecord> records;
+    if(!load_workload_trace(config.trace_file, header, records))
+        return 1;
+
+    if(records.empty()){
+        printf("%s is empty\n", config.trace_file.c_str());
+        return 0;
+    }
+
+    // 多个线程分批写文件，批次之间不保证有序
+    stable_sort(records.begin(), records.end(), [](const WorkloadRecord& a, const WorkloadRecord& b){
+        return a.timestamp_us < b.timestamp_us;
+    });
+
+    iLogger::set_log_level(ILOGGER_FATAL);
+
+    shared_ptr<MockS3Server> mock;
+    if(config.endpoint.empty()){
+        mock = newMockS3Server(config.mock);
+        if(mock == nullptr){
+            fprintf(stderr, "Start mock server failed\n");
+            return 1;
+        }
+        config.endpoint = mock->endpoint();
+    }
+
+    MinioClient minio(config.endpoint, config.access_key, config.secret_key);
+    if(config.limiter > 0)
+        minio.set_concurrency_limit(config.limiter);
+
+    auto object_key = [](uint64_t key_hash){
+        return iLogger::format("obj-%016llx", (unsigned long long)key_hash);
+    };
+
+    auto object_path = [&](uint64_t key_hash){
+        return "/" + config.bucket + "/" + object_key(key_hash);
+    };
+
+    // 被读取过的key按录制到的最大尺寸预先写入，保证GET有数据
+    map<uint64_t, uint64_t> read_keys;
+    uint64_t max_size = 0;
+    for(auto& r : records){
+        max_size = max(max_size, r.size);
+        if(r.operation == MinioOperation_GetFile || r.operation == MinioOperation_GetRange)
+            read_keys[r.key_hash] = max(read_keys[r.key_hash], r.size);
+    }
+
+    string payload(max_size, 'x');
+    if(mock){
+        for(auto& item : read_keys)
+            mock->put_object(config.bucket, object_key(item.first), payload.substr(0, item.second));
+    }else{
+        minio.make_bucket(config.bucket);
+        for(auto& item : read_keys){
+            if(!minio.upload_filedata(object_path(item.first), payload.data(), item.second)){
+                fprintf(stderr, "Prepare %s failed\n", object_path(item.first).c_str());
+                return 1;
+            }
+        }
+    }
+
+    double recorded_seconds = records.back().timestamp_us / 1e6;
+    printf("replay %s: %d records, %.2f s recorded, %d keys read, endpoint %s, speed %g, concurrency %d\n",
+        config.trace_file.c_str(), (int)records.size(), recorded_seconds, (int)read_keys.size(),
+        config.endpoint.c_str(), config.speed, config.concurrency);
+
+    ReplayStats stats[MinioOperation_Count];
+    LatencyHistogram lag_us;
+    deque<const WorkloadRecord*> queue;
+    mutex queue_lock;
+    condition_variable queue_cv;
+    bool dispatch_done = false;
+
+    auto begin = chrono::steady_clock::now();
+    auto scheduled_time = [&](const WorkloadRecord& r){
+        if(config.speed <= 0) return begin;
+        return begin + chrono::microseconds((long long)(r.timestamp_us / config.speed));
+    };
+
+    auto worker = [&]{
+        while(true){
+            const WorkloadRecord* r = nullptr;
+            {
+                unique_lock<mutex> l(queue_lock);
+                queue_cv.wait(l, [&]{return !queue.empty() || dispatch_done;});
+                if(queue.empty()) return;
+
+                r = queue.front();
+                queue.pop_front();
+            }
+
+            auto start = chrono::steady_clock::now();
+            lag_us.record(chrono::duration_cast<chrono::microseconds>(start - scheduled_time(*r)).count());
+
+            bool success = false;
+            size_t bytes = 0;
+            auto path = object_path(r->key_hash);
+            switch(r->operation){
+            case MinioOperation_UploadFile:
+            case MinioOperation_UploadFileData:
+                success = minio.upload_filedata(path, payload.data(), r->size);
+                bytes = r->size;
+                break;
+            case MinioOperation_GetFile:
+                bytes = minio.get_file(path, &success).size();
+                break;
+            case MinioOperation_GetRange:
+                bytes = minio.get_range(path, 0, r->size, &success).size();
+                break;
+            case MinioOperation_GetBucketList:
+                minio.get_bucket_list(&success);
+                break;
+            case MinioOperation_MakeBucket:
+                success = minio.make_bucket(iLogger::format("%s-%016llx", config.bucket.c_str(), (unsigned long long)r->key_hash));
+                break;
+            case MinioOperation_ListObjects:
+                minio.list_objects(config.bucket, object_key(r->key_hash), &success);
+                break;
+            case MinioOperation_RemoveObject:
+                success = minio.remove_object(path);
+                break;
+            default:
+                continue;
+            }
+
+            auto latency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            auto& s = stats[r->operation];
+            s.recorded_latency_us.record(r->latency_us);
+            if(success){
+                s.replay_latency_us.record(latency);
+                s.bytes += bytes;
+            }else{
+                s.errors++;
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for(int i = 0; i < config.concurrency; ++i)
+        threads.emplace_back(worker);
+
+    // 开环按时间戳派发，服务端变慢时请求在队列里堆积，体现为滞后
+    for(auto& r : records){
+        this_thread::sleep_until(scheduled_time(r));
+        {
+            lock_guard<mutex> l(queue_lock);
+            queue.push_back(&r);
+        }
+        queue_cv.notify_one();
+    }
+
+    {
+        lock_guard<mutex> l(queue_lock);
+        dispatch_done = true;
+    }
+    queue_cv.notify_all();
+
+    for(auto& t : threads)
+        t.join();
+
+    double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count() / 1e6;
+    printf("elapsed %.2f s\n", seconds);
+    printf("%-16s %8s %8s %10s %10s   %-29s   %-29s\n", "operation", "ops", "errors", "ops/s", "MB/s", "replay p50/p99/p999 ms", "recorded p50/p99/p999 ms");
+    for(int op = 0; op < MinioOperation_Count; ++op){
+        auto& s = stats[op];
+        auto replay = snapshot_of(s.replay_latency_us);
+        auto recorded = snapshot_of(s.recorded_latency_us);
+        if(recorded.count == 0)
+            continue;
+
+        printf("%-16s %8lld %8lld %10.1f %10.2f   %9.2f %9.2f %9.2f   %9.2f %9.2f %9.2f\n",
+            minio_operation_name((MinioOperation)op), (long long)recorded.count, s.errors.load(),
+            replay.count / seconds, s.bytes / seconds / 1024 / 1024,
+            replay.percentile(0.5) / 1000.0, replay.percentile(0.99) / 1000.0, replay.percentile(0.999) / 1000.0,
+            recorded.percentile(0.5) / 1000.0, recorded.percentile(0.99) / 1000.0, recorded.percentile(0.999) / 1000.0
+        );
+    }
+
+    auto lag = snapshot_of(lag_us);
+    printf("schedule lag: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", lag.percentile(0.5) / 1000.0, lag.percentile(0.99) / 1000.0, lag.max / 1000.0);
+
+    if(config.limiter > 0){
+        auto state = minio.concurrency_limiter()->state();
+        printf("limiter: limit %.1f, min latency %.2f ms, drops %lld, waits %lld\n",
+            state.limit, state.min_latency_us / 1000.0, state.total_drops, state.total_waits);
+    }
+
+    if(mock)
+        mock->stop();
+    return 0;
+}